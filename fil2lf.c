@@ -0,0 +1,454 @@
+static const char *version = "\
+fil2lf version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Converts SIGPROC filterbank to bbx format\n\
+\n\
+  -h, --help              print this usage information\n\
+  -H, --man               display the program's man page\n\
+      --manpage           print the program's man page (groff)\n\
+      --markdown          print the program's man page (markdown)\n\
+  -V, --version           print program version\n\
+  -v, --verbosity=LEVEL   set status message reporting level\n\
+  -c, --channel=ID        set channel ID of output (default XX)\n\
+\n";
+
+static const char *description = "\
+# fil2lf(1)\n\
+\n\
+## NAME\n\
+\n\
+`fil2lf(1)` - convert SIGPROC filterbank file to lofasm-filterbank(5) file\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`fil2lf` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program converts a SIGPROC filterbank file _INFILE_ to a\n\
+lofasm-filterbank(5) file _OUTFILE_ of real64 data.  It is the\n\
+inverse of lf2fil(1), and allows products of pulsar search pipelines\n\
+to be brought back into the `lofasmio` tools.  If _INFILE_ or\n\
+_OUTFILE_ is not specified, or is a single `-` character, then\n\
+standard input or standard output is used instead.\n\
+\n\
+The input must be a single-IF filterbank (`nifs` = 1) with 8-bit or\n\
+16-bit unsigned integer, or 32-bit floating-point, samples.  Channels\n\
+are reordered into increasing frequency if necessary.  The frequency\n\
+range is computed assuming that `fch1` is the outer edge of the first\n\
+channel, as written by lf2fil(1); for files where `fch1` is the centre\n\
+of the first channel, the output frequencies will be offset by half a\n\
+channel.  The time of the first sample is taken from `tstart` (MJD),\n\
+and the station ID from `telescope_id`.\n\
+\n\
+A named _INFILE_ is memory-mapped, so rows are converted directly from\n\
+the file pages without intermediate copies.  Standard input is first\n\
+spooled to a temporary file, since the number of rows must be known\n\
+before the output header can be written.  The number of rows is\n\
+determined from the size of the data; a warning is given if this is\n\
+not a whole number of rows.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-c, --channel=`_ID_:\n\
+    Sets the `%channel:` field of the output header, since SIGPROC\n\
+    headers do not record a polarization.  The default is `XX`.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lf2fil(1),\n\
+lfbxWrite(3),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+#include "sigproc.h"
+
+static const char short_opts[] = "hHVv:c:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "channel", 1, 0, 'c' },
+  { 0, 0, 0, 0} };
+
+#define LEN 1024          /* character buffer size */
+#define MJD_J2000 51544.5 /* MJD of J2000 epoch */
+#define MJD_UNIX 40587.0  /* MJD of Unix epoch */
+
+/* Conversion kernels: each widens n samples from in to out, reversing
+   their order if rev is set.  Samples are copied bytewise since mapped
+   data need not be aligned. */
+static void
+widen_uint8( const unsigned char *restrict in, double *restrict out,
+	     int64_t n, int rev )
+{
+  int64_t j; /* index */
+  if ( rev )
+    for ( j = 0; j < n; j++ )
+      out[n-1-j] = in[j];
+  else
+    for ( j = 0; j < n; j++ )
+      out[j] = in[j];
+  return;
+}
+
+static void
+widen_uint16( const unsigned char *restrict in, double *restrict out,
+	      int64_t n, int rev )
+{
+  int64_t j; /* index */
+  uint16_t u; /* sample */
+  if ( rev )
+    for ( j = 0; j < n; j++ ) {
+      memcpy( &u, in + 2*j, 2 );
+      out[n-1-j] = u;
+    }
+  else
+    for ( j = 0; j < n; j++ ) {
+      memcpy( &u, in + 2*j, 2 );
+      out[j] = u;
+    }
+  return;
+}
+
+static void
+widen_float( const unsigned char *restrict in, double *restrict out,
+	     int64_t n, int rev )
+{
+  int64_t j; /* index */
+  float f;   /* sample */
+  if ( rev )
+    for ( j = 0; j < n; j++ ) {
+      memcpy( &f, in + 4*j, 4 );
+      out[n-1-j] = f;
+    }
+  else
+    for ( j = 0; j < n; j++ ) {
+      memcpy( &f, in + 4*j, 4 );
+      out[j] = f;
+    }
+  return;
+}
+
+#define CLEANEXIT( code ) \
+do { \
+  head.data_type = NULL; \
+  lfbxFree( &head ); \
+  if ( map ) munmap( map, size ); \
+  if ( buf ) free( buf ); \
+  if ( row ) free( row ); \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  exit( code ); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  char *channel = "XX";     /* -c option */
+  FILE *fpin = NULL;        /* input file pointer */
+  FILE *fpout = NULL;       /* output file pointer */
+  sfb_hdr ihead = {};       /* input header */
+  lfb_hdr head = {};        /* output header */
+  char str[LEN];            /* string buffer */
+  unsigned char *map = NULL; /* memory-mapped input file */
+  unsigned char *buf = NULL; /* one input row, if not mapped */
+  double *row = NULL;       /* one output row */
+  struct stat st;           /* input file status */
+  size_t size = 0;          /* size of input file */
+  int64_t hlen;             /* length of input header */
+  int64_t nchan, nrow;      /* number of channels and rows */
+  int64_t lrow, i;          /* bytes per input row, and row index */
+  int rev;                  /* whether to reverse channels */
+  time_t tt;                /* start time (Unix) */
+  struct tm tm;             /* start time (broken down) */
+  double t;                 /* start time (seconds) */
+  void (*widen)( const unsigned char *restrict, double *restrict,
+		 int64_t, int ); /* conversion kernel */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      CLEANEXIT( 0 );
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      CLEANEXIT( 0 );
+    case 'H':
+      markdown_to_man_out( description );
+      CLEANEXIT( 0 );
+    case 'V':
+      fputs( version, stdout );
+      CLEANEXIT( 0 );
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'c':
+      if ( !optarg[0] || strpbrk( optarg, " \t\n" ) ) {
+	lf_error( "bad argument %s to -c, --channel", optarg );
+	CLEANEXIT( 1 );
+      }
+      channel = optarg;
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      CLEANEXIT( 1 );
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      CLEANEXIT( 1 );
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      CLEANEXIT( 1 );
+    }
+  }
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    CLEANEXIT( 1 );
+  }
+
+  /* Open input, spooling stdin to a temporary file. */
+  if ( !infile ) {
+    size_t n; /* bytes read */
+    infile = "stdin";
+    if ( !( fpin = tmpfile() ) ) {
+      lf_error( "could not open temporary file" );
+      CLEANEXIT( 2 );
+    }
+    while ( ( n = fread( str, 1, LEN, stdin ) ) > 0 )
+      if ( fwrite( str, 1, n, fpin ) < n ) {
+	lf_error( "could not write temporary file" );
+	CLEANEXIT( 2 );
+      }
+    if ( ferror( stdin ) || fflush( fpin ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    rewind( fpin );
+  } else if ( !( fpin = fopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input %s", infile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Read and check input header. */
+  if ( ( hlen = read_header( &ihead, fpin ) ) < 0 ) {
+    lf_error( "could not parse SIGPROC header from %s", infile );
+    CLEANEXIT( 3 );
+  }
+  if ( ihead.nifs != 1 ) {
+    lf_error( "%s has %d IFs; only 1 is supported", infile, ihead.nifs );
+    CLEANEXIT( 3 );
+  }
+  if ( ihead.nbits == 8 )
+    widen = widen_uint8;
+  else if ( ihead.nbits == 16 )
+    widen = widen_uint16;
+  else if ( ihead.nbits == 32 )
+    widen = widen_float;
+  else {
+    lf_error( "%s has unsupported nbits=%d", infile, ihead.nbits );
+    CLEANEXIT( 3 );
+  }
+  if ( ( nchan = ihead.nchans ) < 1 || !( ihead.tsamp > 0.0 ) ||
+       ihead.foff == 0.0 ) {
+    lf_error( "%s has bad nchans, tsamp, or foff", infile );
+    CLEANEXIT( 3 );
+  }
+
+  /* Get number of rows from file size. */
+  if ( fstat( fileno( fpin ), &st ) || !S_ISREG( st.st_mode ) ) {
+    lf_error( "could not get size of %s", infile );
+    CLEANEXIT( 2 );
+  }
+  size = st.st_size;
+  lrow = nchan*( ihead.nbits/8 );
+  nrow = ( (int64_t)( size ) - hlen )/lrow;
+  if ( (int64_t)( size ) - hlen != nrow*lrow )
+    lf_warning( "%s has a partial row of %lld bytes", infile,
+		(long long)( size - hlen - nrow*lrow ) );
+  if ( nrow < 1 ) {
+    lf_error( "%s has no data", infile );
+    size = 0;
+    CLEANEXIT( 3 );
+  }
+
+  /* Map input file, falling back on reading rows. */
+  if ( ( map = (unsigned char *)mmap( NULL, size, PROT_READ, MAP_PRIVATE,
+				      fileno( fpin ), 0 ) ) == MAP_FAILED ) {
+    lf_info( "could not map %s; reading instead", infile );
+    map = NULL;
+  } else
+    madvise( map, size, MADV_SEQUENTIAL );
+  if ( ( !map && !( buf = (unsigned char *)malloc( lrow ) ) ) ||
+       !( row = (double *)malloc( nchan*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+
+  /* Set up output header.  Channels are reversed if foff < 0, in
+     which case fch1 is the top edge of the band (as written by
+     lf2fil). */
+  rev = ( ihead.foff < 0.0 );
+  snprintf( str, LEN, "%d", ihead.stationid );
+  head.station = strdup( str );
+  head.hdr_type = strdup( "LoFASM-filterbank" );
+  head.channel = strdup( channel );
+  head.dim1_label = strdup( "time (s)" );
+  head.dim2_label = strdup( "frequency (Hz)" );
+  t = ( ihead.tstart - MJD_UNIX )*86400.0;
+  tt = (time_t)floor( t );
+  if ( gmtime_r( &tt, &tm ) ) {
+    strftime( str, LEN, "%Y-%m-%dT%H:%M:%S", &tm );
+    snprintf( str + strlen( str ), LEN - strlen( str ), ".%06dZ",
+	      (int)( 1.0e6*( t - floor( t ) ) ) );
+    head.start_time = strdup( str );
+  }
+  if ( !head.station || !head.hdr_type || !head.channel ||
+       !head.dim1_label || !head.dim2_label ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  head.hdr_version = LFB_VERSION;
+  head.time_offset_J2000 = 0.0;
+  head.frequency_offset_DC = 0.0;
+  head.start_mjd = ihead.tstart;
+  head.dim1_start = ( ihead.tstart - MJD_J2000 )*86400.0;
+  head.dim1_span = nrow*ihead.tsamp;
+  head.dim2_span = nchan*fabs( ihead.foff )*1.0e6;
+  head.dim2_start = ihead.fch1*1.0e6 - ( rev ? head.dim2_span : 0.0 );
+  head.data_offset = head.data_scale = NAN;
+  head.data_type = "real64";
+  head.dims[0] = nrow;
+  head.dims[1] = nchan;
+  head.dims[2] = 1;
+  head.dims[3] = 64;
+
+  /* Open output and write header. */
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "could not write header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Convert rows. */
+  if ( !map && fseek( fpin, hlen, SEEK_SET ) ) {
+    lf_error( "could not seek in %s", infile );
+    CLEANEXIT( 2 );
+  }
+  for ( i = 0; i < nrow; i++ ) {
+    if ( map )
+      widen( map + hlen + i*lrow, row, nchan, rev );
+    else if ( fread( buf, 1, lrow, fpin ) < lrow ) {
+      lf_error( "could not read row %lld from %s", (long long)( i ),
+		infile );
+      CLEANEXIT( 2 );
+    } else
+      widen( buf, row, nchan, rev );
+    if ( fwrite( row, sizeof(double), nchan, fpout ) < nchan ) {
+      lf_error( "could not write data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+  }
+  lf_info( "wrote %lld rows of %lld channels to %s", (long long)( nrow ),
+	   (long long)( nchan ), outfile );
+  if ( fclose( fpout ) ) {
+    fpout = NULL;
+    lf_error( "could not write data to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  fpout = NULL;
+  CLEANEXIT( 0 );
+}
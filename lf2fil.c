@@ -1,5 +1,5 @@
 static const char *version = "\
-lfstats version " VERSION "\n\
+lf2fil version " VERSION "\n\
 Copyright (c) 2016 Teviet Creighton.\n\
 \n\
 This program is free software: you can redistribute it and/or modify\n\
@@ -17,7 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
 \n";
 
 static const char *usage = "\
-Usage: %s [OPTION]... INFILE  OUTFILE\n\
+Usage: %s [OPTION]... [INFILE]... OUTFILE\n\
 Converts bbx to SIGPROC filterbank format\n\
 \n\
   -h, --help              print this usage information\n\
@@ -26,10 +26,13 @@ Converts bbx to SIGPROC filterbank format\n\
       --markdown          print the program's man page (markdown)\n\
   -V, --version           print program version\n\
   -v, --verbosity=LEVEL   set status message reporting level\n\
+  -b, --nbits=NBITS       output bits per sample (32, 16, or 8)\n\
+  -c, --calibrate=NROWS   rows used to set 8/16-bit scaling\n\
+  -k, --clip=K            8/16-bit full range in standard deviations\n\
 \n";
 
 static const char *description = "\
-# lfstats(1)\n\
+# lf2fil(1)\n\
 \n\
 ## NAME\n\
 \n\
@@ -37,14 +40,45 @@ static const char *description = "\
 \n\
 ## SYNOPSIS\n\
 \n\
-`lf2fil` [_OPTION_]... _INFILE_  _OUTFILE_\n\
+`lf2fil` [_OPTION_]... [_INFILE_]... _OUTFILE_\n\
 \n\
 ## DESCRIPTION\n\
 \n\
-This program converts lofasm-filterbank file to SIGPROC-filterbank file.\n\
-If _INFILE_ is absent or a single `-` character, then\n\
-data is read from standard input. \n\
-output.\n\
+This program converts one or more lofasm-filterbank files _INFILE_...\n\
+to a single SIGPROC filterbank file _OUTFILE_, concatenating their\n\
+rows in the order given.  The files must have the same number of\n\
+frequency channels and the same time sampling; a warning is printed\n\
+if their frequency ranges differ or if there is a gap or overlap in\n\
+time between consecutive files.  The SIGPROC header is taken from the\n\
+first file.\n\
+\n\
+At least one non-option argument _OUTFILE_ must be given.  If\n\
+_OUTFILE_ is a single `-` character, the result will be written to\n\
+standard output.  If no other non-option argument _INFILE_ is given, a\n\
+single input file is read from standard input.  Also, any one of\n\
+_INFILE_ may be a single `-` character, indicating a file to be read\n\
+from standard input.\n\
+\n\
+The input data must be real, of type `real64` or `real32`.  SIGPROC\n\
+files list channels in order of decreasing frequency, so each row is\n\
+reversed as it is converted.  Data are streamed one row at a time, so\n\
+memory usage does not depend on the length of the files.\n\
+\n\
+By default the output is 32-bit floating point.  With `-b 16` or\n\
+`-b 8`, data are quantized to unsigned integers with a separate\n\
+offset and scale for each channel, estimated from the first _NROWS_\n\
+rows (see `-c, --calibrate`): the mean of each channel is mapped to\n\
+the middle of the output range, and the full range spans _K_ standard\n\
+deviations either side of it (see `-k, --clip`).  The mean and\n\
+standard deviation are computed after discarding points more than 3\n\
+standard deviations from a first estimate, so that bright transients\n\
+or RFI in the calibration rows do not inflate the scaling.  Values\n\
+outside the range are clipped, and non-finite values are written as\n\
+the channel mean.  The SIGPROC header has no place to store this\n\
+scaling, so it is not recorded in _OUTFILE_; with `-v 3`, the offset\n\
+and step of each channel are reported as information messages, and\n\
+an output sample _Q_ represents an input value of approximately the\n\
+offset plus the step times (_Q_ - 2^(_NBITS_-1)).\n\
 \n\
 ## OPTIONS\n\
 \n\
@@ -69,6 +103,21 @@ output.\n\
     (verbose, errors and warnings), or `3` (very verbose, errors,\n\
     warnings, and extra information).\n\
 \n\
+`-b, --nbits=`_NBITS_:\n\
+    Sets the number of bits per output sample: `32` (floating point,\n\
+    the default), `16`, or `8` (unsigned integers).\n\
+\n\
+`-c, --calibrate=`_NROWS_:\n\
+    Sets the number of rows at the start of the data used to compute\n\
+    the quantization scaling for 8 or 16-bit output.  These rows are\n\
+    buffered in memory until the scaling is known.  The default is\n\
+    `256`.\n\
+\n\
+`-k, --clip=`_K_:\n\
+    Sets the quantization range for 8 or 16-bit output to _K_\n\
+    standard deviations either side of the channel mean.  The default\n\
+    is `6`.\n\
+\n\
 ## EXIT STATUS\n\
 \n\
 The proram exits with status 0 normally, 1 if there is an error\n\
@@ -77,19 +126,21 @@ formatted. and 4 on memory allocation errors.\n\
 \n\
 ## SEE ALSO\n\
 \n\
+fil2lf(1),\n\
 lfbxRead(3),\n\
 lfbxWrite(3),\n\
 lofasm-filterbank(5)\n\
 \n";
 
 #include <stdio.h>
+#include <unistd.h>
 #include <getopt.h>
 #include <math.h>
 #include "markdown_parser.h"
 #include "lofasmIO.h"
 #include "sigproc.h"
 
-static const char short_opts[] = "hHVv:p:m:";
+static const char short_opts[] = "hHVv:b:c:k:";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -97,176 +148,387 @@ static const struct option long_opts[] = {
   { "markdown", 0, 0, 0 },
   { "version", 0, 0, 'V' },
   { "verbosity", 1, 0, 'v' },
+  { "nbits", 1, 0, 'b' },
+  { "calibrate", 1, 0, 'c' },
+  { "clip", 1, 0, 'k' },
   { 0, 0, 0, 0} };
 
+/* Conversion kernels: each writes in[0..n-1] to out in reverse
+   channel order. */
+static void
+rev_float( const double *restrict in, float *restrict out, int64_t n )
+{
+  int64_t j; /* index */
+  for ( j = 0; j < n; j++ )
+    out[n-1-j] = in[j];
+  return;
+}
+
+static void
+rev_uint16( const double *restrict in, uint16_t *restrict out,
+	    const double *restrict off, const double *restrict scl,
+	    int64_t n )
+{
+  int64_t j; /* index */
+  for ( j = 0; j < n; j++ ) {
+    double t = ( in[j] - off[j] )*scl[j] + 32768.5;
+    t = ( t >= 0.0 ? ( t < 65535.0 ? t : 65535.0 ) :
+	  ( t < 0.0 ? 0.0 : 32768.0 ) );
+    out[n-1-j] = (uint16_t)( t );
+  }
+  return;
+}
+
+static void
+rev_uint8( const double *restrict in, uint8_t *restrict out,
+	   const double *restrict off, const double *restrict scl,
+	   int64_t n )
+{
+  int64_t j; /* index */
+  for ( j = 0; j < n; j++ ) {
+    double t = ( in[j] - off[j] )*scl[j] + 128.5;
+    t = ( t >= 0.0 ? ( t < 255.0 ? t : 255.0 ) :
+	  ( t < 0.0 ? 0.0 : 128.0 ) );
+    out[n-1-j] = (uint8_t)( t );
+  }
+  return;
+}
+
+/* Computes the quantization offset (mean) and scale of each of n
+   channels from nrow rows of data, rejecting points more than 3
+   standard deviations from a first estimate, and reports them at
+   verbosity 3 since they are not stored in the output. */
+static void
+calibrate( const double *dat, int64_t nrow, int64_t n, int nbits,
+	   double clip, double *off, double *scl )
+{
+  int64_t i, j, c;   /* indecies and count */
+  double d, m, s;    /* datum, mean, and variance */
+  int pass;          /* clipping pass */
+  for ( j = 0; j < n; j++ ) {
+    m = 0.0;
+    s = INFINITY;
+    for ( pass = 0; pass < 2; pass++ ) {
+      double sum = 0.0, sq = 0.0, lim = 9.0*s;
+      for ( i = c = 0; i < nrow; i++ )
+	if ( isfinite( d = dat[i*n+j] ) &&
+	     ( pass == 0 || ( d - m )*( d - m ) <= lim ) ) {
+	  sum += d;
+	  sq += d*d;
+	  c++;
+	}
+      if ( c == 0 )
+	break;
+      m = sum/c;
+      s = sq/c - m*m;
+      s = ( s > 0.0 ? s : 0.0 );
+    }
+    off[j] = m;
+    scl[j] = ( s > 0.0 && isfinite( s ) ?
+	       ldexp( 1.0, nbits - 1 )/( clip*sqrt( s ) ) : 0.0 );
+    lf_info( "input channel %lld: offset %g, step %g", (long long)( j ),
+	     off[j], ( scl[j] > 0.0 ? 1.0/scl[j] : 0.0 ) );
+  }
+  return;
+}
+
+#define CLEANEXIT( code ) \
+do { \
+  lfbxFree( &header ); \
+  lfbxFree( &first ); \
+  if ( data ) free( data ); \
+  if ( fdat ) free( fdat ); \
+  if ( odat ) free( odat ); \
+  if ( cal ) free( cal ); \
+  if ( off ) free( off ); \
+  if ( scl ) free( scl ); \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  exit( code ); \
+} while ( 0 )
+
 int
 main( int argc, char **argv )
 {
-		char opt;                 /* short option character */
-		int lopt;                 /* long option index */
-		char *infile;             /* input file name */
-		char *outfile;            /* output file name */
-		FILE *fpin = NULL;        /* input file pointer */
-		FILE *fpout = NULL;       /* output file pointer */
-		lfb_hdr ihead = {};       /* input header */
-		sfb_hdr ohead = {};       /* output header */
-		int64_t i, j;             /* indecies in dims 1 and 2 */
-		int64_t nrow;             /* number of elements in one row*/
-		int64_t n;                /* number of data read */
-		int64_t iarg;             /* number of file arguments */
-		double *data;             /* one row */
-		float *rata;              /* reversed one row */
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  FILE *fpin = NULL;        /* input file pointer */
+  FILE *fpout = NULL;       /* output file pointer */
+  lfb_hdr header = {};      /* header of current input file */
+  lfb_hdr first = {};       /* header of first input file */
+  lfb_hdr *h;               /* pointer to current header */
+  sfb_hdr ohead = {};       /* output header */
+  int nbits = 32;           /* bits per output sample */
+  int64_t ncal = 256;       /* rows used for calibration */
+  double clip = 6.0;        /* quantization range in sigma */
+  int64_t nin, n;           /* number and index of input files */
+  int64_t i, r;             /* row indecies */
+  int64_t nchan = 0;        /* channels per row */
+  int64_t nrow = 0;         /* rows converted so far */
+  int64_t k;                /* number of data read */
+  size_t osize = 0;         /* bytes per output row */
+  double dt = 0.0, t = 0.0; /* time step and expected start time */
+  double *data = NULL;      /* one row, as doubles */
+  float *fdat = NULL;       /* one row, as read from real32 input */
+  void *odat = NULL;        /* one row of output */
+  double *cal = NULL;       /* buffered calibration rows */
+  double *off = NULL;       /* quantization offsets */
+  double *scl = NULL;       /* quantization scales */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      CLEANEXIT( 0 );
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      CLEANEXIT( 0 );
+    case 'H':
+      markdown_to_man_out( description );
+      CLEANEXIT( 0 );
+    case 'V':
+      fputs( version, stdout );
+      CLEANEXIT( 0 );
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'b':
+      nbits = atoi( optarg );
+      if ( nbits != 32 && nbits != 16 && nbits != 8 ) {
+	lf_error( "bad argument %s to -b, --nbits", optarg );
+	CLEANEXIT( 1 );
+      }
+      break;
+    case 'c':
+      if ( ( ncal = atoll( optarg ) ) < 1 ) {
+	lf_error( "bad argument %s to -c, --calibrate", optarg );
+	CLEANEXIT( 1 );
+      }
+      break;
+    case 'k':
+      if ( !( ( clip = atof( optarg ) ) > 0.0 ) ) {
+	lf_error( "bad argument %s to -k, --clip", optarg );
+	CLEANEXIT( 1 );
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      CLEANEXIT( 1 );
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      CLEANEXIT( 1 );
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      CLEANEXIT( 1 );
+    }
+  }
+
+  /* Count input files. */
+  nin = argc - optind - 1;
+  if ( nin < 0 ) {
+    lf_error( "no output file specified\n\t"
+	      "Try %s --help for more information", argv[0] );
+    CLEANEXIT( 1 );
+  }
+  outfile = argv[argc-1];
+
+  /* Loop over input files.  If there are no input file arguments,
+     read one file from stdin. */
+  for ( n = 0; n < nin || ( n == 0 && nin == 0 ); n++ ) {
 
-		/* Parse options. */
-		while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
-						!= -1 ) {
-				switch ( opt ) {
-						case 0:
-								if ( !strcmp( long_opts[lopt].name, "manpage" ) )
-										markdown_to_manpage( description, NULL );
-								else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
-										fputs( description, stdout );
-								return 0;
-						case 'h':
-								fprintf( stdout, usage, argv[0] );
-								return 0;
-						case 'H':
-								markdown_to_man_out( description );
-								return 0;
-						case 'V':
-								fputs( version, stdout );
-								return 0;
-						case 'v':
-								lofasm_verbosity = atoi( optarg );
-								break;
-						case '?':
-								if ( optopt )
-										lf_error( "unknown option -%c\n\t"
-														"Try %s --help for more information",
-														optopt, argv[0] );
-								else
-										lf_error( "unknown option %s\n\t"
-														"Try %s --help for more information",
-														argv[optind-1], argv[0] );
-								return 1;
-						case ':':
-								if ( optopt )
-										lf_error( "option -%c requires an argument\n\t"
-														"Try %s --help for more information",
-														optopt, argv[0] );
-								else
-										lf_error( "option %s requires an argument\n\t"
-														"Try %s --help for more information",
-														argv[optind-1], argv[0] );
-								return 1;
-						default:
-								lf_error( "internal error parsing option code %c\n\t"
-												"Try %s --help for more information",
-												opt, argv[0] );
-								return 1;
-				}
-		}
+    /* Open file and read header. */
+    if ( nin == 0 || !strcmp( argv[optind+n], "-" ) ) {
+      if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+	lf_error( "could not read from stdin" );
+	CLEANEXIT( 2 );
+      }
+      infile = "stdin";
+    } else if ( !( fpin = lfopen( ( infile = argv[optind+n] ), "rb" ) ) ) {
+      lf_error( "could not open input %s", infile );
+      CLEANEXIT( 2 );
+    }
+    h = ( n == 0 ? &first : &header );
+    lfbxFree( h );
+    if ( lfbxRead( fpin, h, NULL ) ) {
+      lf_error( "could not parse header from %s", infile );
+      CLEANEXIT( 2 );
+    }
 
-		/* Trivial checks. */
-		iarg = argc - optind;
-		if ( iarg <= 1 ) {
-				lf_error( "no output file specified\n\t"
-								"Try %s --help for more information", argv[0] );
-				return 1;
-		}
-		if ( iarg > 2 ) {
-				lf_error( "too many arguments specified\n\t"
-								"Try %s --help for more information", argv[0] );
-				return 1;
-		}
+    /* Check data type. */
+    if ( h->dims[2] != 1 ) {
+      lf_error( "requires real data, not %lld components in %s",
+		(long long)( h->dims[2] ), infile );
+      CLEANEXIT( 3 );
+    }
+    if ( h->dims[3] != 64 && h->dims[3] != 32 ) {
+      lf_error( "requires real64 or real32 data in %s", infile );
+      CLEANEXIT( 3 );
+    }
+    if ( !h->data_type ||
+	 strcmp( h->data_type, ( h->dims[3] == 64 ? "real64" : "real32" ) ) )
+      lf_warning( "treating %s as real%d data", infile, (int)h->dims[3] );
 
-		/* Read input header. */
-		if ( !strcmp( argv[argc-2], "-" ) ) {
-				if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
-						lf_error( "could not read from stdin" );
-						fclose ( fpin );
-						return 2;
-				}
-				infile = "stdin";
-		} else {
-				if ( !( fpin = lfopen( ( infile = argv[argc-2] ), "rb" ) ) ) {
-						lf_error( "could not open input %s", infile );
-						fclose ( fpin );
-						return 2;
-				}
-		}
-		if ( lfbxRead( fpin, &ihead, NULL ) ) {
-				lf_error( "could not parse header from %s", infile );
-				fclose( fpin );
-				lfbxFree( &ihead );
-				return 2;
-		}
+    /* The first file sets the output header and row length, and
+       storage is allocated accordingly. */
+    if ( n == 0 ) {
+      nchan = first.dims[1];
+      if ( first.dims[0] < 1 || !( first.dim1_span > 0.0 ) ) {
+	lf_error( "could not get timestep from %s", infile );
+	CLEANEXIT( 3 );
+      }
+      dt = first.dim1_span/first.dims[0];
+      t = first.time_offset_J2000 + first.dim1_start;
+      lf2sg_hdr( &first, &ohead );
+      ohead.nbits = nbits;
+      osize = nchan*( nbits/8 );
+      if ( !( data = (double *)malloc( nchan*sizeof(double) ) ) ||
+	   !( fdat = (float *)malloc( nchan*sizeof(float) ) ) ||
+	   !( odat = malloc( osize ) ) ||
+	   ( nbits < 32 &&
+	     ( !( cal = (double *)malloc( ncal*nchan*sizeof(double) ) ) ||
+	       !( off = (double *)malloc( nchan*sizeof(double) ) ) ||
+	       !( scl = (double *)malloc( nchan*sizeof(double) ) ) ) ) ) {
+	lf_error( "memory error" );
+	CLEANEXIT( 4 );
+      }
 
-		/* Check data type. */
-		if ( ihead.dims[3] != 64 ) {
-				lf_error( "requires real64 data" );
-				fclose( fpin );
-				lfbxFree( &ihead );
-				return 3;
-		}
-		if ( !ihead.data_type || strcmp( ihead.data_type, "real64" ) )
-				lf_warning( "treating as real64 data" );
+      /* Open output and write header. */
+      if ( !strcmp( outfile, "-" ) ) {
+	if ( isatty( 1 ) || !( fpout = fdopen( 1, "wb" ) ) ) {
+	  lf_error( "could not write to stdout" );
+	  CLEANEXIT( 2 );
+	}
+	outfile = "stdout";
+      } else if ( !( fpout = fopen( outfile, "wb" ) ) ) {
+	lf_error( "could not open output file %s", outfile );
+	CLEANEXIT( 2 );
+      }
+      write_header( &ohead, fpout );
+      if ( ferror( fpout ) ) {
+	lf_error( "could not write header to %s", outfile );
+	CLEANEXIT( 2 );
+      }
+    }
 
-		/* Prepare output sigproc filterbank and write header */
-		lf2sg_hdr (&ihead, &ohead);
-		if ( !( fpout = fopen( ( outfile =  argv[argc-1] ) , "wb" ) ) ) {
-				lf_error( "could not open output file %s", outfile );
-				fclose( fpin );
-				lfbxFree( &ihead );
-				return 2;
-		}
-		write_header (&ohead, fpout);
+    /* Check for consistent sampling with previous files. */
+    else {
+      if ( header.dims[1] != nchan ) {
+	lf_error( "%s has %lld channels, expected %lld", infile,
+		  (long long)( header.dims[1] ), (long long)( nchan ) );
+	CLEANEXIT( 3 );
+      }
+      if ( header.dims[0] < 1 ||
+	   fabs( header.dim1_span/header.dims[0] - dt ) > 1.0e-6*dt ) {
+	lf_error( "%s has a different timestep", infile );
+	CLEANEXIT( 3 );
+      }
+      if ( first.frequency_offset_DC + first.dim2_start !=
+	   header.frequency_offset_DC + header.dim2_start ||
+	   first.dim2_span != header.dim2_span )
+	lf_warning( "%s has a different frequency range", infile );
+      if ( fabs( header.time_offset_J2000 + header.dim1_start - t )
+	   > 0.5*dt )
+	lf_warning( "%s starts %g s after end of previous file", infile,
+		    header.time_offset_J2000 + header.dim1_start - t );
+      t = header.time_offset_J2000 + header.dim1_start;
+    }
+    t += h->dims[0]*dt;
 
-		/* Allocate data row and reverse data row */
-		nrow = 1;
-		for ( i = 1; i < LFB_DMAX && ihead.dims[i]; i++ )
-				nrow *= ihead.dims[i];
-		nrow /= 8; /* number of bytes */
-		nrow /= sizeof(double); /* number of doubles */
-		if ( !( data = (double *)malloc( nrow*sizeof(double) ) ) ) {
-				lf_error( "memory error" );
-				fclose( fpin );
-				fclose( fpout );
-				lfbxFree( &ihead );
-				return 4;
-		}
-		if ( !( rata = (float *)malloc( nrow*sizeof(float) ) ) ) {
-				lf_error( "memory error" );
-				fclose( fpin );
-				fclose( fpout );
-				lfbxFree( &ihead );
-				return 4;
-		}
+    /* Read, convert, and write rows, padding with zeros if data are
+       missing. */
+    for ( i = 0; i < h->dims[0]; i++, nrow++ ) {
+      if ( h->dims[3] == 64 )
+	k = ( feof( fpin ) ? 0 : fread( data, sizeof(double), nchan, fpin ) );
+      else {
+	k = ( feof( fpin ) ? 0 : fread( fdat, sizeof(float), nchan, fpin ) );
+	for ( r = 0; r < k; r++ )
+	  data[r] = fdat[r];
+      }
+      if ( k < nchan ) {
+	if ( !feof( fpin ) || k > 0 )
+	  lf_warning( "read %lld data from %s, expected %lld",
+		      (long long)( i*nchan + k ), infile,
+		      (long long)( h->dims[0]*nchan ) );
+	memset( data + k, 0, ( nchan - k )*sizeof(double) );
+      }
 
-		/* Read data, reverse and write. */
-		for ( i = 0; i < ihead.dims[0]; i++ ) {
-				// read step
-				if ( feof( fpin ) )
-						memset( data, 0, nrow*sizeof(double) );
-				else if ( ( n = fread( data, sizeof(double), nrow, fpin ) ) < nrow ) {
-						lf_warning( "read %lld doubles, expected %lld",
-										(long long)( i*nrow + n ), (long long)( ihead.dims[0]*nrow ) );
-						memset( data + n, 0, ( nrow - n )*sizeof(double) );
-				}
-				// reverse step
-				for ( j = 0; j < nrow; j++ ) {
-						rata[nrow-j-1] = data[j];
-				}
-				// write step
-				fwrite (rata, sizeof (float), nrow, fpout);
-		}
+      /* Buffer rows until quantization scale is known. */
+      if ( nbits < 32 && nrow < ncal ) {
+	memcpy( cal + nrow*nchan, data, nchan*sizeof(double) );
+	if ( nrow < ncal - 1 )
+	  continue;
+	calibrate( cal, ncal, nchan, nbits, clip, off, scl );
+	for ( r = 0; r < ncal; r++ ) {
+	  if ( nbits == 16 )
+	    rev_uint16( cal + r*nchan, odat, off, scl, nchan );
+	  else
+	    rev_uint8( cal + r*nchan, odat, off, scl, nchan );
+	  if ( fwrite( odat, 1, osize, fpout ) < osize ) {
+	    lf_error( "could not write data to %s", outfile );
+	    CLEANEXIT( 2 );
+	  }
+	}
+	continue;
+      }
 
-		/* Close files */
-		fclose( fpin );
-		fclose( fpout );
-		/* Free data */
-		free ( data );
-		free ( rata );
+      /* Convert and write row. */
+      if ( nbits == 32 )
+	rev_float( data, odat, nchan );
+      else if ( nbits == 16 )
+	rev_uint16( data, odat, off, scl, nchan );
+      else
+	rev_uint8( data, odat, off, scl, nchan );
+      if ( fwrite( odat, 1, osize, fpout ) < osize ) {
+	lf_error( "could not write data to %s", outfile );
+	CLEANEXIT( 2 );
+      }
+    }
+    fclose( fpin );
+    fpin = NULL;
+  }
 
-		return 0;
+  /* Flush any buffered rows if there were fewer than ncal. */
+  if ( nbits < 32 && nrow < ncal ) {
+    calibrate( cal, nrow, nchan, nbits, clip, off, scl );
+    for ( r = 0; r < nrow; r++ ) {
+      if ( nbits == 16 )
+	rev_uint16( cal + r*nchan, odat, off, scl, nchan );
+      else
+	rev_uint8( cal + r*nchan, odat, off, scl, nchan );
+      if ( fwrite( odat, 1, osize, fpout ) < osize ) {
+	lf_error( "could not write data to %s", outfile );
+	CLEANEXIT( 2 );
+      }
+    }
+  }
+  lf_info( "wrote %lld rows of %lld channels to %s", (long long)( nrow ),
+	   (long long)( nchan ), outfile );
+  if ( fclose( fpout ) ) {
+    fpout = NULL;
+    lf_error( "could not write data to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  fpout = NULL;
+  CLEANEXIT( 0 );
 }
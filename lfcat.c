@@ -74,6 +74,14 @@ information messages (see `-v, --verbosity` below) will report any\n\
 misalignment; options allow this to trigger warnings or errors at\n\
 user-specified thresholds.\n\
 \n\
+The inputs may also be `bit1` mask files, such as are written by\n\
+lfflag(1), so that the masks of a set of files can be concatenated\n\
+alongside the data.  Since the bits of a mask file are packed without\n\
+padding between rows, these are handled bit by bit rather than row by\n\
+row.  Gaps are always padded with set (flagged) bits, as are rows\n\
+missing from truncated inputs, and the `-p`, `-m`, and `-l` options\n\
+are ignored.\n\
+\n\
 ## OPTIONS\n\
 \n\
 `-h, --help`:\n\
@@ -155,6 +163,7 @@ errors.\n\
 \n\
 lfbxRead(3),\n\
 lfbxWrite(3),\n\
+lfmaskRead(3),\n\
 lofasm-filterbank(5)\n\
 \n";
 
@@ -207,6 +216,79 @@ ascendingDoubles( const void *p1, const void *p2 )
 }
 
 
+/* Concatenates nin bit1 mask files, whose headers are hdrs (sorted
+   by idx) and whose names are names, writing them to fpout.  Gaps
+   before file idx[i] are filled with set bits, unless ignore is set.
+   Returns 0 on success, or an exit code on error. */
+int
+catMasks( FILE *fpout, const char *outfile, lfb_hdr *hdrs, const int *idx,
+	  int nin, char **names, double t0, double dt, int ignore )
+{
+  int i;                       /* file index */
+  int64_t k, kstart, kend, n;  /* output row indecies, and bits read */
+  int64_t ncol = hdrs[0].dims[1]; /* bits per row */
+  lfb_mask min, mout = {};     /* input and output mask state */
+  unsigned char *row, *gap;    /* row of mask bits, and gap row */
+  FILE *fp;                    /* input file */
+  const char *infile;          /* input file name */
+
+  if ( !( row = (unsigned char *)malloc( 2*ncol*sizeof(unsigned char) ) ) ) {
+    lf_error( "memory error" );
+    return 4;
+  }
+  gap = row + ncol;
+  memset( gap, 1, ncol*sizeof(unsigned char) );
+  for ( i = k = 0; i < nin; i++ ) {
+    lfb_hdr *h = hdrs + idx[i]; /* this file's header */
+    kstart = ( ignore ? k : (int64_t)round( ( h->dim1_start - t0 )/dt ) );
+    kend = kstart + h->dims[0];
+
+    /* Reopen input file and skip to data (if not stdin). */
+    if ( !strcmp( ( infile = names[idx[i]] ), "-" ) ) {
+      fp = stdin;
+      infile = "stdin";
+    } else if ( !( fp = lfopen( infile, "rb" ) ) ) {
+      lf_error( "could not open input %s", infile );
+      free( row );
+      return 2;
+    } else
+      bxSkipHeader( fp );
+
+    /* Fill any gap, then copy the file, flagging missing rows. */
+    memset( &min, 0, sizeof(lfb_mask) );
+    for ( ; k < kend; k++ ) {
+      if ( k < kstart ) {
+	n = lfmaskWrite( gap, ncol, &mout, fpout );
+      } else {
+	if ( ( n = lfmaskRead( row, ncol, &min, fp ) ) < ncol ) {
+	  if ( !feof( fp ) || n > 0 )
+	    lf_info( "read %lld bits from %s, expected %lld",
+		     (long long)( ( k - kstart )*ncol + n ), infile,
+		     (long long)( ( kend - kstart )*ncol ) );
+	  memset( row + n, 1, ncol - n );
+	}
+	n = lfmaskWrite( row, ncol, &mout, fpout );
+      }
+      if ( n < ncol ) {
+	lf_error( "error writing to %s", outfile );
+	if ( fp != stdin )
+	  fclose( fp );
+	free( row );
+	return 2;
+      }
+    }
+    if ( fp != stdin )
+      fclose( fp );
+  }
+  free( row );
+  if ( lfmaskFlush( &mout, fpout ) ) {
+    lf_error( "error writing to %s", outfile );
+    return 2;
+  }
+  return 0;
+}
+
+
 /* Macro to free all memory and close all files, prior to exiting.
    This should only within main(), which should initialize all
    unallocated pointers to NULL to avoid potentially trying to free
@@ -374,7 +456,13 @@ main( int argc, char **argv )
     nrow = 1;
     for ( i = 1; i < LFB_DMAX && header.dims[i]; i++ )
       nrow *= header.dims[i];
-    nrow /= 8;
+    k = header.dims[0];
+    if ( nrow % 8 ) {
+      /* Bit-packed rows: copy the data as a single block. */
+      nrow = ( nrow*k + 7 )/8;
+      k = 1;
+    } else
+      nrow /= 8;
     if ( !( row = (unsigned char *)malloc( nrow*sizeof(unsigned char) ) ) ) {
       lf_error( "memory error" );
       CLEANEXIT( 4 );
@@ -394,10 +482,10 @@ main( int argc, char **argv )
       lf_error( "error writing to %s", outfile );
       CLEANEXIT( 2 );
     }
-    for ( i = 0; i < header.dims[0] && !feof( fpin ); i++ ) {
+    for ( i = 0; i < k && !feof( fpin ); i++ ) {
       if ( ( n = fread( row, 1, nrow, fpin ) ) < nrow )
 	lf_warning( "read %lld rows from %s, expected %lld", (long long)( i ),
-		    infile, (long long)( header.dims[0] ) );
+		    infile, (long long)( k ) );
       if ( n > 0 && fwrite( row, 1, n, fpout ) < n ) {
 	lf_error( "error writing to %s", outfile );
 	CLEANEXIT( 2 );
@@ -430,8 +518,10 @@ main( int argc, char **argv )
       lf_error( "could not parse header from %s", infile );
       CLEANEXIT( 2 );
     }
-    if ( !istd )
+    if ( !istd ) {
       fclose( fpin );
+      fpin = NULL;
+    }
     /* If using median padding, discard files less than 2 timesteps;
        it's just too much work trying to deal with them. */
     if ( med && headers[i].dims[0] < 2 ) {
@@ -575,6 +665,15 @@ main( int argc, char **argv )
     CLEANEXIT( 2 );
   }
 
+  /* Mask files are bit-packed, so rows need not be whole bytes. */
+  if ( header.dims[LFB_DMAX-1] == 1 ) {
+    if ( med || padd != 0.0 )
+      lf_warning( "padding options ignored for bit1 mask files" );
+    n = catMasks( fpout, outfile, headers, idx, nin, argv + optind, t0, dt,
+		  ignore );
+    CLEANEXIT( n );
+  }
+
   /* Allocate data row and gap-filling row. */
   nrow = 1;
   for ( i = 1; i < LFB_DMAX && header.dims[i]; i++ )
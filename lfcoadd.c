@@ -27,6 +27,7 @@ Coadd distinct baseline LoFASM files starting at same time.\n\
   -V, --version          print program version\n\
   -v, --verbosity=LEVEL  set status message reporting level\n\
   -i, --ignore-align     ignore time/freq/data misalignments\n\
+  -M, --mask=MASKFILE    mask for next input file (repeatable)\n\
 \n";
 
 static const char *description = "\
@@ -63,6 +64,11 @@ is used. The hardlimit of four is set since lofasm offers four auto-correlations
 The motive behind coaddition is to improve S/N and reduce noise artefacts by adding\n\
 overlapping power levels.\n\
 \n\
+If mask files are given with the `-M, --mask` option, one per input\n\
+file, then each output sample is the average over only those inputs\n\
+in which it is not flagged, and is `nan` if it is flagged in all of\n\
+them.\n\
+\n\
 ## OPTIONS\n\
 \n\
 `-h, --help`:\n\
@@ -89,6 +95,15 @@ overlapping power levels.\n\
 				Ignores time/frequency/data misalignments\n\
 				and only checks for dimensions match for coaddition\n\
 \n\
+`-M, --mask=`_MASKFILE_:\n\
+    Reads a `bit1` mask file (see lofasm-filterbank(5)) for an input\n\
+    file.  This option may be given several times: the first mask\n\
+    applies to the first _INFILE_, the second to the second, and so\n\
+    on.  If any masks are given, there must be one for each input.\n\
+    Each mask must have the same rows and columns as its input, and\n\
+    a set bit excludes all components of that sample from the\n\
+    average.\n\
+\n\
 ## EXIT STATUS\n\
 \n\
 The proram exits with status 0 normally, 1 if there is an error\n\
@@ -101,6 +116,8 @@ errors.\n\
 \n\
 lfbxRead(3),\n\
 lfbxWrite(3),\n\
+lfmaskRead(3),\n\
+lfflag(1),\n\
 lofasm-filterbank(5)\n\
 \n";
 
@@ -111,7 +128,7 @@ lofasm-filterbank(5)\n\
 #include "markdown_parser.h"
 #include "lofasmIO.h"
 
-static const char short_opts[] = "hHVv:i";
+static const char short_opts[] = "hHVv:iM:";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -120,6 +137,7 @@ static const struct option long_opts[] = {
   { "version", 0, 0, 'V' },
   { "verbosity", 1, 0, 'v' },
   { "ignore-timing", 0, 0, 'i' },
+  { "mask", 1, 0, 'M' },
   { 0, 0, 0, 0} };
 
 #define LEN 1024 /* character buffer size */
@@ -139,6 +157,10 @@ do { \
   if ( fpins[2] ) fclose( fpins[2] ); \
   if ( fpins[3] ) fclose( fpins[3] ); \
   if ( fpout ) fclose( fpout ); \
+  for ( i = 0; i < MAXC; i++ ) \
+    if ( fpmasks[i] ) fclose( fpmasks[i] ); \
+  if ( msk ) free( msk ); \
+  if ( cnt ) free( cnt ); \
   exit( code ); \
 } while ( 0 )
 
@@ -165,6 +187,13 @@ main( int argc, char **argv )
 		int64_t odim1;              /* output size */ 
 		int64_t iodim1;             /* index of headers w/ output size */ 
 		int64_t i, j, k, n;         /* indecies and size/return code */
+		char *maskfiles[MAXC];      /* mask file names */
+		int nmask = 0;              /* number of mask files */
+		FILE *fpmasks[MAXC] = {NULL}; /* mask files */
+		lfb_mask mstates[MAXC] = {}; /* mask read states */
+		unsigned char *msk = NULL;  /* mask bits for one row */
+		double *cnt = NULL;         /* number of unflagged inputs */
+		int64_t ncomp;              /* data per mask bit */
 
 		/* Parse options. */
 		while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
@@ -191,6 +220,13 @@ main( int argc, char **argv )
 						case 'i':
 								ignore = 1;
 								break;
+						case 'M':
+								if ( nmask >= MAXC ) {
+										lf_error( "too many -M, --mask options" );
+										CLEANEXIT( 1 );
+								}
+								maskfiles[nmask++] = optarg;
+								break;
 						case '?':
 								if ( optopt )
 										lf_error( "unknown option -%c\n\t"
@@ -237,6 +273,10 @@ main( int argc, char **argv )
 				CLEANEXIT( 1 );
 		}
 		iin = 1.0 / nin ; 
+		if ( nmask && nmask != nin ) {
+				lf_error( "got %d masks for %d input files", nmask, nin );
+				CLEANEXIT( 1 );
+		}
 
 		/* Set up array of file headers. */
 		for ( i = 0; i < nin; i++ ) {
@@ -338,6 +378,18 @@ main( int argc, char **argv )
 				CLEANEXIT( 4 );
 		}
 
+		/* Open mask files, if any. */
+		ncomp = header.dims[2];
+		for ( i = 0; i < nmask; i++ )
+				if ( !( fpmasks[i] = lfmaskOpen( maskfiles[i], headers + i ) ) )
+						CLEANEXIT( 2 );
+		if ( nmask &&
+						( !( msk = (unsigned char *)malloc( header.dims[1] ) ) ||
+								!( cnt = (double *)malloc( nrow*sizeof(double) ) ) ) ) {
+				lf_error( "memory error" );
+				CLEANEXIT( 4 );
+		}
+
 		/* Open input argument files */
 		for ( i = 0; i < nin; i++ ) {
 				if ( !strcmp( argv[optind+i], "-" ) ) {
@@ -364,6 +416,8 @@ main( int argc, char **argv )
 				// initialize step
 				for ( i = 0; i < nrow; i++ )
 						rrow[i] = 0.0f;
+				if ( cnt )
+						memset( cnt, 0, nrow*sizeof(double) );
 				// work step
 				for ( i = 0; i < nin; i++ ) {
 						// read step
@@ -374,11 +428,29 @@ main( int argc, char **argv )
 								for ( j = n; j < nrow; j++ )
 										row[j] = 0.0f;
 						}
-						// sum step
-						for ( j = 0; j < nrow; j++ ) {
-								rrow[j] += (iin * row[j]);
-						}
+						// sum step, counting only unflagged samples if masked
+						if ( fpmasks[i] ) {
+								if ( ( n = lfmaskRead( msk, header.dims[1], mstates + i,
+																							fpmasks[i] ) ) < header.dims[1] ) {
+										lf_info( "read %lld bits from %s, expected %lld",
+														(long long)( n ), maskfiles[i],
+														(long long)( header.dims[1] ) );
+										memset( msk + n, 0, header.dims[1] - n );
+								}
+								for ( j = 0; j < nrow; j++ ) {
+										int m = msk[j/ncomp]; /* whether sample is flagged */
+										rrow[j] += ( m ? 0.0 : row[j] );
+										cnt[j] += !m;
+								}
+						} else
+								for ( j = 0; j < nrow; j++ ) {
+										rrow[j] += (iin * row[j]);
+								}
 				}
+				// normalize step for masked inputs
+				if ( cnt )
+						for ( j = 0; j < nrow; j++ )
+								rrow[j] = ( cnt[j] > 0.0 ? rrow[j]/cnt[j] : NAN );
 				// write step
 				if ( fwrite( rrow, sizeof(double), nrow, fpout ) < nrow ) {
 						lf_error( "error writing to %s", outfile );
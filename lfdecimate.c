@@ -0,0 +1,492 @@
+static const char *version = "\
+lfdecimate version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Downsample a LoFASM file with an anti-aliasing filter.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -t, --dim1=FAC1        decimation factor in dimension 1\n\
+  -f, --dim2=FAC2        decimation factor in dimension 2\n\
+  -n, --taps=NTAP        filter half-length in output samples (default 8)\n\
+  -c, --cutoff=FRAC      cutoff as a fraction of output Nyquist (default 0.9)\n\
+\n";
+
+static const char *description = "\
+# lfdecimate(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfdecimate(1)` - downsample a lofasm-filterbank(5) file with an\n\
+anti-aliasing filter\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfdecimate` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program reduces the resolution of a lofasm-filterbank(5) file\n\
+_INFILE_ by integer factors along dimension 1 (time) and/or dimension\n\
+2 (frequency), writing the result to _OUTFILE_.  If _INFILE_ or\n\
+_OUTFILE_ is not specified, or is a single `-` character, then\n\
+standard input or standard output is used instead.\n\
+\n\
+lfsquish(1) downsamples by averaging boxes of points, which is a poor\n\
+low-pass filter: periodic signals above the new Nyquist frequency\n\
+(such as pulsar harmonics) leak through its sidelobes and alias into\n\
+the output.  This program instead applies a windowed-sinc\n\
+finite-impulse-response (FIR) filter with a cutoff just below the\n\
+output Nyquist frequency, strongly suppressing components that would\n\
+otherwise alias.  The filter has 2 _NTAP_ _FAC_ taps (plus one if _FAC_\n\
+is odd), tapered by a Blackman window, and is normalized to unit gain\n\
+at zero frequency.\n\
+\n\
+The output has the same dimensions as lfsquish(1) would produce: each\n\
+dimension is divided by its factor, rounded down, and output sample\n\
+_M_ is centred on the box of input samples _M_ _FAC_ through (_M_+1)\n\
+_FAC_-1.  Near the ends of the data, where part of the filter falls\n\
+outside the array, the output is renormalized by the sum of the taps\n\
+that remain.\n\
+\n\
+The filter is applied in polyphase form: only the retained output\n\
+samples are computed, at a cost of about 2 _NTAP_ operations per\n\
+input datum per dimension.  Along dimension 1, each input row is\n\
+multiplied by the appropriate taps and added into the handful of\n\
+output rows it contributes to, which are held in a ring buffer of\n\
+about 2 _NTAP_ rows and written out as soon as they are complete.\n\
+Thus the program streams its input, and the inner loops run along\n\
+whole rows so that the compiler can vectorize them across channels.\n\
+\n\
+The data may be stored as `real32` or `real64`; the output is stored\n\
+with the same type as the input.  Data with more than one component\n\
+(e.g. complex cross-power) are filtered component by component.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-t, --dim1=`_FAC1_:\n\
+`-f, --dim2=`_FAC2_:\n\
+    Sets the decimation factor for the dimension 1 and 2 axes (time\n\
+    and frequency, respectively, for standard LoFASM spectrograms).\n\
+    The factors must be positive integers not exceeding the length of\n\
+    their respective axes.  A value of 1 (the default) leaves that\n\
+    axis unchanged and unfiltered.\n\
+\n\
+`-n, --taps=`_NTAP_:\n\
+    Sets the half-length of the filter, in units of output samples.\n\
+    Longer filters have sharper cutoffs and better stopband rejection,\n\
+    at proportionally greater cost.  The default is `8`.\n\
+\n\
+`-c, --cutoff=`_FRAC_:\n\
+    Sets the filter cutoff as a fraction of the output Nyquist\n\
+    frequency, between 0 and 1.  Values close to 1 preserve more of the\n\
+    passband but let more of the transition band alias.  The default\n\
+    is `0.9`.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfmean(1),\n\
+lfsquish(1),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:t:f:n:c:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "dim1", 1, 0, 't' },
+  { "dim2", 1, 0, 'f' },
+  { "taps", 1, 0, 'n' },
+  { "cutoff", 1, 0, 'c' },
+  { 0, 0, 0, 0} };
+
+
+/* Decimating FIR filter.  Output sample m is the sum over k of
+   h[k]*x[m*fac+k-shift], divided by the sum of the taps h[k] for
+   which x is in range. */
+typedef struct {
+  int64_t fac;    /* decimation factor */
+  int64_t k;      /* number of taps */
+  int64_t shift;  /* offset of first tap relative to m*fac */
+  double *h;      /* taps */
+} lfdecim;
+
+
+/* Designs a windowed-sinc filter for decimation by fac, with ntap
+   output samples on either side and cutoff frac of the output
+   Nyquist frequency.  The length is chosen so that the filter is
+   centred on each box of fac input samples.  Returns 0 on success,
+   nonzero on memory errors. */
+static int
+design( lfdecim *filt, int64_t fac, int64_t ntap, double frac )
+{
+  int64_t k;      /* tap index */
+  double t, sum;  /* offset from centre, and sum of taps */
+
+  filt->fac = fac;
+  if ( fac == 1 ) {
+    filt->k = 1;
+    filt->shift = 0;
+  } else {
+    filt->k = 2*ntap*fac + ( fac % 2 );
+    filt->shift = ( filt->k - fac )/2;
+  }
+  if ( !( filt->h = (double *)malloc( filt->k*sizeof(double) ) ) )
+    return 1;
+  for ( k = 0, sum = 0.0; k < filt->k; k++ ) {
+    t = k - 0.5*( filt->k - 1 );
+    filt->h[k] = ( t == 0.0 ? 1.0 :
+		   sin( M_PI*frac*t/fac )/( M_PI*frac*t/fac ) );
+    t = 2.0*M_PI*( k + 1 )/( filt->k + 1 );
+    filt->h[k] *= 0.42 - 0.5*cos( t ) + 0.08*cos( 2.0*t );
+    sum += filt->h[k];
+  }
+  for ( k = 0; k < filt->k; k++ )
+    filt->h[k] /= sum;
+  return 0;
+}
+
+
+/* Decimates n points of in (with the given stride) along the row,
+   computing nout outputs in out (with the same stride), for each of
+   stride interleaved sequences. */
+static void
+decimate_row( const lfdecim *filt, const double *in, double *out, int64_t n,
+	      int64_t nout, int64_t stride )
+{
+  int64_t m, k, s, lo, hi; /* indecies, and range of taps */
+  int64_t j;               /* input index of tap 0 (may be negative) */
+  double sum, w;           /* filtered value, and sum of taps */
+
+  for ( m = 0; m < nout; m++ ) {
+    j = m*filt->fac - filt->shift;
+    lo = ( j < 0 ? -j : 0 );
+    hi = ( n - j < filt->k ? n - j : filt->k );
+    for ( k = lo, w = 0.0; k < hi; k++ )
+      w += filt->h[k];
+    w = ( w != 0.0 ? 1.0/w : 0.0 );
+    for ( s = 0; s < stride; s++ ) {
+      for ( k = lo, sum = 0.0; k < hi; k++ )
+	sum += filt->h[k]*in[ ( j + k )*stride + s ];
+      out[ m*stride + s ] = sum*w;
+    }
+  }
+  return;
+}
+
+
+/* Reads a row of n data, padding with zeros past the end of the
+   input.  Returns the number of data actually read. */
+static int64_t
+read_row( double *row, int bits, int64_t n, FILE *fp )
+{
+  int64_t m = 0; /* number read */
+  if ( !feof( fp ) && !ferror( fp ) )
+    m = lfrealRead( row, bits, n, fp );
+  if ( m < n )
+    memset( row + m, 0, ( n - m )*sizeof(double) );
+  return m;
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  if ( in ) free( in ); \
+  if ( acc ) free( acc ); \
+  if ( wt ) free( wt ); \
+  if ( filt[0].h ) free( filt[0].h ); \
+  if ( filt[1].h ) free( filt[1].h ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;           /* option character and index */
+  char *infile, *outfile;  /* input/output file names */
+  FILE *fpin = NULL, *fpout = NULL; /* input/output file pointers */
+  long long fac[2] = { 1, 1 }; /* decimation factors */
+  long long ntap = 8;      /* filter half-length in output samples */
+  double frac = 0.9;       /* cutoff as fraction of output Nyquist */
+  lfdecim filt[2] = {};    /* filters for each dimension */
+  int64_t nin, nchan;      /* input rows and columns */
+  int64_t nout[2];         /* output dimensions */
+  int64_t lin, lmid, lout; /* input, intermediate, and output row lengths */
+  int64_t nring;           /* number of output rows in ring buffer */
+  int64_t i, j, m, m0, k;  /* indecies */
+  int64_t nread = 0, nrow; /* data read, and rows actually available */
+  lfb_hdr head = {};       /* file header */
+  double *in = NULL;       /* input row */
+  double *acc = NULL;      /* ring buffer of output rows, plus workspace */
+  double *wt = NULL;       /* sum of taps for each output row */
+  double *a, *row, w;      /* accumulated row, output row, and tap */
+  int bits;                /* bit depth of data (32 or 64) */
+  char *end;               /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 't':
+    case 'f':
+      k = ( opt == 't' ? 0 : 1 );
+      if ( ( fac[k] = strtoll( optarg, &end, 10 ) ) < 1 || *end ) {
+	lf_error( "bad -%c, --dim%d argument %s", opt, (int)( k + 1 ),
+		  optarg );
+	return 1;
+      }
+      break;
+    case 'n':
+      if ( ( ntap = strtoll( optarg, &end, 10 ) ) < 1 || *end ) {
+	lf_error( "bad -n, --taps argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'c':
+      if ( !( ( frac = strtod( optarg, &end ) ) > 0.0 ) || frac > 1.0 ||
+	   *end ) {
+	lf_error( "bad -c, --cutoff argument %s", optarg );
+	return 1;
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Check data type and dimensions. */
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  for ( k = 0; k < 2; k++ )
+    if ( ( nout[k] = head.dims[k]/fac[k] ) < 1 ) {
+      lf_error( "dim%d factor %lld exceeds length %lld", (int)( k + 1 ),
+		fac[k], (long long)( head.dims[k] ) );
+      CLEANEXIT( 1 );
+    }
+
+  /* Design filters and allocate storage.  The ring buffer holds every
+     output row that a single input row can contribute to, plus one
+     row of workspace for decimating along dimension 2. */
+  if ( design( filt, fac[0], ntap, frac ) ||
+       design( filt + 1, fac[1], ntap, frac ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  nin = head.dims[0];
+  nchan = head.dims[1];
+  lin = lmid = head.dims[1]*head.dims[2];
+  lout = nout[1]*head.dims[2];
+  nring = ( filt[0].k - 1 )/filt[0].fac + 1;
+  if ( !( in = (double *)malloc( lin*sizeof(double) ) ) ||
+       !( acc = (double *)calloc( ( nring + 1 )*lmid, sizeof(double) ) ) ||
+       !( wt = (double *)calloc( nring, sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+
+  /* Write output file header. */
+  head.dim1_span *= (double)( fac[0] )*nout[0]/head.dims[0];
+  head.dim2_span *= (double)( fac[1] )*nout[1]/head.dims[1];
+  head.dims[0] = nout[0];
+  head.dims[1] = nout[1];
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Stream input rows.  Input row i contributes tap i-m*fac+shift to
+     output rows m; output row m is complete once input row
+     m*fac+k-1-shift has been added, or the input runs out. */
+  row = acc + nring*lmid;
+  nrow = nin;
+  for ( i = 0, m0 = 0; m0 < nout[0]; i++ ) {
+
+    /* Add next input row into the output rows it contributes to. */
+    if ( i < nrow ) {
+      if ( ( j = read_row( in, bits, lin, fpin ) ) < lin ) {
+	nrow = i + ( j > 0 );
+	if ( j == 0 )
+	  continue;
+      }
+      nread += j;
+      m = i + filt[0].shift - filt[0].k + filt[0].fac;
+      m = ( m < 0 ? 0 : m/filt[0].fac );
+      for ( ; m <= ( i + filt[0].shift )/filt[0].fac && m < nout[0]; m++ ) {
+	w = filt[0].h[ i - m*filt[0].fac + filt[0].shift ];
+	a = acc + ( m % nring )*lmid;
+	wt[ m % nring ] += w;
+	for ( j = 0; j < lin; j++ )
+	  a[j] += w*in[j];
+      }
+    }
+
+    /* Write out any completed output rows. */
+    while ( m0 < nout[0] &&
+	    ( i >= nrow - 1 ||
+	      m0*filt[0].fac + filt[0].k - 1 - filt[0].shift <= i ) ) {
+      a = acc + ( m0 % nring )*lmid;
+      w = ( wt[ m0 % nring ] != 0.0 ? 1.0/wt[ m0 % nring ] : 0.0 );
+      for ( j = 0; j < lmid; j++ )
+	a[j] *= w;
+      if ( filt[1].fac > 1 )
+	decimate_row( filt + 1, a, row, nchan, nout[1], head.dims[2] );
+      else
+	memcpy( row, a, lout*sizeof(double) );
+      if ( lfrealWrite( row, bits, lout, fpout ) < lout ) {
+	lf_error( "could not write data to %s", outfile );
+	CLEANEXIT( 2 );
+      }
+      memset( a, 0, lmid*sizeof(double) );
+      wt[ m0 % nring ] = 0.0;
+      m0++;
+    }
+  }
+  if ( nread < nin*lin )
+    lf_warning( "read %lld data from %s, expected %lld",
+		(long long)( nread ), infile, (long long)( nin*lin ) );
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
@@ -0,0 +1,638 @@
+static const char *version = "\
+lfdedisp version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Dedisperse a LoFASM file over a range of dispersion measures.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -d, --dm-max=DM        maximum dispersion measure (pc/cm^3)\n\
+  -b, --block=NROW       output rows computed per block\n\
+  -j, --threads=N        compute using N threads\n\
+\n";
+
+static const char *description = "\
+# lfdedisp(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfdedisp(1)` - dedisperse a lofasm-filterbank(5) file\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfdedisp` [_OPTION_]... `-d` _DM_ [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program reads a lofasm-filterbank(5) spectrogram _INFILE_ and\n\
+writes a lofasm-filterbank(5) file _OUTFILE_ whose dimension 2 is\n\
+dispersion measure rather than frequency.  Each output datum is the\n\
+mean of the input power along the dispersed track\n\
+\n\
+> _t_(_f_) = _t_ + 4.148808e3 s x _DM_ x ( (_f_/MHz)^-2 - (_fmax_/MHz)^-2 ),\n\
+\n\
+where _fmax_ is the upper edge of the band, so that a dispersed pulse\n\
+appears as a peak at the time it crossed the top of the band and at\n\
+its dispersion measure.  If _INFILE_ or _OUTFILE_ is not specified, or\n\
+is a single `-` character, then standard input or standard output is\n\
+used instead.\n\
+\n\
+The dispersion measures are those whose total delay across the band\n\
+is 0, 1, 2, ... time samples, up to the value given by `-d, --dm-max`;\n\
+the header of _OUTFILE_ records the corresponding range.  The output\n\
+has fewer rows than the input, since the last rows would require data\n\
+past the end of the file: specifically, it is shorter by the number\n\
+of dispersion measures, less one.\n\
+\n\
+The sums are computed with the fast dispersion measure transform\n\
+(FDMT) of Zackay & Ofek (2017): adjacent subbands are dedispersed\n\
+separately and then combined pairwise, doubling the bandwidth at\n\
+each stage, so that the cost is of order _Nt_ _Ndm_ log2(_Nf_) rather\n\
+than _Nt_ _Ndm_ _Nf_ for a brute-force sum, where _Nt_, _Ndm_, and\n\
+_Nf_ are the numbers of times, dispersion measures, and channels.  The\n\
+quadratic dispersion law is followed exactly at each stage, and\n\
+dispersion within a single channel is accounted for by summing over\n\
+the samples that the track crosses in that channel.\n\
+\n\
+The input is streamed in blocks of output rows, each of which needs\n\
+the block's input rows plus an overlap of one maximum delay, so that\n\
+memory usage depends on the number of channels and dispersion measures\n\
+but not on the length of the file.  The work within each stage is\n\
+divided among several threads by dispersion measure.\n\
+\n\
+The input must be `real32` or `real64` data with one component per\n\
+channel (e.g. power: use lfsquish(1) with `-z pow` to convert complex\n\
+cross-power), and dimension 2 must be frequency in Hz with a band\n\
+above zero frequency.  The output is stored with the same type as the\n\
+input.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-d, --dm-max=`_DM_:\n\
+    Sets the maximum dispersion measure to search, in pc/cm^3.  This\n\
+    option is required.\n\
+\n\
+`-b, --block=`_NROW_:\n\
+    Sets the number of output rows computed per block.  Larger blocks\n\
+    spend proportionally less effort on the overlap between blocks,\n\
+    but use more memory.  The default is the number of dispersion\n\
+    measures or 256, whichever is larger.\n\
+\n\
+`-j, --threads=`_N_:\n\
+    Computes each stage of the transform using _N_ threads.  By\n\
+    default, one thread per online processor is used.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lf2fil(1),\n\
+lfsquish(1),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:d:b:j:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "dm-max", 1, 0, 'd' },
+  { "block", 1, 0, 'b' },
+  { "threads", 1, 0, 'j' },
+  { 0, 0, 0, 0} };
+
+#define KDM 4.148808e3 /* dispersion constant, in s MHz^2 cm^3/pc */
+#define NTHR 64        /* maximum number of threads */
+#define BLOCK 256      /* minimum default block length */
+#define NSTAGE 64      /* maximum number of stages of the transform */
+
+/* Subband at one stage of the transform.  Rows off through
+   off + nd - 1 of the stage array hold sums over the subband for
+   delays of 0 through nd - 1 samples across the subband. */
+typedef struct {
+  double flo, fhi; /* band edges (MHz) */
+  int64_t nd;      /* number of delays */
+  int64_t off;     /* first row in stage array */
+} fdmt_band;
+
+/* Source of one row of a stage: the sum of row up of the previous
+   stage and row lo (if lo >= 0) delayed by shift samples.  For the
+   initial stage, up is the channel and shift is the delay. */
+typedef struct {
+  int64_t up, lo, shift; /* source rows and delay */
+} fdmt_map;
+
+/* One stage of the transform. */
+typedef struct {
+  int64_t nband;    /* number of subbands */
+  int64_t nrow;     /* total number of rows */
+  fdmt_band *band;  /* subbands */
+  fdmt_map *map;    /* source of each row */
+  double *cnt;      /* number of input samples summed in each row */
+} fdmt_stage;
+
+/* Parameters for computing one stage over a block of data. */
+typedef struct {
+  const fdmt_stage *stage; /* stage being computed */
+  int init;                /* whether this is the initial stage */
+  int64_t nt;              /* number of samples in each row */
+  int64_t nchan;           /* number of input channels */
+  const double *src;       /* previous stage, or input block */
+  double *dst;             /* stage being computed */
+} fdmt_par;
+
+/* Range of rows to be computed by one thread. */
+typedef struct {
+  const fdmt_par *par;     /* stage parameters */
+  int64_t r0, r1;          /* range of rows [r0,r1) */
+} fdmt_job;
+
+
+/* Returns the dispersion delay across a band, in units of KDM*DM. */
+static double
+sweep( double flo, double fhi )
+{
+  return 1.0/( flo*flo ) - 1.0/( fhi*fhi );
+}
+
+
+/* Sets up the stages of the transform for nchan channels of width df
+   starting at f0 (MHz), with ndm delays across the full band.  Returns
+   the number of stages, or 0 on memory errors. */
+static int
+fdmt_setup( fdmt_stage *stages, int64_t nchan, double f0, double df,
+	    int64_t ndm )
+{
+  int n;                      /* stage index */
+  int64_t b, d, r;            /* band, delay, and row indecies */
+  double q = sweep( f0, f0 + nchan*df ); /* sweep across full band */
+  fdmt_stage *st, *prev = NULL; /* current and previous stages */
+  fdmt_band *band, *lo, *up;  /* current, lower, and upper subbands */
+
+  for ( n = 0, b = nchan; ; n++, b = ( b + 1 )/2 ) {
+    st = stages + n;
+    st->nband = b;
+    if ( !( st->band = (fdmt_band *)malloc( b*sizeof(fdmt_band) ) ) )
+      return 0;
+    for ( b = st->nrow = 0; b < st->nband; b++ ) {
+      band = st->band + b;
+      if ( n == 0 ) {
+	band->flo = f0 + b*df;
+	band->fhi = band->flo + df;
+      } else {
+	prev = stages + n - 1;
+	band->flo = prev->band[2*b].flo;
+	band->fhi = prev->band[ 2*b + 1 < prev->nband ? 2*b + 1 : 2*b ].fhi;
+      }
+      if ( st->nband == 1 )
+	band->nd = ndm;
+      else
+	band->nd = (int64_t)ceil( ( ndm - 1 )*
+				  sweep( band->flo, band->fhi )/q ) + 1;
+      band->off = st->nrow;
+      st->nrow += band->nd;
+    }
+    if ( !( st->map = (fdmt_map *)malloc( st->nrow*sizeof(fdmt_map) ) ) ||
+	 !( st->cnt = (double *)malloc( st->nrow*sizeof(double) ) ) )
+      return 0;
+
+    /* Map rows onto previous stage.  For a merged band, the delay d
+       is split between the upper and lower halves in proportion to
+       their sweeps. */
+    for ( b = 0; b < st->nband; b++ ) {
+      band = st->band + b;
+      for ( d = 0; d < band->nd; d++ ) {
+	fdmt_map *m = st->map + band->off + d;
+	r = band->off + d;
+	if ( n == 0 ) {
+	  m->up = b;
+	  m->lo = -1;
+	  m->shift = d;
+	  st->cnt[r] = d + 1;
+	} else if ( 2*b + 1 >= prev->nband ) {
+	  up = prev->band + 2*b;
+	  m->up = up->off + ( d < up->nd ? d : up->nd - 1 );
+	  m->lo = -1;
+	  m->shift = 0;
+	  st->cnt[r] = prev->cnt[m->up];
+	} else {
+	  lo = prev->band + 2*b;
+	  up = prev->band + 2*b + 1;
+	  m->shift = (int64_t)floor( d*sweep( up->flo, up->fhi )/
+				     sweep( band->flo, band->fhi ) + 0.5 );
+	  m->shift = ( m->shift < up->nd ? m->shift : up->nd - 1 );
+	  m->up = up->off + m->shift;
+	  m->lo = d - m->shift;
+	  m->lo = lo->off + ( m->lo < lo->nd ? m->lo : lo->nd - 1 );
+	  st->cnt[r] = prev->cnt[m->up] + prev->cnt[m->lo];
+	}
+      }
+    }
+    if ( st->nband == 1 )
+      return n + 1;
+  }
+}
+
+
+/* Computes rows job->r0 to job->r1 - 1 of a stage.  The loops over
+   time are kept free of branches so that the compiler can vectorize
+   them; samples past the end of the block are taken to be zero, and
+   only affect outputs that are not used. */
+static void *
+fdmt_rows( void *arg )
+{
+  fdmt_job *job = (fdmt_job *)arg;  /* job to be done */
+  const fdmt_par *p = job->par;     /* stage parameters */
+  int64_t nt = p->nt;               /* number of samples */
+  int64_t r, t, n;                  /* indecies, and overlap length */
+
+  for ( r = job->r0; r < job->r1; r++ ) {
+    const fdmt_map *m = p->stage->map + r;
+    double *restrict y = p->dst + r*nt;
+    n = nt - m->shift;
+
+    /* Initial stage: successive delays within a channel add one more
+       input sample to the previous row. */
+    if ( p->init ) {
+      const double *restrict x = p->src + m->up;
+      if ( m->shift == 0 )
+	for ( t = 0; t < nt; t++ )
+	  y[t] = x[t*p->nchan];
+      else {
+	const double *restrict z = y - nt;
+	x += m->shift*p->nchan;
+	for ( t = 0; t < n; t++ )
+	  y[t] = z[t] + x[t*p->nchan];
+	for ( ; t < nt; t++ )
+	  y[t] = z[t];
+      }
+    }
+
+    /* Later stages: add the upper subband to the delayed lower
+       subband. */
+    else {
+      const double *restrict u = p->src + m->up*nt;
+      if ( m->lo < 0 )
+	memcpy( y, u, nt*sizeof(double) );
+      else {
+	const double *restrict l = p->src + m->lo*nt + m->shift;
+	for ( t = 0; t < n; t++ )
+	  y[t] = u[t] + l[t];
+	for ( ; t < nt; t++ )
+	  y[t] = u[t];
+      }
+    }
+  }
+  return NULL;
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  for ( s = 0; s < NSTAGE; s++ ) { \
+    if ( stages[s].band ) free( stages[s].band ); \
+    if ( stages[s].map ) free( stages[s].map ); \
+    if ( stages[s].cnt ) free( stages[s].cnt ); \
+  } \
+  if ( blk ) free( blk ); \
+  if ( buf[0] ) free( buf[0] ); \
+  if ( buf[1] ) free( buf[1] ); \
+  if ( out ) free( out ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  FILE *fpin = NULL, *fpout = NULL; /* input/output file pointers */
+  double dmmax = 0.0;       /* maximum dispersion measure */
+  long long nblk = 0;       /* output rows per block */
+  int nthreads = 0;         /* number of threads */
+  int nstage = 0, s;        /* number of stages, and index */
+  fdmt_stage stages[NSTAGE] = {}; /* stages of the transform */
+  fdmt_par par;             /* parameters of current stage */
+  fdmt_job jobs[NTHR];      /* threads' work */
+  lfb_hdr head = {};        /* file header */
+  int bits;                 /* bit depth of data (32 or 64) */
+  int64_t nchan, nin, nout; /* channels, input rows, output rows */
+  int64_t ndm, nt;          /* number of delays, and samples per block */
+  int64_t i, j, k, n;       /* indecies */
+  int64_t nread = 0;        /* number of data read */
+  double f0, df, dt;        /* start frequency, channel width, sample time */
+  double *blk = NULL;       /* block of input data */
+  double *buf[2] = {};      /* stage arrays */
+  double *out = NULL;       /* output row */
+  const double *cnt;        /* samples summed in each output */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'd':
+      if ( !( ( dmmax = strtod( optarg, &end ) ) > 0.0 ) || *end ) {
+	lf_error( "bad -d, --dm-max argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'b':
+      if ( ( nblk = strtoll( optarg, &end, 10 ) ) < 1 || *end ) {
+	lf_error( "bad -b, --block argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'j':
+      if ( ( nthreads = atoi( optarg ) ) < 1 ) {
+	lf_error( "bad argument %s to -j, --threads", optarg );
+	return 1;
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+  if ( dmmax <= 0.0 ) {
+    lf_error( "must specify -d, --dm-max\n\t"
+	      "Try %s --help for more information", argv[0] );
+    return 1;
+  }
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Set number of threads. */
+#ifndef NO_THREADS
+  if ( nthreads < 1 && ( nthreads = sysconf( _SC_NPROCESSORS_ONLN ) ) < 1 )
+    nthreads = 1;
+#else
+  if ( nthreads > 1 )
+    lf_warning( "compiled with NO_THREADS; ignoring -j, --threads" );
+  nthreads = 1;
+#endif
+  if ( nthreads > NTHR )
+    nthreads = NTHR;
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Check data type and frequency range. */
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  if ( head.dims[2] != 1 ) {
+    lf_error( "requires one component per channel (e.g. power)" );
+    CLEANEXIT( 3 );
+  }
+  nin = head.dims[0];
+  nchan = head.dims[1];
+  f0 = ( head.frequency_offset_DC + head.dim2_start )*1.0e-6;
+  df = head.dim2_span/nchan*1.0e-6;
+  dt = head.dim1_span/nin;
+  if ( !( f0 > 0.0 ) || !( df > 0.0 ) || !( dt > 0.0 ) ) {
+    lf_error( "%s has bad time or frequency range", infile );
+    CLEANEXIT( 3 );
+  }
+
+  /* Set up transform. */
+  ndm = (int64_t)ceil( dmmax*KDM*sweep( f0, f0 + nchan*df )/dt ) + 1;
+  if ( ( nout = nin - ndm + 1 ) < 1 ) {
+    lf_error( "maximum delay %lld exceeds length %lld",
+	      (long long)( ndm - 1 ), (long long)( nin ) );
+    CLEANEXIT( 1 );
+  }
+  if ( nblk < 1 )
+    nblk = ( ndm > BLOCK ? ndm : BLOCK );
+  if ( nblk > nout )
+    nblk = nout;
+  nt = nblk + ndm - 1;
+  if ( !( nstage = fdmt_setup( stages, nchan, f0, df, ndm ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  for ( s = 0, n = 0; s < nstage; s++ )
+    n = ( stages[s].nrow > n ? stages[s].nrow : n );
+  if ( !( blk = (double *)malloc( nt*nchan*sizeof(double) ) ) ||
+       !( buf[0] = (double *)malloc( n*nt*sizeof(double) ) ) ||
+       !( buf[1] = (double *)malloc( n*nt*sizeof(double) ) ) ||
+       !( out = (double *)malloc( ndm*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  cnt = stages[nstage-1].cnt;
+  lf_info( "%lld dispersion measures, %d stages, %lld rows per block",
+	   (long long)( ndm ), nstage, (long long)( nblk ) );
+
+  /* Write output file header. */
+  n = nchan;
+  head.frequency_offset_DC = 0.0;
+  head.dim1_span = nout*dt;
+  head.dim2_start = 0.0;
+  head.dim2_span = ndm*dt/( KDM*sweep( f0, f0 + nchan*df ) );
+  if ( head.dim2_label )
+    free( head.dim2_label );
+  if ( !( head.dim2_label = strdup( "dispersion measure (pc/cm^3)" ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  head.dims[0] = nout;
+  head.dims[1] = ndm;
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Process blocks.  Each block holds nt input rows, of which the
+     last ndm - 1 are carried over to the start of the next block. */
+  par.nt = nt;
+  par.nchan = nchan;
+  for ( i = 0, k = 0; i < nout; i += nblk ) {
+
+    /* Fill block with new rows, padding with zeros. */
+    for ( ; k < nt; k++ ) {
+      j = 0;
+      if ( !feof( fpin ) && !ferror( fpin ) )
+	j = lfrealRead( blk + k*nchan, bits, nchan, fpin );
+      if ( j < nchan )
+	memset( blk + ( k*nchan + j ), 0, ( nchan - j )*sizeof(double) );
+      nread += j;
+    }
+
+    /* Compute each stage, dividing rows among threads. */
+    for ( s = 0; s < nstage; s++ ) {
+      par.stage = stages + s;
+      par.init = ( s == 0 );
+      par.src = ( s == 0 ? blk : buf[( s - 1 ) % 2] );
+      par.dst = buf[s % 2];
+      for ( j = 0; j < nthreads; j++ ) {
+	jobs[j].par = &par;
+	jobs[j].r0 = ( j*par.stage->nrow )/nthreads;
+	jobs[j].r1 = ( ( j + 1 )*par.stage->nrow )/nthreads;
+      }
+
+      /* The initial stage builds each delay from the previous one, so
+	 it is divided among threads by whole channels. */
+      if ( s == 0 )
+	for ( j = 0; j < nthreads; j++ ) {
+	  n = ( j*nchan )/nthreads;
+	  jobs[j].r0 = par.stage->band[n].off;
+	  n = ( ( j + 1 )*nchan )/nthreads;
+	  jobs[j].r1 = ( n < nchan ? par.stage->band[n].off :
+			 par.stage->nrow );
+	}
+      lfthreadRun( fdmt_rows, jobs, sizeof(*jobs), nthreads );
+    }
+
+    /* Write output rows, normalizing sums to means. */
+    for ( k = 0; k < nblk && i + k < nout; k++ ) {
+      for ( j = 0; j < ndm; j++ )
+	out[j] = par.dst[ j*nt + k ]/cnt[j];
+      if ( lfrealWrite( out, bits, ndm, fpout ) < ndm ) {
+	lf_error( "could not write data to %s", outfile );
+	CLEANEXIT( 2 );
+      }
+    }
+
+    /* Carry over overlap to next block. */
+    memmove( blk, blk + nblk*nchan, ( ndm - 1 )*nchan*sizeof(double) );
+    k = ndm - 1;
+  }
+  if ( nread < nin*nchan )
+    lf_warning( "read %lld data from %s, expected %lld",
+		(long long)( nread ), infile, (long long)( nin*nchan ) );
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
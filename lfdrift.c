@@ -0,0 +1,477 @@
+static const char *version = "\
+lfdrift version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Sum a LoFASM file along drifting-frequency tracks.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -n, --length=NT        block length in rows (a power of 2)\n\
+  -j, --threads=N        compute using N threads\n\
+\n";
+
+static const char *description = "\
+# lfdrift(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfdrift(1)` - de-Doppler a lofasm-filterbank(5) file\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfdrift` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program searches a lofasm-filterbank(5) file _INFILE_ for\n\
+narrowband signals whose frequency drifts linearly in time, such as\n\
+Doppler-shifted transmitters, which are smeared out by ordinary time\n\
+averaging.  It divides the input into blocks of _NT_ rows, and for\n\
+each block, frequency channel, and drift rate, averages the data\n\
+along a straight track in the time-frequency plane starting at that\n\
+channel.  The results are written to _OUTFILE_ as a\n\
+lofasm-filterbank(5) file.  If _INFILE_ or _OUTFILE_ is not specified,\n\
+or is a single `-` character, then standard input or standard output\n\
+is used instead.\n\
+\n\
+The track sums are computed with the Taylor tree algorithm: adjacent\n\
+pairs of rows are combined into 2-row sums for every drift of 0 or 1\n\
+channel, then pairs of these into 4-row sums for every drift of 0 to 3\n\
+channels, and so on, so that all _NT_ drifts are computed in log2(_NT_)\n\
+passes over the block, rather than the _NT_ passes required to sum\n\
+each track separately.  Tracks are approximated by a nearest-channel\n\
+path, which is exact for drifts of 0 and _NT_-1 channels per block.\n\
+The same transform is applied to the block with its frequency axis\n\
+reversed to obtain negative drifts.  The channels are divided among\n\
+several threads, each transforming its own range of channels plus the\n\
+_NT_-1 neighbouring channels its tracks can reach.\n\
+\n\
+The output has one row per block, and the same columns as the input,\n\
+with 2 _NT_-1 components per column: component _p_ is the mean along\n\
+the track from that channel at the start of the block to the channel\n\
+_p_-_NT_+1 higher at the end of the block.  Thus if _df_ is the\n\
+channel width and _dt_ the sampling interval, component _p_\n\
+corresponds to a drift rate of (_p_-_NT_+1) _df_/((_NT_-1) _dt_), and\n\
+component _NT_-1 is the ordinary block average.  Tracks that leave\n\
+the band before the end of the block are set to `nan`.  Non-finite\n\
+input values are treated as zero, and any rows left over after the\n\
+last full block are ignored.\n\
+\n\
+The data must be stored as `real32` or `real64`, with one component\n\
+per column; the output is stored with the same type as the input.\n\
+Memory usage is proportional to _NT_ times the number of columns.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-n, --length=`_NT_:\n\
+    Sets the length of each block, in rows, which must be a power of 2\n\
+    no larger than the number of rows.  The default is the largest\n\
+    power of 2 not exceeding the number of rows or 64.\n\
+\n\
+`-j, --threads=`_N_:\n\
+    Computes the transforms using _N_ threads.  By default, one thread\n\
+    per online processor is used.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfdedisp(1),\n\
+lfpower(1),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:n:j:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "length", 1, 0, 'n' },
+  { "threads", 1, 0, 'j' },
+  { 0, 0, 0, 0} };
+
+#define NTHR 64       /* maximum number of threads */
+#define NMAX 64       /* maximum default block length */
+
+/* Parameters for transforming one block.  Row t of the block is
+   stored in blk[t*nchan] through blk[t*nchan+nchan-1], and the result
+   for channel f and drift d (from -(nt-1) to nt-1) is stored in
+   out[f*(2*nt-1)+nt-1+d]. */
+typedef struct {
+  int64_t nt;               /* block length */
+  int64_t nchan;            /* number of channels */
+  const double *blk;        /* input block */
+  double *out;              /* output row */
+} drift_par;
+
+/* Range of channels to be transformed by one thread. */
+typedef struct {
+  const drift_par *par;     /* transform parameters */
+  int64_t c0, c1;           /* range of channels [c0,c1) */
+  double *a, *b;            /* tree workspaces */
+} drift_job;
+
+
+/* Computes the Taylor tree of nt rows of w channels stored in a,
+   using b as workspace.  On return, row d of the result holds the sum
+   along tracks drifting by d channels from each starting channel,
+   with channels beyond w treated as zero.  Returns a pointer to the
+   result, which is either a or b. */
+static double *
+taylor_tree( double *a, double *b, int64_t nt, int64_t w )
+{
+  int64_t n, s, d, h, o, f; /* subblock size and start, drift, indecies */
+  double *tmp;              /* pointer for swapping */
+
+  /* Each pass combines subblocks of n/2 rows into subblocks of n
+     rows, whose drift d track follows drift d/2 through the first
+     half, then drift d/2 from d - d/2 channels higher. */
+  for ( n = 2; n <= nt; n *= 2 ) {
+    for ( s = 0; s < nt; s += n )
+      for ( d = 0; d < n; d++ ) {
+	const double *x = a + ( s + d/2 )*w;
+	const double *y = x + ( n/2 )*w;
+	double *z = b + ( s + d )*w;
+	h = d/2;
+	o = d - h;
+	for ( f = 0; f < w - o; f++ )
+	  z[f] = x[f] + y[f+o];
+	for ( ; f < w; f++ )
+	  z[f] = x[f];
+      }
+    tmp = a;
+    a = b;
+    b = tmp;
+  }
+  return a;
+}
+
+
+/* Transforms channels job->c0 to job->c1 - 1, for positive and then
+   negative drifts, storing track means in the output row. */
+static void *
+drift_chans( void *arg )
+{
+  drift_job *job = (drift_job *)arg; /* job to be done */
+  const drift_par *p = job->par;     /* transform parameters */
+  int64_t nt = p->nt, nchan = p->nchan; /* block dimensions */
+  int64_t nd = 2*nt - 1;             /* number of drifts */
+  int64_t lo, w, t, d, f;            /* channel range and indecies */
+  double *r;                         /* tree result */
+
+  /* Positive drifts read channels c0 to c1 + nt - 2. */
+  lo = job->c0;
+  w = ( job->c1 + nt - 1 < nchan ? job->c1 + nt - 1 : nchan ) - lo;
+  for ( t = 0; t < nt; t++ )
+    for ( f = 0; f < w; f++ ) {
+      double x = p->blk[ t*nchan + lo + f ];
+      job->a[t*w+f] = ( isfinite( x ) ? x : 0.0 );
+    }
+  r = taylor_tree( job->a, job->b, nt, w );
+  for ( f = job->c0; f < job->c1; f++ )
+    for ( d = 0; d < nt; d++ )
+      p->out[ f*nd + nt - 1 + d ] =
+	( f + d < nchan ? r[ d*w + f - lo ]/nt : NAN );
+
+  /* Negative drifts read channels c0 - nt + 1 to c1 - 1 in reverse
+     order. */
+  lo = ( job->c0 - nt + 1 > 0 ? job->c0 - nt + 1 : 0 );
+  w = job->c1 - lo;
+  for ( t = 0; t < nt; t++ )
+    for ( f = 0; f < w; f++ ) {
+      double x = p->blk[ t*nchan + job->c1 - 1 - f ];
+      job->a[t*w+f] = ( isfinite( x ) ? x : 0.0 );
+    }
+  r = taylor_tree( job->a, job->b, nt, w );
+  for ( f = job->c0; f < job->c1; f++ )
+    for ( d = 1; d < nt; d++ )
+      p->out[ f*nd + nt - 1 - d ] =
+	( f - d >= 0 ? r[ d*w + job->c1 - 1 - f ]/nt : NAN );
+  return NULL;
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  if ( blk ) free( blk ); \
+  if ( out ) free( out ); \
+  if ( work ) free( work ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  FILE *fpin = NULL, *fpout = NULL; /* input/output file pointers */
+  long long nt = 0;         /* block length */
+  int nthreads = 0;         /* number of threads */
+  lfb_hdr head = {};        /* file header */
+  int bits;                 /* bit depth of data (32 or 64) */
+  int64_t nin, nchan, nd;   /* input rows, columns, and drifts */
+  int64_t nblk, wmax;       /* number of blocks, and channels per job */
+  int64_t j, k, s;          /* indecies */
+  double dt, df;            /* sample interval and channel width */
+  double *blk = NULL;       /* input block */
+  double *out = NULL;       /* output row */
+  double *work = NULL;      /* tree workspaces */
+  drift_par par;            /* transform parameters */
+  drift_job jobs[NTHR];     /* threads' work */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'n':
+      if ( ( nt = strtoll( optarg, &end, 10 ) ) < 2 || *end ||
+	   ( nt & ( nt - 1 ) ) ) {
+	lf_error( "bad -n, --length argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'j':
+      if ( ( nthreads = atoi( optarg ) ) < 1 ) {
+	lf_error( "bad argument %s to -j, --threads", optarg );
+	return 1;
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Set number of threads. */
+#ifndef NO_THREADS
+  if ( nthreads < 1 && ( nthreads = sysconf( _SC_NPROCESSORS_ONLN ) ) < 1 )
+    nthreads = 1;
+#else
+  if ( nthreads > 1 )
+    lf_warning( "compiled with NO_THREADS; ignoring -j, --threads" );
+  nthreads = 1;
+#endif
+  if ( nthreads > NTHR )
+    nthreads = NTHR;
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  if ( head.dims[2] != 1 ) {
+    lf_error( "requires one component per column" );
+    CLEANEXIT( 3 );
+  }
+  nin = head.dims[0];
+  nchan = head.dims[1];
+  dt = head.dim1_span/nin;
+  df = head.dim2_span/nchan;
+
+  /* Set block length. */
+  if ( nt < 1 )
+    for ( nt = 2; 2*nt <= nin && 2*nt <= NMAX; nt *= 2 )
+      ;
+  if ( nt > nin ) {
+    lf_error( "block length %lld exceeds length %lld", nt,
+	      (long long)( nin ) );
+    CLEANEXIT( 1 );
+  }
+  nblk = nin/nt;
+  nd = 2*nt - 1;
+  if ( nblk*nt < nin )
+    lf_info( "ignoring last %lld rows", (long long)( nin - nblk*nt ) );
+  lf_info( "drift rate resolution %g Hz/s", df/( ( nt - 1 )*dt ) );
+  if ( nthreads > nchan )
+    nthreads = nchan;
+  wmax = ( nchan + nthreads - 1 )/nthreads + nt - 1;
+
+  /* Allocate storage. */
+  if ( !( blk = (double *)malloc( nt*nchan*sizeof(double) ) ) ||
+       !( out = (double *)malloc( nchan*nd*sizeof(double) ) ) ||
+       !( work = (double *)malloc( nthreads*2*nt*wmax*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  par.nt = nt;
+  par.nchan = nchan;
+  par.blk = blk;
+  par.out = out;
+  for ( k = 0; k < nthreads; k++ ) {
+    jobs[k].par = &par;
+    jobs[k].c0 = ( k*nchan )/nthreads;
+    jobs[k].c1 = ( ( k + 1 )*nchan )/nthreads;
+    jobs[k].a = work + 2*k*nt*wmax;
+    jobs[k].b = jobs[k].a + nt*wmax;
+  }
+
+  /* Write output file header. */
+  head.dim1_span = nblk*nt*dt;
+  if ( head.data_label ) {
+    char *label = head.data_label; /* old data label */
+    if ( !( head.data_label = (char *)malloc( strlen( label ) + 32 ) ) ) {
+      lf_error( "memory error" );
+      head.data_label = label;
+      CLEANEXIT( 4 );
+    }
+    sprintf( head.data_label, "drift track mean of %s", label );
+    free( label );
+  }
+  head.dims[0] = nblk;
+  head.dims[2] = nd;
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Read, transform, and write each block. */
+  for ( s = 0; s < nblk; s++ ) {
+    if ( ( j = lfrealRead( blk, bits, nt*nchan, fpin ) ) < nt*nchan ) {
+      lf_warning( "read %lld data from %s, expected %lld",
+		  (long long)( s*nt*nchan + j ), infile,
+		  (long long)( nin*nchan ) );
+      memset( blk + j, 0, ( nt*nchan - j )*sizeof(double) );
+    }
+    lfthreadRun( drift_chans, jobs, sizeof(*jobs), nthreads );
+    if ( lfrealWrite( out, bits, nchan*nd, fpout ) < nchan*nd ) {
+      lf_error( "could not write data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+  }
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
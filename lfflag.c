@@ -0,0 +1,529 @@
+static const char *version = "\
+lfflag version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Flag interference in a LoFASM file, writing a mask.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -b, --block=M          rows per block for statistics (default 64)\n\
+  -k, --sk=SIGMA         spectral kurtosis threshold (default 3)\n\
+  -n, --accum=N          spectra accumulated per sample (default 1)\n\
+  -m, --mad=SIGMA        outlier threshold in robust sigmas (default 5)\n\
+  -c, --clean=FILE       write data with flagged samples replaced\n\
+  -r, --replace=VALUE    replacement value (default median)\n\
+\n";
+
+static const char *description = "\
+# lfflag(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfflag(1)` - flag interference in a lofasm-filterbank(5) file\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfflag` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program reads a spectrogram stored in a lofasm-filterbank(5) file\n\
+_INFILE_, flags samples that appear to be contaminated by\n\
+radio-frequency interference, and writes a bit-packed mask file to\n\
+_OUTFILE_ (see lofasm-filterbank(5) and lfmaskRead(3)), in which a 1\n\
+bit marks a flagged sample.  If _INFILE_ or _OUTFILE_ is not\n\
+specified, or is a single `-` character, then standard input or\n\
+standard output is used instead.\n\
+\n\
+The input is processed in a single pass, in consecutive blocks of _M_\n\
+rows (the last block may be shorter), so that memory usage is\n\
+proportional to _M_ times the number of channels.  Within each block,\n\
+three tests are applied to each channel:\n\
+\n\
+* Non-finite values are always flagged.\n\
+\n\
+* The spectral kurtosis estimator of Nita and Gary (2010),\n\
+\n\
+        SK = (M N + 1)/(M - 1) (M S2/S1^2 - 1)\n\
+\n\
+  is computed from the sums _S1_ and _S2_ of the channel's values and\n\
+  their squares over the block, where each value is taken to be the\n\
+  sum or average of _N_ power spectra.  For Gaussian noise this has an\n\
+  expected value of 1, and a variance that depends only on _M_ and _N_;\n\
+  if it differs from 1 by more than _SIGMA_ standard deviations, the\n\
+  whole channel is flagged within the block.  This detects\n\
+  interference that is persistent or intermittent within the block,\n\
+  even if it is too weak to stand out in any one sample.\n\
+\n\
+* The channel's median and median absolute deviation (MAD) over the\n\
+  block are computed, and any sample that differs from the median by\n\
+  more than _SIGMA_ times 1.4826 MAD (the standard deviation for\n\
+  Gaussian noise) is flagged.  This detects strong impulsive\n\
+  interference.\n\
+\n\
+The sums for spectral kurtosis are accumulated a row at a time across\n\
+all channels, so the inner loops run over contiguous data.\n\
+\n\
+Optionally, with `-c, --clean`, a copy of the data is written with the\n\
+flagged samples replaced, for programs that do not read masks.  The\n\
+mask file has the same header as _INFILE_ except for its data type\n\
+(`bit1`), data label, and dimensions.  The data must be stored as\n\
+`real32` or `real64`, with one component per column; the cleaned data\n\
+are stored with the same type as the input.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-b, --block=`_M_:\n\
+    Sets the number of rows in each block.  The default is `64`.\n\
+\n\
+`-k, --sk=`_SIGMA_:\n\
+    Sets the spectral kurtosis threshold, in standard deviations.  The\n\
+    default is `3`; a value of `0` disables the test, which should be\n\
+    done if the data are not power spectra (e.g. if they have been\n\
+    normalized to zero mean).\n\
+\n\
+`-n, --accum=`_N_:\n\
+    Sets the number of power spectra accumulated in each sample of\n\
+    the input, which determines the expected distribution of spectral\n\
+    kurtosis.  The default is `1`.\n\
+\n\
+`-m, --mad=`_SIGMA_:\n\
+    Sets the outlier threshold, in robust standard deviations.  The\n\
+    default is `5`; a value of `0` disables the test.\n\
+\n\
+`-c, --clean=`_FILE_:\n\
+    Writes the input data to _FILE_, with flagged samples replaced as\n\
+    specified by `-r, --replace`.\n\
+\n\
+`-r, --replace=`_VALUE_:\n\
+    Sets the value substituted for flagged samples by `-c, --clean`.\n\
+    This may be `median`, indicating the median of the channel over\n\
+    the block (the default), or a floating-point number: in addition\n\
+    to ordinary numbers, you may also specify `nan`, `inf`, etc.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfmed(1),\n\
+lfstats(1),\n\
+lfmaskRead(3),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:b:k:n:m:c:r:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "block", 1, 0, 'b' },
+  { "sk", 1, 0, 'k' },
+  { "accum", 1, 0, 'n' },
+  { "mad", 1, 0, 'm' },
+  { "clean", 1, 0, 'c' },
+  { "replace", 1, 0, 'r' },
+  { 0, 0, 0, 0} };
+
+#define MADSIG 1.4826 /* ratio of standard deviation to MAD for Gaussian */
+
+
+/* Returns the kth smallest of n values in a, partially reordering
+   them (Hoare's selection algorithm). */
+static double
+select_kth( double *a, int64_t n, int64_t k )
+{
+  int64_t lo = 0, hi = n - 1, i, j; /* partition limits and indecies */
+  double p, t;                     /* pivot and temporary */
+
+  while ( lo < hi ) {
+    p = a[ lo + ( hi - lo )/2 ];
+    for ( i = lo, j = hi; i <= j; ) {
+      while ( a[i] < p )
+	i++;
+      while ( a[j] > p )
+	j--;
+      if ( i <= j ) {
+	t = a[i];
+	a[i++] = a[j];
+	a[j--] = t;
+      }
+    }
+    if ( k <= j )
+      hi = j;
+    else if ( k >= i )
+      lo = i;
+    else
+      break;
+  }
+  return a[k];
+}
+
+
+/* Writes a mask file header matching the data header head, returning
+   the result of lfbxWrite().  The header is copied shallowly, so head
+   is not modified and no strings need be freed. */
+static int
+write_mask_header( FILE *fp, const lfb_hdr *head )
+{
+  lfb_hdr mhead; /* mask header */
+
+  memcpy( &mhead, head, sizeof(lfb_hdr) );
+  mhead.data_type = (char *)"bit1";
+  mhead.data_label = (char *)"interference mask";
+  mhead.data_offset = 0.0;
+  mhead.data_scale = 1.0;
+  mhead.dims[2] = mhead.dims[3] = 1;
+  return lfbxWrite( fp, &mhead, NULL );
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  if ( fpcln ) fclose( fpcln ); \
+  if ( blk ) free( blk ); \
+  if ( flag ) free( flag ); \
+  if ( stat ) free( stat ); \
+  if ( cnt ) free( cnt ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  char *clnfile = NULL;     /* cleaned data file name */
+  FILE *fpin = NULL, *fpout = NULL, *fpcln = NULL; /* file pointers */
+  long long nblk = 64;      /* rows per block */
+  double sksig = 3.0;       /* spectral kurtosis threshold */
+  double nacc = 1.0;        /* spectra accumulated per sample */
+  double madsig = 5.0;      /* MAD outlier threshold */
+  double repl = 0.0;        /* replacement value */
+  int usemed = 1;           /* whether to replace with median */
+  lfb_hdr head = {};        /* file header */
+  lfb_mask mask = {};       /* mask writing state */
+  int bits;                 /* bit depth of data (32 or 64) */
+  int64_t nin, nchan;       /* input rows and columns */
+  int64_t r, m, i, j, k;    /* row, block length, indecies */
+  int64_t nflag = 0;        /* number of flagged samples */
+  int64_t *cnt = NULL;      /* finite values per channel */
+  double *blk = NULL;       /* block of input rows */
+  unsigned char *flag = NULL; /* block of flags */
+  double *stat = NULL;      /* per-channel statistics and workspace */
+  double *s1, *s2, *med, *tmp; /* sums, medians, and workspace */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'b':
+      if ( ( nblk = strtoll( optarg, &end, 10 ) ) < 2 || *end ) {
+	lf_error( "bad -b, --block argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'k':
+      if ( !( ( sksig = strtod( optarg, &end ) ) >= 0.0 ) || *end ) {
+	lf_error( "bad -k, --sk argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'n':
+      if ( !( ( nacc = strtod( optarg, &end ) ) > 0.0 ) || *end ||
+	   isinf( nacc ) ) {
+	lf_error( "bad -n, --accum argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'm':
+      if ( !( ( madsig = strtod( optarg, &end ) ) >= 0.0 ) || *end ) {
+	lf_error( "bad -m, --mad argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'c':
+      clnfile = optarg;
+      break;
+    case 'r':
+      if ( !( usemed = !strcmp( optarg, "median" ) ) ) {
+	repl = strtod( optarg, &end );
+	if ( *end ) {
+	  lf_error( "could not parse replacement value %s", optarg );
+	  return 1;
+	}
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  if ( head.dims[2] != 1 ) {
+    lf_error( "requires one component per column" );
+    CLEANEXIT( 3 );
+  }
+  nin = head.dims[0];
+  nchan = head.dims[1];
+  if ( nblk > nin )
+    nblk = ( nin > 0 ? nin : 1 );
+
+  /* Allocate storage. */
+  if ( !( blk = (double *)malloc( nblk*nchan*sizeof(double) ) ) ||
+       !( flag = (unsigned char *)malloc( nblk*nchan ) ) ||
+       !( stat = (double *)malloc( ( 3*nchan + nblk )*sizeof(double) ) ) ||
+       !( cnt = (int64_t *)malloc( nchan*sizeof(int64_t) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  s1 = stat;
+  s2 = s1 + nchan;
+  med = s2 + nchan;
+  tmp = med + nchan;
+
+  /* Open output files and write headers. */
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( write_mask_header( fpout, &head ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( clnfile ) {
+    if ( !( fpcln = lfopen( clnfile, "wb" ) ) ) {
+      lf_error( "could not open output file %s", clnfile );
+      CLEANEXIT( 2 );
+    }
+    if ( lfbxWrite( fpcln, &head, NULL ) ) {
+      lf_error( "error writing header to %s", clnfile );
+      CLEANEXIT( 2 );
+    }
+  }
+
+  /* Process each block. */
+  for ( r = 0; r < nin; r += m ) {
+    m = ( nin - r < nblk ? nin - r : nblk );
+    if ( ( j = lfrealRead( blk, bits, m*nchan, fpin ) ) < m*nchan ) {
+      lf_warning( "read %lld data from %s, expected %lld",
+		  (long long)( r*nchan + j ), infile,
+		  (long long)( nin*nchan ) );
+      for ( ; j < m*nchan; j++ )
+	blk[j] = NAN;
+    }
+
+    /* Accumulate sums across channels, flagging non-finite values. */
+    memset( s1, 0, 2*nchan*sizeof(double) );
+    memset( cnt, 0, nchan*sizeof(int64_t) );
+    for ( i = 0; i < m; i++ ) {
+      const double *x = blk + i*nchan;
+      unsigned char *f = flag + i*nchan;
+      for ( j = 0; j < nchan; j++ ) {
+	f[j] = !isfinite( x[j] );
+	if ( !f[j] ) {
+	  s1[j] += x[j];
+	  s2[j] += x[j]*x[j];
+	  cnt[j]++;
+	}
+      }
+    }
+
+    /* Flag channels with anomalous spectral kurtosis. */
+    if ( sksig > 0.0 )
+      for ( j = 0; j < nchan; j++ ) {
+	double n = cnt[j], nd = n*nacc; /* samples and total spectra */
+	double sk, sd;                  /* kurtosis and its deviation */
+	if ( n < 2.0 || !( s1[j] > 0.0 ) )
+	  continue;
+	sk = ( nd + 1.0 )/( n - 1.0 )*( n*s2[j]/( s1[j]*s1[j] ) - 1.0 );
+	sd = sqrt( 2.0*nacc*( nacc + 1.0 )*n*n/
+		   ( ( n - 1.0 )*( nd + 2.0 )*( nd + 3.0 ) ) );
+	if ( fabs( sk - 1.0 ) > sksig*sd )
+	  for ( i = 0; i < m; i++ )
+	    flag[ i*nchan + j ] = 1;
+      }
+
+    /* Compute medians, and flag outliers from the median. */
+    if ( madsig > 0.0 || ( fpcln && usemed ) )
+      for ( j = 0; j < nchan; j++ ) {
+	double mad; /* scaled median absolute deviation */
+	for ( i = k = 0; i < m; i++ )
+	  if ( isfinite( blk[ i*nchan + j ] ) )
+	    tmp[k++] = blk[ i*nchan + j ];
+	if ( !k ) {
+	  med[j] = NAN;
+	  continue;
+	}
+	med[j] = select_kth( tmp, k, k/2 );
+	if ( !( madsig > 0.0 ) )
+	  continue;
+	for ( i = 0; i < k; i++ )
+	  tmp[i] = fabs( tmp[i] - med[j] );
+	if ( ( mad = MADSIG*select_kth( tmp, k, k/2 ) ) > 0.0 )
+	  for ( i = 0; i < m; i++ )
+	    if ( fabs( blk[ i*nchan + j ] - med[j] ) > madsig*mad )
+	      flag[ i*nchan + j ] = 1;
+      }
+
+    /* Write mask, and cleaned data if requested. */
+    for ( i = 0; i < m*nchan; i++ )
+      nflag += flag[i];
+    if ( lfmaskWrite( flag, m*nchan, &mask, fpout ) < m*nchan ) {
+      lf_error( "could not write data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+    if ( fpcln ) {
+      for ( i = 0; i < m; i++ )
+	for ( j = 0; j < nchan; j++ )
+	  if ( flag[ i*nchan + j ] )
+	    blk[ i*nchan + j ] = ( usemed ? med[j] : repl );
+      if ( lfrealWrite( blk, bits, m*nchan, fpcln ) < m*nchan ) {
+	lf_error( "could not write data to %s", clnfile );
+	CLEANEXIT( 2 );
+      }
+    }
+  }
+  if ( lfmaskFlush( &mask, fpout ) ) {
+    lf_error( "could not write data to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  lf_info( "flagged %lld of %lld samples", (long long)( nflag ),
+	   (long long)( nin*nchan ) );
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
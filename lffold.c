@@ -0,0 +1,510 @@
+static const char *version = "\
+lffold version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Fold a LoFASM file at a known period.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -p, --period=P         fold at period P (s)\n\
+  -d, --pdot=PDOT        period derivative (s/s, default 0)\n\
+  -e, --epoch=MJD        epoch of period and zero phase\n\
+  -n, --bins=NBIN        number of phase bins (default 64)\n\
+  -a, --pad=VALUE        set value for bins with no data\n\
+  -j, --threads=N        accumulate using N threads\n\
+\n";
+
+static const char *description = "\
+# lffold(1)\n\
+\n\
+## NAME\n\
+\n\
+`lffold(1)` - fold a lofasm-filterbank(5) file at a known period\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lffold` `-p` _P_ [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program reads a lofasm-filterbank(5) file _INFILE_ and folds it\n\
+at the period of a known periodic source such as a pulsar, averaging\n\
+its timesteps into bins of rotational phase for each frequency bin\n\
+separately, and writes the resulting phase-frequency filterbank to\n\
+_OUTFILE_.  If _INFILE_ or _OUTFILE_ is not specified, or is a single\n\
+`-` character, then standard input or standard output is used\n\
+instead.\n\
+\n\
+The time of each input timestep is computed as in lfstack(1), from the\n\
+`time_offset_J2000` and `dim1_start` header fields and the time\n\
+sampling interval, taking the centre of the timestep; if `dim1_start`\n\
+is absent, the `start_mjd` field is used instead.  Relative to the\n\
+epoch _MJD_ given by `-e, --epoch`, at time _t_ the rotational phase\n\
+(in cycles) is:\n\
+\n\
+    phase = f t + fdot t^2/2\n\
+\n\
+where _f_=1/_P_ and _fdot_=-_PDOT_/_P_^2 are the rotation frequency\n\
+and its derivative at the epoch.  The fractional part of the phase\n\
+determines which of _NBIN_ bins the timestep falls in.  No barycentric\n\
+or dispersion corrections are made, so the period should be the\n\
+apparent period at the observatory over the span of the file, and the\n\
+data should be dedispersed first if the dispersion delay across the\n\
+band is significant.\n\
+\n\
+The input is streamed in blocks of rows, which are divided among\n\
+several threads; each thread accumulates its rows into its own\n\
+partial sums and counts for each phase bin, which are merged once the\n\
+whole file has been read.  Thus the memory required depends only on\n\
+the number of bins, the row length, and the number of threads, not on\n\
+the length of the file.  Non-finite input values (e.g. `nan` padding\n\
+inserted by lfcat(1)) are ignored.\n\
+\n\
+The output file has the same frequency axis, data type, and metadata\n\
+as the input file, but its dimension 1 is pulse phase, measured in\n\
+cycles from 0 to 1, and its `time_offset_J2000` and `start_mjd` fields\n\
+are set to zero.  Each output point is the mean of all finite input\n\
+values in that phase bin.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-p, --period=`_P_:\n\
+    Sets the folding period at the epoch, in seconds.  This option is\n\
+    required.\n\
+\n\
+`-d, --pdot=`_PDOT_:\n\
+    Sets the time derivative of the period (dimensionless).  The\n\
+    default is `0`.\n\
+\n\
+`-e, --epoch=`_MJD_:\n\
+    Sets the epoch, as a modified Julian date, at which the period is\n\
+    _P_ and the phase is zero.  The default is the start time of the\n\
+    input file.\n\
+\n\
+`-n, --bins=`_NBIN_:\n\
+    Sets the number of phase bins spanning one period.  The default is\n\
+    `64`.\n\
+\n\
+`-a, --pad=`_VALUE_:\n\
+    Sets a value to be used for output points that received no finite\n\
+    input data.  The value will be parsed as a floating-point number:\n\
+    in addition to ordinary numbers, you may also specify `nan`,\n\
+    `inf`, etc.  The default is `nan`.\n\
+\n\
+`-j, --threads=`_N_:\n\
+    Accumulates the phase bins using _N_ threads.  By default, one\n\
+    thread per online processor is used.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfdedisp(1),\n\
+lfpower(1),\n\
+lfstack(1),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:p:d:e:n:a:j:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "period", 1, 0, 'p' },
+  { "pdot", 1, 0, 'd' },
+  { "epoch", 1, 0, 'e' },
+  { "bins", 1, 0, 'n' },
+  { "pad", 1, 0, 'a' },
+  { "threads", 1, 0, 'j' },
+  { 0, 0, 0, 0} };
+
+#define NTHR 64           /* maximum number of threads */
+#define NBLK 256          /* number of rows read per block */
+#define MJD_J2000 51544.5 /* MJD of J2000 epoch */
+
+/* Parameters for folding one block of rows.  Row i of the block is
+   stored in blk[i*lin] through blk[i*lin+lin-1], and falls in phase
+   bin bin[i]. */
+typedef struct {
+  int64_t lin;              /* number of data per row */
+  int64_t nrow;             /* number of rows in the block */
+  const double *blk;        /* block of rows */
+  const int64_t *bin;       /* phase bin of each row */
+  int nthreads;             /* number of threads sharing the block */
+} fold_par;
+
+/* One thread's share of the folding, with its own partial profile:
+   the sums and counts for bin k are stored in sum[k*lin] and
+   cnt[k*lin] onwards. */
+typedef struct {
+  const fold_par *par;      /* folding parameters */
+  int idx;                  /* index of this thread */
+  double *sum;              /* partial sums */
+  uint32_t *cnt;            /* partial counts */
+} fold_job;
+
+
+/* Adds this thread's share of the current block's rows into its
+   partial profile, ignoring non-finite values. */
+static void *
+fold_rows( void *arg )
+{
+  fold_job *job = (fold_job *)arg; /* job to be done */
+  const fold_par *p = job->par;    /* folding parameters */
+  int64_t lin = p->lin;            /* row length */
+  int64_t i, i1, j;                /* row range and column index */
+
+  i = ( job->idx*p->nrow )/p->nthreads;
+  i1 = ( ( job->idx + 1 )*p->nrow )/p->nthreads;
+  for ( ; i < i1; i++ ) {
+    const double *x = p->blk + i*lin;
+    double *s = job->sum + p->bin[i]*lin;
+    uint32_t *c = job->cnt + p->bin[i]*lin;
+    for ( j = 0; j < lin; j++ )
+      if ( isfinite( x[j] ) ) {
+	s[j] += x[j];
+	c[j]++;
+      }
+  }
+  return NULL;
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  if ( blk ) free( blk ); \
+  if ( bin ) free( bin ); \
+  if ( sum ) free( sum ); \
+  if ( cnt ) free( cnt ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  FILE *fpin = NULL, *fpout = NULL; /* input/output file pointers */
+  double period = 0.0;      /* folding period */
+  double pdot = 0.0;        /* period derivative */
+  double epoch = NAN;       /* epoch (MJD) */
+  long long nbin = 64;      /* number of phase bins */
+  double pad = NAN;         /* value for empty bins */
+  int nthreads = 0;         /* number of threads */
+  lfb_hdr head = {};        /* file header */
+  int bits;                 /* bit depth of data (32 or 64) */
+  int64_t nin, lin;         /* input rows and data per row */
+  int64_t i, j, k, n, r;    /* indecies and counts */
+  double f, fdot;           /* rotation frequency and derivative */
+  double t0, dt, t, ph;     /* start time, timestep, time and phase */
+  double *blk = NULL;       /* block of input rows */
+  int64_t *bin = NULL;      /* phase bin of each row */
+  double *sum = NULL;       /* partial sums for each thread */
+  uint32_t *cnt = NULL;     /* partial counts for each thread */
+  fold_par par;             /* folding parameters */
+  fold_job jobs[NTHR];      /* threads' work */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'p':
+      if ( !( ( period = strtod( optarg, &end ) ) > 0.0 ) || *end ||
+	   isinf( period ) ) {
+	lf_error( "bad -p, --period argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'd':
+      pdot = strtod( optarg, &end );
+      if ( *end || !isfinite( pdot ) ) {
+	lf_error( "bad -d, --pdot argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'e':
+      epoch = strtod( optarg, &end );
+      if ( *end || !isfinite( epoch ) ) {
+	lf_error( "bad -e, --epoch argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'n':
+      if ( ( nbin = strtoll( optarg, &end, 10 ) ) < 1 || *end ) {
+	lf_error( "bad -n, --bins argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'a':
+      pad = strtod( optarg, &end );
+      if ( *end ) {
+	lf_error( "could not parse pad value %s", optarg );
+	return 1;
+      }
+      break;
+    case 'j':
+      if ( ( nthreads = atoi( optarg ) ) < 1 ) {
+	lf_error( "bad argument %s to -j, --threads", optarg );
+	return 1;
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+  if ( !( period > 0.0 ) ) {
+    lf_error( "missing required -p, --period option\n\t"
+	      "Try %s --help for more information", argv[0] );
+    return 1;
+  }
+  f = 1.0/period;
+  fdot = -pdot*f*f;
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Set number of threads. */
+#ifndef NO_THREADS
+  if ( nthreads < 1 && ( nthreads = sysconf( _SC_NPROCESSORS_ONLN ) ) < 1 )
+    nthreads = 1;
+#else
+  if ( nthreads > 1 )
+    lf_warning( "compiled with NO_THREADS; ignoring -j, --threads" );
+  nthreads = 1;
+#endif
+  if ( nthreads > NTHR )
+    nthreads = NTHR;
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  nin = head.dims[0];
+  lin = head.dims[1]*head.dims[2];
+  if ( nin < 1 || !( head.dim1_span > 0.0 ) ) {
+    lf_error( "no timing information in %s", infile );
+    CLEANEXIT( 3 );
+  }
+
+  /* Get start time and epoch in seconds since J2000, and timestep. */
+  if ( isnan( head.dim1_start ) )
+    t0 = ( head.start_mjd - MJD_J2000 )*86400.0;
+  else
+    t0 = head.time_offset_J2000 + head.dim1_start;
+  if ( !isnan( epoch ) )
+    t0 -= ( epoch - MJD_J2000 )*86400.0;
+  else
+    t0 = 0.0;
+  dt = head.dim1_span/nin;
+  if ( nthreads > NBLK )
+    nthreads = NBLK;
+
+  /* Allocate storage. */
+  if ( !( blk = (double *)malloc( NBLK*lin*sizeof(double) ) ) ||
+       !( bin = (int64_t *)malloc( NBLK*sizeof(int64_t) ) ) ||
+       !( sum = (double *)calloc( nthreads*nbin*lin, sizeof(double) ) ) ||
+       !( cnt = (uint32_t *)calloc( nthreads*nbin*lin,
+				    sizeof(uint32_t) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  par.lin = lin;
+  par.blk = blk;
+  par.bin = bin;
+  par.nthreads = nthreads;
+  for ( k = 0; k < nthreads; k++ ) {
+    jobs[k].par = &par;
+    jobs[k].idx = k;
+    jobs[k].sum = sum + k*nbin*lin;
+    jobs[k].cnt = cnt + k*nbin*lin;
+  }
+
+  /* Read and fold each block, computing the phase bin of each row
+     from its time relative to the epoch. */
+  for ( r = 0; r < nin; r += n ) {
+    n = ( nin - r < NBLK ? nin - r : NBLK );
+    if ( ( j = lfrealRead( blk, bits, n*lin, fpin ) ) < n*lin ) {
+      lf_warning( "read %lld data from %s, expected %lld",
+		  (long long)( r*lin + j ), infile, (long long)( nin*lin ) );
+      n = j/lin;
+      nin = r + n;
+    }
+    for ( i = 0; i < n; i++ ) {
+      t = t0 + ( r + i + 0.5 )*dt;
+      ph = t*( f + 0.5*fdot*t );
+      ph -= floor( ph );
+      if ( ( bin[i] = (int64_t)( ph*nbin ) ) >= nbin )
+	bin[i] = nbin - 1;
+    }
+    par.nrow = n;
+    lfthreadRun( fold_rows, jobs, sizeof(*jobs), nthreads );
+  }
+  lf_info( "folded %lld rows into %lld bins", (long long)( nin ), nbin );
+
+  /* Merge the partial profiles into the first. */
+  for ( k = 1; k < nthreads; k++ )
+    for ( j = 0; j < nbin*lin; j++ ) {
+      sum[j] += jobs[k].sum[j];
+      cnt[j] += jobs[k].cnt[j];
+    }
+
+  /* Write output file header. */
+  head.time_offset_J2000 = 0.0;
+  head.start_mjd = 0.0;
+  head.dim1_start = 0.0;
+  head.dim1_span = 1.0;
+  head.dims[0] = nbin;
+  if ( head.dim1_label )
+    free( head.dim1_label );
+  if ( !( head.dim1_label = strdup( "pulse phase (cycles)" ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Write mean profiles. */
+  for ( j = 0; j < nbin*lin; j++ )
+    sum[j] = ( cnt[j] ? sum[j]/cnt[j] : pad );
+  if ( lfrealWrite( sum, bits, nbin*lin, fpout ) < nbin*lin ) {
+    lf_error( "could not write data to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
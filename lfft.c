@@ -0,0 +1,220 @@
+// 2>&-### SELF-EXTRACTING DOCUMENTATION ###############################
+// 2>&-#                                                               #
+// 2>&-# Run "bash <thisfile> > <docfile.md>" to extract documentation #
+// 2>&-#                                                               #
+// 2>&-#################################################################
+// 2>&-; awk '/^<\/MARKDOWN>/{f=0};f;/^<MARKDOWN>/{f=1}' $0; exit 0
+
+/***********************************************************************
+lfft.c
+Copyright (c) 2016 Teviet Creighton.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "lofasmIO.h"
+#include "lfft.h"
+
+/* FFT plan: the transform length, its bit-reversal permutation, and
+   a table of twiddle factors exp(-2*pi*i*k/n) for k < n/2, stored as
+   interleaved real and imaginary parts. */
+struct tag_lfft_plan {
+  int64_t n;     /* transform length */
+  int64_t *rev;  /* bit-reversed index of each index */
+  double *w;     /* twiddle factors */
+};
+
+/*
+<MARKDOWN>
+# lfftPlan(3), lfftLength(3), lfftForward(3), lfftInverse(3), lfftFree(3)
+
+## NAME
+
+`lfftPlan(3), lfftLength(3), lfftForward(3), lfftInverse(3),
+lfftFree(3)` - simple complex fast Fourier transforms
+
+## SYNOPSIS
+
+`#include "lfft.h"`
+
+`lfft_plan *lfftPlan( int64_t `_n_ `);`  
+`int64_t lfftLength( int64_t `_n_ `);`  
+`void lfftForward( const lfft_plan *`_plan_`, double *`_z_ `);`  
+`void lfftInverse( const lfft_plan *`_plan_`, double *`_z_ `);`  
+`void lfftFree( lfft_plan *`_plan_ `);`
+
+## DESCRIPTION
+
+These functions provide an in-tree radix-2 fast Fourier transform,
+so that `lofasmio` programs can perform convolutions, correlations,
+and spectral analysis without an external FFT library.  They are
+intended to be simple and predictable rather than maximally fast.
+
+lfftPlan() precomputes the bit-reversal permutation and twiddle
+factors for complex transforms of length _n_, which must be a power
+of 2.  lfftLength() returns the smallest power of 2 that is greater
+than or equal to _n_, which is convenient for choosing padded
+transform lengths.
+
+lfftForward() and lfftInverse() transform the array _z_ in place.
+_z_ stores _n_ complex numbers as interleaved real and imaginary
+parts (2*_n_ doubles).  The forward transform computes
+
+> _Z_[_k_] = sum over _j_ of _z_[_j_] exp( -2 pi i _j_ _k_ / _n_ ),
+
+and the inverse transform uses the opposite sign of the exponent and
+divides by _n_, so that an inverse transform exactly undoes a forward
+transform (up to rounding).  A plan may be used by several threads at
+once, since it is not modified by the transforms.
+
+A real sequence can be transformed by storing it in the real parts
+with zero imaginary parts.  Since a convolution with a real kernel
+acts independently on the real and imaginary parts, two real
+sequences can be convolved with one pair of transforms by storing
+them as the real and imaginary parts of a single complex sequence.
+
+lfftFree() frees a plan.
+
+## RETURN VALUE
+
+lfftPlan() returns a pointer to the new plan, or NULL if _n_ is not a
+positive power of 2 or memory could not be allocated.  lfftLength()
+returns the padded length.  The other functions do not return a
+value.
+
+## SEE ALSO
+
+lfmean(1)
+
+</MARKDOWN> */
+lfft_plan *
+lfftPlan( int64_t n )
+{
+  lfft_plan *plan; /* new plan */
+  int64_t j, k, b; /* indecies, and bit */
+
+  if ( n < 1 || ( n & ( n - 1 ) ) ) {
+    lf_error( "FFT length %lld is not a power of 2", (long long)( n ) );
+    return NULL;
+  }
+  if ( !( plan = (lfft_plan *)calloc( 1, sizeof(lfft_plan) ) ) ||
+       !( plan->rev = (int64_t *)malloc( n*sizeof(int64_t) ) ) ||
+       !( plan->w = (double *)malloc( ( n > 1 ? n : 2 )*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    lfftFree( plan );
+    return NULL;
+  }
+  plan->n = n;
+  for ( j = 0; j < n; j++ ) {
+    for ( k = 0, b = 1; b < n; b <<= 1 )
+      k = ( k << 1 ) | ( ( j & b ) != 0 );
+    plan->rev[j] = k;
+  }
+  for ( k = 0; k < n/2; k++ ) {
+    plan->w[2*k] = cos( 2.0*M_PI*k/n );
+    plan->w[2*k+1] = -sin( 2.0*M_PI*k/n );
+  }
+  return plan;
+}
+
+
+int64_t
+lfftLength( int64_t n )
+{
+  int64_t m; /* power of 2 */
+  for ( m = 1; m < n; m <<= 1 )
+    ;
+  return m;
+}
+
+
+/* Performs the transform in place: the forward transform if inverse
+   is zero, or the unnormalized inverse transform (with conjugated
+   twiddle factors) if it is nonzero. */
+static void
+lfft_transform( const lfft_plan *plan, double *z, int inverse )
+{
+  int64_t n = plan->n;      /* transform length */
+  int64_t j, k, h, s;       /* indecies, half-length, and stride */
+  double sgn = ( inverse ? -1.0 : 1.0 ); /* sign of twiddle imaginary part */
+  double tr, ti, wr, wi;    /* temporary and twiddle values */
+
+  /* Permute into bit-reversed order. */
+  for ( j = 0; j < n; j++ )
+    if ( ( k = plan->rev[j] ) > j ) {
+      tr = z[2*j];
+      ti = z[2*j+1];
+      z[2*j] = z[2*k];
+      z[2*j+1] = z[2*k+1];
+      z[2*k] = tr;
+      z[2*k+1] = ti;
+    }
+
+  /* Butterflies: at each stage, combine pairs of transforms of
+     length h into transforms of length 2h. */
+  for ( h = 1, s = n/2; h < n; h <<= 1, s >>= 1 )
+    for ( k = 0; k < h; k++ ) {
+      wr = plan->w[2*k*s];
+      wi = sgn*plan->w[2*k*s+1];
+      for ( j = k; j < n; j += 2*h ) {
+	double *a = z + 2*j, *b = z + 2*( j + h ); /* butterfly pair */
+	tr = wr*b[0] - wi*b[1];
+	ti = wr*b[1] + wi*b[0];
+	b[0] = a[0] - tr;
+	b[1] = a[1] - ti;
+	a[0] += tr;
+	a[1] += ti;
+      }
+    }
+  return;
+}
+
+
+void
+lfftForward( const lfft_plan *plan, double *z )
+{
+  lfft_transform( plan, z, 0 );
+  return;
+}
+
+
+void
+lfftInverse( const lfft_plan *plan, double *z )
+{
+  int64_t j;                   /* index */
+  double norm = 1.0/plan->n;   /* normalization */
+  lfft_transform( plan, z, 1 );
+  for ( j = 0; j < 2*plan->n; j++ )
+    z[j] *= norm;
+  return;
+}
+
+
+void
+lfftFree( lfft_plan *plan )
+{
+  if ( !plan )
+    return;
+  if ( plan->rev )
+    free( plan->rev );
+  if ( plan->w )
+    free( plan->w );
+  free( plan );
+  return;
+}
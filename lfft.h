@@ -0,0 +1,56 @@
+// 2>&-### SELF-EXTRACTING DOCUMENTATION ###############################
+// 2>&-#                                                               #
+// 2>&-# Run "bash <thisfile> > <docfile.md>" to extract documentation #
+// 2>&-#                                                               #
+// 2>&-#################################################################
+// 2>&-; awk '/^<\/MARKDOWN>/{f=0};f;/^<MARKDOWN>/{f=1}' $0; exit 0
+
+/***********************************************************************
+lfft.h
+Copyright (c) 2016 Teviet Creighton.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+***********************************************************************/
+
+#ifndef _LFFT_H
+#define _LFFT_H
+#ifdef  __cplusplus
+extern "C" {
+#if 0
+};
+#endif
+#endif
+
+#include <stdint.h>
+
+/* Fast Fourier transform function prototypes. */
+typedef struct tag_lfft_plan lfft_plan;
+lfft_plan *
+lfftPlan( int64_t n );
+int64_t
+lfftLength( int64_t n );
+void
+lfftForward( const lfft_plan *plan, double *z );
+void
+lfftInverse( const lfft_plan *plan, double *z );
+void
+lfftFree( lfft_plan *plan );
+
+#ifdef  __cplusplus
+#if 0
+{
+#endif
+}
+#endif
+#endif /* _LFFT_H */
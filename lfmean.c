@@ -28,6 +28,9 @@ Compute running means of a LoFASM file.\n\
   -v, --verbosity=LEVEL  set status message reporting level\n\
   -y, --cols=LEN         average LEN points along columns (dimension 1)\n\
   -x, --rows=LEN         average LEN points along rows (dimension 2)\n\
+  -Y, --col-kernel=KERN  convolve columns with kernel KERN\n\
+  -X, --row-kernel=KERN  convolve rows with kernel KERN\n\
+  -M, --mask=MASKFILE    exclude samples flagged in MASKFILE\n\
 \n";
 
 static const char *description = "\
@@ -51,8 +54,16 @@ standard input or standard output is used instead.\n\
 \n\
 If run without options, the program will perform the uninteresting\n\
 task of copying _INFILE_ to _OUTFILE_.  At least one of the\n\
-`-x, --rows` option or the `-y, --cols` option, or both, must be given\n\
-to apply a filter.\n\
+`-x, --rows`, `-y, --cols`, `-X, --row-kernel`, or `-Y, --col-kernel`\n\
+options must be given to apply a filter.  Along each dimension one may\n\
+apply either a running mean or a general convolution kernel, but not\n\
+both.\n\
+\n\
+The data may be stored as `real32` or `real64`.  Sums are accumulated\n\
+in double precision, and the output is stored with the same type as\n\
+the input.  Data with more than one component (e.g. complex\n\
+cross-power) are averaged component by component, which preserves\n\
+the phase of complex data.\n\
 \n\
 Typically one computes a running mean before downsampling a data file.\n\
 To facilitate this, the average is a forward-looking average rather\n\
@@ -67,6 +78,61 @@ slower: see lfmed(1).  The algorithm used by this program can compute\n\
 a running mean in order _N_ operations, where _N_ is the number of\n\
 data points.\n\
 \n\
+### Convolution kernels\n\
+\n\
+The `-X, --row-kernel` and `-Y, --col-kernel` options smooth the data\n\
+with a general kernel of _K_ taps _h_[0], ..., _h_[_K_-1], which is\n\
+centred on the datum rather than forward-looking:\n\
+\n\
+> _y_[_N_] = sum over _k_ of _h_[_k_] _x_[_N_+_k_-_C_],\n\
+\n\
+where _C_ = (_K_-1)/2 rounded down.  Note that the taps are applied as\n\
+a correlation, so a template read from a file acts directly as a\n\
+matched filter; for the symmetric named kernels this is the same as a\n\
+convolution.  The kernel _KERN_ may be one of the following:\n\
+\n\
+`gauss:`_SIGMA_:\n\
+    A Gaussian with standard deviation _SIGMA_ samples, truncated at\n\
+    4 _SIGMA_ on either side.\n\
+\n\
+`hann:`_WIDTH_:\n\
+    A Hann (raised-cosine) window with _WIDTH_ nonzero taps.\n\
+\n\
+`box:`_WIDTH_:\n\
+    A centred boxcar of _WIDTH_ taps.\n\
+\n\
+`file:`_PATH_:\n\
+    Taps read from the text file _PATH_, as whitespace-separated\n\
+    numbers.\n\
+\n\
+The named kernels are normalized to unit sum, and near the ends of\n\
+the data, where part of the kernel falls outside the array, the\n\
+output is renormalized by the sum of the taps that remain, so that\n\
+the edges are not biased towards zero.  Taps read from a file are used\n\
+as given, with data beyond the ends of the array taken to be zero.\n\
+\n\
+Short kernels (up to 32 taps) are applied directly.  Longer kernels\n\
+are applied by overlap-save fast Fourier transforms in blocks a few\n\
+times the kernel length, so the cost per datum grows only as the\n\
+logarithm of the kernel length.  Column convolution is streamed: only\n\
+one block of rows, of order the kernel length, is held in memory at a\n\
+time, so wide kernels can be applied to long files.\n\
+\n\
+### Masked data\n\
+\n\
+The `-M, --mask` option reads a mask file of flagged samples, such as\n\
+is written by lfflag(1), and excludes those samples from the means.\n\
+Each output point is then the weighted mean of the unflagged input\n\
+points under the filter, with the weights given by the filter taps:\n\
+that is, the filter is applied both to the data (with flagged points\n\
+zeroed) and to the mask weights (1 for unflagged points and 0 for\n\
+flagged points), and the first result is divided by the second.  The\n\
+weights are carried through the filters as an extra component of each\n\
+point, so this costs about as much as filtering one more component,\n\
+and streams in the same way.  Points with no unflagged inputs under\n\
+the filter are set to `nan`.  Since the division renormalizes the\n\
+taps, kernels read from a file are effectively renormalized as well.\n\
+\n\
 ## OPTIONS\n\
 \n\
 `-h, --help`:\n\
@@ -106,6 +172,23 @@ data points.\n\
     conjunction with `-y, --cols`, above, column filtering is\n\
     performed first.\n\
 \n\
+`-Y, --col-kernel=`_KERN_:\n\
+    Convolves each column of data (time) with the kernel _KERN_, as\n\
+    described above.  Unlike `-y, --cols`, this does not require the\n\
+    entire file to be loaded into memory.  May not be combined with\n\
+    `-y, --cols`.\n\
+\n\
+`-X, --row-kernel=`_KERN_:\n\
+    Convolves each row of data (frequency) with the kernel _KERN_, as\n\
+    described above.  If specified in conjunction with column\n\
+    filtering, column filtering is performed first.  May not be\n\
+    combined with `-x, --rows`.\n\
+\n\
+`-M, --mask=`_MASKFILE_:\n\
+    Reads a `bit1` mask file with the same rows and columns as the\n\
+    input (see lofasm-filterbank(5)), and excludes samples whose mask\n\
+    bit is set from all of the averages, as described above.\n\
+\n\
 ## EXIT STATUS\n\
 \n\
 The proram exits with status 0 normally, 1 if there is an error\n\
@@ -114,19 +197,24 @@ formatted. and 4 on memory allocation errors.\n\
 \n\
 ## SEE ALSO\n\
 \n\
+lfmed(1),\n\
 lfbxRead(3),\n\
 lfbxWrite(3),\n\
+lfftPlan(3),\n\
+lfmaskRead(3),\n\
 lofasm-filterbank(5)\n\
 \n";
 
+
 #include <stdio.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <math.h>
 #include "markdown_parser.h"
 #include "lofasmIO.h"
+#include "lfft.h"
 
-static const char short_opts[] = "hHVv:y:x:";
+static const char short_opts[] = "hHVv:y:x:Y:X:M:";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -136,21 +224,447 @@ static const struct option long_opts[] = {
   { "verbosity", 1, 0, 'v' },
   { "cols", 1, 0, 'y' },
   { "rows", 1, 0, 'x' },
+  { "col-kernel", 1, 0, 'Y' },
+  { "row-kernel", 1, 0, 'X' },
+  { "mask", 1, 0, 'M' },
   { 0, 0, 0, 0} };
 
+/* Longest kernel applied by direct convolution, and number of rows
+   per block in direct column convolution. */
+#define KMAX 32
+#define BLOCK 256
+
+/* Smallest filtered mask weight treated as nonzero, allowing for
+   roundoff in FFT convolution. */
+#define WMIN 1.0e-9
+
+/* Convolution kernel, along with the storage needed to apply it. */
+typedef struct {
+  int64_t k, c;    /* number of taps, and index of central tap */
+  int norm;        /* whether to renormalize at edges */
+  double *h;       /* taps */
+  double *cum;     /* cumulative sums of taps (k+1 values) */
+  int64_t m, l;    /* block length, and outputs per block */
+  lfft_plan *plan; /* FFT plan (NULL for direct convolution) */
+  double *spec;    /* FFT of time-reversed taps */
+  double *z;       /* FFT workspace */
+} lfkernel;
+
+
+/* Parses a kernel specification KIND:ARG, storing the taps in kern.
+   Returns 0 on success, 1 on a bad argument, 2 if a kernel file
+   could not be read, or 4 on memory errors. */
+static int
+kernel_parse( const char *arg, lfkernel *kern )
+{
+  const char *a;   /* argument after colon */
+  char *end;       /* end of parsed number */
+  double x;        /* parsed number, or tap value */
+  int64_t k, r = 0; /* tap index, and kernel half-width */
+  FILE *fp;        /* kernel file */
+
+  memset( kern, 0, sizeof(lfkernel) );
+  if ( !( a = strchr( arg, ':' ) ) || !*( ++a ) )
+    return 1;
+  if ( !strncmp( arg, "file:", 5 ) ) {
+    if ( !( fp = fopen( a, "r" ) ) ) {
+      lf_error( "could not open kernel file %s", a );
+      return 2;
+    }
+    r = 0;
+    while ( fscanf( fp, "%lf", &x ) == 1 ) {
+      if ( kern->k >= r ) {
+	double *h = (double *)realloc( kern->h, ( r = 2*r + 16 )*
+				       sizeof(double) );
+	if ( !h ) {
+	  lf_error( "memory error" );
+	  fclose( fp );
+	  return 4;
+	}
+	kern->h = h;
+      }
+      kern->h[kern->k++] = x;
+    }
+    if ( !feof( fp ) || kern->k == 0 ) {
+      lf_error( "could not parse taps from kernel file %s", a );
+      fclose( fp );
+      return 2;
+    }
+    fclose( fp );
+  } else {
+    x = strtod( a, &end );
+    if ( *end || !( x > 0.0 ) || x > INT32_MAX )
+      return 1;
+    if ( !strncmp( arg, "gauss:", 6 ) )
+      kern->k = 2*( r = (int64_t)ceil( 4.0*x ) ) + 1;
+    else if ( !strncmp( arg, "hann:", 5 ) || !strncmp( arg, "box:", 4 ) ) {
+      if ( x != floor( x ) )
+	return 1;
+      kern->k = (int64_t)( x );
+    } else
+      return 1;
+    if ( !( kern->h = (double *)malloc( kern->k*sizeof(double) ) ) ) {
+      lf_error( "memory error" );
+      return 4;
+    }
+    for ( k = 0; k < kern->k; k++ )
+      if ( arg[0] == 'g' )
+	kern->h[k] = exp( -0.5*( k - r )*( k - r )/( x*x ) );
+      else if ( arg[0] == 'h' ) {
+	double s = sin( M_PI*( k + 1 )/( kern->k + 1 ) );
+	kern->h[k] = s*s;
+      } else
+	kern->h[k] = 1.0;
+    kern->norm = 1;
+  }
+
+  /* Compute cumulative sums, and normalize named kernels. */
+  kern->c = ( kern->k - 1 )/2;
+  if ( !( kern->cum = (double *)malloc( ( kern->k + 1 )*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    return 4;
+  }
+  for ( k = 0, x = 0.0; k < kern->k; k++ )
+    x += kern->h[k];
+  if ( kern->norm )
+    for ( k = 0; k < kern->k; k++ )
+      kern->h[k] /= x;
+  for ( k = 0, kern->cum[0] = 0.0; k < kern->k; k++ )
+    kern->cum[k+1] = kern->cum[k] + kern->h[k];
+  return 0;
+}
+
+
+/* Chooses how to apply a kernel to sequences of length n, setting up
+   the FFT if the kernel is long.  Returns 0 on success, nonzero on
+   memory errors. */
+static int
+kernel_plan( lfkernel *kern, int64_t n )
+{
+  int64_t k, m; /* indecies */
+
+  if ( kern->k <= KMAX ) {
+    kern->l = ( n < BLOCK ? n : BLOCK );
+    kern->m = kern->l + kern->k - 1;
+    return 0;
+  }
+  m = lfftLength( 2*kern->k );
+  if ( m > lfftLength( n + kern->k - 1 ) )
+    m = lfftLength( n + kern->k - 1 );
+  kern->m = m;
+  kern->l = m - kern->k + 1;
+  if ( !( kern->plan = lfftPlan( m ) ) ||
+       !( kern->spec = (double *)calloc( 2*m, sizeof(double) ) ) ||
+       !( kern->z = (double *)malloc( 2*m*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    return 4;
+  }
+  for ( k = 0; k < kern->k; k++ )
+    kern->spec[2*k] = kern->h[kern->k-1-k];
+  lfftForward( kern->plan, kern->spec );
+  return 0;
+}
+
+
+/* Frees storage associated with a kernel. */
+static void
+kernel_free( lfkernel *kern )
+{
+  if ( kern->h )
+    free( kern->h );
+  if ( kern->cum )
+    free( kern->cum );
+  if ( kern->spec )
+    free( kern->spec );
+  if ( kern->z )
+    free( kern->z );
+  lfftFree( kern->plan );
+  memset( kern, 0, sizeof(lfkernel) );
+  return;
+}
+
+
+/* Returns the sum of the taps that overlap a sequence of length n
+   when computing output i, or 1 if the kernel is not renormalized. */
+static double
+kernel_weight( const lfkernel *kern, int64_t i, int64_t n )
+{
+  int64_t lo = kern->c - i, hi = kern->c + n - i; /* range of taps */
+  if ( !kern->norm )
+    return 1.0;
+  lo = ( lo < 0 ? 0 : lo );
+  hi = ( hi > kern->k ? kern->k : hi );
+  return ( hi > lo ? kern->cum[hi] - kern->cum[lo] : 1.0 );
+}
+
+
+/* Multiplies the FFT workspace by the kernel spectrum, in place. */
+static void
+kernel_multiply( lfkernel *kern )
+{
+  int64_t j;                 /* index */
+  double *z = kern->z;       /* data spectrum */
+  const double *g = kern->spec; /* kernel spectrum */
+  double re;                 /* real part of product */
+
+  for ( j = 0; j < 2*kern->m; j += 2 ) {
+    re = z[j]*g[j] - z[j+1]*g[j+1];
+    z[j+1] = z[j]*g[j+1] + z[j+1]*g[j];
+    z[j] = re;
+  }
+  return;
+}
+
+
+/* Convolves n points of in (with the given stride) with the kernel,
+   storing the result in out (with the same stride), for each of
+   stride interleaved sequences. */
+static void
+row_convolve( lfkernel *kern, const double *in, double *out, int64_t n,
+	      int64_t stride )
+{
+  int64_t i, i0, k, t, s;  /* indecies */
+  int64_t lo, hi;          /* range of overlapping taps */
+  const int64_t c = kern->c; /* index of central tap */
+  double sum;              /* accumulated output */
+
+  if ( !kern->plan ) {
+    for ( s = 0; s < stride; s++ )
+      for ( i = 0; i < n; i++ ) {
+	lo = ( c - i < 0 ? 0 : c - i );
+	hi = ( c + n - i > kern->k ? kern->k : c + n - i );
+	for ( k = lo, sum = 0.0; k < hi; k++ )
+	  sum += kern->h[k]*in[ ( i + k - c )*stride + s ];
+	out[ i*stride + s ] = sum/kernel_weight( kern, i, n );
+      }
+    return;
+  }
+
+  /* Overlap-save, transforming two sequences at once as the real and
+     imaginary parts of the FFT input. */
+  for ( s = 0; s < stride; s += 2 )
+    for ( i0 = 0; i0 < n; i0 += kern->l ) {
+      for ( t = 0; t < kern->m; t++ ) {
+	i = i0 + t - c;
+	if ( i < 0 || i >= n )
+	  kern->z[2*t] = kern->z[2*t+1] = 0.0;
+	else {
+	  kern->z[2*t] = in[ i*stride + s ];
+	  kern->z[2*t+1] = ( s + 1 < stride ? in[ i*stride + s + 1 ] : 0.0 );
+	}
+      }
+      lfftForward( kern->plan, kern->z );
+      kernel_multiply( kern );
+      lfftInverse( kern->plan, kern->z );
+      for ( t = 0, i = i0; t < kern->l && i < n; t++, i++ ) {
+	sum = kernel_weight( kern, i, n );
+	out[ i*stride + s ] = kern->z[ 2*( t + kern->k - 1 ) ]/sum;
+	if ( s + 1 < stride )
+	  out[ i*stride + s + 1 ] = kern->z[ 2*( t + kern->k - 1 ) + 1 ]/sum;
+      }
+    }
+  return;
+}
+
+
+/* Convolves a block of rows with the kernel along columns.  blk
+   stores kern->m rows of length lin, where row t is input row
+   i0 + t - kern->c (or zero if that is outside the n input rows).
+   Computes output rows i0 through i0 + kern->l - 1 (or n - 1 if that
+   is smaller), and stores them in out. */
+static void
+col_convolve( lfkernel *kern, const double *blk, double *out, int64_t lin,
+	      int64_t i0, int64_t n )
+{
+  int64_t j, k, t;         /* indecies */
+  int64_t l = ( n - i0 < kern->l ? n - i0 : kern->l ); /* rows out */
+  double w;                /* tap value or edge weight */
+  double *o;               /* output row */
+  const double *b;         /* input row */
+
+  if ( !kern->plan ) {
+    for ( t = 0; t < l; t++ ) {
+      o = out + t*lin;
+      memset( o, 0, lin*sizeof(double) );
+      for ( k = 0; k < kern->k; k++ ) {
+	w = kern->h[k];
+	b = blk + ( t + k )*lin;
+	for ( j = 0; j < lin; j++ )
+	  o[j] += w*b[j];
+      }
+      if ( ( w = kernel_weight( kern, i0 + t, n ) ) != 1.0 )
+	for ( j = 0; j < lin; j++ )
+	  o[j] /= w;
+    }
+    return;
+  }
+
+  /* Overlap-save, transforming pairs of columns at once. */
+  for ( j = 0; j < lin; j += 2 ) {
+    for ( t = 0, b = blk + j; t < kern->m; t++, b += lin ) {
+      kern->z[2*t] = b[0];
+      kern->z[2*t+1] = ( j + 1 < lin ? b[1] : 0.0 );
+    }
+    lfftForward( kern->plan, kern->z );
+    kernel_multiply( kern );
+    lfftInverse( kern->plan, kern->z );
+    for ( t = 0, o = out + j; t < l; t++, o += lin ) {
+      w = kernel_weight( kern, i0 + t, n );
+      o[0] = kern->z[ 2*( t + kern->k - 1 ) ]/w;
+      if ( j + 1 < lin )
+	o[1] = kern->z[ 2*( t + kern->k - 1 ) + 1 ]/w;
+    }
+  }
+  return;
+}
+
+
+/* Computes a forward-looking running mean of length l over n points
+   of in, with stride istride, storing the result in out with stride
+   ostride.  Near the end of the array the averaging length is
+   reduced. */
+static void
+boxcar( const double *in, int64_t istride, double *out, int64_t ostride,
+	int64_t n, int64_t l )
+{
+  int64_t i;      /* index */
+  double sum;     /* running sum */
+
+  for ( i = 0, sum = 0.0; i < l; i++ )
+    sum += in[ i*istride ];
+  for ( i = 0; i < n; i++ ) {
+    out[ i*ostride ] = sum/( n - i < l ? n - i : l );
+    sum -= in[ i*istride ];
+    if ( i + l < n )
+      sum += in[ ( i + l )*istride ];
+  }
+  return;
+}
+
+
+/* Mask applied to the input, if any.  When masking, each point of a
+   row carries an extra component holding its weight. */
+typedef struct {
+  FILE *fp;            /* mask file */
+  lfb_mask state;      /* mask read state */
+  unsigned char *bits; /* mask bits for one row */
+  int64_t ncol, ncomp; /* points per row, and data components per point */
+} mean_mask;
+
+
+/* Reads a row of n data, padding with zeros past the end of the
+   input.  If mask->fp is set, n is the row length including weights:
+   the data are read along with a row of mask bits, and each point is
+   expanded to hold its components (zeroed if flagged) followed by its
+   weight (0 if flagged, 1 otherwise).  Returns the number of data
+   actually read. */
+static int64_t
+read_row( double *row, int bits, int64_t n, FILE *fp, mean_mask *mask )
+{
+  int64_t m = 0, k; /* number read, and mask bits read */
+  int64_t j, z;     /* point and component indecies */
+  const int64_t c = mask->ncomp; /* components per point */
+  if ( mask->fp )
+    n = mask->ncol*c;
+  if ( !feof( fp ) && !ferror( fp ) )
+    m = lfrealRead( row, bits, n, fp );
+  if ( m < n )
+    memset( row + m, 0, ( n - m )*sizeof(double) );
+  if ( !mask->fp )
+    return m;
+
+  /* Expand in place, working backwards so as not to overwrite data
+     not yet moved. */
+  if ( ( k = lfmaskRead( mask->bits, mask->ncol, &( mask->state ),
+			 mask->fp ) ) < mask->ncol )
+    memset( mask->bits + k, 0, mask->ncol - k );
+  for ( j = mask->ncol - 1; j >= 0; j-- ) {
+    int f = mask->bits[j]; /* whether point is flagged */
+    row[ j*( c + 1 ) + c ] = !f;
+    for ( z = c - 1; z >= 0; z-- )
+      row[ j*( c + 1 ) + z ] = ( f ? 0.0 : row[ j*c + z ] );
+  }
+  return m;
+}
+
+
+/* Divides the filtered data in a row by the filtered weights, and
+   packs the results into the first ncol*ncomp elements of row. */
+static void
+unweight_row( double *row, const mean_mask *mask )
+{
+  int64_t j, z;   /* point and component indecies */
+  const int64_t c = mask->ncomp; /* components per point */
+  double w;       /* filtered weight */
+  for ( j = 0; j < mask->ncol; j++ ) {
+    w = row[ j*( c + 1 ) + c ];
+    for ( z = 0; z < c; z++ )
+      row[ j*c + z ] = ( w > WMIN ? row[ j*( c + 1 ) + z ]/w : NAN );
+  }
+  return;
+}
+
+
+/* Loads rows t0 through t1 - 1 of a column-convolution block, where
+   row t of the block is input row e0 + t.  Rows before the start or
+   past the end of the n input rows are set to zero.  Returns the
+   number of data read. */
+static int64_t
+load_rows( double *blk, int64_t t0, int64_t t1, int64_t e0, int64_t n,
+	   int64_t lin, int bits, FILE *fp, mean_mask *mask )
+{
+  int64_t t, m = 0; /* row index, and number of data read */
+  for ( t = t0; t < t1; t++ )
+    if ( e0 + t < 0 || e0 + t >= n )
+      memset( blk + t*lin, 0, lin*sizeof(double) );
+    else
+      m += read_row( blk + t*lin, bits, lin, fp, mask );
+  return m;
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) \
+    fclose( fpin ); \
+  if ( fpout ) \
+    fclose( fpout ); \
+  if ( dat ) \
+    free( dat ); \
+  if ( out ) \
+    free( out ); \
+  if ( blk ) \
+    free( blk ); \
+  kernel_free( &xkern ); \
+  if ( mask.fp ) \
+    fclose( mask.fp ); \
+  if ( mask.bits ) \
+    free( mask.bits ); \
+  kernel_free( &ykern ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+
 int
 main( int argc, char **argv )
 {
   int opt, lopt;           /* option character and index */
   unsigned long long l1 = 1, l2 = 1; /* filter length along each dimension */
   char *infile, *outfile;  /* input/output file names */
-  FILE *fpin, *fpout;      /* input/output file pointers */
-  int64_t i, j, n, k, z;   /* indecies */
+  FILE *fpin = NULL, *fpout = NULL; /* input/output file pointers */
+  int64_t i, j, n, z;      /* indecies */
+  int64_t lin, nrow, nread = 0; /* row length, rows, and data read */
   int64_t stride;          /* step between successive samples */
   lfb_hdr head = {};       /* file header */
-  double *dat, *row, *out; /* data block, row, and fitered output */
-  double *buf;             /* circular buffer of filtered data */
-  double sum;              /* cumulative sum of data */
+  double *dat = NULL, *row, *out = NULL; /* data block, row, and output */
+  double *blk = NULL, *cout = NULL; /* column-convolution input, output */
+  lfkernel xkern = {}, ykern = {}; /* row and column kernels */
+  int bits;                /* bit depth of data (32 or 64) */
+  char *maskfile = NULL;   /* mask file name */
+  mean_mask mask = {};     /* input mask */
+  int64_t ldat;            /* data per row (excluding weights) */
 
   /* Parse options. */
   while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
@@ -161,31 +675,50 @@ main( int argc, char **argv )
 	markdown_to_manpage( description, NULL );
       else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
 	fputs( description, stdout );
-      return 0;
+      CLEANEXIT( 0 );
     case 'h':
       fprintf( stdout, usage, argv[0] );
-      return 0;
+      CLEANEXIT( 0 );
     case 'H':
       markdown_to_man_out( description );
-      return 0;
+      CLEANEXIT( 0 );
     case 'V':
       fputs( version, stdout );
-      return 0;
+      CLEANEXIT( 0 );
     case 'v':
       lofasm_verbosity = atoi( optarg );
       break;
     case 'y':
       if ( ( l1 = strtoull( optarg, NULL, 10 ) ) < 1 || l1 > INT64_MAX ) {
 	lf_error( "bad -y, --cols argument %s", optarg );
-	return 1;
+	CLEANEXIT( 1 );
       }
       break;
     case 'x':
       if ( ( l2 = strtoull( optarg, NULL, 10 ) ) < 1 || l2 > INT64_MAX ) {
 	lf_error( "bad -x, --rows argument %s", optarg );
-	return 1;
+	CLEANEXIT( 1 );
       }
       break;
+    case 'Y':
+      kernel_free( &ykern );
+      if ( ( i = kernel_parse( optarg, &ykern ) ) ) {
+	if ( i == 1 )
+	  lf_error( "bad -Y, --col-kernel argument %s", optarg );
+	CLEANEXIT( i );
+      }
+      break;
+    case 'X':
+      kernel_free( &xkern );
+      if ( ( i = kernel_parse( optarg, &xkern ) ) ) {
+	if ( i == 1 )
+	  lf_error( "bad -X, --row-kernel argument %s", optarg );
+	CLEANEXIT( i );
+      }
+      break;
+    case 'M':
+      maskfile = optarg;
+      break;
     case '?':
       if ( optopt )
 	lf_error( "unknown option -%c\n\t"
@@ -195,7 +728,7 @@ main( int argc, char **argv )
 	lf_error( "unknown option %s\n\t"
 		  "Try %s --help for more information",
 		  argv[optind-1], argv[0] );
-      return 1;
+      CLEANEXIT( 1 );
     case ':':
       if ( optopt )
 	lf_error( "option -%c requires an argument\n\t"
@@ -205,14 +738,22 @@ main( int argc, char **argv )
 	lf_error( "option %s requires an argument\n\t"
 		  "Try %s --help for more information",
 		  argv[optind-1], argv[0] );
-      return 1;
+      CLEANEXIT( 1 );
     default:
       lf_error( "internal error parsing option code %c\n\t"
 		"Try %s --help for more information",
 		opt, argv[0] );
-      return 1;
+      CLEANEXIT( 1 );
     }
   }
+  if ( l1 > 1 && ykern.h ) {
+    lf_error( "-y, --cols and -Y, --col-kernel are mutually exclusive" );
+    CLEANEXIT( 1 );
+  }
+  if ( l2 > 1 && xkern.h ) {
+    lf_error( "-x, --rows and -X, --row-kernel are mutually exclusive" );
+    CLEANEXIT( 1 );
+  }
 
   /* Parse other arguments. */
   if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
@@ -221,189 +762,147 @@ main( int argc, char **argv )
     outfile = NULL;
   if ( optind < argc ) {
     lf_error( "too many arguments" );
-    return 1;
+    CLEANEXIT( 1 );
   }
 
   /* Read input header. */
   if ( !infile ) {
     if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
       lf_error( "could not read stdin" );
-      return 2;
+      CLEANEXIT( 2 );
     }
     infile = "stdin";
   } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
     lf_error( "could not open input file %s", infile );
-    fclose( fpin );
-    return 2;
+    CLEANEXIT( 2 );
   }
   if ( lfbxRead( fpin, &head, NULL ) ) {
     lf_error( "could not parse header from %s", infile );
-    fclose( fpin );
-    lfbxFree( &head );
-    return 2;
+    CLEANEXIT( 2 );
   }
 
   /* Check data type. */
-  if ( head.dims[3] != 64 ) {
-    lf_error( "requires real64 data" );
-    fclose( fpin );
-    lfbxFree( &head );
-    return 3;
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
   }
-  if ( !head.data_type || strcmp( head.data_type, "real64" ) )
-    lf_warning( "treating as real64 data" );
 
-  /* Check lengths. */
-  if ( l1 > head.dims[0] )
-    l1 = head.dims[0];
+  /* Open mask, if any, and check lengths. */
+  if ( maskfile ) {
+    if ( !( mask.fp = lfmaskOpen( maskfile, &head ) ) )
+      CLEANEXIT( 2 );
+    mask.ncol = head.dims[1];
+    mask.ncomp = head.dims[2];
+    if ( !( mask.bits = (unsigned char *)malloc( mask.ncol ) ) ) {
+      lf_error( "memory error" );
+      CLEANEXIT( 4 );
+    }
+  }
+  nrow = head.dims[0];
+  ldat = head.dims[1]*head.dims[2];
+  lin = head.dims[1]*( head.dims[2] + ( mask.fp ? 1 : 0 ) );
+  if ( l1 > nrow )
+    l1 = nrow;
   if ( l2 > head.dims[1] )
     l2 = head.dims[1];
 
   /* Allocate data storage. */
-  n = ( l1 > 1 ? head.dims[0] : 1 );
-  dat = (double *)malloc( n*head.dims[1]*head.dims[2]*sizeof(double) );
-  n = ( l2 > 1 && head.dims[1] > n ? head.dims[1] : n );
+  n = ( l1 > 1 ? nrow : 1 );
+  dat = (double *)malloc( n*lin*sizeof(double) );
+  n = ( l1 > 1 && nrow > lin ? nrow : lin );
   out = (double *)malloc( n*sizeof(double) );
-  buf = (double *)malloc( ( l1 > l2 ? l1 : l2 )*sizeof(double) );
-  if ( !dat || !out || !buf ) {
+  if ( !dat || !out ) {
     lf_error( "memory error" );
-    fclose( fpin );
-    if ( dat )
-      free( dat );
-    if ( out )
-      free( out );
-    if ( buf )
-      free( buf );
-    lfbxFree( &head );
-    return 4;
+    CLEANEXIT( 4 );
+  }
+  if ( ykern.h ) {
+    if ( kernel_plan( &ykern, nrow ) ||
+	 !( blk = (double *)malloc( ( ykern.m + ykern.l )*lin*
+				    sizeof(double) ) ) ) {
+      lf_error( "memory error" );
+      CLEANEXIT( 4 );
+    }
+    cout = blk + ykern.m*lin;
   }
+  if ( xkern.h && kernel_plan( &xkern, head.dims[1] ) )
+    CLEANEXIT( 4 );
 
   /* Write output file header. */
   if ( !outfile ) {
     if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
       lf_error( "could not write to stdout" );
-      fclose( fpin );
-      free( dat );
-      free( out );
-      free( buf );
-      lfbxFree( &head );
-      return 2;
+      CLEANEXIT( 2 );
     }
     outfile = "stdout";
   } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
     lf_error( "could not open output file %s", outfile );
-    fclose( fpin );
-    free( dat );
-    free( out );
-    free( buf );
-    lfbxFree( &head );
-    return 2;
+    CLEANEXIT( 2 );
   }
   if ( lfbxWrite( fpout, &head, NULL ) ) {
     lf_error( "error writing header to %s", outfile );
-    fclose( fpout );
-    fclose( fpin );
-    free( dat );
-    free( out );
-    free( buf );
-    lfbxFree( &head );
-    return 2;
+    CLEANEXIT( 2 );
   }
 
-  /* Do column filtering, if requested. */
+  /* Do running-mean column filtering, if requested. */
   if ( l1 > 1 ) {
-    n = head.dims[0]*head.dims[1]*head.dims[2];
-    if ( ( i = fread( dat, sizeof(double), n, fpin ) ) < n ) {
-      lf_warning( "read %lld data from %s, expected %lld",
-		  (long long)( i ), infile, (long long)( n ) );
-      memset( dat + i, 0, ( n - i )*sizeof(double) );
-    }
-    stride = head.dims[1]*head.dims[2];
-    for ( j = 0; j < stride; j++ ) {
-      for ( i = 0, sum = 0.0; i < l1; i++ )
-	sum += buf[i] = dat[ i*stride + j ];
-      for ( i = k = 0; i < head.dims[0] - l1; i++ ) {
-	sum -= buf[k];
-	sum += buf[k] = dat[ ( i + l1 )*stride + j ];
-	out[i] = sum/l1;
-	if ( ++k > l1 )
-	  k -= l1;
-      }
-      for ( ; i < head.dims[0]; i++ ) {
-	sum -= buf[k];
-	out[i] = sum/( head.dims[0] - i );
-	if ( ++k > l1 )
-	  k -= l1;
-      }
-      for ( i = 0; i < head.dims[0]; i++ )
-	dat[ i*stride + j ] = out[i];
+    for ( i = 0; i < nrow; i++ )
+      nread += read_row( dat + i*lin, bits, lin, fpin, &mask );
+    for ( j = 0; j < lin; j++ ) {
+      boxcar( dat + j, lin, out, 1, nrow, l1 );
+      for ( i = 0; i < nrow; i++ )
+	dat[ i*lin + j ] = out[i];
     }
   }
 
+  /* Load the first block for column convolution: c rows of zeros
+     preceding the data, and enough data to fill the block. */
+  if ( ykern.h )
+    nread += load_rows( blk, 0, ykern.m, -ykern.c, nrow, lin, bits, fpin,
+			&mask );
+
   /* Do row filtering, if requested; write output in any case. */
-  n = head.dims[1]*head.dims[2];
-  stride = head.dims[2];
-  for ( i = 0; i < head.dims[0]; i++ ) {
+  stride = head.dims[2] + ( mask.fp ? 1 : 0 );
+  for ( i = 0; i < nrow; i++ ) {
 
     /* Get next row of data, reading it if we haven't already. */
     if ( l1 > 1 )
-      row = dat + i*n;
-    else {
-      if ( !feof( fpin ) ) {
-	if ( ( j = fread( dat, sizeof(double), n, fpin ) ) < n ) {
-	  lf_warning( "read %lld data from %s, expected %lld",
-		      (long long)( i*n + j ), infile,
-		      (long long)( head.dims[0]*n ) );
-	  memset( dat + j, 0, ( n - j )*sizeof(double) );
+      row = dat + i*lin;
+    else if ( ykern.h ) {
+      if ( ( j = i % ykern.l ) == 0 ) {
+	if ( i > 0 ) {
+	  memmove( blk, blk + ykern.l*lin, ( ykern.k - 1 )*lin*
+		   sizeof(double) );
+	  nread += load_rows( blk, ykern.k - 1, ykern.m, i - ykern.c, nrow,
+			      lin, bits, fpin, &mask );
 	}
-	row = dat;
-      } else {
-	memset( out, 0, n*sizeof(double) );
-	row = NULL;
+	col_convolve( &ykern, blk, cout, lin, i, nrow );
       }
+      row = cout + j*lin;
+    } else {
+      nread += read_row( dat, bits, lin, fpin, &mask );
+      row = dat;
     }
 
-    /* Average it if needed. */
-    if ( l2 > 1 && row ) {
-      stride = head.dims[2];
-      for ( z = 0; z < stride; z++ ) {
-	for ( j = 0, sum = 0.0; j < l2; j++ )
-	  sum += buf[j] = dat[ j*stride + z ];
-	for ( j = k = 0; j < head.dims[1] - l2; j++ ) {
-	  sum -= buf[k];
-	  sum += buf[k] = dat[ ( j + l2 )*stride + z ];
-	  out[ j*stride + z ] = sum/l2;
-	  if ( ++k > l2 )
-	    k -= l2;
-	}
-	for ( ; j < head.dims[1]; j++ ) {
-	  sum -= buf[k];
-	  out[ j*stride + z ] = sum/( head.dims[1] - j );
-	  if ( ++k > l2 )
-	    k -= l2;
-	}
-      }
-    }
-    if ( l2 > 1 )
+    /* Filter it along the row if needed. */
+    if ( l2 > 1 ) {
+      for ( z = 0; z < stride; z++ )
+	boxcar( row + z, stride, out + z, stride, head.dims[1], l2 );
       row = out;
-    if ( fwrite( row, sizeof(double), n, fpout ) < n ) {
+    } else if ( xkern.h ) {
+      row_convolve( &xkern, row, out, head.dims[1], stride );
+      row = out;
+    }
+    if ( mask.fp )
+      unweight_row( row, &mask );
+    if ( lfrealWrite( row, bits, ldat, fpout ) < ldat ) {
       lf_error( "could not write data to %s", outfile );
-      fclose( fpin );
-      fclose( fpout );
-      free( dat );
-      free( out );
-      free( buf );
-      lfbxFree( &head );
-      return 2;
+      CLEANEXIT( 2 );
     }
   }
+  if ( nread < nrow*ldat )
+    lf_warning( "read %lld data from %s, expected %lld",
+		(long long)( nread ), infile, (long long)( nrow*ldat ) );
 
   /* Finished. */
-  fclose( fpin );
-  fclose( fpout );
-  free( dat );
-  free( out );
-  free( buf );
-  lfbxFree( &head );
-  return 0;
+  CLEANEXIT( 0 );
 }
@@ -29,6 +29,7 @@ Compute running medians of a LoFASM file.\n\
   -y, --cols=R           average with radius R along columns (dimension 1)\n\
   -x, --rows=R           average with radius R along rows (dimension 2)\n\
   -p, --percent=P        compute a running Pth percentile (default: 50)\n\
+  -z, --complex=MODE     filter complex data by parts or abs (default: parts)\n\
 \n";
 
 static const char *description = "\
@@ -55,6 +56,10 @@ task of copying _INFILE_ to _OUTFILE_.  At least one of the\n\
 `-x, --rows` option or the `-y, --cols` option, or both, must be given\n\
 to apply a filter.\n\
 \n\
+The data may be stored as `real32` or `real64`; medians are computed\n\
+in double precision, and the output is stored with the same type as\n\
+the input.\n\
+\n\
 ### Median Filters\n\
 \n\
 A running median filter differs from the traditional running mean\n\
@@ -77,10 +82,14 @@ running mean can be computed in order _N_ operations, and a\n\
 convolution in order _N_*_W_, or _N_*log(_N_) if using Fourier\n\
 methods.\n\
 \n\
-Technically, a median is not defined on complex data; however you can\n\
-obtain results similar to a running mean by filtering the real and\n\
-imaginary parts separately.  This is not yet implemented in the\n\
-current code.\n\
+Technically, a median is not defined on complex data (or other data\n\
+with more than one component); however you can obtain results similar\n\
+to a running mean by filtering each component separately, which is\n\
+the default behaviour.  Alternatively, for complex cross-power data,\n\
+the `-z abs` option selects the datum whose magnitude is the median\n\
+(or other percentile) of the surrounding data, preserving its phase.\n\
+This removes outliers in cross-power without mixing the real and\n\
+imaginary parts of different points.\n\
 \n\
 ## OPTIONS\n\
 \n\
@@ -131,6 +140,13 @@ current code.\n\
     *P*=0 gives a running minimum, *P*=100 a running maximum, and\n\
     *P*=50 a running median (the default).\n\
 \n\
+`-z, --complex=`_MODE_:\n\
+    Specifies how data with more than one component (normally complex\n\
+    data) are filtered.  If _MODE_ is `parts` (the default), each\n\
+    component is filtered independently.  If _MODE_ is `abs`, the data\n\
+    must be complex, and each output point is the complex datum in the\n\
+    filter window whose magnitude is the requested percentile.\n\
+\n\
 ## EXIT STATUS\n\
 \n\
 The proram exits with status 0 normally, 1 if there is an error\n\
@@ -147,10 +163,11 @@ lofasm-filterbank(5)\n\
 #include <stdio.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <math.h>
 #include "markdown_parser.h"
 #include "lofasmIO.h"
 
-static const char short_opts[] = "hHVv:y:x:p:";
+static const char short_opts[] = "hHVv:y:x:p:z:";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -161,6 +178,7 @@ static const struct option long_opts[] = {
   { "cols", 1, 0, 'y' },
   { "rows", 1, 0, 'x' },
   { "percent", 1, 0, 'p' },
+  { "complex", 1, 0, 'z' },
   { 0, 0, 0, 0} };
 
 /* Array and comparison function for indexed sorting of
@@ -172,9 +190,41 @@ int64_t stride;
 int
 ascend( const void *p1, const void *p2 )
 {
-  double diff = ddata[ *( (int64_t *)(p1) )*stride ];
-  diff -= ddata[ *( (int64_t *)(p2) )*stride ];
-  return ( diff > 0.0 ? 1 : ( diff == 0.0 ? 0 : -1 ) );
+  double d1 = ddata[ *( (int64_t *)(p1) )*stride ];
+  double d2 = ddata[ *( (int64_t *)(p2) )*stride ];
+  return ( isnan( d1 ) ? ( isnan( d2 ) ? 0 : -1 ) :
+	   ( isnan( d2 ) ? 1 : ( d1 > d2 ) - ( d1 < d2 ) ) );
+}
+
+/* Runs a percentile filter of half-width r over n points of in,
+   spaced by istride, writing results to out with spacing ostride.  If
+   mag is nonzero, each point is a complex pair in[0], in[1], and the
+   pair with the given percentile of magnitude is copied to out[0],
+   out[1].  The arrays key and idx must have room for 2*r+1 elements,
+   and in and out must not overlap. */
+static void
+percentile( const double *in, int64_t istride, double *out,
+	    int64_t ostride, int64_t n, int64_t r, double p, int mag,
+	    double *key, int64_t *idx )
+{
+  int64_t i, k, imin, imax, m; /* indecies, window range, selected point */
+  for ( i = 0; i < n; i++ ) {
+    imin = ( i < r ? 0 : i - r );
+    imax = ( i + r > n - 1 ? n - 1 : i + r );
+    for ( k = 0; k <= imax - imin; k++ ) {
+      const double *z = in + ( imin + k )*istride; /* point in window */
+      key[k] = ( mag ? z[0]*z[0] + z[1]*z[1] : z[0] );
+      idx[k] = k;
+    }
+    ddata = key;
+    stride = 1;
+    qsort( idx, imax - imin + 1, sizeof(int64_t), ascend );
+    m = imin + idx[ (int64_t)( p*( imax - imin ) + 0.5 ) ];
+    out[i*ostride] = in[m*istride];
+    if ( mag )
+      out[i*ostride+1] = in[m*istride+1];
+  }
+  return;
 }
 
 int
@@ -185,12 +235,14 @@ main( int argc, char **argv )
   char *tail;              /* pointer within option argument */
   char *infile, *outfile;  /* input/output file names */
   FILE *fpin, *fpout;      /* input/output file pointers */
-  int64_t i, imin, imax;   /* index and range in columns */
-  int64_t j, jmin, jmax;   /* index and range in rows */
-  int64_t n, k;            /* more indecies */
+  int64_t i, j, c;         /* indecies over rows, columns, components */
+  int64_t n, nc, lin;      /* number of points, components, row length */
+  int bits;                /* bit depth of data (32 or 64) */
+  int mag = 0;             /* whether to select complex data by magnitude */
   double p = 0.5;          /* percentile expressed as a fraction */
   lfb_hdr head = {};       /* file header */
   double *dat, *row, *out; /* data block, row, and fitered output */
+  double *key;             /* sorting keys */
   int64_t *idx;            /* sorting index */
 
   /* Parse options. */
@@ -236,6 +288,16 @@ main( int argc, char **argv )
 	return 1;
       }
       break;
+    case 'z':
+      if ( !strcmp( optarg, "abs" ) )
+	mag = 1;
+      else if ( !strcmp( optarg, "parts" ) )
+	mag = 0;
+      else {
+	lf_error( "bad -z, --complex argument %s", optarg );
+	return 1;
+      }
+      break;
     case '?':
       if ( optopt )
 	lf_error( "unknown option -%c\n\t"
@@ -294,34 +356,42 @@ main( int argc, char **argv )
   }
 
   /* Check data type. */
-  if ( head.dims[2] != 1 ) {
-    lf_error( "requires real scalar data" );
+  if ( mag && head.dims[2] != 2 ) {
+    lf_error( "-z abs requires complex data" );
     fclose( fpin );
     lfbxFree( &head );
     return 3;
   }
-  if ( head.dims[3] != 64 ) {
-    lf_error( "requires real64 data" );
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
     fclose( fpin );
     lfbxFree( &head );
     return 3;
   }
-  if ( !head.data_type || strcmp( head.data_type, "real64" ) )
-    lf_warning( "treating as real64 data" );
 
   /* Allocate data storage. */
+  if ( r1 > head.dims[0] )
+    r1 = head.dims[0];
+  if ( r2 > head.dims[1] )
+    r2 = head.dims[1];
+  nc = head.dims[2];
+  lin = head.dims[1]*nc;
   n = ( r1 > 0 ? head.dims[0] : 1 );
-  dat = (double *)malloc( n*head.dims[1]*sizeof(double) );
-  n = ( r2 > 0 && head.dims[1] > n ? head.dims[1] : n );
+  dat = (double *)malloc( n*lin*sizeof(double) );
+  n = ( r1 > 0 && head.dims[0]*nc > lin ? head.dims[0]*nc : lin );
   out = (double *)malloc( n*sizeof(double) );
+  n = 2*( r1 > r2 ? r1 : r2 ) + 1;
+  key = (double *)malloc( n*sizeof(double) );
   idx = (int64_t *)malloc( n*sizeof(int64_t) );
-  if ( !dat || !out || !idx ) {
+  if ( !dat || !out || !key || !idx ) {
     lf_error( "memory error" );
     fclose( fpin );
     if ( dat )
       free( dat );
     if ( out )
       free( out );
+    if ( key )
+      free( key );
     if ( idx )
       free( idx );
     lfbxFree( &head );
@@ -335,6 +405,7 @@ main( int argc, char **argv )
       fclose( fpin );
       free( dat );
       free( out );
+      free( key );
       free( idx );
       lfbxFree( &head );
       return 2;
@@ -345,6 +416,7 @@ main( int argc, char **argv )
     fclose( fpin );
     free( dat );
     free( out );
+    free( key );
     free( idx );
     lfbxFree( &head );
     return 2;
@@ -355,78 +427,67 @@ main( int argc, char **argv )
     fclose( fpin );
     free( dat );
     free( out );
+    free( key );
     free( idx );
     lfbxFree( &head );
     return 2;
   }
 
-  /* Do column filtering, if requested. */
+  /* Do column filtering, if requested.  Each column (and component,
+     or complex pair) is filtered into out, then copied back. */
   if ( r1 > 0 ) {
-    n = head.dims[0]*head.dims[1];
-    if ( ( i = fread( dat, sizeof(double), n, fpin ) ) < n ) {
+    n = head.dims[0]*lin;
+    if ( ( i = lfrealRead( dat, bits, n, fpin ) ) < n ) {
       lf_warning( "read %lld data from %s, expected %lld",
 		  (long long)( i ), infile, (long long)( n ) );
       memset( dat + i, 0, ( n - i )*sizeof(double) );
     }
-    stride = head.dims[1];
-    for ( j = 0; j < head.dims[1]; j++ ) {
+    for ( j = 0; j < lin; j += ( mag ? 2 : 1 ) ) {
+      percentile( dat + j, lin, out, nc, head.dims[0], r1, p, mag, key,
+		  idx );
       for ( i = 0; i < head.dims[0]; i++ ) {
-	imin = ( i - r1 < 0 ? 0 : i - r1 );
-	imax = ( i + r1 > head.dims[0] - 1 ? head.dims[0] - 1 : i + r1 );
-	ddata = dat + imin*head.dims[1] + j;
-	for ( k = 0; k < imax - imin; k++ )
-	  idx[k] = k;
-	qsort( idx, imax - imin, sizeof(int64_t), ascend );
-	out[i] = ddata[ ( idx[ ( imax - imin )/2 ] )*stride ];
+	dat[ i*lin + j ] = out[i*nc];
+	if ( mag )
+	  dat[ i*lin + j + 1 ] = out[i*nc+1];
       }
-      for ( i = 0; i < head.dims[0]; i++ )
-	dat[ i*stride + j ] = out[i];
     }
   }
 
   /* Do row filtering, if requested; write output in any case. */
-  n = head.dims[1];
-  stride = 1;
   for ( i = 0; i < head.dims[0]; i++ ) {
 
     /* Get next row of data, reading it if we haven't already. */
     if ( r1 > 0 )
-      row = dat + i*n;
+      row = dat + i*lin;
     else {
       if ( !feof( fpin ) ) {
-	if ( ( j = fread( dat, sizeof(double), n, fpin ) ) < n ) {
+	if ( ( j = lfrealRead( dat, bits, lin, fpin ) ) < lin ) {
 	  lf_warning( "read %lld data from %s, expected %lld",
-		      (long long)( i*n + j ), infile,
-		      (long long)( head.dims[0]*n ) );
-	  memset( dat + j, 0, ( n - j )*sizeof(double) );
+		      (long long)( i*lin + j ), infile,
+		      (long long)( head.dims[0]*lin ) );
+	  memset( dat + j, 0, ( lin - j )*sizeof(double) );
 	}
 	row = dat;
       } else {
-	memset( out, 0, n*sizeof(double) );
-	row = NULL;
+	memset( out, 0, lin*sizeof(double) );
+	row = out;
       }
     }
 
-    /* Sort it if needed. */
-    if ( r2 > 0 && row ) {
-      for ( j = 0; j < n; j++ ) {
-	jmin = ( j - r2 < 0 ? 0 : j - r2 );
-	jmax = ( j + r2 > n - 1 ? n - 1 : j + r2 );
-	ddata = row + jmin;
-	for ( k = 0; k < jmax - jmin; k++ )
-	  idx[k] = k;
-	qsort( idx, jmax - jmin, sizeof(int64_t), ascend );
-	out[j] = ddata[ ( idx[ (int)( p*( jmax - jmin - 1 ) + 0.5 ) ] ) ];
-      }
-    }
-    if ( r2 > 0 )
+    /* Filter it if needed. */
+    if ( r2 > 0 && row != out ) {
+      for ( c = 0; c < nc; c += ( mag ? 2 : 1 ) )
+	percentile( row + c, nc, out + c, nc, head.dims[1], r2, p, mag,
+		    key, idx );
       row = out;
-    if ( fwrite( row, sizeof(double), n, fpout ) < n ) {
+    }
+    if ( lfrealWrite( row, bits, lin, fpout ) < lin ) {
       lf_error( "could not write data to %s", outfile );
       fclose( fpin );
       fclose( fpout );
       free( dat );
       free( out );
+      free( key );
       free( idx );
       lfbxFree( &head );
       return 2;
@@ -438,6 +499,7 @@ main( int argc, char **argv )
   fclose( fpout );
   free( dat );
   free( out );
+  free( key );
   free( idx );
   lfbxFree( &head );
   return 0;
@@ -0,0 +1,507 @@
+static const char *version = "\
+lfnorm version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Normalize the bandpass of a LoFASM file with running robust statistics.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -w, --window=LEN       rows in running window (default 128)\n\
+  -n, --no-scale         subtract the median only, without dividing\n\
+  -z, --zero-dm          subtract the mean of each normalized row\n\
+  -M, --mask=MASKFILE    exclude samples flagged in MASKFILE\n\
+\n";
+
+static const char *description = "\
+# lfnorm(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfnorm(1)` - normalize the bandpass of a lofasm-filterbank(5) file\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfnorm` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program flattens the bandpass of a spectrogram stored in a\n\
+lofasm-filterbank(5) file _INFILE_, writing the result to _OUTFILE_.\n\
+If _INFILE_ or _OUTFILE_ is not specified, or is a single `-`\n\
+character, then standard input or standard output is used instead.\n\
+\n\
+Each datum _x_ is replaced by\n\
+\n\
+> _y_ = (_x_ - _m_)/(1.4826 _D_),\n\
+\n\
+where _m_ and _D_ are the median and median absolute deviation (MAD)\n\
+of its column (channel) over a running window of _LEN_ rows centred on\n\
+it; for Gaussian noise 1.4826 _D_ is the standard deviation, so the\n\
+output has zero median and unit robust variance in each channel.  Near\n\
+the start and end of the file the window is truncated.  Data with more\n\
+than one component are normalized component by component.\n\
+\n\
+The input is streamed: each channel keeps the values in its window in\n\
+sorted order, updated by one insertion and one deletion per row, so\n\
+the median is read off directly and the MAD is found by a binary\n\
+search over the deviations on either side of the median.  Only the\n\
+window itself is held in memory, so memory usage is proportional to\n\
+_LEN_ times the number of channels, regardless of the file length,\n\
+and the output lags the input by about _LEN_/2 rows.\n\
+\n\
+Non-finite values, and samples flagged in a mask file given by\n\
+`-M, --mask`, are excluded from the running statistics and are set\n\
+to 0 in the output, as are samples in channels whose window has zero\n\
+MAD.  With `-z, --zero-dm`, the mean of the remaining normalized\n\
+samples in each row is then subtracted from them, which removes\n\
+broadband (undispersed) signals and gain fluctuations common to all\n\
+channels.\n\
+\n\
+The data may be stored as `real32` or `real64`; statistics are\n\
+computed in double precision, and the output is stored with the same\n\
+type as the input.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-w, --window=`_LEN_:\n\
+    Sets the number of rows in the running window, which is centred\n\
+    on each output row (with one more row before it than after if\n\
+    _LEN_ is even).  The default is `128`.  If _LEN_ exceeds the\n\
+    number of rows in the file, each channel is normalized by its\n\
+    statistics over the whole file.\n\
+\n\
+`-n, --no-scale`:\n\
+    Subtracts the running median only, without dividing by the MAD,\n\
+    so that the output keeps the units of the input.\n\
+\n\
+`-z, --zero-dm`:\n\
+    Subtracts the mean over channels of each normalized row, as\n\
+    described above.\n\
+\n\
+`-M, --mask=`_MASKFILE_:\n\
+    Reads a `bit1` mask file with the same rows and columns as the\n\
+    input (see lofasm-filterbank(5)), such as is written by\n\
+    lfflag(1), and excludes samples whose mask bit is set.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfmed(1),\n\
+lfflag(1),\n\
+lfdedisp(1),\n\
+lfmaskRead(3),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:w:nzM:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "window", 1, 0, 'w' },
+  { "no-scale", 0, 0, 'n' },
+  { "zero-dm", 0, 0, 'z' },
+  { "mask", 1, 0, 'M' },
+  { 0, 0, 0, 0} };
+
+#define MADSIG 1.4826 /* ratio of standard deviation to MAD for Gaussian */
+
+
+/* Returns the index of the first of n sorted values in s that is not
+   less than x. */
+static int64_t
+lower_bound( const double *s, int64_t n, double x )
+{
+  int64_t lo = 0, hi = n, i; /* search range and midpoint */
+  while ( lo < hi )
+    if ( s[ i = lo + ( hi - lo )/2 ] < x )
+      lo = i + 1;
+    else
+      hi = i;
+  return lo;
+}
+
+/* Inserts x into n sorted values in s, which must have room for one
+   more. */
+static void
+sorted_insert( double *s, int64_t n, double x )
+{
+  int64_t i = lower_bound( s, n, x ); /* insertion point */
+  memmove( s + i + 1, s + i, ( n - i )*sizeof(double) );
+  s[i] = x;
+  return;
+}
+
+/* Removes one instance of x from n sorted values in s. */
+static void
+sorted_remove( double *s, int64_t n, double x )
+{
+  int64_t i = lower_bound( s, n, x ); /* removal point */
+  if ( i < n )
+    memmove( s + i, s + i + 1, ( n - i - 1 )*sizeof(double) );
+  return;
+}
+
+/* Returns the median absolute deviation of n > 0 sorted values in s
+   about their (upper) median s[n/2], i.e. the (upper) median of their
+   absolute deviations.  The deviations below and above the median
+   form two ascending sequences, so their combined kth smallest is
+   found by binary search on the number taken from the lower side. */
+static double
+sorted_mad( const double *s, int64_t n )
+{
+  int64_t p = n/2, k = n/2 + 1; /* median index, and number to take */
+  int64_t lo, hi, a, b;         /* search range, and numbers taken */
+  double med = s[p];            /* median */
+  double l, r;                  /* largest deviations taken */
+
+  /* Lower deviations are med - s[p-1-a] for a < p, upper deviations
+     s[p+b] - med for b < n - p.  Find the fewest lower deviations
+     a such that the kth smallest is not among the upper ones beyond
+     those taken. */
+  lo = ( k > n - p ? k - ( n - p ) : 0 );
+  hi = ( k < p ? k : p );
+  while ( lo < hi ) {
+    a = lo + ( hi - lo )/2;
+    b = k - a;
+    if ( s[p+b-1] - med > med - s[p-1-a] )
+      lo = a + 1;
+    else
+      hi = a;
+  }
+  a = lo;
+  b = k - a;
+  l = ( a > 0 ? med - s[p-a] : 0.0 );
+  r = ( b > 0 ? s[p+b-1] - med : 0.0 );
+  return ( l > r ? l : r );
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  if ( fpmask ) fclose( fpmask ); \
+  if ( ring ) free( ring ); \
+  if ( srt ) free( srt ); \
+  if ( cnt ) free( cnt ); \
+  if ( stat ) free( stat ); \
+  if ( msk ) free( msk ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  char *maskfile = NULL;    /* mask file name */
+  FILE *fpin = NULL, *fpout = NULL, *fpmask = NULL; /* file pointers */
+  long long nwin = 128;     /* rows in window */
+  int scale = 1;            /* whether to divide by MAD */
+  int zerodm = 0;           /* whether to subtract row means */
+  lfb_hdr head = {};        /* file header */
+  lfb_mask mstate = {};     /* mask read state */
+  int bits;                 /* bit depth of data (32 or 64) */
+  int64_t nin, ncol, ncomp, lin; /* rows, columns, components, row length */
+  int64_t i, j, z, k, n;    /* indecies and counts */
+  int64_t next = 0, old = 0; /* next row to read, and oldest in window */
+  int64_t nread = 0;        /* number of data read */
+  int64_t half;             /* rows in window before output row */
+  int64_t *cnt = NULL;      /* finite values in each window */
+  double *ring = NULL;      /* window of input rows */
+  double *srt = NULL;       /* sorted windows for each series */
+  double *stat = NULL;      /* medians, scales, and output row */
+  double *med, *scl, *out;  /* pointers into stat */
+  unsigned char *msk = NULL; /* mask bits, and row usage flags */
+  unsigned char *use;       /* whether output samples are usable */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'w':
+      if ( ( nwin = strtoll( optarg, &end, 10 ) ) < 1 || *end ) {
+	lf_error( "bad -w, --window argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'n':
+      scale = 0;
+      break;
+    case 'z':
+      zerodm = 1;
+      break;
+    case 'M':
+      maskfile = optarg;
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Read input header, and mask header if any. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  if ( maskfile && !( fpmask = lfmaskOpen( maskfile, &head ) ) )
+    CLEANEXIT( 2 );
+  nin = head.dims[0];
+  ncol = head.dims[1];
+  ncomp = head.dims[2];
+  lin = ncol*ncomp;
+  if ( nwin > nin )
+    nwin = ( nin > 0 ? nin : 1 );
+  half = nwin/2;
+
+  /* Allocate storage. */
+  if ( !( ring = (double *)malloc( nwin*lin*sizeof(double) ) ) ||
+       !( srt = (double *)malloc( nwin*lin*sizeof(double) ) ) ||
+       !( cnt = (int64_t *)calloc( lin, sizeof(int64_t) ) ) ||
+       !( stat = (double *)malloc( 3*lin*sizeof(double) ) ) ||
+       !( msk = (unsigned char *)malloc( ncol + lin ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  med = stat;
+  scl = med + lin;
+  out = scl + lin;
+  use = msk + ncol;
+
+  /* Write output header. */
+  {
+    char *label = head.data_label; /* old data label */
+    if ( !( head.data_label = (char *)malloc( ( label ? strlen( label ) : 4 )
+					      + 12 ) ) ) {
+      lf_error( "memory error" );
+      head.data_label = label;
+      CLEANEXIT( 4 );
+    }
+    sprintf( head.data_label, "normalized %s", ( label ? label : "data" ) );
+    if ( label )
+      free( label );
+  }
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Generate output row by row.  The window for row i covers input
+     rows i - half through i - half + nwin - 1, clipped to the file. */
+  for ( i = 0; i < nin; i++ ) {
+    double *x; /* input row i */
+
+    /* Drop rows that have left the window. */
+    for ( ; old < i - half; old++ ) {
+      x = ring + ( old % nwin )*lin;
+      for ( j = 0; j < lin; j++ )
+	if ( isfinite( x[j] ) )
+	  sorted_remove( srt + j*nwin, cnt[j]--, x[j] );
+    }
+
+    /* Read rows that have entered the window.  Flagged values are
+       stored as NaN, so they are never entered in the sorted
+       windows. */
+    for ( ; next < nin && next <= i - half + nwin - 1; next++ ) {
+      x = ring + ( next % nwin )*lin;
+      if ( !feof( fpin ) && !ferror( fpin ) )
+	nread += ( n = lfrealRead( x, bits, lin, fpin ) );
+      else
+	n = 0;
+      for ( j = n; j < lin; j++ )
+	x[j] = NAN;
+      if ( fpmask ) {
+	if ( ( k = lfmaskRead( msk, ncol, &mstate, fpmask ) ) < ncol )
+	  memset( msk + k, 0, ncol - k );
+	for ( j = 0; j < lin; j++ )
+	  x[j] = ( msk[j/ncomp] ? NAN : x[j] );
+      }
+      for ( j = 0; j < lin; j++ )
+	if ( isfinite( x[j] ) )
+	  sorted_insert( srt + j*nwin, cnt[j]++, x[j] );
+    }
+
+    /* Update statistics. */
+    for ( j = 0; j < lin; j++ ) {
+      const double *s = srt + j*nwin; /* sorted window */
+      double d;                       /* MAD */
+      if ( ( n = cnt[j] ) == 0 ) {
+	med[j] = scl[j] = 0.0;
+	continue;
+      }
+      med[j] = s[n/2];
+      if ( !scale )
+	scl[j] = 1.0;
+      else
+	scl[j] = ( ( d = sorted_mad( s, n ) ) > 0.0 ? 1.0/( MADSIG*d ) : 0.0 );
+    }
+
+    /* Normalize.  Unusable samples are set to zero. */
+    x = ring + ( i % nwin )*lin;
+    for ( j = 0; j < lin; j++ ) {
+      double y = ( x[j] - med[j] )*scl[j]; /* normalized value */
+      int u = isfinite( y ) && scl[j] > 0.0; /* whether usable */
+      use[j] = u;
+      out[j] = ( u ? y : 0.0 );
+    }
+
+    /* Subtract the mean of usable samples for each component. */
+    if ( zerodm )
+      for ( z = 0; z < ncomp; z++ ) {
+	double sum = 0.0; /* sum of usable samples */
+	for ( j = z, n = 0; j < lin; j += ncomp ) {
+	  sum += out[j];
+	  n += use[j];
+	}
+	if ( n > 0 )
+	  for ( j = z, sum /= n; j < lin; j += ncomp )
+	    out[j] -= ( use[j] ? sum : 0.0 );
+      }
+
+    if ( lfrealWrite( out, bits, lin, fpout ) < lin ) {
+      lf_error( "could not write data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+  }
+  if ( nread < nin*lin )
+    lf_warning( "read %lld data from %s, expected %lld",
+		(long long)( nread ), infile, (long long)( nin*lin ) );
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
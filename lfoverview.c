@@ -0,0 +1,308 @@
+static const char *version = "\
+lfoverview version " VERSION "\n\
+Copyright (c) 2019 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Append reduced-resolution overview levels to a LoFASM file.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -n, --levels=NLEV      number of overview levels (default 4)\n\
+\n";
+
+static const char *description = "\
+# lfoverview(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfoverview(1)` - add overview levels to a lofasm-filterbank(5) file\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfoverview` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program copies a lofasm-filterbank(5) file _INFILE_ to\n\
+_OUTFILE_, appending reduced-resolution overview levels after the\n\
+full-resolution data.  Level _l_ is the average of the data over boxes\n\
+of 2^_l_ x 2^_l_ points in time and frequency, so that a day-long file\n\
+can be inspected at a range of resolutions without rerunning\n\
+lfsquish(1) each time: see the `-o, --overview` option of\n\
+lfplot2d(1).  The format of the overview levels is described in\n\
+lofasm-filterbank(5); programs that do not use them simply ignore\n\
+them.  Any overview levels already present in _INFILE_ are discarded\n\
+and recomputed.\n\
+\n\
+If _INFILE_ or _OUTFILE_ is not specified, or is a single `-`\n\
+character, then standard input or standard output is used instead.\n\
+The data are streamed one row at a time, with the overview levels\n\
+computed in the same pass and buffered in temporary files until the\n\
+full-resolution data have been written, so memory usage does not\n\
+depend on the length of the file.  The input must be real32 or real64\n\
+data; the overview levels are stored with the same type.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-n, --levels=`_NLEV_:\n\
+    Sets the number of overview levels, downsampled by factors of 2,\n\
+    4, ..., 2^_NLEV_.  The default is `4`.  If either dimension of the\n\
+    data is too short, fewer levels are computed.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfplot2d(1),\n\
+lfsquish(1),\n\
+lfovrOpen(3),\n\
+lfovrRead(3),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:n:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "levels", 1, 0, 'n' },
+  { 0, 0, 0, 0} };
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;          /* option character and index */
+  int nlev = 4;           /* number of overview levels */
+  char *infile, *outfile; /* input/output file names */
+  FILE *fpin, *fpout;     /* input/output file pointers */
+  int64_t i, n, lin;      /* row index, number read, and row length */
+  int bits;               /* bit depth of data (32 or 64) */
+  lfb_hdr head = {};      /* file header */
+  lfb_ovr *ovr;           /* overview levels */
+  double *row;            /* data row */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'n':
+      if ( ( nlev = atoi( optarg ) ) < 1 ) {
+	lf_error( "bad -n, --levels argument %s", optarg );
+	return 1;
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      return 2;
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    return 2;
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    fclose( fpin );
+    lfbxFree( &head );
+    return 2;
+  }
+
+  /* Check data type. */
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    fclose( fpin );
+    lfbxFree( &head );
+    return 3;
+  }
+
+  /* Set up overviews and allocate data storage. */
+  lin = head.dims[1]*head.dims[2];
+  if ( !( ovr = lfovrOpen( &head, nlev ) ) ) {
+    lf_error( "could not set up overview levels" );
+    fclose( fpin );
+    lfbxFree( &head );
+    return 3;
+  }
+  if ( !( row = (double *)malloc( lin*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    fclose( fpin );
+    lfovrFree( ovr );
+    lfbxFree( &head );
+    return 4;
+  }
+
+  /* Write output file header. */
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      fclose( fpin );
+      free( row );
+      lfovrFree( ovr );
+      lfbxFree( &head );
+      return 2;
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    fclose( fpin );
+    free( row );
+    lfovrFree( ovr );
+    lfbxFree( &head );
+    return 2;
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    fclose( fpout );
+    fclose( fpin );
+    free( row );
+    lfovrFree( ovr );
+    lfbxFree( &head );
+    return 2;
+  }
+
+  /* Copy data, padding any missing data with zeros. */
+  for ( i = 0; i < head.dims[0]; i++ ) {
+    if ( ( n = lfrealRead( row, bits, lin, fpin ) ) < lin ) {
+      if ( !feof( fpin ) || n > 0 )
+	lf_warning( "read %lld data from %s, expected %lld",
+		    (long long)( i*lin + n ), infile,
+		    (long long)( head.dims[0]*lin ) );
+      memset( row + n, 0, ( lin - n )*sizeof(double) );
+    }
+    if ( lfrealWrite( row, bits, lin, fpout ) < lin ||
+	 lfovrAdd( ovr, row ) ) {
+      lf_error( "could not write data to %s", outfile );
+      fclose( fpout );
+      fclose( fpin );
+      free( row );
+      lfovrFree( ovr );
+      lfbxFree( &head );
+      return 2;
+    }
+  }
+  fclose( fpin );
+  free( row );
+
+  /* Append overview levels. */
+  if ( lfovrWrite( fpout, &head, ovr ) ) {
+    lf_error( "could not write overviews to %s", outfile );
+    fclose( fpout );
+    lfbxFree( &head );
+    return 2;
+  }
+  fclose( fpout );
+  lfbxFree( &head );
+  return 0;
+}
@@ -33,6 +33,7 @@ Plot one or more rows or columns of a LoFASM data.\n\
   -s, --lin=SCALE[+OFF]  convert on a linear scale\n\
   -l, --log=BASE         convert to log scale\n\
   -r, --range=MIN[+MAX]  restrict range of data\n\
+  -e, --envelope=MODE    decimate long series to envelopes\n\
 \n";
 
 static const char *description = "\
@@ -137,6 +138,22 @@ option can convert complex data to real for plotting.\n\
     range [*MIN*,*MAX*].  This is done before any linear or\n\
     logarithmic remapping, above.\n\
 \n\
+`-e, --envelope=`_MODE_:\n\
+    Specifies whether to decimate each plotted line to an envelope.\n\
+    If _MODE_ is `m4`, the data falling within each horizontal unit\n\
+    (point or pixel) of the plot are reduced to at most four points:\n\
+    the first, minimum, maximum, and last values, in their original\n\
+    order.  When rendered at the plot resolution this is visually\n\
+    indistinguishable from plotting every datum, but the size of the\n\
+    output is proportional to _W_ (see `-g, --geometry`) rather than to\n\
+    the length of the data.  When plotting columns (`-d 1`), rows are\n\
+    streamed through the envelopes one at a time rather than reading\n\
+    the entire file into memory.  Non-finite data are skipped, and the\n\
+    line is broken only across horizontal units with no finite data.\n\
+    If _MODE_ is `none`, every datum is plotted.  If _MODE_ is `auto`\n\
+    (the default), envelopes are used if there are more than 4 data\n\
+    per horizontal unit.\n\
+\n\
 ## EXIT STATUS\n\
 \n\
 The proram exits with status 0 normally, 1 if there is an error\n\
@@ -157,7 +174,7 @@ lofasm-filterbank(5)\n\
 #include "markdown_parser.h"
 #include "lofasmIO.h"
 
-static const char short_opts[] = ":hHVv:g:d:n:z:l:s:r:";
+static const char short_opts[] = ":hHVv:g:d:n:z:l:s:r:e:";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -172,10 +189,72 @@ static const struct option long_opts[] = {
   { "log", 1, 0, 'l' },
   { "lin", 1, 0, 's' },
   { "range", 1, 0, 'r' },
+  { "envelope", 1, 0, 'e' },
   { 0, 0, 0, 0} };
 
 #define LEN 1024 /* character buffer size */
 
+/* Adds datum d with sample index k to pixel column x of an envelope,
+   where v stores the first, minimum, maximum, and last values in each
+   column, iv stores their sample indecies, and cnt stores the number
+   of data in each column. */
+static void
+env_add( double *v, int64_t *iv, int64_t *cnt, int64_t x, int64_t k,
+	 double d )
+{
+  v += 4*x;
+  iv += 4*x;
+  if ( !( cnt[x]++ ) ) {
+    v[0] = v[1] = v[2] = v[3] = d;
+    iv[0] = iv[1] = iv[2] = iv[3] = k;
+    return;
+  }
+  if ( d < v[1] ) {
+    v[1] = d;
+    iv[1] = k;
+  }
+  if ( d > v[2] ) {
+    v[2] = d;
+    iv[2] = k;
+  }
+  v[3] = d;
+  iv[3] = k;
+  return;
+}
+
+/* Writes an envelope of width pixel columns to fp as a PostScript
+   path, with sample k of len plotted at x-coordinate width*k/len. */
+static void
+env_plot( FILE *fp, const double *v, const int64_t *iv,
+	  const int64_t *cnt, int width, int64_t len, int height )
+{
+  int64_t x;   /* pixel column */
+  int a, b;    /* order of extrema */
+  int first;   /* whether to start a new subpath */
+  int64_t k;   /* last sample index written */
+  for ( x = 0, first = 1; x < width; x++, v += 4, iv += 4 ) {
+    if ( !cnt[x] ) {
+      first = 1;
+      continue;
+    }
+    a = ( iv[1] <= iv[2] ? 1 : 2 );
+    b = 3 - a;
+    fprintf( fp, "%f %f %s\n", width*iv[0]/(double)( len ), height*v[0],
+	     ( first ? "m" : "l" ) );
+    k = iv[0];
+    if ( iv[a] != k )
+      fprintf( fp, "%f %f l\n", width*( k = iv[a] )/(double)( len ),
+	       height*v[a] );
+    if ( iv[b] != k )
+      fprintf( fp, "%f %f l\n", width*( k = iv[b] )/(double)( len ),
+	       height*v[b] );
+    if ( iv[3] != k )
+      fprintf( fp, "%f %f l\n", width*iv[3]/(double)( len ), height*v[3] );
+    first = 0;
+  }
+  return;
+}
+
 int
 main( int argc, char **argv )
 {
@@ -197,6 +276,9 @@ main( int argc, char **argv )
   int multi;                     /* plot multiple dim3 components */
   int first, eod = 0;            /* flags for NaN or end-of-data */
   double d, dmin, dmax;          /* datum and extrema */
+  int env = -1;                  /* -e option (-1 = auto) */
+  double *ev = NULL;             /* envelope values */
+  int64_t *iv = NULL, *cnt = NULL; /* envelope indecies and counts */
 
   /* Parse options. */
   opterr = 0;
@@ -227,6 +309,7 @@ main( int argc, char **argv )
 	lf_error( "bad argyment %s to -g, --geometry", optarg );
 	return 1;
       }
+      break;
     case 'd':
       if ( ( dim = atoi( optarg ) ) < 1 ) {
 	lf_error( "bad argyment %s to -d, --dimension", optarg );
@@ -270,6 +353,18 @@ main( int argc, char **argv )
 	return 1;
       }
       break;
+    case 'e':
+      if ( !strcmp( optarg, "auto" ) )
+	env = -1;
+      else if ( !strcmp( optarg, "none" ) )
+	env = 0;
+      else if ( !strcmp( optarg, "m4" ) )
+	env = 1;
+      else {
+	lf_error( "bad argument %s to -e, --envelope", optarg );
+	return 1;
+      }
+      break;
     case '?':
       if ( optopt )
 	lf_error( "unknown option -%c\n\t"
@@ -340,8 +435,17 @@ main( int argc, char **argv )
 		  head.data_type + strlen( "%data_type: " ) );
   }
 
-  /* Allocate data. */
-  n = ( dim == 1 ? head.dims[0] : 1 );
+  /* Allocate data.  Columns are read in their entirety unless they
+     are being streamed through envelopes. */
+  if ( dim > 2 ) {
+    lf_error( "bad argument %d to -d, --dimension", dim );
+    fclose( fpin );
+    lfbxFree( &head );
+    return 1;
+  }
+  if ( env < 0 )
+    env = ( head.dims[dim-1] > 4*(int64_t)( width ) );
+  n = ( dim == 1 && !env ? head.dims[0] : 1 );
   n *= head.dims[1]*head.dims[2];
   if ( !( dat = (double *)malloc( n*sizeof(double) ) ) ) {
     lf_error( "memory error" );
@@ -372,7 +476,7 @@ main( int argc, char **argv )
   fprintf( fpout, "%%!PS-Adobe-3.0 EPSF-3.0\n" );
   if ( outfile )
     fprintf( fpout, "%%%%Title: %s\n", outfile );
-  fprintf( fpout, "%%%%Creator: lfplot2d\n" );
+  fprintf( fpout, "%%%%Creator: lfplot\n" );
   fprintf( fpout, "%%%%Orientation: Portrait\n"
 	   "%%%%Pages: 0\n"
 	   "%%%%LanguageLevel: 2\n"
@@ -394,9 +498,69 @@ main( int argc, char **argv )
   if ( head.dims[2] != 2 && zarg[0] )
     lf_warning( "ignoring --components=%s on non-complex data", zarg );
 
-  /* Read entire array if plotting columns. */
+  /* Allocate envelopes. */
+  if ( env && ( !( ev = (double *)
+		   malloc( 4*num*width*sizeof(double) ) ) ||
+		!( iv = (int64_t *)
+		   malloc( 4*num*width*sizeof(int64_t) ) ) ||
+		!( cnt = (int64_t *)
+		   calloc( num*width, sizeof(int64_t) ) ) ) ) {
+    lf_error( "memory error" );
+    fclose( fpout );
+    fclose( fpin );
+    free( dat );
+    if ( ev )
+      free( ev );
+    if ( iv )
+      free( iv );
+    lfbxFree( &head );
+    return 4;
+  }
+
+  /* Stream rows through envelopes if plotting columns. */
   stride = head.dims[2];
-  if ( dim == 1 ) {
+  if ( dim == 1 && env ) {
+    for ( j = 0; j < head.dims[0]; j++ ) {
+      if ( !eod && ( k = fread( dat, sizeof(double), n, fpin ) ) < n ) {
+	lf_warning( "read %lld numbers from %s, expected %lld",
+		    (long long)( j*n + k ), infile,
+		    (long long)( head.dims[0]*n ) );
+	memset( dat + k, 0, ( n - k )*sizeof(double) );
+	eod = 1;
+      } else if ( eod == 1 ) {
+	memset( dat, 0, n*sizeof(double) );
+	eod = 2;
+      }
+      for ( i = 0; i < num; i++ ) {
+	plt = dat + ( ( i*head.dims[1] )/num )*head.dims[2]
+	  + ( multi ? i%head.dims[2] : 0 );
+	d = plt[0];
+	if ( zarg[0] ) {
+	  if ( !strcmp( zarg, "im" ) )
+	    d = plt[1];
+	  else if ( !strcmp( zarg, "abs" ) )
+	    d = hypot( plt[0], plt[1] );
+	  else if ( !strcmp( zarg, "arg" ) )
+	    d = atan2( plt[1], plt[0] );
+	}
+	if ( isnan( d ) || isinf( d ) )
+	  continue;
+	if ( range > 0 && !( d > min ) )
+	  d = min;
+	if ( range > 1 && !( d < max ) )
+	  d = max;
+	d = scale*d + off;
+	if ( base != 0.0 )
+	  d = log( d )*base;
+	if ( isfinite( d ) )
+	  env_add( ev + 4*i*width, iv + 4*i*width, cnt + i*width,
+		   ( j*width )/head.dims[0], j, d );
+      }
+    }
+  }
+
+  /* Read entire array if plotting columns. */
+  else if ( dim == 1 ) {
     if ( ( k = fread( dat, sizeof(double), n, fpin ) ) < n ) {
       lf_warning( "read %lld numbers from %s, expected %lld",
 		  (long long)( k ), infile, (long long)( n ) );
@@ -408,7 +572,9 @@ main( int argc, char **argv )
   /* Make plots. */
   j = -1;
   for ( i = 0; i < num; i++ ) {
-    if ( dim == 1 )
+    if ( dim == 1 && env )
+      plt = NULL;
+    else if ( dim == 1 )
       plt = dat + ( ( i*head.dims[1] )/num )*head.dims[2]
 	+ ( multi ? i%head.dims[2] : 0 );
     else {
@@ -428,11 +594,11 @@ main( int argc, char **argv )
 	memset( dat, 0, n*sizeof(double) );
 	eod = 2;
       }
-      plt = dat;
+      plt = dat + ( multi ? i%head.dims[2] : 0 );
     }
 
     /* Apply transformations. */
-    if ( zarg[0] ) {
+    if ( plt && zarg[0] ) {
       if ( !strcmp( zarg, "im" ) )
 	for ( k = 0; k < head.dims[dim-1]; k++ )
 	  plt[k*stride] = plt[k*stride+1];
@@ -457,19 +623,25 @@ main( int argc, char **argv )
     else
       fprintf( fpout, "0 %f %f setrgbcolor\n", 1.5 - 1.5*i/( num - 0.999 ),
 	       2.0*i/( num - 0.999 ) - 1.0 );
-    for ( k = 0, first = 1; k < head.dims[dim-1]; k++ ) {
-      d = ( multi ? plt[k*stride] : plt[ k*stride + i%head.dims[2] ] );
+    for ( k = 0, first = 1; plt && k < head.dims[dim-1]; k++ ) {
+      d = plt[k*stride];
       if ( isnan( d ) || isinf( d ) )
 	first = 1;
       else {
 	if ( range > 0 && !( d > min ) )
 	  d = min;
-	if ( range > 0 && !( d < max ) )
+	if ( range > 1 && !( d < max ) )
 	  d = max;
 	if ( scale != 1.0 || off != 0.0 )
 	  d = scale*d + off;
 	if ( base != 0.0 )
 	  d = log( d )*base;
+	if ( env ) {
+	  if ( isfinite( d ) )
+	    env_add( ev + 4*i*width, iv + 4*i*width, cnt + i*width,
+		     ( k*width )/head.dims[dim-1], k, d );
+	  continue;
+	}
 	if ( d < dmin )
 	  dmin = d;
 	if ( d > dmax )
@@ -483,6 +655,19 @@ main( int argc, char **argv )
 	  fprintf( fpout, "l\n" );
       }
     }
+    if ( env ) {
+      for ( k = 0; k < width; k++ )
+	if ( cnt[i*width+k] ) {
+	  d = ev[4*( i*width + k ) + 1];
+	  if ( d < dmin )
+	    dmin = d;
+	  d = ev[4*( i*width + k ) + 2];
+	  if ( d > dmax )
+	    dmax = d;
+	}
+      env_plot( fpout, ev + 4*i*width, iv + 4*i*width, cnt + i*width,
+		width, head.dims[dim-1], height );
+    }
     fprintf( fpout, "stroke\n" );
   }
 
@@ -492,6 +677,11 @@ main( int argc, char **argv )
   fclose( fpout );
   fclose( fpin );
   free( dat );
+  if ( env ) {
+    free( ev );
+    free( iv );
+    free( cnt );
+  }
   lfbxFree( &head );
   return 0;
 }
@@ -34,6 +34,11 @@ Make a two-dimensional colour plot of LoFASM data.\n\
   -r, --range=MIN[+MAX]  restrict range of data\n\
   -c, --colourmap=MAP    specify colour scale for output\n\
   -p, --postscript       generate PostScript output\n\
+  -P, --png              generate PNG output\n\
+  -o, --overview         plot from overview levels if present\n\
+  -j, --threads=N        render using N threads\n\
+  -f, --follow=N         follow growing input, writing every N rows\n\
+  -w, --wait=SEC         stop following after SEC idle seconds\n\
 \n";
 
 static const char *description = "\
@@ -50,7 +55,8 @@ static const char *description = "\
 ## DESCRIPTION\n\
 \n\
 This program generates a two-dimensional plot of data read from\n\
-_INFILE_ in lofasm-filterbank(5) format.  The plot is printed to\n\
+_INFILE_ in lofasm-filterbank(5) format, with `real32` or `real64`\n\
+data.  The plot is printed to\n\
 _OUTFILE_ in BX image format, or another format as specified by\n\
 options.  If _INFILE_ or _OUTFILE_ is not specified, or is a single\n\
 `-` character, then standard input or standard output is used instead.\n\
@@ -187,6 +193,71 @@ viewed with gv(1) and converted with gs(1).\n\
     directly to gv(1) for viewing or gs(1) for conversion to another\n\
     format.\n\
 \n\
+`-P, --png`:\n\
+    Specifies that the output will be a PNG image (8-bit RGB).  Rows\n\
+    are filtered and compressed as they are rendered, so the image is\n\
+    written in a single pass without being held in memory, and no\n\
+    separate conversion step is needed.  The output is never\n\
+    gzipped, regardless of the _OUTFILE_ extension.  This option is\n\
+    not available if the program was compiled with `NO_ZLIB`, and\n\
+    cannot be combined with `-p, --postscript`.\n\
+\n\
+`-o, --overview`:\n\
+    Specifies that, if _INFILE_ contains reduced-resolution overview\n\
+    levels (see lfoverview(1)), the plot will be made from the\n\
+    coarsest level that still has at least as many rows and columns as\n\
+    the output, rather than from the full-resolution data.  This is\n\
+    much faster for large files, and also averages over the data\n\
+    rather than simply sampling it.  If no such level is present, then\n\
+    _INFILE_ is reopened and the full-resolution data are used;\n\
+    this is an error if the input is standard input.\n\
+\n\
+`-j, --threads=`_N_:\n\
+    Renders blocks of output rows in parallel using _N_ threads.  The\n\
+    default is the number of online processors.  This option has no\n\
+    effect if the program was compiled without thread support.\n\
+\n\
+`-f, --follow=`_N_:\n\
+    Runs in follow mode, for monitoring a file that is still being\n\
+    written.  The output is a rolling image of the most recent rows,\n\
+    whose height and width are given by `-y, --rows` and `-x,\n\
+    --cols` as usual; rows are sampled at a fixed spacing equal to the\n\
+    ratio of input to output rows (rounded to an integer).  Rows\n\
+    continue to be read past the end of the data block described in\n\
+    the header, and each row is rendered only once, as it arrives.\n\
+    After every _N_ new output rows, a complete frame is written: if\n\
+    _OUTFILE_ is named, it is written to _OUTFILE_`.part` and then\n\
+    renamed to _OUTFILE_, so that viewers never see a partial image\n\
+    (the frame is compressed or not according to the name of\n\
+    _OUTFILE_, as without this option); if writing to standard\n\
+    output, successive frames are simply concatenated\n\
+    (uncompressed).  Rows not yet received are drawn in the NaN\n\
+    colour.\n\
+\n\
+    When _INFILE_ is named, it is read directly (it must not be\n\
+    compressed), and on reaching the end of the file the program\n\
+    polls for new data.  When reading standard input, the program\n\
+    stops at end of file.  A final frame is written if there are any\n\
+    rows not yet shown.  Follow mode cannot be combined with `-o,\n\
+    --overview`.\n\
+\n\
+`-w, --wait=`_SEC_:\n\
+    In follow mode, stops after _SEC_ seconds without new data.  By\n\
+    default, a named _INFILE_ is followed indefinitely.\n\
+\n\
+## COLOUR RENDERING\n\
+\n\
+For speed, data are not mapped through the colourmap individually.\n\
+Instead, the colourmap is tabulated in advance: on a grid of 4096\n\
+evenly spaced levels spanning its finite input levels, or, when the\n\
+`-l, --log` option is given, on a grid of the linearly-scaled data\n\
+with a relative spacing of 2^-8 (0.4%), so that no logarithms need\n\
+be computed for individual pixels.  Each datum is then assigned the\n\
+colour of its nearest table entry.  This quantization is well below\n\
+the resolution of the 8-bit output colour levels for smooth\n\
+colourmaps, but may shift sharp breaks in a colourmap by up to one\n\
+table spacing.\n\
+\n\
 ## EXIT STATUS\n\
 \n\
 The proram exits with status 0 normally, 1 if there is an error\n\
@@ -195,8 +266,10 @@ incorrect syntax.\n\
 \n\
 ## SEE ALSO\n\
 \n\
+lfoverview(1),\n\
 lfbxRead(3),\n\
 lfbxWrite(3),\n\
+lfovrRead(3),\n\
 lofasm-filterbank(5)\n\
 \n";
 
@@ -207,7 +280,7 @@ lofasm-filterbank(5)\n\
 #include "markdown_parser.h"
 #include "lofasmIO.h"
 
-static const char short_opts[] = ":hHVv:y:x:z:l:s:r:c:p";
+static const char short_opts[] = ":hHVv:y:x:z:l:s:r:c:pPoj:f:w:";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -223,6 +296,11 @@ static const struct option long_opts[] = {
   { "range", 1, 0, 'r' },
   { "colourmap", 1, 0, 'c' },
   { "postscript", 0, 0, 'p' },
+  { "png", 0, 0, 'P' },
+  { "overview", 0, 0, 'o' },
+  { "threads", 1, 0, 'j' },
+  { "follow", 1, 0, 'f' },
+  { "wait", 1, 0, 'w' },
   { 0, 0, 0, 0} };
 
 static char *colour_maps[] = {
@@ -234,14 +312,426 @@ static char *colour_maps[] = {
   "rainbow", "0+1+0+0+.25+1+1+0+.5+0+1+0+.625+0+1+1+.75+0+0+1+1+.75+0+1",
   0 };
 
-#define LEN 1024 /* character buffer size */
+#define LEN 1024     /* character buffer size */
+#define NLUT 4096    /* length of linear colour lookup table */
+#define LOGSHIFT 15  /* float bits discarded when indexing log table */
+#define NBLK 64      /* number of rows rendered per block */
+#define PNGBUF 65536 /* maximum size of a PNG data chunk */
+#define POLL 250000  /* microseconds between polls in follow mode */
+
+/* Parameters for rendering a block of rows.  Each row of dat holds
+   ncol real parts followed by ncol imaginary parts (if complex); each
+   row of out holds ncol RGB triplets. */
+typedef struct {
+  int64_t ncol;             /* number of output columns */
+  int cplx;                 /* whether data are complex */
+  int z;                    /* component: 0=re, 1=im, 2=abs, 3=arg */
+  int range;                /* number of -r limits */
+  double min, max;          /* -r limits */
+  double scale, off;        /* -s scaling */
+  int logscale;             /* whether lut is indexed by float bits */
+  double lo, inv;           /* linear lut origin and inverse spacing */
+  const unsigned char *lut; /* colour lookup table */
+  double *dat;              /* block of input data */
+  unsigned char *out;       /* block of output colours */
+} plot_par;
+
+/* Range of rows to be rendered by one thread. */
+typedef struct {
+  const plot_par *par;      /* rendering parameters */
+  int64_t r0, r1;           /* range of rows [r0,r1) */
+  double ylo, yhi;          /* extrema of scaled data */
+} plot_job;
+
+/* Computes the colour of level d in colourmap cmap of length
+   clength, or cnan if d is NaN, storing it in rgb[0..2]. */
+static void
+cmap_colour( const double *cmap, int clength, const double *cnan,
+	     double d, unsigned char *rgb )
+{
+  int k, m;  /* indecies in colourmap */
+  double f;  /* fractional position within cmap */
+  if ( isnan( d ) )
+    for ( k = 0; k < 3; k++ )
+      rgb[k] = (unsigned char)( cnan[k+1] );
+  else if ( d < cmap[0] )
+    for ( k = 0; k < 3; k++ )
+      rgb[k] = (unsigned char)( cmap[k+1] );
+  else {
+    for ( m = 1; m < clength; m++ )
+      if ( d < cmap[4*m] ) {
+	f = ( d - cmap[4*m-4] )/( cmap[4*m] - cmap[4*m-4] );
+	if ( isnan( f ) )
+	  f = 1.0;
+	for ( k = 0; k < 3; k++ )
+	  rgb[k] = (unsigned char)
+	    ( ( 1.0 - f )*cmap[4*m+k-3] + f*cmap[4*m+k+1] );
+	break;
+      }
+    if ( m == clength )
+      for ( k = 0; k < 3; k++ )
+	rgb[k] = (unsigned char)( cmap[4*clength+k-3] );
+  }
+  return;
+}
+
+/* Renders rows job->r0 to job->r1 - 1, updating job->ylo and
+   job->yhi. */
+static void *
+render_rows( void *arg )
+{
+  plot_job *job = (plot_job *)arg;      /* job to be done */
+  const plot_par *p = job->par;         /* rendering parameters */
+  const unsigned char *lut = p->lut;    /* colour lookup table */
+  int64_t n = p->ncol;                  /* number of columns */
+  double ylo = job->ylo, yhi = job->yhi; /* data extrema */
+  int64_t r, j, k;                      /* indecies */
+
+  for ( r = job->r0; r < job->r1; r++ ) {
+    double *restrict y = p->dat + 2*n*r;
+    const double *restrict im = y + n;
+    unsigned char *restrict out = p->out + 3*n*r;
+
+    /* Convert to real and rescale. */
+    if ( p->cplx ) {
+      if ( p->z == 1 )
+	for ( j = 0; j < n; j++ )
+	  y[j] = im[j];
+      else if ( p->z == 2 )
+	for ( j = 0; j < n; j++ )
+	  y[j] = sqrt( y[j]*y[j] + im[j]*im[j] );
+      else if ( p->z == 3 )
+	for ( j = 0; j < n; j++ )
+	  y[j] = atan2( im[j], y[j] );
+    }
+    if ( p->range > 0 )
+      for ( j = 0; j < n; j++ )
+	y[j] = ( y[j] > p->min ? y[j] : p->min );
+    if ( p->range > 1 )
+      for ( j = 0; j < n; j++ )
+	y[j] = ( y[j] < p->max ? y[j] : p->max );
+    for ( j = 0; j < n; j++ ) {
+      y[j] = p->scale*y[j] + p->off;
+      ylo = ( y[j] < ylo ? y[j] : ylo );
+      yhi = ( y[j] > yhi ? y[j] : yhi );
+    }
+
+    /* Look up colours. */
+    if ( p->logscale )
+      for ( j = 0; j < n; j++ ) {
+	float f = y[j];
+	uint32_t u;
+	memcpy( &u, &f, sizeof(uint32_t) );
+	k = 3*( u >> LOGSHIFT );
+	out[3*j] = lut[k];
+	out[3*j+1] = lut[k+1];
+	out[3*j+2] = lut[k+2];
+      }
+    else
+      for ( j = 0; j < n; j++ ) {
+	double t = ( y[j] - p->lo )*p->inv + 0.5;
+	k = 3*( t >= 0.0 ? ( t < NLUT - 1 ? (int64_t)( t ) : NLUT - 1 ) :
+		( t < 0.0 ? 0 : NLUT ) );
+	out[3*j] = lut[k];
+	out[3*j+1] = lut[k+1];
+	out[3*j+2] = lut[k+2];
+      }
+  }
+  job->ylo = ylo;
+  job->yhi = yhi;
+  return NULL;
+}
+
+#ifndef NO_ZLIB
+/* State of a PNG image being written. */
+typedef struct {
+  FILE *fp;                  /* output file */
+  z_stream z;                /* deflate stream */
+  int64_t n;                 /* bytes per row */
+  unsigned char *prev;       /* previous (unfiltered) row */
+  unsigned char *filt;       /* row with each of the 5 filter types */
+  unsigned char buf[PNGBUF]; /* compressed data */
+} png_out;
+
+/* Stores x as a big-endian 32-bit integer. */
+static void
+png_be32( unsigned char *b, uint32_t x )
+{
+  b[0] = x >> 24;
+  b[1] = x >> 16;
+  b[2] = x >> 8;
+  b[3] = x;
+  return;
+}
+
+/* Writes a PNG chunk with the given 4-character type and data.
+   Returns 0 normally, nonzero on write errors. */
+static int
+png_chunk( FILE *fp, const char *type, const unsigned char *data,
+	   uint32_t len )
+{
+  unsigned char b[4];                 /* length or CRC bytes */
+  uLong crc = crc32( 0L, NULL, 0 );   /* chunk CRC */
+  crc = crc32( crc, (const Bytef *)type, 4 );
+  if ( len )
+    crc = crc32( crc, data, len );
+  png_be32( b, len );
+  if ( fwrite( b, 1, 4, fp ) < 4 || fwrite( type, 1, 4, fp ) < 4 ||
+       ( len && fwrite( data, 1, len, fp ) < len ) )
+    return 1;
+  png_be32( b, crc );
+  return ( fwrite( b, 1, 4, fp ) < 4 );
+}
+
+/* Passes pending input through the deflate stream with the given
+   flush mode, writing IDAT chunks as the output buffer fills.
+   Returns 0 normally, nonzero on errors. */
+static int
+png_deflate( png_out *png, int flush )
+{
+  int ret; /* return code from deflate() */
+  do {
+    if ( ( ret = deflate( &( png->z ), flush ) ) == Z_STREAM_ERROR )
+      return 1;
+    if ( png->z.avail_out == 0 ||
+	 ( ret == Z_STREAM_END && png->z.avail_out < PNGBUF ) ) {
+      if ( png_chunk( png->fp, "IDAT", png->buf,
+		      PNGBUF - png->z.avail_out ) )
+	return 1;
+      png->z.next_out = png->buf;
+      png->z.avail_out = PNGBUF;
+    }
+  } while ( png->z.avail_in > 0 ||
+	    ( flush == Z_FINISH && ret != Z_STREAM_END ) );
+  return 0;
+}
+
+/* Frees memory associated with a PNG image. */
+static void
+png_free( png_out *png )
+{
+  deflateEnd( &( png->z ) );
+  if ( png->prev )
+    free( png->prev );
+  if ( png->filt )
+    free( png->filt );
+  png->prev = png->filt = NULL;
+  return;
+}
+
+/* Writes the PNG signature and header for an 8-bit RGB image of the
+   given dimensions to fp, and sets up compression.  Returns 0
+   normally, 1 on bad dimensions, 2 on write errors, or 4 on memory
+   errors. */
+static int
+png_open( png_out *png, FILE *fp, int64_t width, int64_t height )
+{
+  unsigned char ihdr[13] = {}; /* header chunk data */
+  memset( png, 0, sizeof(png_out) );
+  if ( width < 1 || height < 1 || width > INT32_MAX ||
+       height > INT32_MAX || 3*width >= UINT32_MAX ) {
+    lf_error( "dimensions out of range for PNG" );
+    return 1;
+  }
+  png->fp = fp;
+  png->n = 3*width;
+  if ( deflateInit( &( png->z ), Z_DEFAULT_COMPRESSION ) != Z_OK ||
+       !( png->prev = (unsigned char *)calloc( png->n, 1 ) ) ||
+       !( png->filt = (unsigned char *)malloc( 5*( png->n + 1 ) ) ) ) {
+    lf_error( "memory error" );
+    png_free( png );
+    return 4;
+  }
+  png->z.next_out = png->buf;
+  png->z.avail_out = PNGBUF;
+  png_be32( ihdr, width );
+  png_be32( ihdr + 4, height );
+  ihdr[8] = 8; /* bit depth */
+  ihdr[9] = 2; /* RGB colour type */
+  if ( fwrite( "\211PNG\r\n\032\n", 1, 8, fp ) < 8 ||
+       png_chunk( fp, "IHDR", ihdr, 13 ) ) {
+    png_free( png );
+    return 2;
+  }
+  return 0;
+}
+
+/* Filters and compresses one row of RGB data, choosing for each row
+   the filter type that minimizes the sum of absolute (signed)
+   filtered bytes.  Returns 0 normally, nonzero on errors. */
+static int
+png_row( png_out *png, const unsigned char *row )
+{
+  const unsigned char *up = png->prev; /* previous row */
+  int64_t n = png->n, i;               /* row length and index */
+  uint64_t sum[5] = {}, min;           /* filtered sums and minimum */
+  int t, best = 0;                     /* filter type */
+  unsigned char *f[5];                 /* filtered rows */
+
+  for ( t = 0; t < 5; t++ ) {
+    f[t] = png->filt + t*( n + 1 );
+    *( f[t]++ ) = t;
+  }
+  for ( i = 0; i < n; i++ ) {
+    int a = ( i >= 3 ? row[i-3] : 0 );  /* left */
+    int b = up[i];                      /* above */
+    int c = ( i >= 3 ? up[i-3] : 0 );   /* above left */
+    int p = a + b - c;                  /* Paeth estimate */
+    int pa = abs( p - a ), pb = abs( p - b ), pc = abs( p - c );
+    f[0][i] = row[i];
+    f[1][i] = row[i] - a;
+    f[2][i] = row[i] - b;
+    f[3][i] = row[i] - ( ( a + b ) >> 1 );
+    f[4][i] = row[i] - ( pa <= pb && pa <= pc ? a : ( pb <= pc ? b : c ) );
+    for ( t = 0; t < 5; t++ )
+      sum[t] += abs( (signed char)( f[t][i] ) );
+  }
+  for ( min = sum[0], t = 1; t < 5; t++ )
+    if ( sum[t] < min ) {
+      min = sum[t];
+      best = t;
+    }
+  png->z.next_in = f[best] - 1;
+  png->z.avail_in = n + 1;
+  memcpy( png->prev, row, n );
+  return png_deflate( png, Z_NO_FLUSH );
+}
+
+/* Finishes compression and writes the PNG trailer, then frees
+   memory.  Returns 0 normally, nonzero on errors. */
+static int
+png_close( png_out *png )
+{
+  int err;  /* error code */
+  png->z.avail_in = 0;
+  err = png_deflate( png, Z_FINISH ) ||
+    png_chunk( png->fp, "IEND", NULL, 0 );
+  png_free( png );
+  return err;
+}
+#else
+/* Stubs for PNG output, which requires zlib. */
+typedef int png_out;
+static int
+png_open( png_out *png, FILE *fp, int64_t width, int64_t height )
+{
+  lf_error( "compiled with NO_ZLIB; PNG output not available" );
+  return 1;
+}
+static int
+png_row( png_out *png, const unsigned char *row )
+{
+  return 1;
+}
+static int
+png_close( png_out *png )
+{
+  return 1;
+}
+static void
+png_free( png_out *png )
+{
+  return;
+}
+#endif
+
+/* Writes the PostScript prolog for an image of the given size. */
+static void
+ps_header( FILE *fp, const char *name, int64_t width, int64_t height )
+{
+  fprintf( fp, "%%!PS-Adobe-3.0 EPSF-3.0\n" );
+  if ( name )
+    fprintf( fp, "%%%%Title: %s\n", name );
+  fprintf( fp, "%%%%Creator: lfplot2d\n" );
+  fprintf( fp, "%%%%Orientation: Portrait\n"
+	   "%%%%Pages: 0\n"
+	   "%%%%LanguageLevel: 2\n"
+	   "%%%%BoundingBox: 0 0 %lld %lld\n"
+	   "%%%%EndComments\n\n"
+	   "%%%%BeginProlog\n"
+	   "/raw256 {\n"
+	   "  4 -1 roll 3 1 roll exch 3 index 3 index scale\n"
+	   "  [ 4 index 0 0 6 index dup neg exch 0 exch ] exch\n"
+	   "  currentfile exch false exch colorimage\n"
+	   "} def\n"
+	   "%%%%EndProlog\n",
+	   (long long)( width ), (long long)( height ) );
+  return;
+}
+
+/* Writes a complete image from a rolling buffer img of head->dims[0]
+   rows, starting with row start and wrapping around.  Returns 0
+   normally, nonzero on errors. */
+static int
+write_image( FILE *fp, const char *name, lfb_hdr *head, int ps,
+	     int png, const unsigned char *img, int64_t start )
+{
+  int64_t nrow = head->dims[0], nout = 3*head->dims[1]; /* dimensions */
+  int64_t r;    /* row index */
+  png_out pngs; /* PNG output state */
+  if ( ps )
+    ps_header( fp, name, head->dims[1], head->dims[0] );
+  if ( png ) {
+    if ( png_open( &pngs, fp, head->dims[1], head->dims[0] ) )
+      return 1;
+    for ( r = 0; r < nrow; r++ )
+      if ( png_row( &pngs, img + ( ( start + r )%nrow )*nout ) ) {
+	png_free( &pngs );
+	return 2;
+      }
+    return png_close( &pngs );
+  }
+  return ( lfbxWrite( fp, head, NULL ) > 1 ||
+	   fwrite( img + start*nout, 1, ( nrow - start )*nout, fp )
+	   < ( nrow - start )*nout ||
+	   fwrite( img, 1, start*nout, fp ) < start*nout );
+}
+
+/* Writes a frame in follow mode: to the temporary file part, renamed
+   to outfile, if part is non-NULL, or to fp otherwise.  Since part
+   does not end in .gz, compression is set from the name of outfile.
+   Returns 0 normally, or 2 on errors. */
+static int
+write_frame( FILE *fp, const char *outfile, const char *part,
+	     lfb_hdr *head, int ps, int png, const unsigned char *img,
+	     int64_t start )
+{
+  int err;                  /* error flag */
+  size_t n;                 /* length of outfile */
+  const char *mode = "wbT"; /* lfopen() mode */
+  if ( !part ) {
+    if ( write_image( fp, "stdout", head, ps, png, img, start ) ||
+	 fflush( fp ) ) {
+      lf_error( "could not write to stdout" );
+      return 2;
+    }
+    return 0;
+  }
+  if ( !png && ( n = strlen( outfile ) ) > 3 &&
+       !strcmp( outfile + n - 3, ".gz" ) )
+    mode = "wbZ";
+  if ( !( fp = lfopen( part, mode ) ) ) {
+    lf_error( "could not open %s", part );
+    return 2;
+  }
+  err = write_image( fp, outfile, head, ps, png, img, start );
+  if ( fclose( fp ) || err ) {
+    lf_error( "could not write %s", part );
+    return 2;
+  }
+  if ( rename( part, outfile ) ) {
+    lf_error( "could not rename %s to %s", part, outfile );
+    return 2;
+  }
+  return 0;
+}
 
 int
 main( int argc, char **argv )
 {
   int opt, lopt;                      /* option character and index */
   char *infile, *outfile;             /* input/output filenames */
-  FILE *fpin, *fpout;                 /* input/output file objects */
+  FILE *fpin, *fpout = NULL;          /* input/output file objects */
   double *rowin = NULL;               /* single timestep of data read */
   double *rowdat = NULL;              /* single timestep of data parsed */
   unsigned char *rowout = NULL;       /* single timestep of output */
@@ -252,16 +742,29 @@ main( int argc, char **argv )
   double min, max;                    /* -r option */
   int range = 0;                      /* -r flag */
   int ps = 0;                         /* -p flag */
+  int png = 0;                        /* -P flag */
+  png_out pngs;                       /* PNG output state */
+  int ovr = 0;                        /* -o flag */
+  int isstd = 0;                      /* whether data is read from stdin */
+  int bits;                           /* input bit depth */
+  int nthreads = 0;                   /* -j option */
+  int64_t follow = 0;                 /* -f option */
+  double wait = -1.0;                 /* -w option */
   double *cmap, *cnan;                /* colourmap */
+  unsigned char *lut = NULL;          /* tabulated colourmap */
+  int64_t nlut;                       /* number of entries in lut */
+  plot_par par;                       /* rendering parameters */
+  plot_job jobs[NBLK];                /* rendering jobs */
   int clength, csize;                 /* current/allocated length of cmap */
   int done = 0;                       /* whether finished reading cmap */
   int cmapstd = 0;                    /* whether cmap was read from stdin */
   lfb_hdr head = {};                  /* lofasm header */
   int64_t dims[LFB_DMAX] = {};        /* saved input dimensions */
   int64_t i, iin, jin, iout, j;       /* index in infile and outfile */
+  int64_t r, nblk = 0;                /* index and number of rows in block */
   int k, m;                           /* indecies in colourmap */
-  double f;                           /* fractional position within cmap */
   double d, dmin, dmax;               /* minimum and maximum scaled values */
+  double ylo, yhi;                    /* extrema before log scaling */
   int64_t n, nin, ndat, nout;         /* data per row in infile and outfile */
   char *a, *b;                        /* pointers within a string */
   char **c;                           /* pointer to colourmaps */
@@ -345,6 +848,34 @@ main( int argc, char **argv )
     case 'p':
       ps = 1;
       break;
+    case 'P':
+#ifdef NO_ZLIB
+      lf_error( "compiled with NO_ZLIB; -P, --png not available" );
+      return 1;
+#endif
+      png = 1;
+      break;
+    case 'o':
+      ovr = 1;
+      break;
+    case 'f':
+      if ( ( follow = atoll( optarg ) ) < 1 ) {
+	lf_error( "bad argument %s to -f, --follow", optarg );
+	return 1;
+      }
+      break;
+    case 'w':
+      if ( ( wait = atof( optarg ) ) < 0.0 ) {
+	lf_error( "bad argument %s to -w, --wait", optarg );
+	return 1;
+      }
+      break;
+    case 'j':
+      if ( ( nthreads = atoi( optarg ) ) < 1 ) {
+	lf_error( "bad argument %s to -j, --threads", optarg );
+	return 1;
+      }
+      break;
     case '?':
       if ( optopt )
 	lf_error( "unknown option -%c\n\t"
@@ -374,6 +905,14 @@ main( int argc, char **argv )
   }
 
   /* Parse other arguments. */
+  if ( ps && png ) {
+    lf_error( "cannot specify both -p, --postscript and -P, --png" );
+    return 1;
+  }
+  if ( follow && ovr ) {
+    lf_error( "cannot specify both -f, --follow and -o, --overview" );
+    return 1;
+  }
   if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
     infile = NULL;
   if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
@@ -383,6 +922,18 @@ main( int argc, char **argv )
     return 1;
   }
 
+  /* Set number of threads. */
+#ifndef NO_THREADS
+  if ( nthreads < 1 && ( nthreads = sysconf( _SC_NPROCESSORS_ONLN ) ) < 1 )
+    nthreads = 1;
+#else
+  if ( nthreads > 1 )
+    lf_warning( "compiled with NO_THREADS; ignoring -j, --threads" );
+  nthreads = 1;
+#endif
+  if ( nthreads > NBLK )
+    nthreads = NBLK;
+
   /* Read colourmap. */
   if ( !( cnan = cmap = (double *)malloc( LEN*sizeof(double) ) ) ) {
     lf_error( "memory error" );
@@ -461,9 +1012,10 @@ main( int argc, char **argv )
       return 2;
     }
     infile = "stdin";
-  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    isstd = 1;
+  } else if ( !( fpin = ( follow ? fopen( infile, "rb" ) :
+			  lfopen( infile, "rb" ) ) ) ) {
     lf_error( "could not open input file %s", infile );
-    fclose( fpin );
     free( cnan );
     return 2;
   }
@@ -477,6 +1029,7 @@ main( int argc, char **argv )
 
   /* Compute output dimensions. */
   memcpy( dims, head.dims, LFB_DMAX*sizeof(int64_t) );
+  bits = lfrealBits( &head );
   head.dims[2] = 3;
   head.dims[3] = 8;
   if ( yarg ) {
@@ -499,7 +1052,7 @@ main( int argc, char **argv )
     double x = strtod( xarg + ( strchr( "x/", xarg[0] ) ? 1 : 0 ), &b );
     if ( xarg[0] == 'x' )
       x = dims[1]*x;
-    else if ( x != 0.0 && yarg[0] == '/' )
+    else if ( x != 0.0 && xarg[0] == '/' )
       x = dims[1]/x;
     x += 0.5;
     if ( b[0] || x < 1.0 || x > INT64_MAX ) {
@@ -512,24 +1065,51 @@ main( int argc, char **argv )
     head.dims[1] = (int64_t)( x );
   }
 
-  /* Check output type. */
-  if ( dims[3] != 64 ) {
-    lf_error( "require real64 data" );
+  /* Find overview level, or reopen file to get full data. */
+  if ( ovr ) {
+    lfb_hdr ohead = {}; /* overview header */
+    memcpy( ohead.dims, dims, LFB_DMAX*sizeof(int64_t) );
+    if ( ( k = lfovrRead( fpin, &ohead, head.dims[0], head.dims[1] ) )
+	 == 0 ) {
+      lf_info( "using %lldx%lld overview level",
+	       (long long)( ohead.dims[0] ), (long long)( ohead.dims[1] ) );
+      memcpy( dims, ohead.dims, LFB_DMAX*sizeof(int64_t) );
+      bits = lfrealBits( &ohead );
+    } else if ( k == 1 && !isstd ) {
+      lf_info( "no suitable overview level; using full data" );
+      fclose( fpin );
+      if ( !( fpin = lfopen( infile, "rb" ) ) ||
+	   lfbxRead( fpin, &ohead, NULL ) > 1 ) {
+	lf_error( "could not reread %s", infile );
+	k = 2;
+      }
+    } else if ( k == 1 )
+      lf_error( "no suitable overview level in %s", infile );
+    lfbxFree( &ohead );
+    if ( k == 2 || ( k == 1 && isstd ) ) {
+      if ( fpin )
+	fclose( fpin );
+      free( cnan );
+      lfbxFree( &head );
+      return 2;
+    }
+  }
+
+  /* Check input type. */
+  if ( !bits ) {
+    lf_error( "require real32 or real64 data" );
     fclose( fpin );
     free( cnan );
     lfbxFree( &head );
     return 1;
   }
   if ( head.data_type ) {
-    if ( !strstr( head.data_type, "real64" ) )
-      lf_warning( "reading as real64 not %s",
-		  head.data_type + strlen( "%data_type: " ) );
     free( head.data_type );
     head.data_type = NULL;
   }
 
   /* Allocate data. */
-  if ( dims[1] > INT64_MAX/dims[2] || head.dims[1] > INT64_MAX/3 ) {
+  if ( dims[1] > INT64_MAX/dims[2] || head.dims[1] > INT64_MAX/3/NBLK ) {
     lf_error( "dimensions out of range" );
     fclose( fpin );
     free( cnan );
@@ -539,20 +1119,70 @@ main( int argc, char **argv )
   nin = dims[1]*dims[2];
   ndat = head.dims[1]*2;
   nout = head.dims[1]*3;
+  nlut = ( base != 0.0 ? ( (int64_t)( 1 ) << ( 32 - LOGSHIFT ) ) : NLUT + 1 );
   if ( !( rowin = (double *)malloc( nin*sizeof(double) ) ) ||
-       !( rowdat = (double *)malloc( ndat*sizeof(double) ) ) ||
-       !( rowout = (unsigned char *)malloc( nout*sizeof(unsigned char) ) ) ) {
+       !( rowdat = (double *)malloc( NBLK*ndat*sizeof(double) ) ) ||
+       !( rowout = (unsigned char *)
+	  malloc( NBLK*nout*sizeof(unsigned char) ) ) ||
+       !( lut = (unsigned char *)malloc( 3*nlut*sizeof(unsigned char) ) ) ) {
     lf_error( "memory error" );
     fclose( fpin );
     if ( rowin )
       free( rowin );
     if ( rowdat )
       free( rowdat );
+    if ( rowout )
+      free( rowout );
     free( cnan );
     lfbxFree( &head );
     return 4;
   }
 
+  /* Tabulate colourmap.  The log table is indexed by the leading bits
+     of the single-precision scaled datum, so each entry is evaluated
+     at the midpoint of the values sharing those bits (or at the value
+     itself for zeros, denormals, infinities, and NaNs). */
+  memset( &par, 0, sizeof(plot_par) );
+  if ( base != 0.0 ) {
+    for ( i = 0; i < nlut; i++ ) {
+      uint32_t u = (uint32_t)( i ) << LOGSHIFT;
+      float y;
+      if ( ( u & 0x7f800000 ) && ( u & 0x7f800000 ) != 0x7f800000 )
+	u |= (uint32_t)( 1 ) << ( LOGSHIFT - 1 );
+      memcpy( &y, &u, sizeof(uint32_t) );
+      cmap_colour( cmap, clength, cnan, log( y )*base, lut + 3*i );
+    }
+    par.logscale = 1;
+  } else {
+    for ( m = 0; m < clength && isinf( cmap[4*m] ); m++ )
+      ;
+    for ( k = clength - 1; k > m && isinf( cmap[4*k] ); k-- )
+      ;
+    par.lo = ( m < clength ? cmap[4*m] : 0.0 );
+    d = ( k > m ? cmap[4*k] : par.lo );
+    if ( d <= par.lo ) {
+      par.lo -= 1.0;
+      d = par.lo + 2.0;
+    }
+    par.inv = ( NLUT - 1 )/( d - par.lo );
+    for ( i = 0; i < NLUT; i++ )
+      cmap_colour( cmap, clength, cnan, par.lo + i/par.inv, lut + 3*i );
+    cmap_colour( cmap, clength, cnan, strtod( "nan", 0 ), lut + 3*NLUT );
+  }
+  par.ncol = head.dims[1];
+  par.cplx = ( dims[2] == 2 );
+  par.z = ( !strcmp( zarg, "im" ) ? 1 :
+	    ( !strcmp( zarg, "abs" ) ? 2 :
+	      ( !strcmp( zarg, "arg" ) ? 3 : 0 ) ) );
+  par.range = range;
+  par.min = min;
+  par.max = max;
+  par.scale = scale;
+  par.off = off;
+  par.lut = lut;
+  par.dat = rowdat;
+  par.out = rowout;
+
   /* Adjust output header. */
   if ( ( a = head.data_label ) && ( b = strchr( a, '(' ) ) ) {
     if ( !( head.data_label = (char *)
@@ -573,26 +1203,128 @@ main( int argc, char **argv )
   head.data_scale = strtod( "nan", 0 );
   head.data_type = "uchar8";
 
+  /* In follow mode, render rows into a rolling image as they
+     arrive. */
+  if ( follow ) {
+    unsigned char *img;        /* rolling image */
+    char *part = NULL;         /* temporary output file name */
+    int64_t step, start = 0;   /* input rows per output row, first row */
+    int64_t nb = nin*( bits/8 ), got = 0; /* bytes per row, read */
+    int64_t nnew = 0;          /* rows since last frame */
+    double idle = 0.0;         /* seconds without new data */
+    int err = 0;               /* error code */
+    if ( ( step = ( dims[0] + head.dims[0]/2 )/head.dims[0] ) < 1 )
+      step = 1;
+    if ( !( img = (unsigned char *)malloc( head.dims[0]*nout ) ) ||
+	 ( outfile && !( part = (char *)
+			 malloc( strlen( outfile ) + strlen( ".part" ) + 1 ) ) ) ) {
+      lf_error( "memory error" );
+      err = 4;
+    } else if ( !outfile && ( isatty( 1 ) ||
+				!( fpout = lfdopen( 1, "wbT" ) ) ) ) {
+      lf_error( "could not write to stdout" );
+      err = 2;
+    }
+    if ( part ) {
+      strcpy( part, outfile );
+      strcat( part, ".part" );
+    }
+    for ( j = 0; !err && j < head.dims[0]*nout; j++ )
+      img[j] = (unsigned char)( cnan[j%3+1] );
+    jobs[0].par = &par;
+    jobs[0].r0 = 0;
+    jobs[0].r1 = 1;
+    jobs[0].ylo = strtod( "+inf", 0 );
+    jobs[0].yhi = strtod( "-inf", 0 );
+    for ( i = 0; !err; ) {
+
+      /* Read a row, polling at end of file. */
+      got += fread( (char *)( rowin ) + got, 1, nb - got, fpin );
+      if ( got < nb ) {
+	if ( ferror( fpin ) || isstd || ( wait >= 0.0 && idle >= wait ) )
+	  break;
+	clearerr( fpin );
+	usleep( POLL );
+	idle += 1.0e-6*POLL;
+	continue;
+      }
+      idle = 0.0;
+      got = 0;
+      if ( ( i++ )%step )
+	continue;
+
+      /* Widen single-precision data in place, from the end. */
+      if ( bits == 32 )
+	for ( j = nin - 1; j >= 0; j-- ) {
+	  float f;
+	  memcpy( &f, (char *)( rowin ) + j*sizeof(float), sizeof(float) );
+	  rowin[j] = f;
+	}
+
+      /* Sample, render, and store row. */
+      for ( j = 0; j < head.dims[1]; j++ ) {
+	jin = ( ( j*dims[1] )/head.dims[1] )*dims[2];
+	rowdat[j] = rowin[jin];
+	if ( par.cplx )
+	  rowdat[head.dims[1]+j] = rowin[jin+1];
+      }
+      render_rows( jobs );
+      memcpy( img + start*nout, rowout, nout );
+      start = ( start + 1 )%head.dims[0];
+
+      /* Write frame. */
+      if ( ++nnew >= follow ) {
+	err = write_frame( fpout, outfile, part, &head, ps, png, img, start );
+	lf_info( "wrote frame at input row %lld", (long long)( i ) );
+	nnew = 0;
+      }
+    }
+    if ( got > 0 )
+      lf_warning( "discarding partial row of %lld bytes", (long long)( got ) );
+
+    /* Write final frame, if needed, and clean up. */
+    if ( !err && nnew )
+      err = write_frame( fpout, outfile, part, &head, ps, png, img, start );
+    if ( !outfile && fpout )
+      fclose( fpout );
+    fclose( fpin );
+    if ( img )
+      free( img );
+    if ( part )
+      free( part );
+    free( rowin );
+    free( rowdat );
+    free( rowout );
+    free( lut );
+    free( cnan );
+    head.data_type = NULL;
+    lfbxFree( &head );
+    return err;
+  }
+
   /* Open output file. */
   if ( !outfile ) {
-    if ( isatty( 1 ) || !( fpout = lfdopen( 1, ( ps ? "wbT" : "wbZ" ) ) ) ) {
+    if ( isatty( 1 ) ||
+	 !( fpout = lfdopen( 1, ( ps || png || follow ? "wbT" : "wbZ" ) ) ) ) {
       lf_error( "could not write to stdout" );
       fclose( fpin );
       free( rowin );
       free( rowdat );
       free( rowout );
+      free( lut );
       free( cnan );
       head.data_type = NULL;
       lfbxFree( &head );
       return 2;
     }
     outfile = "stdout";
-  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+  } else if ( !( fpout = lfopen( outfile, ( png ? "wbT" : "wb" ) ) ) ) {
     lf_error( "could not open output file %s", outfile );
     fclose( fpin );
     free( rowin );
     free( rowdat );
     free( rowout );
+    free( lut );
     free( cnan );
     head.data_type = NULL;
     lfbxFree( &head );
@@ -600,138 +1332,130 @@ main( int argc, char **argv )
   }
 
   /* Write PostScript header. */
-  if ( ps ) {
-    fprintf( fpout, "%%!PS-Adobe-3.0 EPSF-3.0\n" );
-    if ( outfile )
-      fprintf( fpout, "%%%%Title: %s\n", outfile );
-    fprintf( fpout, "%%%%Creator: lfplot2d\n" );
-    fprintf( fpout, "%%%%Orientation: Portrait\n"
-	     "%%%%Pages: 0\n"
-	     "%%%%LanguageLevel: 2\n"
-	     "%%%%BoundingBox: 0 0 %lld %lld\n"
-	     "%%%%EndComments\n\n"
-	     "%%%%BeginProlog\n"
-	     "/raw256 {\n"
-	     "  4 -1 roll 3 1 roll exch 3 index 3 index scale\n"
-	     "  [ 4 index 0 0 6 index dup neg exch 0 exch ] exch\n"
-	     "  currentfile exch false exch colorimage\n"
-	     "} def\n"
-	     "%%%%EndProlog\n",
-	     (long long)( head.dims[1] ), (long long)( head.dims[0] ) );
-  }
-
-  /* Write BX output header. */
-  if ( lfbxWrite( fpout, &head, NULL ) > 1 ) {
+  if ( ps )
+    ps_header( fpout, outfile, head.dims[1], head.dims[0] );
+
+  /* Write PNG or BX output header. */
+  if ( png )
+    k = png_open( &pngs, fpout, head.dims[1], head.dims[0] );
+  else
+    k = ( lfbxWrite( fpout, &head, NULL ) > 1 ? 2 : 0 );
+  head.data_type = NULL;
+  if ( k ) {
     lf_error( "error writing header to %s", outfile );
     fclose( fpout );
     fclose( fpin );
     free( rowin );
     free( rowdat );
     free( rowout );
+    free( lut );
     free( cnan );
     lfbxFree( &head );
-    return 2;
+    return k;
   }
-  head.data_type = NULL;
 
   /* Set up extrema. */
-  dmin = strtod( "+inf", 0 );
-  dmax = strtod( "-inf", 0 );
+  ylo = strtod( "+inf", 0 );
+  yhi = strtod( "-inf", 0 );
 
-  /* Step through files. */
+  /* Step through blocks of output rows. */
   i = -1;
-  for ( iout = 0; iout < head.dims[0]; iout++ ) {
-
-    /* Read row. */
-    iin = ( iout*dims[0] )/head.dims[0];
-    if ( !feof( fpin ) ) {
-      for ( ; i < iin; i++ )
-	if ( ( n = fread( rowin, sizeof(double), nin, fpin ) ) < nin ) {
-	  lf_warning( "read %lld numbers from %s, expected %lld",
-		      (long long)( ( i + 1 )*nin + n ), infile,
-		      (long long)( dims[0]*nin ) );
-	  memset( rowin + n, 0, ( nin - n )*sizeof(double) );
-	}
-    } else
-      memset( rowin, 0, nin*sizeof(double) );
-    for ( j = 0; j < head.dims[1]; j++ ) {
-      jin = ( j*dims[1] )/head.dims[1];
-      memcpy( rowdat + j*2, rowin + jin*dims[2], dims[2]*sizeof(double) );
-    }
+  for ( iout = 0; iout < head.dims[0]; iout += nblk ) {
+    nblk = ( head.dims[0] - iout < NBLK ? head.dims[0] - iout : NBLK );
 
-    /* Apply transformations. */
-    if ( dims[2] == 2 ) {
-      if ( !strcmp( zarg, "im" ) )
-	for ( j = 0; j < head.dims[1]; j++ )
-	  rowdat[2*j] = rowdat[2*j+1];
-      else if ( !strcmp( zarg, "abs" ) )
-	for ( j = 0; j < head.dims[1]; j++ )
-	  rowdat[2*j] = hypot( rowdat[2*j], rowdat[2*j+1] );
-      else if ( !strcmp( zarg, "arg" ) )
-	for ( j = 0; j < head.dims[1]; j++ )
-	  rowdat[2*j] = atan2( rowdat[2*j+1], rowdat[2*j] );
-    }
-    if ( range > 0 )
-      for ( j = 0; j < head.dims[1]; j++ )
-	if ( !( rowdat[2*j] > min ) )
-	  rowdat[2*j] = min;
-    if ( range > 1 )
-      for ( j = 0; j < head.dims[1]; j++ )
-	if ( !( rowdat[2*j] < max ) )
-	  rowdat[2*j] = max;
-    if ( scale != 1.0 || off != 0.0 )
-      for ( j = 0; j < head.dims[1]; j++ )
-	rowdat[2*j] = scale*rowdat[2*j] + off;
-    if ( base != 0.0 )
-      for ( j = 0; j < head.dims[1]; j++ )
-	rowdat[2*j] = log( rowdat[2*j] )*base;
-
-    /* Compute colour. */
-    for ( j = 0; j < head.dims[1]; j++ ) {
-      if ( ( d = rowdat[2*j] ) < dmin )
-	dmin = d;
-      if ( d > dmax )
-	dmax = d;
-      if ( isnan( d ) )
-	for ( k = 0; k < 3; k++ )
-	  rowout[3*j+k] = (unsigned char)( cnan[k+1] );
-      else if ( d < cmap[0] )
-	for ( k = 0; k < 3; k++ )
-	  rowout[3*j+k] = (unsigned char)( cmap[k+1] );
-      else {
-	for ( m = 1; m < clength; m++ )
-	  if ( d < cmap[4*m] ) {
-	    f = ( d - cmap[4*m-4] )/( cmap[4*m] - cmap[4*m-4] );
-	    for ( k = 0; k < 3; k++ )
-	      rowout[3*j+k] = (unsigned char)
-		( ( 1.0 - f )*cmap[4*m+k-3] + f*cmap[4*m+k+1] );
-	    break;
+    /* Read and sample rows. */
+    for ( r = 0; r < nblk; r++ ) {
+      double *y = rowdat + r*ndat; /* real parts */
+      double *im = y + head.dims[1]; /* imaginary parts */
+      iin = ( ( iout + r )*dims[0] )/head.dims[0];
+      if ( !feof( fpin ) ) {
+	for ( ; i < iin; i++ )
+	  if ( ( n = lfrealRead( rowin, bits, nin, fpin ) ) < nin ) {
+	    lf_warning( "read %lld numbers from %s, expected %lld",
+			(long long)( ( i + 1 )*nin + n ), infile,
+			(long long)( dims[0]*nin ) );
+	    memset( rowin + n, 0, ( nin - n )*sizeof(double) );
 	  }
-	if ( m == clength )
-	  for ( k = 0; k < 3; k++ )
-	    rowout[3*j+k] = (unsigned char)( cmap[4*clength+k-3] );
+      } else
+	memset( rowin, 0, nin*sizeof(double) );
+      for ( j = 0; j < head.dims[1]; j++ ) {
+	jin = ( ( j*dims[1] )/head.dims[1] )*dims[2];
+	y[j] = rowin[jin];
+	if ( par.cplx )
+	  im[j] = rowin[jin+1];
       }
     }
 
-    /* Write line out. */
-    if ( fwrite( rowout, sizeof(unsigned char), nout, fpout ) < nout ) {
+    /* Render rows, in parallel if possible. */
+    for ( k = 0; k < nthreads; k++ ) {
+      jobs[k].par = &par;
+      jobs[k].r0 = ( k*nblk )/nthreads;
+      jobs[k].r1 = ( ( k + 1 )*nblk )/nthreads;
+      jobs[k].ylo = ylo;
+      jobs[k].yhi = yhi;
+    }
+    lfthreadRun( render_rows, jobs, sizeof(*jobs), nthreads );
+    for ( k = 0; k < nthreads; k++ ) {
+      if ( jobs[k].ylo < ylo )
+	ylo = jobs[k].ylo;
+      if ( jobs[k].yhi > yhi )
+	yhi = jobs[k].yhi;
+    }
+
+    /* Write lines out. */
+    if ( png ) {
+      for ( r = 0; r < nblk && !png_row( &pngs, rowout + r*nout ); r++ )
+	;
+      k = ( r < nblk );
+    } else
+      k = ( fwrite( rowout, sizeof(unsigned char), nblk*nout, fpout )
+	    < nblk*nout );
+    if ( k ) {
       lf_error( "error writing to %s", outfile );
+      if ( png )
+	png_free( &pngs );
       fclose( fpout );
       fclose( fpin );
       free( rowin );
       free( rowdat );
       free( rowout );
+      free( lut );
       free( cnan );
       lfbxFree( &head );
       return 2;
     }
   }
+  if ( base != 0.0 ) {
+    dmin = log( ylo )*base;
+    dmax = log( yhi )*base;
+    if ( dmin > dmax ) {
+      d = dmin;
+      dmin = dmax;
+      dmax = d;
+    }
+  } else {
+    dmin = ylo;
+    dmax = yhi;
+  }
   lf_info( "scaled data: [%g,%g]", dmin, dmax );
+  if ( png && png_close( &pngs ) ) {
+    lf_error( "error writing to %s", outfile );
+    fclose( fpout );
+    fclose( fpin );
+    free( rowin );
+    free( rowdat );
+    free( rowout );
+    free( lut );
+    free( cnan );
+    lfbxFree( &head );
+    return 2;
+  }
   fclose( fpout );
   fclose( fpin );
   free( rowin );
   free( rowdat );
   free( rowout );
+  free( lut );
   free( cnan );
   lfbxFree( &head );
   return 0;
@@ -0,0 +1,604 @@
+static const char *version = "\
+lfpower version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Compute power spectra of each column of a LoFASM file.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -n, --length=NFFT      transform length in rows (a power of 2)\n\
+  -k, --harmonics=NH     sum up to NH harmonics (a power of 2, default 1)\n\
+  -r, --raw              do not normalize spectra\n\
+  -j, --threads=N        compute using N threads\n\
+\n";
+
+static const char *description = "\
+# lfpower(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfpower(1)` - compute power spectra of a lofasm-filterbank(5) file\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfpower` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program computes the power spectrum of the time series in each\n\
+column of a lofasm-filterbank(5) file _INFILE_, for finding periodic\n\
+signals such as pulsars or periodic interference, and writes them to\n\
+_OUTFILE_ as a lofasm-filterbank(5) file whose dimension 1 is\n\
+fluctuation frequency (in Hz) rather than time.  Dimension 2 is\n\
+unchanged, so the columns may be frequency channels of a spectrogram\n\
+or dedispersed time series from lfdedisp(1).  If _INFILE_ or _OUTFILE_\n\
+is not specified, or is a single `-` character, then standard input or\n\
+standard output is used instead.\n\
+\n\
+The input is read in segments of _NFFT_ rows, which are transposed\n\
+into one time series per column.  The mean of each series is\n\
+subtracted, and its discrete Fourier transform computed with an\n\
+in-tree radix-2 FFT (see lfftPlan(3)); since the series are real, two\n\
+columns are transformed at once as the real and imaginary parts of a\n\
+single complex transform, and then separated.  The squared magnitudes\n\
+are averaged over all segments, giving _NFFT_/2+1 frequencies from\n\
+zero to the Nyquist frequency; any rows left over after the last full\n\
+segment are ignored.  The columns are divided among several threads.\n\
+\n\
+Unless `-r, --raw` is given, each column's spectrum is then divided by\n\
+its mean as estimated from the median (excluding zero frequency),\n\
+allowing for the skewed distribution of powers summed over a given\n\
+number of segments, so that white noise has a mean power of 1 in\n\
+every column, and spectral lines appear as powers well above 1\n\
+regardless of the column's noise level.\n\
+\n\
+Pulsars and other non-sinusoidal periodic signals spread their power\n\
+over many harmonics.  With `-k, --harmonics`=_NH_, the output has\n\
+log2(_NH_)+1 planes in dimension 3: plane _p_ holds the incoherent sum\n\
+of the powers at frequencies _f_, 2 _f_, ..., 2^_p_ _f_, for each\n\
+fundamental frequency _f_ (harmonics above the Nyquist frequency are\n\
+omitted).  Thus plane 0 is the ordinary power spectrum.\n\
+\n\
+The data may be stored as `real32` or `real64`, with one component per\n\
+column; the output is stored with the same type as the input.  Memory\n\
+usage is proportional to _NFFT_ times the number of columns.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-n, --length=`_NFFT_:\n\
+    Sets the length of each transformed segment, in rows, which must\n\
+    be a power of 2 no larger than the number of rows.  The default is\n\
+    the largest power of 2 not exceeding the number of rows or 65536.\n\
+\n\
+`-k, --harmonics=`_NH_:\n\
+    Sets the largest number of harmonics to sum, which must be a power\n\
+    of 2.  The default is `1` (no harmonic summing).\n\
+\n\
+`-r, --raw`:\n\
+    Writes the averaged squared magnitudes of the Fourier transforms,\n\
+    divided by _NFFT_, without normalizing each column.\n\
+\n\
+`-j, --threads=`_N_:\n\
+    Computes the transforms using _N_ threads.  By default, one thread\n\
+    per online processor is used.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfdedisp(1),\n\
+lfmean(1),\n\
+lfftPlan(3),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+#include "lfft.h"
+
+static const char short_opts[] = "hHVv:n:k:rj:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "length", 1, 0, 'n' },
+  { "harmonics", 1, 0, 'k' },
+  { "raw", 0, 0, 'r' },
+  { "threads", 1, 0, 'j' },
+  { 0, 0, 0, 0} };
+
+#define NTHR 64       /* maximum number of threads */
+#define NMAX 65536    /* maximum default transform length */
+
+/* Parameters for transforming one segment.  Column j of the segment
+   is stored in seg[j*nfft] through seg[j*nfft+nfft-1], and its power
+   is accumulated in pow[j*nfreq] through pow[j*nfreq+nfreq-1]. */
+typedef struct {
+  const lfft_plan *plan;    /* FFT plan */
+  int64_t nfft, nfreq;      /* transform length and number of powers */
+  int64_t ncol;             /* number of columns */
+  const double *seg;        /* transposed segment */
+  double *pow;              /* accumulated powers */
+} power_par;
+
+/* Range of column pairs to be transformed by one thread. */
+typedef struct {
+  const power_par *par;     /* transform parameters */
+  int64_t p0, p1;           /* range of column pairs [p0,p1) */
+  double *z;                /* FFT workspace */
+} power_job;
+
+
+/* Transforms column pairs job->p0 to job->p1 - 1, adding their powers
+   to the accumulators.  Columns 2p and 2p+1 are the real and
+   imaginary parts of one complex series z, whose transform Z gives
+   the two real transforms as (Z[k] + conj(Z[n-k]))/2 and
+   (Z[k] - conj(Z[n-k]))/2i. */
+static void *
+power_pairs( void *arg )
+{
+  power_job *job = (power_job *)arg; /* job to be done */
+  const power_par *p = job->par;     /* transform parameters */
+  int64_t n = p->nfft;               /* transform length */
+  int64_t c, k, t;                   /* column and indecies */
+  double *z = job->z;                /* workspace */
+  double m0, m1;                     /* means of the two series */
+  double ar, ai, br, bi;             /* Z[k] and conj(Z[n-k]) */
+  double norm = 0.25/n;              /* normalization of powers */
+
+  for ( c = 2*job->p0; c < 2*job->p1 && c < p->ncol; c += 2 ) {
+    const double *x0 = p->seg + c*n;
+    const double *x1 = ( c + 1 < p->ncol ? x0 + n : NULL );
+    double *pw0 = p->pow + c*p->nfreq;
+    double *pw1 = pw0 + p->nfreq;
+
+    /* Load series with means removed. */
+    for ( t = 0, m0 = m1 = 0.0; t < n; t++ ) {
+      m0 += x0[t];
+      m1 += ( x1 ? x1[t] : 0.0 );
+    }
+    m0 /= n;
+    m1 /= n;
+    for ( t = 0; t < n; t++ ) {
+      z[2*t] = x0[t] - m0;
+      z[2*t+1] = ( x1 ? x1[t] - m1 : 0.0 );
+    }
+    lfftForward( p->plan, z );
+
+    /* Separate and accumulate powers. */
+    for ( k = 0; k < p->nfreq; k++ ) {
+      t = ( n - k ) % n;
+      ar = z[2*k];
+      ai = z[2*k+1];
+      br = z[2*t];
+      bi = -z[2*t+1];
+      pw0[k] += norm*( ( ar + br )*( ar + br ) + ( ai + bi )*( ai + bi ) );
+      if ( x1 )
+	pw1[k] += norm*( ( ai - bi )*( ai - bi ) + ( ar - br )*( ar - br ) );
+    }
+  }
+  return NULL;
+}
+
+
+/* Returns the median of a gamma distribution with shape k and unit
+   scale, which describes the sum of k independent unit-mean
+   exponential powers.  Small k are solved by bisection on the
+   Poisson sum for the upper tail, large k from the asymptotic series
+   k - 1/3 + 8/(405k) + 184/(25515k^2) (Choi 1994). */
+static double
+gamma_median( int64_t k )
+{
+  double lo = k - 1.0, hi = k, x, t, q; /* bracket, midpoint, terms */
+  int64_t i, n;                         /* indecies */
+
+  if ( k > 100 )
+    return k - 1.0/3.0 + 8.0/( 405.0*k ) + 184.0/( 25515.0*k*k );
+  for ( n = 0; n < 60; n++ ) {
+    x = 0.5*( lo + hi );
+    for ( i = 1, t = q = exp( -x ); i < k; i++ )
+      q += ( t *= x/i );
+    if ( q > 0.5 )
+      lo = x;
+    else
+      hi = x;
+  }
+  return 0.5*( lo + hi );
+}
+
+
+/* Returns the kth smallest of n values in a, partially reordering
+   them (Hoare's selection algorithm). */
+static double
+select_kth( double *a, int64_t n, int64_t k )
+{
+  int64_t lo = 0, hi = n - 1, i, j; /* partition limits and indecies */
+  double p, t;                     /* pivot and temporary */
+
+  while ( lo < hi ) {
+    p = a[ lo + ( hi - lo )/2 ];
+    for ( i = lo, j = hi; i <= j; ) {
+      while ( a[i] < p )
+	i++;
+      while ( a[j] > p )
+	j--;
+      if ( i <= j ) {
+	t = a[i];
+	a[i++] = a[j];
+	a[j--] = t;
+      }
+    }
+    if ( k <= j )
+      hi = j;
+    else if ( k >= i )
+      lo = i;
+    else
+      break;
+  }
+  return a[k];
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  if ( seg ) free( seg ); \
+  if ( pow ) free( pow ); \
+  if ( row ) free( row ); \
+  if ( work ) free( work ); \
+  lfftFree( plan ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  FILE *fpin = NULL, *fpout = NULL; /* input/output file pointers */
+  long long nfft = 0;       /* transform length */
+  long long nh = 1;         /* number of harmonics */
+  int raw = 0;              /* whether to skip normalization */
+  int nthreads = 0;         /* number of threads */
+  int npl;                  /* number of harmonic-sum planes */
+  lfb_hdr head = {};        /* file header */
+  int bits;                 /* bit depth of data (32 or 64) */
+  int64_t nin, ncol, nfreq; /* input rows, columns, output rows */
+  int64_t nseg, npair;      /* number of segments and column pairs */
+  int64_t i, j, k, s, t;    /* indecies */
+  int p;                    /* plane index */
+  double dt, norm;          /* sample interval, and normalization */
+  double ratio = 1.0;       /* mean/median of summed white noise powers */
+  double *seg = NULL;       /* transposed segment */
+  double *pow = NULL;       /* accumulated powers */
+  double *row = NULL;       /* input or output row */
+  double *work = NULL;      /* FFT workspaces */
+  lfft_plan *plan = NULL;   /* FFT plan */
+  power_par par;            /* transform parameters */
+  power_job jobs[NTHR];     /* threads' work */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'n':
+      if ( ( nfft = strtoll( optarg, &end, 10 ) ) < 2 || *end ||
+	   ( nfft & ( nfft - 1 ) ) ) {
+	lf_error( "bad -n, --length argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'k':
+      if ( ( nh = strtoll( optarg, &end, 10 ) ) < 1 || *end ||
+	   ( nh & ( nh - 1 ) ) ) {
+	lf_error( "bad -k, --harmonics argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'r':
+      raw = 1;
+      break;
+    case 'j':
+      if ( ( nthreads = atoi( optarg ) ) < 1 ) {
+	lf_error( "bad argument %s to -j, --threads", optarg );
+	return 1;
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+  for ( npl = 1; ( 1LL << ( npl - 1 ) ) < nh; npl++ )
+    ;
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Set number of threads. */
+#ifndef NO_THREADS
+  if ( nthreads < 1 && ( nthreads = sysconf( _SC_NPROCESSORS_ONLN ) ) < 1 )
+    nthreads = 1;
+#else
+  if ( nthreads > 1 )
+    lf_warning( "compiled with NO_THREADS; ignoring -j, --threads" );
+  nthreads = 1;
+#endif
+  if ( nthreads > NTHR )
+    nthreads = NTHR;
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  if ( head.dims[2] != 1 ) {
+    lf_error( "requires one component per column" );
+    CLEANEXIT( 3 );
+  }
+  nin = head.dims[0];
+  ncol = head.dims[1];
+  dt = head.dim1_span/nin;
+
+  /* Set transform length. */
+  if ( nfft < 1 )
+    for ( nfft = 2; 2*nfft <= nin && 2*nfft <= NMAX; nfft *= 2 )
+      ;
+  if ( nfft > nin ) {
+    lf_error( "transform length %lld exceeds length %lld", nfft,
+	      (long long)( nin ) );
+    CLEANEXIT( 1 );
+  }
+  nseg = nin/nfft;
+  nfreq = nfft/2 + 1;
+  npair = ( ncol + 1 )/2;
+  if ( nthreads > npair )
+    nthreads = npair;
+  if ( nseg*nfft < nin )
+    lf_info( "ignoring last %lld rows", (long long)( nin - nseg*nfft ) );
+
+  /* Allocate storage. */
+  if ( !( plan = lfftPlan( nfft ) ) ||
+       !( seg = (double *)malloc( ncol*nfft*sizeof(double) ) ) ||
+       !( pow = (double *)calloc( ncol*nfreq, sizeof(double) ) ) ||
+       !( row = (double *)malloc( ( ncol*npl > nfreq ? ncol*npl : nfreq )*
+				  sizeof(double) ) ) ||
+       !( work = (double *)malloc( nthreads*2*nfft*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  par.plan = plan;
+  par.nfft = nfft;
+  par.nfreq = nfreq;
+  par.ncol = ncol;
+  par.seg = seg;
+  par.pow = pow;
+  for ( k = 0; k < nthreads; k++ ) {
+    jobs[k].par = &par;
+    jobs[k].p0 = ( k*npair )/nthreads;
+    jobs[k].p1 = ( ( k + 1 )*npair )/nthreads;
+    jobs[k].z = work + 2*k*nfft;
+  }
+
+  /* Read and transform each segment. */
+  for ( s = 0; s < nseg; s++ ) {
+    for ( t = 0; t < nfft; t++ ) {
+      if ( ( j = lfrealRead( row, bits, ncol, fpin ) ) < ncol ) {
+	lf_warning( "read %lld data from %s, expected %lld",
+		    (long long)( ( s*nfft + t )*ncol + j ), infile,
+		    (long long)( nin*ncol ) );
+	break;
+      }
+      for ( j = 0; j < ncol; j++ )
+	seg[ j*nfft + t ] = row[j];
+    }
+    if ( t < nfft ) {
+      lf_info( "ignoring incomplete segment %lld", (long long)( s ) );
+      break;
+    }
+    lfthreadRun( power_pairs, jobs, sizeof(*jobs), nthreads );
+  }
+  if ( ( nseg = s ) < 1 ) {
+    lf_error( "no complete segment in %s", infile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Average over segments, and normalize each column by its mean as
+     estimated from the median.  For white noise each summed power is
+     a sum of nseg exponential variates, whose median is gamma_median(
+     nseg ) times their mean (ln(2) for a single segment). */
+  if ( !raw )
+    ratio = nseg/gamma_median( nseg );
+  for ( j = 0; j < ncol; j++ ) {
+    double *pw = pow + j*nfreq;
+    norm = 1.0/nseg;
+    if ( !raw && nfreq > 1 ) {
+      memcpy( row, pw + 1, ( nfreq - 1 )*sizeof(double) );
+      norm = select_kth( row, nfreq - 1, ( nfreq - 1 )/2 )*ratio;
+      norm = ( norm > 0.0 ? 1.0/norm : 0.0 );
+    }
+    for ( i = 0; i < nfreq; i++ )
+      pw[i] *= norm;
+  }
+
+  /* Write output file header. */
+  head.dim1_start = 0.0;
+  head.dim1_span = nfreq/( nfft*dt );
+  if ( head.dim1_label )
+    free( head.dim1_label );
+  if ( !( head.dim1_label = strdup( "fluctuation frequency (Hz)" ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  if ( npl > 1 || !raw ) {
+    char *label = head.data_label; /* old data label */
+    if ( !( head.data_label = (char *)malloc( ( label ? strlen( label ) : 4 )
+					      + 64 ) ) ) {
+      lf_error( "memory error" );
+      head.data_label = label;
+      CLEANEXIT( 4 );
+    }
+    sprintf( head.data_label, "%s%s of %s",
+	     ( raw ? "power" : "normalized power" ),
+	     ( npl > 1 ? " harmonic sums" : "" ), ( label ? label : "data" ) );
+    if ( label )
+      free( label );
+  }
+  head.dims[0] = nfreq;
+  head.dims[2] = npl;
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Write powers and harmonic sums, one fundamental frequency per
+     row.  Plane p adds harmonics 2^(p-1)+1 through 2^p to plane
+     p - 1. */
+  for ( i = 0; i < nfreq; i++ ) {
+    for ( j = 0; j < ncol; j++ ) {
+      const double *pw = pow + j*nfreq;
+      double sum = pw[i];
+      row[j*npl] = sum;
+      for ( p = 1, k = 2; p < npl; p++ ) {
+	for ( ; k <= ( 1LL << p ) && k*i < nfreq; k++ )
+	  sum += pw[k*i];
+	k = ( 1LL << p ) + 1;
+	row[ j*npl + p ] = sum;
+      }
+    }
+    if ( lfrealWrite( row, bits, ncol*npl, fpout ) < ncol*npl ) {
+      lf_error( "could not write data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+  }
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
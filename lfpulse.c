@@ -0,0 +1,647 @@
+static const char *version = "\
+lfpulse version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Search a LoFASM file for single pulses.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -w, --widths=W1[,...]  boxcar widths to search (default 1,2,4,...,64)\n\
+  -s, --snr=THRESH       report events above THRESH (default 6)\n\
+  -b, --block=NROW       rows per block for noise statistics (default 4096)\n\
+  -g, --gap=NROW         join events separated by up to NROW rows\n\
+  -a, --all              list every event, without clustering\n\
+\n";
+
+static const char *description = "\
+# lfpulse(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfpulse(1)` - search a lofasm-filterbank(5) file for single pulses\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfpulse` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program searches each column of a lofasm-filterbank(5) file\n\
+_INFILE_ for short bright pulses, and writes a list of candidates to\n\
+_OUTFILE_ as text.  Typically _INFILE_ is the output of lfdedisp(1),\n\
+so that each column is a dedispersed time series at one dispersion\n\
+measure, but the columns may equally be the raw frequency channels\n\
+of a spectrogram.  If _INFILE_ or _OUTFILE_ is not specified, or is a\n\
+single `-` character, then standard input or standard output is used\n\
+instead.\n\
+\n\
+The search is a matched filter with boxcars of several widths.  The\n\
+data are read in blocks of rows; in each block, the median and the\n\
+median absolute deviation (scaled to a Gaussian standard deviation)\n\
+of each column are used as robust estimates of its noise level.  The\n\
+signal-to-noise ratio of a boxcar of width _W_ starting at row _N_ is\n\
+then the sum of the median-subtracted data in rows _N_ through\n\
+_N_+_W_-1, divided by the standard deviation times sqrt(_W_).\n\
+Non-finite data are replaced by the column median.  The sums are\n\
+computed as differences of cumulative sums, so each width costs one\n\
+subtraction per datum regardless of its length, and the loops run\n\
+across the columns of each row so that the compiler can vectorize\n\
+them.  Successive blocks overlap by the largest width less one, so\n\
+pulses straddling a block boundary are not missed.\n\
+\n\
+At each row and column, the width giving the largest signal-to-noise\n\
+ratio is kept, and reported as an event if it exceeds the threshold.\n\
+A bright pulse produces many events, at neighbouring times, widths,\n\
+and dispersion measures; unless `-a, --all` is given, these are\n\
+grouped into clusters, and only the brightest event of each cluster\n\
+is listed.  Events in the same column are joined if their boxcars\n\
+overlap or are separated by no more than `-g, --gap` rows; these runs\n\
+are then joined across adjacent columns if their time spans overlap\n\
+(within the same gap).\n\
+\n\
+The output is a text table, with a commented header, listing one\n\
+candidate per line in order of time.  The fields are the time of the\n\
+start of the boxcar (from the dimension 1 axis), the coordinate of\n\
+the column (from the dimension 2 axis: the dispersion measure for\n\
+lfdedisp(1) output), the signal-to-noise ratio, the boxcar width in\n\
+rows, the row and column indecies, the number of events in the\n\
+cluster, and the first and last columns of the cluster.\n\
+\n\
+The data may be stored as `real32` or `real64`, and must have one\n\
+component per column.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-w, --widths=`_W1_[`,`...]:\n\
+    Sets the boxcar widths to search, as a comma-separated list of\n\
+    positive integers.  The default is `1,2,4,8,16,32,64`.\n\
+\n\
+`-s, --snr=`_THRESH_:\n\
+    Sets the signal-to-noise threshold for reporting events.  The\n\
+    default is `6`.\n\
+\n\
+`-b, --block=`_NROW_:\n\
+    Sets the number of rows over which the noise statistics are\n\
+    estimated, which should be long compared to the widest boxcar but\n\
+    short compared to any drifts in the noise level.  The default is\n\
+    `4096`.\n\
+\n\
+`-g, --gap=`_NROW_:\n\
+    Joins events into the same cluster if they are separated in time\n\
+    by no more than _NROW_ rows.  The default is `0`: only overlapping\n\
+    or adjacent boxcars are joined.\n\
+\n\
+`-a, --all`:\n\
+    Lists every event above threshold, without clustering.  The last\n\
+    three fields are then `1` and the event's own column.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfdedisp(1),\n\
+lfstats(1),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:w:s:b:g:a";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "widths", 1, 0, 'w' },
+  { "snr", 1, 0, 's' },
+  { "block", 1, 0, 'b' },
+  { "gap", 1, 0, 'g' },
+  { "all", 0, 0, 'a' },
+  { 0, 0, 0, 0} };
+
+#define NWID 64      /* maximum number of boxcar widths */
+#define MADSIG 1.4826 /* ratio of standard deviation to MAD for Gaussian */
+
+/* Event above threshold. */
+typedef struct {
+  int64_t row, col;  /* starting row and column */
+  int64_t width;     /* boxcar width */
+  double snr;        /* signal-to-noise ratio */
+  int64_t run;       /* run containing event, then cluster */
+} lfp_event;
+
+/* Run of overlapping events within one column.  For the root run of
+   a cluster, the last four fields summarize the whole cluster. */
+typedef struct {
+  int64_t col;       /* column */
+  int64_t t0, t1;    /* span of rows [t0,t1) */
+  int64_t parent;    /* parent run in cluster tree */
+  int64_t best;      /* index of brightest event */
+  int64_t nev;       /* number of events */
+  int64_t c0, c1;    /* range of columns */
+} lfp_run;
+
+
+/* Comparison function for sorting events by column then row. */
+static int
+by_col( const void *a, const void *b )
+{
+  const lfp_event *x = (const lfp_event *)a, *y = (const lfp_event *)b;
+  if ( x->col != y->col )
+    return ( x->col < y->col ? -1 : 1 );
+  return ( x->row < y->row ? -1 : ( x->row > y->row ? 1 : 0 ) );
+}
+
+
+/* Comparison function for sorting events by row then column. */
+static int
+by_row( const void *a, const void *b )
+{
+  const lfp_event *x = (const lfp_event *)a, *y = (const lfp_event *)b;
+  if ( x->row != y->row )
+    return ( x->row < y->row ? -1 : 1 );
+  return ( x->col < y->col ? -1 : ( x->col > y->col ? 1 : 0 ) );
+}
+
+
+/* Returns the kth smallest of n values in a, partially reordering
+   them (Hoare's selection algorithm). */
+static double
+select_kth( double *a, int64_t n, int64_t k )
+{
+  int64_t lo = 0, hi = n - 1, i, j; /* partition limits and indecies */
+  double p, t;                     /* pivot and temporary */
+
+  while ( lo < hi ) {
+    p = a[ lo + ( hi - lo )/2 ];
+    for ( i = lo, j = hi; i <= j; ) {
+      while ( a[i] < p )
+	i++;
+      while ( a[j] > p )
+	j--;
+      if ( i <= j ) {
+	t = a[i];
+	a[i++] = a[j];
+	a[j--] = t;
+      }
+    }
+    if ( k <= j )
+      hi = j;
+    else if ( k >= i )
+      lo = i;
+    else
+      break;
+  }
+  return a[k];
+}
+
+
+/* Finds the root run of a cluster, compressing the path. */
+static int64_t
+find_root( lfp_run *run, int64_t i )
+{
+  int64_t r = i, k; /* root, and next run on path */
+  while ( run[r].parent != r )
+    r = run[r].parent;
+  while ( run[i].parent != r ) {
+    k = run[i].parent;
+    run[i].parent = r;
+    i = k;
+  }
+  return r;
+}
+
+
+/* Groups n events into clusters, as described in the man page, using
+   run as workspace for up to n runs.  The events are sorted by column
+   then row, and on return ev[i].run is the same for all events in a
+   cluster and distinct between clusters. */
+static void
+cluster( lfp_event *ev, lfp_run *run, int64_t n, int64_t gap )
+{
+  int64_t i, j, k, a, b, nrun; /* indecies, and number of runs */
+
+  /* Join events into runs within each column. */
+  qsort( ev, n, sizeof(lfp_event), by_col );
+  for ( i = nrun = 0; i < n; i++ ) {
+    if ( nrun == 0 || ev[i].col != run[nrun-1].col ||
+	 ev[i].row > run[nrun-1].t1 + gap ) {
+      run[nrun].col = ev[i].col;
+      run[nrun].t0 = ev[i].row;
+      run[nrun].t1 = ev[i].row + ev[i].width;
+      run[nrun].parent = nrun;
+      nrun++;
+    } else if ( ev[i].row + ev[i].width > run[nrun-1].t1 )
+      run[nrun-1].t1 = ev[i].row + ev[i].width;
+    ev[i].run = nrun - 1;
+  }
+
+  /* Join runs in adjacent columns whose spans overlap.  Runs within a
+     column are disjoint and in order, so each pair of columns is
+     swept together, advancing whichever run ends first. */
+  for ( i = 0; i < nrun; i = k ) {
+    for ( k = i; k < nrun && run[k].col == run[i].col; k++ )
+      ;
+    if ( k == nrun || run[k].col != run[i].col + 1 )
+      continue;
+    for ( j = k; j < nrun && run[j].col == run[k].col; j++ )
+      ;
+    for ( a = i, b = k; a < k && b < j; ) {
+      if ( run[a].t0 <= run[b].t1 + gap && run[b].t0 <= run[a].t1 + gap )
+	run[ find_root( run, b ) ].parent = find_root( run, a );
+      if ( run[a].t1 <= run[b].t1 )
+	a++;
+      else
+	b++;
+    }
+  }
+  for ( i = 0; i < n; i++ )
+    ev[i].run = find_root( run, ev[i].run );
+  return;
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout && fpout != stdout ) fclose( fpout ); \
+  if ( dat ) free( dat ); \
+  if ( ev ) free( ev ); \
+  if ( run ) free( run ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  FILE *fpin = NULL, *fpout = NULL; /* input/output file pointers */
+  int64_t width[NWID] = { 1, 2, 4, 8, 16, 32, 64 }; /* boxcar widths */
+  int nwid = 7, w;          /* number of widths, and index */
+  int64_t wmax;             /* largest width */
+  double thresh = 6.0;      /* signal-to-noise threshold */
+  long long nblk = 4096;    /* start rows per block */
+  long long gap = 0;        /* clustering gap */
+  int all = 0;              /* whether to skip clustering */
+  lfb_hdr head = {};        /* file header */
+  int bits;                 /* bit depth of data (32 or 64) */
+  int64_t nin, ncol, nt;    /* input rows, columns, rows per buffer */
+  int64_t nv, i0;           /* valid rows in buffer, and first row */
+  int64_t i, j, k, t, n;    /* indecies */
+  int64_t nev = 0, sev = 0; /* number of events, and allocated */
+  double *dat = NULL;       /* buffer, then cumulative sums */
+  double *sum, *tmp;        /* cumulative sums, and column workspace */
+  double *med, *inv;        /* column medians and inverse sigmas */
+  double *best, *bw;        /* best S/N and width for each start */
+  lfp_event *ev = NULL;     /* events above threshold */
+  lfp_run *run = NULL;      /* runs and clusters of events */
+  double dt, dc;            /* row and column spacing */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'w':
+      for ( nwid = 0, end = optarg; nwid < NWID; ) {
+	if ( ( width[nwid++] = strtoll( end, &end, 10 ) ) < 1 ||
+	     *end != ',' )
+	  break;
+	end++;
+      }
+      if ( width[nwid-1] < 1 || *end ) {
+	lf_error( "bad -w, --widths argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 's':
+      thresh = strtod( optarg, &end );
+      if ( *end || isnan( thresh ) ) {
+	lf_error( "bad -s, --snr argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'b':
+      if ( ( nblk = strtoll( optarg, &end, 10 ) ) < 1 || *end ) {
+	lf_error( "bad -b, --block argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'g':
+      if ( ( gap = strtoll( optarg, &end, 10 ) ) < 0 || *end ) {
+	lf_error( "bad -g, --gap argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'a':
+      all = 1;
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+  for ( w = 0, wmax = 1; w < nwid; w++ )
+    wmax = ( width[w] > wmax ? width[w] : wmax );
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  if ( head.dims[2] != 1 ) {
+    lf_error( "requires one component per column" );
+    CLEANEXIT( 3 );
+  }
+  nin = head.dims[0];
+  ncol = head.dims[1];
+  dt = head.dim1_span/nin;
+  dc = head.dim2_span/ncol;
+
+  /* Allocate storage: the data buffer of nt rows is followed by the
+     cumulative sums (nt + 1 rows), best S/N and width (nblk rows
+     each), and column statistics and workspace. */
+  if ( nblk > nin )
+    nblk = ( nin > 0 ? nin : 1 );
+  nt = nblk + wmax - 1;
+  if ( !( dat = (double *)malloc( ( ( 2*nt + 1 + 2*nblk + 2 )*ncol + nt )*
+				  sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  sum = dat + nt*ncol;
+  best = sum + ( nt + 1 )*ncol;
+  bw = best + nblk*ncol;
+  med = bw + nblk*ncol;
+  inv = med + ncol;
+  tmp = inv + ncol;
+
+  /* Open output file. */
+  if ( !outfile ) {
+    fpout = stdout;
+    outfile = "stdout";
+  } else if ( !( fpout = fopen( outfile, "w" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Process blocks.  Block starting at row i0 holds nv <= nt valid
+     rows, and searches boxcars starting in its first nblk rows. */
+  for ( i0 = nv = 0; i0 < nin; i0 += nblk ) {
+
+    /* Fill buffer. */
+    for ( ; nv < nt && i0 + nv < nin && !feof( fpin ); nv++ )
+      if ( ( n = lfrealRead( dat + nv*ncol, bits, ncol, fpin ) ) < ncol ) {
+	lf_warning( "read %lld data from %s, expected %lld",
+		    (long long)( ( i0 + nv )*ncol + n ), infile,
+		    (long long)( nin*ncol ) );
+	break;
+      }
+    if ( nv == 0 )
+      break;
+
+    /* Compute robust statistics of each column. */
+    for ( j = 0; j < ncol; j++ ) {
+      for ( t = n = 0; t < nv; t++ )
+	if ( isfinite( dat[ t*ncol + j ] ) )
+	  tmp[n++] = dat[ t*ncol + j ];
+      if ( n == 0 ) {
+	med[j] = inv[j] = 0.0;
+	continue;
+      }
+      med[j] = select_kth( tmp, n, n/2 );
+      for ( t = 0; t < n; t++ )
+	tmp[t] = fabs( tmp[t] - med[j] );
+      inv[j] = MADSIG*select_kth( tmp, n, n/2 );
+      inv[j] = ( inv[j] > 0.0 ? 1.0/inv[j] : 0.0 );
+    }
+
+    /* Compute cumulative sums of median-subtracted data. */
+    for ( j = 0; j < ncol; j++ )
+      sum[j] = 0.0;
+    for ( t = 0; t < nv; t++ ) {
+      const double *x = dat + t*ncol;
+      const double *s0 = sum + t*ncol;
+      double *s1 = sum + ( t + 1 )*ncol;
+      for ( j = 0; j < ncol; j++ )
+	s1[j] = s0[j] + ( isfinite( x[j] ) ? x[j] - med[j] : 0.0 );
+    }
+
+    /* Find best boxcar at each start, over widths that fit. */
+    for ( k = 0; k < nblk*ncol; k++ )
+      best[k] = bw[k] = 0.0;
+    for ( w = 0; w < nwid; w++ ) {
+      double r = 1.0/sqrt( (double)( width[w] ) ); /* width scaling */
+      for ( t = 0; t < nblk && t + width[w] <= nv; t++ ) {
+	const double *s0 = sum + t*ncol;
+	const double *s1 = sum + ( t + width[w] )*ncol;
+	double *b = best + t*ncol, *c = bw + t*ncol;
+	for ( j = 0; j < ncol; j++ ) {
+	  double snr = ( s1[j] - s0[j] )*inv[j]*r;
+	  c[j] = ( snr > b[j] ? width[w] : c[j] );
+	  b[j] = ( snr > b[j] ? snr : b[j] );
+	}
+      }
+    }
+
+    /* Record events. */
+    for ( t = 0; t < nblk && t < nv; t++ )
+      for ( j = 0; j < ncol; j++ )
+	if ( best[ t*ncol + j ] > thresh && bw[ t*ncol + j ] > 0.0 ) {
+	  if ( nev >= sev ) {
+	    lfp_event *e = (lfp_event *)
+	      realloc( ev, ( sev = 2*sev + 256 )*sizeof(lfp_event) );
+	    if ( !e ) {
+	      lf_error( "memory error" );
+	      CLEANEXIT( 4 );
+	    }
+	    ev = e;
+	  }
+	  ev[nev].row = i0 + t;
+	  ev[nev].col = j;
+	  ev[nev].width = (int64_t)( bw[ t*ncol + j ] );
+	  ev[nev].snr = best[ t*ncol + j ];
+	  ev[nev].run = nev;
+	  nev++;
+	}
+
+    /* Carry overlap into next block. */
+    if ( nv > nblk ) {
+      memmove( dat, dat + nblk*ncol, ( nv - nblk )*ncol*sizeof(double) );
+      nv -= nblk;
+    } else
+      nv = 0;
+  }
+
+  /* Cluster events, and summarize each cluster in its root run. */
+  if ( nev > 0 && !( run = (lfp_run *)malloc( nev*sizeof(lfp_run) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  if ( !all && nev > 0 )
+    cluster( ev, run, nev, gap );
+  else
+    for ( i = 0; i < nev; i++ )
+      ev[i].run = i;
+  for ( i = 0; i < nev; i++ )
+    run[i].nev = 0;
+  for ( i = 0; i < nev; i++ ) {
+    lfp_run *r = run + ev[i].run;
+    if ( r->nev++ == 0 ) {
+      r->best = i;
+      r->c0 = r->c1 = ev[i].col;
+    }
+    r->best = ( ev[i].snr > ev[r->best].snr ? i : r->best );
+    r->c0 = ( ev[i].col < r->c0 ? ev[i].col : r->c0 );
+    r->c1 = ( ev[i].col > r->c1 ? ev[i].col : r->c1 );
+  }
+
+  /* Keep the brightest event of each cluster. */
+  for ( i = n = 0; i < nev; i++ )
+    if ( run[ ev[i].run ].best == i )
+      ev[n++] = ev[i];
+  nev = n;
+  qsort( ev, nev, sizeof(lfp_event), by_row );
+
+  /* Write candidates. */
+  fprintf( fpout, "# lfpulse candidates from %s\n"
+	   "# %lld candidates above S/N %g\n"
+	   "# columns: %s, %s, S/N, width, row, column, events,"
+	   " first column, last column\n", infile, (long long)( nev ), thresh,
+	   ( head.dim1_label ? head.dim1_label : "dim1" ),
+	   ( head.dim2_label ? head.dim2_label : "dim2" ) );
+  for ( i = 0; i < nev; i++ ) {
+    lfp_run *r = run + ev[i].run;
+    if ( fprintf( fpout, "%.6f %.6g %.2f %lld %lld %lld %lld %lld %lld\n",
+		  head.dim1_start + ev[i].row*dt,
+		  head.dim2_start + ev[i].col*dc, ev[i].snr,
+		  (long long)( ev[i].width ), (long long)( ev[i].row ),
+		  (long long)( ev[i].col ), (long long)( r->nev ),
+		  (long long)( r->c0 ), (long long)( r->c1 ) ) < 0 ) {
+      lf_error( "could not write data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+  }
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
@@ -0,0 +1,521 @@
+static const char *version = "\
+lfregrid version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Resample LoFASM data onto a new frequency grid.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -f, --freq=FMIN+FMAX   output frequency range in Hz\n\
+  -n, --channels=N       number of output channels\n\
+  -r, --reference=FILE   take output grid from FILE's header\n\
+  -S, --sum              sum overlapping power rather than averaging\n\
+\n";
+
+static const char *description = "\
+# lfregrid(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfregrid(1)` - resample lofasm-filterbank(5) data in frequency\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfregrid` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program maps the frequency channels (dimension 2) of a\n\
+lofasm-filterbank(5) file _INFILE_ onto an arbitrary new grid of\n\
+equally spaced channels, writing the result to _OUTFILE_.  If _INFILE_\n\
+or _OUTFILE_ is not specified, or is a single `-` character, then\n\
+standard input or standard output is used instead.  This allows data\n\
+from instruments with different channelizations to be combined (e.g.\n\
+with lfcoadd(1)), where lfslice(1) can only select whole channels and\n\
+lfsquish(1) can only merge whole numbers of them.\n\
+\n\
+Each channel is treated as covering a frequency interval, from its\n\
+lower edge up to the lower edge of the next channel.  By default, each\n\
+output channel is the average of the input channels that overlap it,\n\
+weighted by the width of the overlap: this preserves power spectral\n\
+densities.  With `-S, --sum`, each input channel instead contributes\n\
+the fraction of its value given by the fraction of its width that\n\
+falls within the output channel, which preserves total power.  Output\n\
+channels only partly covered by the input are averaged over the\n\
+covered part (or summed over it), and channels not covered at all are\n\
+set to `nan`.  Non-finite input values are excluded, and the weights\n\
+of the remaining values renormalized.\n\
+\n\
+Since each output channel overlaps only a few adjacent input channels,\n\
+the weights form a sparse banded matrix.  This is computed once from\n\
+the two grids, storing for each output channel its first input\n\
+channel and a short contiguous list of weights, and is then applied\n\
+to each row as it is read, so the file is streamed with only one row\n\
+in memory.\n\
+\n\
+The output grid is given either by `-r, --reference`, or by the\n\
+`-f, --freq` and `-n, --channels` options; any of these not specified\n\
+default to the input range, and to the input channel width.  The\n\
+output header is the same as the input header except for the\n\
+frequency range and number of channels.  The data may be stored as\n\
+`real32` or `real64`, and the output is stored with the same type as\n\
+the input.  Data with more than one component are resampled component\n\
+by component.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-f, --freq=`_FMIN_`+`_FMAX_:\n\
+    Specifies the frequency range of the output grid in Hz, from the\n\
+    lower edge of the first channel to the upper edge of the last.\n\
+    As with lfslice(1), the arguments are read as two concatenated\n\
+    double-precision floats, the `+` sign of _FMAX_ delimiting it from\n\
+    _FMIN_.\n\
+\n\
+`-n, --channels=`_N_:\n\
+    Specifies the number of output channels.  The default is the\n\
+    output range divided by the input channel width, rounded to the\n\
+    nearest integer.\n\
+\n\
+`-r, --reference=`_FILE_:\n\
+    Reads the header of the lofasm-filterbank(5) file _FILE_, and uses\n\
+    its frequency range and number of channels as the output grid.\n\
+    May not be combined with `-f, --freq` or `-n, --channels`.\n\
+\n\
+`-S, --sum`:\n\
+    Sums the overlapping parts of input channels, rather than\n\
+    averaging them, as described above.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted or the output grid does not overlap the input, and 4 on\n\
+memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfslice(1),\n\
+lfsquish(1),\n\
+lfcoadd(1),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:f:n:r:S";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "freq", 1, 0, 'f' },
+  { "channels", 1, 0, 'n' },
+  { "reference", 1, 0, 'r' },
+  { "sum", 0, 0, 'S' },
+  { 0, 0, 0, 0} };
+
+/* Overlaps smaller than this fraction of a channel are treated as
+   roundoff between coincident channel edges, and ignored. */
+#define EPS 1.0e-9
+
+/* Sparse overlap weights mapping nin input channels onto nout output
+   channels.  Output channel k overlaps input channels first[k]
+   through first[k] + off[k+1] - off[k] - 1, with weights
+   w[off[k]], ..., w[off[k+1]-1]. */
+typedef struct {
+  int64_t nout;   /* number of output channels */
+  int64_t *first; /* first input channel for each output */
+  int64_t *off;   /* offsets into w (nout + 1 values) */
+  double *w;      /* overlap weights */
+  double *amp;    /* overall factor for each output */
+} regrid_map;
+
+
+/* Frees the storage of a weight map. */
+static void
+map_free( regrid_map *map )
+{
+  if ( map->first )
+    free( map->first );
+  if ( map->off )
+    free( map->off );
+  if ( map->w )
+    free( map->w );
+  if ( map->amp )
+    free( map->amp );
+  memset( map, 0, sizeof(regrid_map) );
+  return;
+}
+
+
+/* Computes the weights mapping nin input channels of width din
+   starting at frequency fin onto nout output channels of width dout
+   starting at fout.  The weights are the overlap widths; amp[k] is 1
+   for averaging, or the total overlap in units of the input channel
+   width if sum is set.  Returns the number of output channels that
+   overlap the input, or -1 on memory errors. */
+static int64_t
+map_plan( regrid_map *map, double fin, double din, int64_t nin,
+	  double fout, double dout, int64_t nout, int sum )
+{
+  int64_t j, k, n = 0, m, lo, hi; /* indecies, counts, and range */
+  double a, b, ov, tot;           /* output edges, overlap, and sum */
+
+  memset( map, 0, sizeof(regrid_map) );
+  map->nout = nout;
+  if ( !( map->first = (int64_t *)malloc( nout*sizeof(int64_t) ) ) ||
+       !( map->off = (int64_t *)malloc( ( nout + 1 )*sizeof(int64_t) ) ) ||
+       !( map->amp = (double *)malloc( nout*sizeof(double) ) ) )
+    return -1;
+
+  /* First pass: find the range of input channels overlapping each
+     output channel. */
+  for ( k = 0, map->off[0] = 0; k < nout; k++ ) {
+    a = fout + k*dout;
+    b = fout + ( k + 1 )*dout;
+    lo = (int64_t)floor( ( a - fin )/din );
+    hi = (int64_t)ceil( ( b - fin )/din );
+    lo = ( lo < 0 ? 0 : lo );
+    hi = ( hi > nin ? nin : hi );
+    map->first[k] = lo;
+    map->off[k+1] = map->off[k] + ( hi > lo ? hi - lo : 0 );
+  }
+  if ( !( map->w = (double *)malloc( ( map->off[nout] > 0 ?
+				       map->off[nout] : 1 )*sizeof(double) ) ) )
+    return -1;
+
+  /* Second pass: compute overlaps, trimming negligible ones at either
+     end of each range. */
+  for ( k = 0, m = 0; k < nout; k++ ) {
+    int64_t o = m; /* start of this output's weights */
+    a = fout + k*dout;
+    b = fout + ( k + 1 )*dout;
+    lo = map->first[k];
+    hi = lo + map->off[k+1] - map->off[k];
+    for ( j = lo, tot = 0.0; j < hi; j++ ) {
+      double c = fin + j*din, d = fin + ( j + 1 )*din; /* input edges */
+      ov = ( b < d ? b : d ) - ( a > c ? a : c );
+      if ( ov <= EPS*din || ov <= EPS*dout ) {
+	if ( m == o )
+	  map->first[k]++;
+	continue;
+      }
+      map->w[m++] = ov;
+      tot += ov;
+    }
+    map->off[k] = o;
+    map->amp[k] = ( sum ? tot/din : 1.0 );
+    n += ( m > o );
+  }
+  map->off[nout] = m;
+  return n;
+}
+
+
+/* Applies the weight map to a row of input channels with ncomp
+   components each, writing the output row.  Non-finite inputs are
+   excluded and the remaining weights renormalized; outputs with no
+   finite inputs are set to NaN. */
+static void
+map_apply( const regrid_map *map, const double *in, double *out,
+	   int64_t ncomp )
+{
+  int64_t k, j, z, m; /* indecies */
+  for ( k = 0; k < map->nout; k++ ) {
+    const double *x = in + map->first[k]*ncomp; /* first input */
+    const double *w = map->w + map->off[k];    /* weights */
+    int64_t n = map->off[k+1] - map->off[k];   /* number of weights */
+    for ( z = 0; z < ncomp; z++ ) {
+      double sum = 0.0, wsum = 0.0; /* weighted sum, and sum of weights */
+      for ( j = 0, m = z; j < n; j++, m += ncomp ) {
+	int f = isfinite( x[m] ); /* whether input is usable */
+	sum += ( f ? w[j]*x[m] : 0.0 );
+	wsum += ( f ? w[j] : 0.0 );
+      }
+      out[ k*ncomp + z ] = ( wsum > 0.0 ? map->amp[k]*sum/wsum : NAN );
+    }
+  }
+  return;
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  if ( in ) free( in ); \
+  if ( out ) free( out ); \
+  map_free( &map ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  char *reffile = NULL;     /* reference file name */
+  FILE *fpin = NULL, *fpout = NULL; /* file pointers */
+  double fmin = NAN, fmax = NAN; /* output frequency range */
+  long long nout = 0;       /* number of output channels */
+  int sum = 0;              /* whether to sum rather than average */
+  lfb_hdr head = {};        /* file header */
+  regrid_map map = {};      /* sparse weight map */
+  int bits;                 /* bit depth of data (32 or 64) */
+  int64_t nrow, nin, ncomp; /* rows, input channels, and components */
+  int64_t i, n, nread = 0;  /* index, and data read */
+  double fin, din;          /* input start frequency and channel width */
+  double *in = NULL, *out = NULL; /* input and output rows */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'f':
+      fmin = strtod( optarg, &end );
+      fmax = strtod( end, &end );
+      if ( *end || !( fmax > fmin ) ) {
+	lf_error( "bad -f, --freq argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'n':
+      if ( ( nout = strtoll( optarg, &end, 10 ) ) < 1 || *end ) {
+	lf_error( "bad -n, --channels argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'r':
+      reffile = optarg;
+      break;
+    case 'S':
+      sum = 1;
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+  if ( reffile && ( nout || !isnan( fmin ) ) ) {
+    lf_error( "-r, --reference may not be combined with -f, --freq or"
+	      " -n, --channels" );
+    return 1;
+  }
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Read reference grid, if any. */
+  if ( reffile ) {
+    if ( !( fpin = lfopen( reffile, "rb" ) ) ) {
+      lf_error( "could not open reference file %s", reffile );
+      CLEANEXIT( 2 );
+    }
+    if ( lfbxRead( fpin, &head, NULL ) ) {
+      lf_error( "could not parse header from %s", reffile );
+      CLEANEXIT( 2 );
+    }
+    fmin = head.frequency_offset_DC + head.dim2_start;
+    fmax = fmin + head.dim2_span;
+    nout = head.dims[1];
+    fclose( fpin );
+    fpin = NULL;
+    lfbxFree( &head );
+    if ( !( fmax > fmin ) || nout < 1 ) {
+      lf_error( "bad frequency grid in %s", reffile );
+      CLEANEXIT( 3 );
+    }
+  }
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  nrow = head.dims[0];
+  nin = head.dims[1];
+  ncomp = head.dims[2];
+  fin = head.frequency_offset_DC + head.dim2_start;
+  din = head.dim2_span/nin;
+  if ( !( din > 0.0 ) || isinf( din ) ) {
+    lf_error( "bad frequency range in %s", infile );
+    CLEANEXIT( 3 );
+  }
+
+  /* Fill in output grid defaults, and plan the weights. */
+  if ( isnan( fmin ) ) {
+    fmin = fin;
+    fmax = fin + head.dim2_span;
+  }
+  if ( nout < 1 && ( nout = (long long)round( ( fmax - fmin )/din ) ) < 1 )
+    nout = 1;
+  if ( ( n = map_plan( &map, fin, din, nin, fmin, ( fmax - fmin )/nout,
+		       nout, sum ) ) < 0 ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  if ( n == 0 ) {
+    lf_error( "output frequencies do not overlap input" );
+    CLEANEXIT( 3 );
+  } else if ( n < nout )
+    lf_warning( "%lld of %lld output channels lie outside input",
+		(long long)( nout - n ), nout );
+  lf_info( "%lld weights for %lld output channels",
+	   (long long)( map.off[nout] ), nout );
+  if ( !( in = (double *)malloc( nin*ncomp*sizeof(double) ) ) ||
+       !( out = (double *)malloc( nout*ncomp*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+
+  /* Write output header. */
+  head.dim2_start = fmin - head.frequency_offset_DC;
+  head.dim2_span = fmax - fmin;
+  head.dims[1] = nout;
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Regrid row by row, padding missing input with NaN. */
+  for ( i = 0; i < nrow; i++ ) {
+    n = 0;
+    if ( !feof( fpin ) && !ferror( fpin ) )
+      nread += ( n = lfrealRead( in, bits, nin*ncomp, fpin ) );
+    for ( ; n < nin*ncomp; n++ )
+      in[n] = NAN;
+    map_apply( &map, in, out, ncomp );
+    if ( lfrealWrite( out, bits, nout*ncomp, fpout ) < nout*ncomp ) {
+      lf_error( "could not write data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+  }
+  if ( nread < nrow*nin*ncomp )
+    lf_warning( "read %lld data from %s, expected %lld",
+		(long long)( nread ), infile, (long long)( nrow*nin*ncomp ) );
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
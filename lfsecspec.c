@@ -0,0 +1,471 @@
+static const char *version = "\
+lfsecspec version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE [OUTFILE]]\n\
+Compute the secondary spectrum of a LoFASM file.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -t, --time=NT          tile length in rows (a power of 2)\n\
+  -f, --freq=NF          tile width in columns (a power of 2)\n\
+  -w, --window=TYPE      window tiles by TYPE (hann or rect)\n\
+\n";
+
+static const char *description = "\
+# lfsecspec(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfsecspec(1)` - compute the secondary spectrum of a lofasm-filterbank(5) file\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfsecspec` [_OPTION_]... [_INFILE_ [_OUTFILE_]]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program computes the secondary spectrum of a dynamic spectrum\n\
+stored in a lofasm-filterbank(5) file _INFILE_, that is, the\n\
+two-dimensional power spectrum of the time-frequency plane, as used\n\
+to study scintillation and other time-frequency structure.  The\n\
+result is written to _OUTFILE_ as a lofasm-filterbank(5) file.  If\n\
+_INFILE_ or _OUTFILE_ is not specified, or is a single `-` character,\n\
+then standard input or standard output is used instead.\n\
+\n\
+The input is divided into tiles of _NT_ rows by _NF_ columns; any rows\n\
+or columns left over after the last full tile are ignored.  The mean\n\
+of each tile is subtracted, and the tile is multiplied by a window\n\
+function in each dimension to reduce spectral leakage.  Its\n\
+two-dimensional discrete Fourier transform is computed with the\n\
+in-tree radix-2 FFT (see lfftPlan(3)), transforming each row,\n\
+transposing the tile in cache-sized blocks, and transforming each\n\
+former column.  The squared magnitudes are averaged over all tiles,\n\
+and normalized by the sum of squares of the window, so that white\n\
+noise of variance 1 has a mean power of 1.  The input is read _NT_\n\
+rows at a time, so memory usage is proportional to _NT_ times the\n\
+number of columns, and does not depend on the length of the file.\n\
+Non-finite input values are replaced by the tile mean.\n\
+\n\
+The output has _NT_ rows and _NF_ columns, with zero frequency moved\n\
+to the centre of each dimension.  Dimension 1 is fluctuation\n\
+frequency (conjugate to time) in Hz, running from -1/(2 _dt_) to\n\
+1/(2 _dt_) where _dt_ is the sampling interval, and dimension 2 is\n\
+delay (conjugate to frequency) in seconds, running from -1/(2 _df_) to\n\
+1/(2 _df_) where _df_ is the channel width.  Each point is labeled by\n\
+the lower edge of its bin, so that zero frequency and delay fall at\n\
+row _NT_/2 and column _NF_/2.  Since the input is real, the output is\n\
+symmetric under reversing both dimensions.\n\
+\n\
+The data must be stored as `real32` or `real64`, with one component\n\
+per column; the output is stored with the same type as the input.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-t, --time=`_NT_:\n\
+    Sets the number of rows in each tile, which must be a power of 2\n\
+    no larger than the number of rows.  The default is the largest\n\
+    power of 2 not exceeding the number of rows or 256.\n\
+\n\
+`-f, --freq=`_NF_:\n\
+    Sets the number of columns in each tile, which must be a power of\n\
+    2 no larger than the number of columns.  The default is the\n\
+    largest power of 2 not exceeding the number of columns or 256.\n\
+\n\
+`-w, --window=`_TYPE_:\n\
+    Sets the window function applied to each tile: `hann` (the\n\
+    default) or `rect` (no windowing).\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the file is badly\n\
+formatted. and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfpower(1),\n\
+lfftPlan(3),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+#include "lfft.h"
+
+static const char short_opts[] = "hHVv:t:f:w:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "time", 1, 0, 't' },
+  { "freq", 1, 0, 'f' },
+  { "window", 1, 0, 'w' },
+  { 0, 0, 0, 0} };
+
+#define NMAX 256      /* maximum default tile dimensions */
+#define TB 16         /* transpose block size */
+
+
+/* Transposes an m-by-n matrix of complex numbers in x into the
+   n-by-m matrix y, working in TB-by-TB blocks so that both the reads
+   and writes stay within cache. */
+static void
+transpose( const double *x, double *y, int64_t m, int64_t n )
+{
+  int64_t i0, j0, i, j, i1, j1; /* block corners and indecies */
+
+  for ( i0 = 0; i0 < m; i0 += TB ) {
+    i1 = ( i0 + TB < m ? i0 + TB : m );
+    for ( j0 = 0; j0 < n; j0 += TB ) {
+      j1 = ( j0 + TB < n ? j0 + TB : n );
+      for ( i = i0; i < i1; i++ )
+	for ( j = j0; j < j1; j++ ) {
+	  y[ 2*( j*m + i ) ] = x[ 2*( i*n + j ) ];
+	  y[ 2*( j*m + i ) + 1 ] = x[ 2*( i*n + j ) + 1 ];
+	}
+    }
+  }
+}
+
+
+/* Sets w[0] through w[n-1] to a window of the given type (0 for
+   rectangular, 1 for Hann), and returns the sum of their squares. */
+static double
+window( double *w, int64_t n, int type )
+{
+  int64_t i;          /* index */
+  double s = 0.0;     /* sum of squares */
+
+  for ( i = 0; i < n; i++ ) {
+    w[i] = ( type ? 0.5 - 0.5*cos( 2.0*M_PI*( i + 0.5 )/n ) : 1.0 );
+    s += w[i]*w[i];
+  }
+  return s;
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  if ( blk ) free( blk ); \
+  if ( z ) free( z ); \
+  if ( y ) free( y ); \
+  if ( pow ) free( pow ); \
+  if ( wt ) free( wt ); \
+  lfftFree( plant ); \
+  lfftFree( planf ); \
+  lfbxFree( &head ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infile, *outfile;   /* input/output file names */
+  FILE *fpin = NULL, *fpout = NULL; /* input/output file pointers */
+  long long nt = 0, nf = 0; /* tile dimensions */
+  int hann = 1;             /* whether to apply a Hann window */
+  lfb_hdr head = {};        /* file header */
+  int bits;                 /* bit depth of data (32 or 64) */
+  int64_t nin, nchan;       /* input rows and columns */
+  int64_t nrow, ncol, ntile; /* tiles down and across, and total */
+  int64_t i, j, k, r, c;    /* indecies */
+  double dt, df;            /* sample interval and channel width */
+  double mean, norm;        /* tile mean and power normalization */
+  double *blk = NULL;       /* block of NT input rows */
+  double *z = NULL, *y = NULL; /* tile and its transpose */
+  double *pow = NULL;       /* accumulated powers */
+  double *wt = NULL, *wf;   /* time and frequency windows */
+  lfft_plan *plant = NULL, *planf = NULL; /* FFT plans */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 't':
+      if ( ( nt = strtoll( optarg, &end, 10 ) ) < 2 || *end ||
+	   ( nt & ( nt - 1 ) ) ) {
+	lf_error( "bad -t, --time argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'f':
+      if ( ( nf = strtoll( optarg, &end, 10 ) ) < 2 || *end ||
+	   ( nf & ( nf - 1 ) ) ) {
+	lf_error( "bad -f, --freq argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'w':
+      if ( !strcmp( optarg, "hann" ) )
+	hann = 1;
+      else if ( !strcmp( optarg, "rect" ) )
+	hann = 0;
+      else {
+	lf_error( "bad -w, --window argument %s", optarg );
+	return 1;
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+
+  /* Parse other arguments. */
+  if ( optind >= argc || !strcmp( ( infile = argv[optind++] ), "-" ) )
+    infile = NULL;
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+
+  /* Read input header. */
+  if ( !infile ) {
+    if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      CLEANEXIT( 2 );
+    }
+    infile = "stdin";
+  } else if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxRead( fpin, &head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    CLEANEXIT( 2 );
+  }
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
+    CLEANEXIT( 3 );
+  }
+  if ( head.dims[2] != 1 ) {
+    lf_error( "requires one component per column" );
+    CLEANEXIT( 3 );
+  }
+  nin = head.dims[0];
+  nchan = head.dims[1];
+  dt = head.dim1_span/nin;
+  df = head.dim2_span/nchan;
+
+  /* Set tile dimensions. */
+  if ( nt < 1 )
+    for ( nt = 2; 2*nt <= nin && 2*nt <= NMAX; nt *= 2 )
+      ;
+  if ( nf < 1 )
+    for ( nf = 2; 2*nf <= nchan && 2*nf <= NMAX; nf *= 2 )
+      ;
+  if ( nt > nin || nf > nchan ) {
+    lf_error( "tile size %lldx%lld exceeds data size %lldx%lld", nt, nf,
+	      (long long)( nin ), (long long)( nchan ) );
+    CLEANEXIT( 1 );
+  }
+  nrow = nin/nt;
+  ncol = nchan/nf;
+  ntile = nrow*ncol;
+  if ( nrow*nt < nin || ncol*nf < nchan )
+    lf_info( "ignoring last %lld rows and %lld columns",
+	     (long long)( nin - nrow*nt ), (long long)( nchan - ncol*nf ) );
+
+  /* Allocate storage. */
+  if ( !( plant = lfftPlan( nt ) ) || !( planf = lfftPlan( nf ) ) ||
+       !( blk = (double *)malloc( nt*nchan*sizeof(double) ) ) ||
+       !( z = (double *)malloc( 2*nt*nf*sizeof(double) ) ) ||
+       !( y = (double *)malloc( 2*nt*nf*sizeof(double) ) ) ||
+       !( pow = (double *)calloc( nt*nf, sizeof(double) ) ) ||
+       !( wt = (double *)malloc( ( nt + nf )*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  wf = wt + nt;
+  norm = window( wt, nt, hann )*window( wf, nf, hann );
+
+  /* Read each row of tiles, and transform each tile. */
+  for ( r = 0; r < nrow; r++ ) {
+    if ( ( j = lfrealRead( blk, bits, nt*nchan, fpin ) ) < nt*nchan ) {
+      lf_warning( "read %lld data from %s, expected %lld",
+		  (long long)( r*nt*nchan + j ), infile,
+		  (long long)( nin*nchan ) );
+      memset( blk + j, 0, ( nt*nchan - j )*sizeof(double) );
+    }
+    for ( c = 0; c < ncol; c++ ) {
+
+      /* Load windowed tile with mean removed. */
+      for ( i = k = 0, mean = 0.0; i < nt; i++ )
+	for ( j = 0; j < nf; j++ )
+	  if ( isfinite( blk[ i*nchan + c*nf + j ] ) ) {
+	    mean += blk[ i*nchan + c*nf + j ];
+	    k++;
+	  }
+      mean = ( k ? mean/k : 0.0 );
+      for ( i = 0; i < nt; i++ )
+	for ( j = 0; j < nf; j++ ) {
+	  double x = blk[ i*nchan + c*nf + j ];
+	  z[ 2*( i*nf + j ) ] = ( isfinite( x ) ? x - mean : 0.0 )*wt[i]*wf[j];
+	  z[ 2*( i*nf + j ) + 1 ] = 0.0;
+	}
+
+      /* Transform rows, transpose, and transform columns.  The powers
+	 are accumulated in transposed order pow[j*nt+i]. */
+      for ( i = 0; i < nt; i++ )
+	lfftForward( planf, z + 2*i*nf );
+      transpose( z, y, nt, nf );
+      for ( j = 0; j < nf; j++ )
+	lfftForward( plant, y + 2*j*nt );
+      for ( k = 0; k < nt*nf; k++ )
+	pow[k] += y[2*k]*y[2*k] + y[2*k+1]*y[2*k+1];
+    }
+  }
+
+  /* Write output file header. */
+  head.dim1_start = -0.5/dt;
+  head.dim1_span = 1.0/dt;
+  head.dim2_start = -0.5/df;
+  head.dim2_span = 1.0/df;
+  head.frequency_offset_DC = 0.0;
+  if ( head.dim1_label )
+    free( head.dim1_label );
+  if ( head.dim2_label )
+    free( head.dim2_label );
+  head.dim2_label = NULL;
+  if ( !( head.dim1_label = strdup( "fluctuation frequency (Hz)" ) ) ||
+       !( head.dim2_label = strdup( "delay (s)" ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  if ( head.data_label ) {
+    char *label = head.data_label; /* old data label */
+    if ( !( head.data_label = (char *)malloc( strlen( label ) + 32 ) ) ) {
+      lf_error( "memory error" );
+      head.data_label = label;
+      CLEANEXIT( 4 );
+    }
+    sprintf( head.data_label, "secondary spectrum of %s", label );
+    free( label );
+  }
+  head.dims[0] = nt;
+  head.dims[1] = nf;
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &head, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Write averaged powers, swapping halves of each dimension to put
+     zero frequency and delay in the centre. */
+  norm = ( ntile > 0 ? 1.0/( ntile*norm ) : 0.0 );
+  for ( i = 0; i < nt; i++ ) {
+    int64_t kt = ( i + nt/2 ) % nt; /* transform index in time */
+    for ( j = 0; j < nf; j++ )
+      z[j] = norm*pow[ ( ( j + nf/2 ) % nf )*nt + kt ];
+    if ( lfrealWrite( z, bits, nf, fpout ) < nf ) {
+      lf_error( "could not write data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+  }
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
@@ -28,6 +28,10 @@ Reduce the time or frequency resolution of a LoFASM file.\n\
   -v, --verbosity=LEVEL    set status message reporting level\n\
   -t, --dim1=FAC1[+OFF1]  downsampling factor, offset in dimension 1\n\
   -f, --dim2=FAC2[+OFF2]  downsampling factor, offset in dimension 2\n\
+  -s, --stats=LIST         record listed box statistics as extra planes\n\
+  -O, --overviews=NLEV     append NLEV overview levels to output\n\
+  -z, --component=COMP     convert complex data to real before averaging\n\
+  -M, --mask=MASKFILE      exclude samples flagged in MASKFILE\n\
 \n";
 
 static const char *description = "\
@@ -50,6 +54,10 @@ standard output is used instead.  This program streams its input and\n\
 output one row at a time, so it is suitable for use within a pipeline\n\
 (e.g. being fed data by lfcat(1) or other programs).\n\
 \n\
+The data may be stored as `real32` or `real64`.  Averages and\n\
+statistics are accumulated in double precision, and the output is\n\
+stored with the same type as the input.\n\
+\n\
 If run without options, the program will perform the uninteresting\n\
 task of copying _INFILE_ to _OUTFILE_.  At least one of the `-t,\n\
 --dim1` option or the `-f, --dim2` option, or both, must be given to\n\
@@ -68,6 +76,17 @@ results in a dimension of zero.\n\
 If neither downsampling option is given, the program performs the\n\
 rather uninteresting task of copying _INFILE_ to _OUTFILE_ unchanged.\n\
 \n\
+Averaging tends to wash out short, strong transients.  The `-s,\n\
+--stats` option instead records several statistics of each box in a\n\
+single pass through the data, e.g. the mean, maximum, and standard\n\
+deviation together, so that peaks are preserved without having to run\n\
+the program once per statistic.\n\
+\n\
+A mask file of flagged samples, such as is written by lfflag(1), can\n\
+be given with the `-M, --mask` option.  Flagged samples are then\n\
+excluded from the box averages, so that interference flagged once\n\
+need not be removed from the data before every reduction.\n\
+\n\
 ## OPTIONS\n\
 \n\
 `-h, --help`:\n\
@@ -115,6 +134,46 @@ rather uninteresting task of copying _INFILE_ to _OUTFILE_ unchanged.\n\
     and the sum of the sampling factor and offset cannot exceed the\n\
     dimension length.\n\
 \n\
+`-s, --stats=`_LIST_:\n\
+    Computes the statistics named in the comma-separated _LIST_ for\n\
+    each box, rather than just the mean.  Allowed names are `mean`,\n\
+    `min`, `max`, `std` (the standard deviation about the box mean,\n\
+    normalized by the number of points), and `nonfinite` (the number\n\
+    of `nan` or `inf` values in the box).  Non-finite values are\n\
+    excluded from the other statistics, which are `nan` if the box has\n\
+    no finite values.  The statistics are stored as extra planes in\n\
+    dimension 3 of the output: i.e. each frequency bin contains the\n\
+    components of the first statistic, followed by the components of\n\
+    the second, and so on, and the `data_label` header field lists the\n\
+    statistics in order.\n\
+\n\
+`-O, --overviews=`_NLEV_:\n\
+    Appends _NLEV_ reduced-resolution overview levels to the output,\n\
+    downsampled by factors of 2, 4, 8, ... in both dimensions relative\n\
+    to the output data, as described in lofasm-filterbank(5).  These\n\
+    are computed as the output is written, and can be used by the\n\
+    `-o, --overview` option of lfplot2d(1) for fast plotting.  See\n\
+    also lfoverview(1).\n\
+\n\
+`-z, --component=`_COMP_:\n\
+    Converts complex data (with two components per point) to real\n\
+    numbers before averaging or computing statistics.  The recognized\n\
+    values of _COMP_ are `re`, `im`, `abs`, or `pow`, giving the real\n\
+    part, imaginary part, complex magnitude, or squared magnitude of\n\
+    the input.  The output then has a single component per point (or\n\
+    one per statistic).  Without this option, complex data are\n\
+    averaged component by component, which preserves the phase of\n\
+    cross-power data; however the `min` and `max` statistics are then\n\
+    also computed separately for the real and imaginary parts.\n\
+\n\
+`-M, --mask=`_MASKFILE_:\n\
+    Reads a `bit1` mask file with the same rows and columns as the\n\
+    input (see lofasm-filterbank(5)), and treats samples whose mask\n\
+    bit is set as non-finite: they are excluded from all statistics\n\
+    except `nonfinite`, which counts them.  The box mean is then taken\n\
+    over the unflagged finite samples only, and is `nan` if there are\n\
+    none.\n\
+\n\
 ## EXIT STATUS\n\
 \n\
 The proram exits with status 0 normally, 1 if there is an error\n\
@@ -125,6 +184,8 @@ formatted. and 4 on memory allocation errors.\n\
 \n\
 lfbxRead(3),\n\
 lfbxWrite(3),\n\
+lfmaskRead(3),\n\
+lfflag(1),\n\
 lofasm-filterbank(5)\n\
 \n";
 
@@ -135,7 +196,7 @@ lofasm-filterbank(5)\n\
 #include "markdown_parser.h"
 #include "lofasmIO.h"
 
-static const char short_opts[] = "hHVv:t:f:";
+static const char short_opts[] = "hHVv:t:f:s:O:z:M:";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -145,8 +206,172 @@ static const struct option long_opts[] = {
   { "verbosity", 1, 0, 'v' },
   { "dim1", 1, 0, 't' },
   { "dim2", 1, 0, 'f' },
+  { "stats", 1, 0, 's' },
+  { "overviews", 1, 0, 'O' },
+  { "component", 1, 0, 'z' },
+  { "mask", 1, 0, 'M' },
   { 0, 0, 0, 0} };
 
+/* Conversions of complex data that can be requested with -z,
+   --component. */
+enum { NONE, RE, IM, ABS, POW, NCOMP };
+static const char *comp_names[NCOMP] = {
+  "", "re", "im", "abs", "pow" };
+
+/* Converts n complex pairs in cin to real numbers in out, according
+   to comp. */
+static void
+to_real( double *restrict out, const double *restrict cin, int64_t n,
+	 int comp )
+{
+  int64_t j; /* index */
+  if ( comp == RE || comp == IM )
+    for ( j = 0, cin += ( comp == IM ); j < n; j++ )
+      out[j] = cin[2*j];
+  else if ( comp == ABS )
+    for ( j = 0; j < n; j++ )
+      out[j] = sqrt( cin[2*j]*cin[2*j] + cin[2*j+1]*cin[2*j+1] );
+  else
+    for ( j = 0; j < n; j++ )
+      out[j] = cin[2*j]*cin[2*j] + cin[2*j+1]*cin[2*j+1];
+  return;
+}
+
+/* Mask applied to the input, if any. */
+typedef struct {
+  FILE *fp;          /* mask file */
+  lfb_mask state;    /* mask read state */
+  unsigned char *bits; /* mask bits for one row */
+  int64_t ncol;      /* mask bits per row */
+} squish_mask;
+
+/* Reads a row of lin reals into in, or, if comp is set, a row of lin
+   complex pairs into cin, converting them into in.  If mask->fp is
+   set, also reads a row of mask bits, and sets flagged values to NaN
+   (all components of a flagged column).  Returns the number of (real)
+   values read. */
+static int64_t
+read_row( double *in, double *cin, int bits, int64_t lin, int comp,
+	  FILE *fp, squish_mask *mask )
+{
+  int64_t n, m, k;  /* number of values and mask bits read, and index */
+  int64_t ncomp;    /* values per mask bit */
+  if ( !comp )
+    n = lfrealRead( in, bits, lin, fp );
+  else {
+    n = lfrealRead( cin, bits, 2*lin, fp )/2;
+    to_real( in, cin, n, comp );
+  }
+  if ( mask->fp ) {
+    if ( ( m = lfmaskRead( mask->bits, mask->ncol, &( mask->state ),
+			   mask->fp ) ) < mask->ncol )
+      memset( mask->bits + m, 0, mask->ncol - m );
+    ncomp = lin/mask->ncol;
+    for ( k = 0; k < n; k++ )
+      in[k] = ( mask->bits[k/ncomp] ? NAN : in[k] );
+  }
+  return n;
+}
+
+/* Box statistics that can be requested with -s, --stats. */
+enum { MEAN, MIN, MAX, STD, NONFINITE, NSTAT };
+static const char *stat_names[NSTAT] = {
+  "mean", "min", "max", "std", "nonfinite" };
+
+/* Per-element accumulators for box statistics.  Sums are taken
+   relative to a shift (the first finite value in the box, if any) to
+   limit roundoff in the variance. */
+typedef struct {
+  double *cnt;   /* number of finite values */
+  double *sum;   /* sum of shifted finite values */
+  double *sq;    /* sum of squares of shifted finite values */
+  double *lo;    /* minimum finite value */
+  double *hi;    /* maximum finite value */
+  double *bad;   /* number of non-finite values */
+  double *shift; /* shift applied to values */
+} squish_acc;
+
+/* Reset accumulators of length n, taking shifts from row. */
+static void
+acc_reset( squish_acc *acc, const double *row, int64_t n )
+{
+  int64_t k;
+  for ( k = 0; k < n; k++ ) {
+    acc->cnt[k] = acc->sum[k] = acc->sq[k] = acc->bad[k] = 0.0;
+    acc->lo[k] = INFINITY;
+    acc->hi[k] = -INFINITY;
+    acc->shift[k] = ( isfinite( row[k] ) ? row[k] : 0.0 );
+  }
+}
+
+/* Add a row of length n to the accumulators. */
+static void
+acc_add( squish_acc *acc, const double *row, int64_t n )
+{
+  double *restrict cnt = acc->cnt, *restrict sum = acc->sum;
+  double *restrict sq = acc->sq, *restrict lo = acc->lo;
+  double *restrict hi = acc->hi, *restrict bad = acc->bad;
+  const double *restrict shift = acc->shift;
+  int64_t k;
+  for ( k = 0; k < n; k++ ) {
+    double x = row[k];
+    int f = isfinite( x );
+    double d = ( f ? x - shift[k] : 0.0 );
+    cnt[k] += f;
+    bad[k] += !f;
+    sum[k] += d;
+    sq[k] += d*d;
+    lo[k] = ( f && x < lo[k] ? x : lo[k] );
+    hi[k] = ( f && x > hi[k] ? x : hi[k] );
+  }
+}
+
+/* Combine the accumulators for the fac input elements starting at k0
+   with the given stride, storing the requested statistics stat[]
+   into out[] with the given stride. */
+static void
+acc_stats( const squish_acc *acc, int64_t k0, int64_t fac, int64_t stride,
+	   const int *stat, int nstat, double *out, int64_t ostride )
+{
+  double n = 0.0, mean = 0.0, m2 = 0.0; /* count, mean, and variance*n */
+  double lo = INFINITY, hi = -INFINITY, bad = 0.0; /* other stats */
+  int64_t j, k;
+  int i;
+  for ( j = 0, k = k0; j < fac; j++, k += stride )
+    if ( acc->cnt[k] > 0 ) {
+      n += acc->cnt[k];
+      mean += acc->shift[k]*acc->cnt[k] + acc->sum[k];
+    }
+  mean /= n;
+  for ( j = 0, k = k0; j < fac; j++, k += stride ) {
+    if ( acc->cnt[k] > 0 ) {
+      double d = acc->shift[k] + acc->sum[k]/acc->cnt[k] - mean;
+      m2 += acc->sq[k] - acc->sum[k]*acc->sum[k]/acc->cnt[k];
+      m2 += acc->cnt[k]*d*d;
+    }
+    if ( acc->lo[k] < lo )
+      lo = acc->lo[k];
+    if ( acc->hi[k] > hi )
+      hi = acc->hi[k];
+    bad += acc->bad[k];
+  }
+  for ( i = 0; i < nstat; i++ ) {
+    double *o = out + i*ostride; /* output location */
+    if ( stat[i] == NONFINITE )
+      *o = bad;
+    else if ( n <= 0.0 )
+      *o = NAN;
+    else if ( stat[i] == MEAN )
+      *o = mean;
+    else if ( stat[i] == MIN )
+      *o = lo;
+    else if ( stat[i] == MAX )
+      *o = hi;
+    else
+      *o = sqrt( m2 > 0.0 ? m2/n : 0.0 );
+  }
+}
+
 int
 main( int argc, char **argv )
 {
@@ -161,6 +386,19 @@ main( int argc, char **argv )
   int d;                  /* dimension index */
   lfb_hdr head = {};      /* file header */
   double *in, *out;       /* input block and output row */
+  int64_t ncomp;          /* number of components per input point */
+  int stat[NSTAT];        /* requested statistics */
+  int nstat = 0;          /* number of requested statistics */
+  squish_acc acc = {};    /* statistics accumulators */
+  int64_t lrow;           /* output row length */
+  int bits;               /* bit depth of data (32 or 64) */
+  int nlev = 0;           /* number of overview levels */
+  int comp = NONE;        /* complex conversion */
+  double *cin = NULL;     /* complex input row */
+  lfb_ovr *ovr = NULL;    /* overview levels */
+  char *maskfile = NULL;  /* mask file name */
+  squish_mask mask = {};  /* input mask */
+  int relabel;            /* whether to label statistics planes */
 
   /* Parse options. */
   while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
@@ -184,6 +422,15 @@ main( int argc, char **argv )
     case 'v':
       lofasm_verbosity = atoi( optarg );
       break;
+    case 'z':
+      for ( comp = NCOMP - 1; comp > NONE; comp-- )
+	if ( !strcmp( optarg, comp_names[comp] ) )
+	  break;
+      if ( comp == NONE ) {
+	lf_error( "bad -z, --component argument %s", optarg );
+	return 1;
+      }
+      break;
     case 't': case 'f':
       d = ( opt == 't' ? 0 : 1 );
       if ( optarg[0] == '/' )
@@ -200,6 +447,38 @@ main( int argc, char **argv )
       } else
 	npt[d] = 0;
       break;
+    case 's':
+      {
+	char *tok, *save = NULL; /* token in list, and parser state */
+	for ( nstat = 0, tok = strtok_r( optarg, ",", &save ); tok;
+	      tok = strtok_r( NULL, ",", &save ) ) {
+	  for ( d = 0; d < NSTAT && strcmp( tok, stat_names[d] ); d++ )
+	    ;
+	  if ( d == NSTAT ) {
+	    lf_error( "unrecognized statistic %s", tok );
+	    return 1;
+	  }
+	  if ( nstat == NSTAT ) {
+	    lf_error( "too many statistics in -s, --stats" );
+	    return 1;
+	  }
+	  stat[nstat++] = d;
+	}
+	if ( nstat == 0 ) {
+	  lf_error( "no statistics given in -s, --stats" );
+	  return 1;
+	}
+      }
+      break;
+    case 'O':
+      if ( ( nlev = atoi( optarg ) ) < 1 ) {
+	lf_error( "bad -O, --overviews argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'M':
+      maskfile = optarg;
+      break;
     case '?':
       if ( optopt )
 	lf_error( "unknown option -%c\n\t"
@@ -258,14 +537,41 @@ main( int argc, char **argv )
   }
 
   /* Check data type. */
-  if ( head.dims[3] != 64 ) {
-    lf_error( "requires real64 data" );
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
     fclose( fpin );
     lfbxFree( &head );
     return 3;
   }
-  if ( !head.data_type || strcmp( head.data_type, "real64" ) )
-    lf_warning( "treating as real64 data" );
+
+  /* Open mask, if any.  With a mask, means are computed by the
+     statistics code, which excludes the flagged values. */
+  if ( maskfile ) {
+    if ( !( mask.fp = lfmaskOpen( maskfile, &head ) ) ) {
+      fclose( fpin );
+      lfbxFree( &head );
+      return 2;
+    }
+    mask.ncol = head.dims[1];
+    if ( !( mask.bits = (unsigned char *)malloc( mask.ncol ) ) ) {
+      lf_error( "memory error" );
+      fclose( mask.fp );
+      fclose( fpin );
+      lfbxFree( &head );
+      return 4;
+    }
+  }
+  if ( ( relabel = nstat ) == 0 && mask.fp )
+    stat[nstat++] = MEAN;
+
+  if ( comp ) {
+    if ( head.dims[2] != 2 ) {
+      lf_warning( "ignoring --component=%s on non-complex data",
+		  comp_names[comp] );
+      comp = NONE;
+    } else
+      head.dims[2] = 1;
+  }
 
   /* Compute downsampling factors and output dimensions. */
   for ( i = 0; i < 2; i++ ) {
@@ -289,23 +595,72 @@ main( int argc, char **argv )
   }
 
   /* Allocate data storage.  Note that output array doubles as
-     accumulator array, so it's the same length as an input row. */
+     accumulator array, so it's the same length as an input row,
+     unless it is storing multiple statistics. */
   nin = head.dims[0];
+  ncomp = head.dims[2];
   lin = head.dims[1]*head.dims[2];
   lout = npt[1]*head.dims[2];
   in = (double *)malloc( lin*sizeof(double) );
-  out = (double *)malloc( lin*sizeof(double) );
-  if ( !in || !out ) {
+  if ( comp && !( cin = (double *)malloc( 2*lin*sizeof(double) ) ) ) {
+    free( in );
+    in = NULL;
+  }
+  if ( nstat ) {
+    out = (double *)malloc( nstat*lout*sizeof(double) );
+    if ( ( acc.cnt = (double *)malloc( 7*lin*sizeof(double) ) ) ) {
+      acc.sum = acc.cnt + lin;
+      acc.sq = acc.sum + lin;
+      acc.lo = acc.sq + lin;
+      acc.hi = acc.lo + lin;
+      acc.bad = acc.hi + lin;
+      acc.shift = acc.bad + lin;
+    }
+  } else
+    out = (double *)malloc( lin*sizeof(double) );
+  if ( !in || !out || ( nstat && !acc.cnt ) ) {
     lf_error( "memory error" );
     fclose( fpin );
     if ( in )
       free( in );
+    if ( cin )
+      free( cin );
     if ( out )
       free( out );
+    if ( acc.cnt )
+      free( acc.cnt );
     lfbxFree( &head );
     return 4;
   }
 
+  /* Label the statistics planes. */
+  if ( relabel ) {
+    char *label = head.data_label; /* old data label */
+    size_t len = ( label ? strlen( label ) : 4 ) + 5; /* label length */
+    for ( i = 0; i < nstat; i++ )
+      len += strlen( stat_names[stat[i]] ) + 1;
+    if ( !( head.data_label = (char *)malloc( len*sizeof(char) ) ) ) {
+      lf_error( "memory error" );
+      head.data_label = label;
+      fclose( fpin );
+      free( in );
+      free( cin );
+      free( out );
+      free( acc.cnt );
+      lfbxFree( &head );
+      return 4;
+    }
+    head.data_label[0] = '\0';
+    for ( i = 0; i < nstat; i++ ) {
+      strcat( head.data_label, stat_names[stat[i]] );
+      strcat( head.data_label, ( i < nstat - 1 ? "," : " of " ) );
+    }
+    strcat( head.data_label, ( label ? label : "data" ) );
+    if ( label )
+      free( label );
+    head.dims[2] *= nstat;
+  }
+
   /* Write output file header. */
   head.dim1_span *= (double)( fac[0] )*npt[0]/head.dims[0];
   head.dim2_span *= (double)( fac[1] )*npt[1]/head.dims[1];
@@ -316,7 +671,9 @@ main( int argc, char **argv )
       lf_error( "could not write to stdout" );
       fclose( fpin );
       free( in );
+      free( cin );
       free( out );
+      free( acc.cnt );
       lfbxFree( &head );
       return 2;
     }
@@ -325,7 +682,9 @@ main( int argc, char **argv )
     lf_error( "could not open output file %s", outfile );
     fclose( fpin );
     free( in );
+    free( cin );
     free( out );
+    free( acc.cnt );
     lfbxFree( &head );
     return 2;
   }
@@ -334,14 +693,30 @@ main( int argc, char **argv )
     fclose( fpout );
     fclose( fpin );
     free( in );
+    free( cin );
     free( out );
+    free( acc.cnt );
     lfbxFree( &head );
     return 2;
   }
 
+  /* Set up overview levels. */
+  lrow = ( nstat ? nstat*lout : lout );
+  if ( nlev && !( ovr = lfovrOpen( &head, nlev ) ) ) {
+    lf_error( "could not set up overview levels" );
+    fclose( fpout );
+    fclose( fpin );
+    free( in );
+    free( cin );
+    free( out );
+    free( acc.cnt );
+    lfbxFree( &head );
+    return 4;
+  }
+
   /* Skip off[0] input rows. */
   for ( n = 0; n < off[0] && !feof( fpin ); n++ )
-    if ( ( j = fread( in, sizeof(double), lin, fpin ) ) < lin )
+    if ( ( j = read_row( in, cin, bits, lin, comp, fpin, &mask ) ) < lin )
       lf_warning( "read %lld data from %s, expected %lld",
 		  (long long)( n*lin + j ), infile,
 		  (long long)( nin*lin ) );
@@ -349,43 +724,70 @@ main( int argc, char **argv )
   /* Generate output row-by-row. */
   for ( i = 0; i < npt[0] && !feof( fpin ); i++ ) {
 
-    /* Read block of fac[0] input lines, accumulating in out array. */
-    memset( out, 0, lin*sizeof(double) );
-    for ( n = 0; n < fac[0] && !feof( fpin ); n++ ) {
-      if ( ( j = fread( in, sizeof(double), lin, fpin ) ) < lin )
+    /* In statistics mode, accumulate a block of fac[0] input lines,
+       then combine along dim2 directly into the output row. */
+    if ( nstat ) {
+      for ( n = 0; n < fac[0] && !feof( fpin ); n++ ) {
+	if ( ( j = read_row( in, cin, bits, lin, comp, fpin, &mask ) ) < lin )
+	  lf_warning( "read %lld data from %s, expected %lld",
+		      (long long)( i*fac[0]*lin + n*lin + j ), infile,
+		      (long long)( nin*lin ) );
+	if ( n == 0 )
+	  acc_reset( &acc, in, lin );
+	acc_add( &acc, in, j );
+      }
+      if ( n == 0 )
+	break;
+      for ( j = 0; j < npt[1]; j++ )
+	for ( k = 0; k < ncomp; k++ )
+	  acc_stats( &acc, ncomp*( j*fac[1] + off[1] ) + k, fac[1], ncomp,
+		     stat, nstat, out + ( j*nstat*ncomp + k ), ncomp );
+    }
+
+    /* Otherwise, read block of fac[0] input lines, accumulating in
+       out array. */
+    else {
+      memset( out, 0, lin*sizeof(double) );
+      for ( n = 0; n < fac[0] && !feof( fpin ); n++ ) {
+	if ( ( j = read_row( in, cin, bits, lin, comp, fpin, &mask ) ) < lin )
+	  lf_warning( "read %lld data from %s, expected %lld",
+		      (long long)( i*fac[0]*lin + n*lin + j ), infile,
+		      (long long)( nin*lin ) );
+	for ( k = off[1]*head.dims[2]; k < j; k++ )
+	  out[k] += in[k];
+      }
+      if ( n < fac[0] )
 	lf_warning( "read %lld data from %s, expected %lld",
-		    (long long)( i*fac[0]*lin + n*lin + j ), infile,
+		    (long long)( i*fac[0]*lin + n*lin ), infile,
 		    (long long)( nin*lin ) );
-      for ( k = off[1]; k < j; k++ )
-	out[k] += in[k];
-    }
-    if ( n < fac[0] )
-      lf_warning( "read %lld data from %s, expected %lld",
-		  (long long)( i*fac[0]*lin + n*lin ), infile,
-		  (long long)( nin*lin ) );
-    for ( k = off[1]; k < lin; k++ )
-      out[k] /= fac[0];
-
-    /* Resample in place along dim2. */
-    for ( j = 0; j < npt[1]; j++ ) {
-      for ( k = 0; k < head.dims[2]; k++ )
-	out[k] = out[head.dims[2]*off[1] + k];
-      for ( n = 1; n < fac[1]; n++ ) {
+      for ( k = off[1]*head.dims[2]; k < lin; k++ )
+	out[k] /= fac[0];
+
+      /* Resample in place along dim2. */
+      for ( j = 0; j < npt[1]; j++ ) {
 	for ( k = 0; k < head.dims[2]; k++ )
-	  out[head.dims[2]*j+k] +=
-	    out[head.dims[2]*( j*fac[1] + n + off[1] ) + k];
+	  out[head.dims[2]*j+k] = out[head.dims[2]*( j*fac[1] + off[1] ) + k];
+	for ( n = 1; n < fac[1]; n++ ) {
+	  for ( k = 0; k < head.dims[2]; k++ )
+	    out[head.dims[2]*j+k] +=
+	      out[head.dims[2]*( j*fac[1] + n + off[1] ) + k];
+	}
       }
+      for ( j = 0; j < lout; j++ )
+	out[j] /= fac[1];
     }
-    for ( j = 0; j < lout; j++ )
-      out[j] /= fac[1];
 
     /* Write row out. */
-    if ( fwrite( out, sizeof(double), lout, fpout ) < lout ) {
+    if ( lfrealWrite( out, bits, lrow, fpout ) < lrow ||
+	 ( ovr && lfovrAdd( ovr, out ) ) ) {
       lf_error( "could not write data to %s", outfile );
       fclose( fpin );
       fclose( fpout );
       free( in );
+      free( cin );
       free( out );
+      free( acc.cnt );
+      lfovrFree( ovr );
       lfbxFree( &head );
       return 2;
     }
@@ -394,18 +796,36 @@ main( int argc, char **argv )
   /* If input terminated prematurely, explicitly fill remainder of
      output array with zeroes. */
   free( in );
+  free( cin );
   fclose( fpin );
-  memset( out, 0, lout*sizeof(double) );
+  if ( acc.cnt )
+    free( acc.cnt );
+  if ( mask.fp ) {
+    fclose( mask.fp );
+    free( mask.bits );
+  }
+  memset( out, 0, lrow*sizeof(double) );
   for ( ; i < npt[0]; i++ ) {
-    if ( fwrite( out, sizeof(double), lout, fpout ) < lout ) {
+    if ( lfrealWrite( out, bits, lrow, fpout ) < lrow ||
+	 ( ovr && lfovrAdd( ovr, out ) ) ) {
       lf_error( "could not write data to %s", outfile );
       fclose( fpout );
       free( out );
+      lfovrFree( ovr );
       lfbxFree( &head );
       return 2;
     }
   }
 
+  /* Append overview levels. */
+  if ( ovr && lfovrWrite( fpout, &head, ovr ) ) {
+    lf_error( "could not write overviews to %s", outfile );
+    fclose( fpout );
+    free( out );
+    lfbxFree( &head );
+    return 2;
+  }
+
   /* Finished. */
   fclose( fpout );
   free( out );
@@ -0,0 +1,573 @@
+static const char *version = "\
+lfstack version " VERSION "\n\
+Copyright (c) 2019 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+
+static const char *usage = "\
+Usage: %s [OPTION]... [INFILE]... OUTFILE\n\
+Stack LoFASM files by local sidereal time.\n\
+\n\
+  -h, --help              print this usage information\n\
+  -H, --man               display the program's man page\n\
+      --manpage           print the program's man page (groff)\n\
+      --markdown          print the program's man page (markdown)\n\
+  -V, --version           print program version\n\
+  -v, --verbosity=LEVEL   set status message reporting level\n\
+  -n, --bins=NBIN         number of sidereal time bins per sidereal day\n\
+  -l, --longitude=DEG     east longitude of station in degrees\n\
+  -t, --trim              reject highest and lowest values in each bin\n\
+  -d, --days              stack only whole sidereal days of input\n\
+  -p, --pad=VALUE         set value for bins with no data\n\
+\n";
+
+static const char *description = "\
+# lfstack(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfstack(1)` - stack lofasm-filterbank(5) files in sidereal time\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfstack` [_OPTION_]... [_INFILE_]... _OUTFILE_\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program reads one or more lofasm-filterbank(5) files _INFILE_...\n\
+spanning the same frequency range, and averages their data into bins\n\
+of local sidereal time, writing the result to _OUTFILE_.  This is\n\
+typically used to build up a sidereal-day average spectrogram from\n\
+many days of observations, where each bin of the output contains the\n\
+mean of all input timesteps that fall within that range of sidereal\n\
+time, for each frequency bin separately.\n\
+\n\
+At least one non-option argument _OUTFILE_ must be given, indicating\n\
+the name of the output file.  If _OUTFILE_ is a single `-` character,\n\
+the result will be written to standard output.  If no other non-option\n\
+argument _INFILE_ is given, a single input file is read from standard\n\
+input.  Also, any one of _INFILE_ may be a single `-` character,\n\
+indicating a file to be read from standard input.\n\
+\n\
+Each input file is streamed one row at a time and accumulated into\n\
+running sums and counts for each sidereal time bin, so the memory\n\
+required depends only on the number of bins and the row length, not\n\
+on the number or length of the input files.  Non-finite input values\n\
+(e.g. `nan` padding inserted by lfcat(1)) are ignored, so that they do\n\
+not contaminate the average.\n\
+\n\
+The time of each input timestep is computed from the `time_offset_J2000`\n\
+and `dim1_start` header fields and the time sampling interval, taking\n\
+the centre of the timestep; if `dim1_start` is absent, the `start_mjd`\n\
+field is used instead, and a file with neither is an error.  The\n\
+Greenwich mean sidereal time is computed from the standard linear\n\
+formula in UT, neglecting the difference between UT1 and UTC, which\n\
+is adequate for bins longer than about a second.  This is converted\n\
+to local sidereal time by adding the station longitude given by the\n\
+`-l, --longitude` option.\n\
+\n\
+The output file has the same frequency axis and metadata as the first\n\
+input file, but its dimension 1 is local sidereal time, measured in\n\
+sidereal seconds from 0 to 86400, and its `time_offset_J2000` and\n\
+`start_mjd` fields are set to zero.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-n, --bins=`_NBIN_:\n\
+    Sets the number of sidereal time bins spanning one sidereal day.\n\
+    By default, the number is chosen so that the bin width is as close\n\
+    as possible to the timestep of the first input file.\n\
+\n\
+`-l, --longitude=`_DEG_:\n\
+    Sets the east longitude of the station, in degrees, used to\n\
+    convert Greenwich to local sidereal time.  The default is `0`,\n\
+    i.e. the output is binned in Greenwich mean sidereal time.\n\
+\n\
+`-t, --trim`:\n\
+    Rejects the single highest and lowest values contributing to each\n\
+    output point, averaging only the remaining values.  This requires\n\
+    only two extra numbers per point to be stored, and provides some\n\
+    robustness against transient interference that affects only one\n\
+    of the stacked days.  Points with fewer than three contributions\n\
+    are averaged normally.\n\
+\n\
+`-d, --days`:\n\
+    Stacks only a whole number of sidereal days of input, measured\n\
+    from the start of the earliest input file, and ignores rows in the\n\
+    final partial day.  Every sidereal time bin is then sampled by\n\
+    the same number of days (apart from gaps in the data), rather than\n\
+    the bins at the ends of the data being sampled once more than the\n\
+    rest.  The headers of all input files are read before stacking, so\n\
+    this option cannot be used with standard input, and it is an\n\
+    error if the inputs span less than one sidereal day.\n\
+\n\
+`-p, --pad=`_VALUE_:\n\
+    Sets a value to be used for output points that received no finite\n\
+    input data.  The value will be parsed as a floating-point number:\n\
+    in addition to ordinary numbers, you may also specify `nan`,\n\
+    `inf`, etc.  The default is `nan`.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the files have\n\
+incompatible frequencies or data types or no valid start time, and 4\n\
+on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfcat(1),\n\
+lfbxRead(3),\n\
+lfbxWrite(3),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+
+static const char short_opts[] = "hHVv:n:l:tdp:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "bins", 1, 0, 'n' },
+  { "longitude", 1, 0, 'l' },
+  { "trim", 0, 0, 't' },
+  { "days", 0, 0, 'd' },
+  { "pad", 1, 0, 'p' },
+  { 0, 0, 0, 0} };
+
+#define MJD_J2000 51544.5        /* MJD of J2000 epoch */
+#define SIDEREAL 1.00273790935   /* ratio of sidereal to solar rate */
+
+/* Macro to free all memory and close all files, prior to exiting.
+   This should only within main(), which should initialize all
+   unallocated pointers to NULL to avoid potentially trying to free
+   random pointer values. */
+#define CLEANEXIT( code ) \
+do { \
+  lfbxFree( &header ); \
+  lfbxFree( &first ); \
+  if ( row ) free( row ); \
+  if ( sum ) free( sum ); \
+  if ( lo ) free( lo ); \
+  if ( hi ) free( hi ); \
+  if ( cnt ) free( cnt ); \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  exit( code ); \
+} while ( 0 )
+
+
+/* Get the start time of a file's data in seconds since J2000, from
+   dim1_start or else start_mjd.  Returns 0, or 1 if neither field
+   gives a valid time. */
+static int
+start_time( const lfb_hdr *h, double *t0 )
+{
+  if ( isfinite( h->dim1_start ) )
+    *t0 = h->time_offset_J2000 + h->dim1_start;
+  else if ( isfinite( h->start_mjd ) && h->start_mjd > 0.0 )
+    *t0 = ( h->start_mjd - MJD_J2000 )*86400.0;
+  else
+    return 1;
+  return isfinite( *t0 ) ? 0 : 1;
+}
+
+
+/* Compute local sidereal time, in sidereal seconds from 0 to 86400,
+   for a time t given in seconds since J2000 and an east longitude
+   lon in degrees. */
+static double
+lst( double t, double lon )
+{
+  double deg = 280.46061837 + 360.98564736629*( t/86400.0 ) + lon;
+  deg = fmod( deg, 360.0 );
+  if ( deg < 0.0 )
+    deg += 360.0;
+  return deg*240.0;
+}
+
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;              /* option character and index */
+  int64_t nbin = 0;           /* number of sidereal time bins */
+  double lon = 0.0;           /* east longitude in degrees */
+  int trim = 0;               /* whether to reject extreme values */
+  int days = 0;               /* whether to stack whole days only */
+  double pad = NAN;           /* value for empty bins */
+  FILE *fpin = NULL;          /* input file */
+  FILE *fpout = NULL;         /* output file */
+  char *infile, *outfile;     /* input/output filenames */
+  lfb_hdr header = {};        /* current input or output header */
+  lfb_hdr first = {};         /* first input header */
+  lfb_hdr *h;                 /* header of current input file */
+  double *row = NULL;         /* single timestep of data */
+  double *sum = NULL;         /* accumulated sums in each bin */
+  double *lo = NULL, *hi = NULL; /* lowest and highest values in bins */
+  uint32_t *cnt = NULL;       /* number of values in each bin */
+  int nin;                    /* number of input files */
+  int64_t lin = 0;            /* number of doubles per row */
+  int64_t nrow = 0;           /* total number of rows stacked */
+  int64_t i, j, k, n;         /* indecies and size/return code */
+  double t0, dt;              /* start time and timestep of input */
+  double tmin = INFINITY;     /* start of earliest input */
+  double tend = INFINITY;     /* end of last whole sidereal day */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      CLEANEXIT( 0 );
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      CLEANEXIT( 0 );
+    case 'H':
+      markdown_to_man_out( description );
+      CLEANEXIT( 0 );
+    case 'V':
+      fputs( version, stdout );
+      CLEANEXIT( 0 );
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'n':
+      if ( ( nbin = atoll( optarg ) ) <= 0 ) {
+	lf_error( "number of bins must be positive" );
+	CLEANEXIT( 1 );
+      }
+      break;
+    case 'l':
+      {
+	char *tail; /* any unparseable part of optarg */
+	lon = strtod( optarg, &tail );
+	if ( tail[0] || !isfinite( lon ) ) {
+	  lf_error( "could not parse longitude %s", optarg );
+	  CLEANEXIT( 1 );
+	}
+      }
+      break;
+    case 't':
+      trim = 1;
+      break;
+    case 'd':
+      days = 1;
+      break;
+    case 'p':
+      {
+	char *tail; /* any unparseable part of optarg */
+	pad = strtod( optarg, &tail );
+	if ( tail[0] ) {
+	  lf_error( "could not parse pad value %s", optarg );
+	  CLEANEXIT( 1 );
+	}
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      CLEANEXIT( 1 );
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      CLEANEXIT( 1 );
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      CLEANEXIT( 1 );
+    }
+  }
+
+  /* Count input files. */
+  nin = argc - optind - 1;
+  if ( nin < 0 ) {
+    lf_error( "no output file specified\n\t"
+	      "Try %s --help for more information", argv[0] );
+    CLEANEXIT( 1 );
+  }
+
+  /* With -d, scan the input headers for the span of the data, and
+     find the end of the last whole sidereal day. */
+  if ( days ) {
+    double tmax = -INFINITY; /* end of latest input */
+    if ( nin == 0 ) {
+      lf_error( "-d, --days cannot read from stdin" );
+      CLEANEXIT( 1 );
+    }
+    for ( n = 0; n < nin; n++ ) {
+      if ( !strcmp( ( infile = argv[optind+n] ), "-" ) ) {
+	lf_error( "-d, --days cannot read from stdin" );
+	CLEANEXIT( 1 );
+      }
+      if ( !( fpin = lfopen( infile, "rb" ) ) ) {
+	lf_error( "could not open input %s", infile );
+	CLEANEXIT( 2 );
+      }
+      lfbxFree( &header );
+      if ( lfbxRead( fpin, &header, NULL ) ) {
+	lf_error( "could not parse header from %s", infile );
+	CLEANEXIT( 2 );
+      }
+      fclose( fpin );
+      fpin = NULL;
+      if ( header.dims[0] < 1 || !( header.dim1_span > 0.0 ) )
+	continue;
+      if ( start_time( &header, &t0 ) ) {
+	lf_error( "no valid start time in %s", infile );
+	CLEANEXIT( 3 );
+      }
+      if ( t0 < tmin )
+	tmin = t0;
+      if ( t0 + header.dim1_span > tmax )
+	tmax = t0 + header.dim1_span;
+    }
+    k = ( tmax > tmin ? (int64_t)( ( tmax - tmin )*SIDEREAL/86400.0 ) : 0 );
+    if ( k < 1 ) {
+      lf_error( "inputs span less than one sidereal day" );
+      CLEANEXIT( 3 );
+    }
+    tend = tmin + k*86400.0/SIDEREAL;
+    lf_info( "stacking %lld whole sidereal days", (long long)( k ) );
+  }
+
+  /* Loop over input files, accumulating data as we go.  If there are
+     no input file arguments, read one file from stdin. */
+  for ( n = 0; n < nin || ( n == 0 && nin == 0 ); n++ ) {
+
+    /* Open file and read header. */
+    if ( nin == 0 || !strcmp( argv[optind+n], "-" ) ) {
+      if ( !( fpin = lfdopen( 0, "rb" ) ) ) {
+	lf_error( "could not read from stdin" );
+	CLEANEXIT( 2 );
+      }
+      infile = "stdin";
+    } else if ( !( fpin = lfopen( ( infile = argv[optind+n] ), "rb" ) ) ) {
+      lf_error( "could not open input %s", infile );
+      CLEANEXIT( 2 );
+    }
+    h = ( n == 0 ? &first : &header );
+    lfbxFree( h );
+    if ( lfbxRead( fpin, h, NULL ) ) {
+      lf_error( "could not parse header from %s", infile );
+      CLEANEXIT( 2 );
+    }
+
+    /* The first file sets the frequency sampling and data type, and
+       the storage is allocated accordingly. */
+    if ( n == 0 ) {
+      if ( first.dims[3] != 64 ) {
+	lf_error( "requires real64 data" );
+	CLEANEXIT( 3 );
+      }
+      if ( !first.data_type || strcmp( first.data_type, "real64" ) )
+	lf_warning( "treating as real64 data" );
+      if ( nbin == 0 ) {
+	if ( first.dims[0] < 1 || !( first.dim1_span > 0.0 ) ) {
+	  lf_error( "could not get timestep from %s", infile );
+	  CLEANEXIT( 3 );
+	}
+	dt = first.dim1_span/first.dims[0];
+	if ( ( nbin = (int64_t)round( 86400.0/( SIDEREAL*dt ) ) ) < 1 )
+	  nbin = 1;
+      }
+      lf_info( "stacking into %lld bins of %f sidereal seconds",
+	       (long long)( nbin ), 86400.0/nbin );
+      lin = first.dims[1]*first.dims[2];
+      row = (double *)malloc( lin*sizeof(double) );
+      sum = (double *)calloc( nbin*lin, sizeof(double) );
+      cnt = (uint32_t *)calloc( nbin*lin, sizeof(uint32_t) );
+      if ( trim ) {
+	lo = (double *)malloc( nbin*lin*sizeof(double) );
+	hi = (double *)malloc( nbin*lin*sizeof(double) );
+      }
+      if ( !row || !sum || !cnt || ( trim && ( !lo || !hi ) ) ) {
+	lf_error( "memory error" );
+	CLEANEXIT( 4 );
+      }
+      if ( trim )
+	for ( i = 0; i < nbin*lin; i++ ) {
+	  lo[i] = INFINITY;
+	  hi[i] = -INFINITY;
+	}
+    }
+
+    /* Check for identical frequency sampling and data types. */
+    if ( first.frequency_offset_DC + first.dim2_start !=
+	 h->frequency_offset_DC + h->dim2_start ||
+	 first.dim2_span != h->dim2_span ||
+	 first.data_offset != h->data_offset ||
+	 first.data_scale != h->data_scale ||
+	 ( first.data_type && h->data_type &&
+	   strcmp( first.data_type, h->data_type ) ) ) {
+      lf_error( "incompatible frequencies/data types in %s", infile );
+      CLEANEXIT( 3 );
+    }
+    for ( i = 1; i < LFB_DMAX; i++ )
+      if ( first.dims[i] != h->dims[i] ) {
+	lf_error( "incompatible frequencies/data types in %s", infile );
+	CLEANEXIT( 3 );
+      }
+
+    /* Get start time in seconds since J2000, and timestep. */
+    if ( h->dims[0] < 1 || !( h->dim1_span > 0.0 ) ) {
+      lf_warning( "skipping %s with no timing information", infile );
+      fclose( fpin );
+      fpin = NULL;
+      continue;
+    }
+    if ( start_time( h, &t0 ) ) {
+      lf_error( "no valid start time in %s", infile );
+      CLEANEXIT( 3 );
+    }
+    dt = h->dim1_span/h->dims[0];
+
+    /* Stream rows, adding finite values into their bins. */
+    for ( i = 0; i < h->dims[0]; i++ ) {
+      double *s, *l, *u; /* pointers to this row's bin */
+      uint32_t *c;       /* pointer to this row's counts */
+      if ( ( j = fread( row, sizeof(double), lin, fpin ) ) < lin ) {
+	lf_warning( "read %lld data from %s, expected %lld",
+		    (long long)( i*lin + j ), infile,
+		    (long long)( h->dims[0]*lin ) );
+	break;
+      }
+      if ( t0 + ( i + 0.5 )*dt >= tend )
+	break;
+      k = (int64_t)( lst( t0 + ( i + 0.5 )*dt, lon )*nbin/86400.0 );
+      if ( k >= nbin )
+	k = nbin - 1;
+      s = sum + k*lin;
+      c = cnt + k*lin;
+      for ( j = 0; j < lin; j++ )
+	if ( isfinite( row[j] ) ) {
+	  s[j] += row[j];
+	  c[j]++;
+	}
+      if ( trim ) {
+	l = lo + k*lin;
+	u = hi + k*lin;
+	for ( j = 0; j < lin; j++ )
+	  if ( isfinite( row[j] ) ) {
+	    if ( row[j] < l[j] )
+	      l[j] = row[j];
+	    if ( row[j] > u[j] )
+	      u[j] = row[j];
+	  }
+      }
+      nrow++;
+    }
+    fclose( fpin );
+    fpin = NULL;
+  }
+  lf_info( "stacked %lld rows from %d files", (long long)( nrow ),
+	   ( nin ? nin : 1 ) );
+
+  /* Write output header. */
+  lfbxFree( &header );
+  memcpy( &header, &first, sizeof(lfb_hdr) );
+  memset( &first, 0, sizeof(lfb_hdr) );
+  header.time_offset_J2000 = 0.0;
+  header.start_mjd = 0.0;
+  header.dim1_start = 0.0;
+  header.dim1_span = 86400.0;
+  header.dims[0] = nbin;
+  free( header.dim1_label );
+  header.dim1_label = NULL;
+  if ( !( header.dim1_label = strdup( "sidereal time (s)" ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  if ( !strcmp( argv[argc-1], "-" ) ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( ( outfile = argv[argc-1] ), "wb" ) ) ) {
+    lf_error( "could not open output %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &header, NULL ) ) {
+    lf_error( "error writing to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Compute averages and write output one bin at a time. */
+  for ( k = 0; k < nbin; k++ ) {
+    double *s = sum + k*lin; /* pointer to this bin's sums */
+    uint32_t *c = cnt + k*lin; /* pointer to this bin's counts */
+    for ( j = 0; j < lin; j++ ) {
+      if ( c[j] == 0 )
+	row[j] = pad;
+      else if ( trim && c[j] > 2 )
+	row[j] = ( s[j] - lo[k*lin+j] - hi[k*lin+j] )/( c[j] - 2 );
+      else
+	row[j] = s[j]/c[j];
+    }
+    if ( fwrite( row, sizeof(double), lin, fpout ) < lin ) {
+      lf_error( "error writing to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+  }
+  CLEANEXIT( 0 );
+}
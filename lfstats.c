@@ -28,6 +28,7 @@ Compute various statistics from a LoFASM file.\n\
   -v, --verbosity=LEVEL   set status message reporting level\n\
   -p, --percent=P1[+...]  compute percentiles\n\
   -m, --moments=N         compute up to Nth moment\n\
+  -M, --mask=MASKFILE     ignore samples flagged in MASKFILE\n\
 \n";
 
 static const char *description = "\
@@ -50,6 +51,13 @@ statistics.  If _INFILE_ is absent or a single `-` character, then\n\
 data is read from standard input; statistics are written to standard\n\
 output.\n\
 \n\
+The data may be stored as `real32` or `real64`; in either case the\n\
+statistics are computed in double precision.\n\
+\n\
+If a mask file is given with the `-M, --mask` option, then flagged\n\
+samples are excluded from all statistics, and the reported number of\n\
+points counts only the unflagged samples.\n\
+\n\
 ## OPTIONS\n\
 \n\
 `-h, --help`:\n\
@@ -98,6 +106,12 @@ output.\n\
 >> standard deviation: _s_ = sqrt[ < ( _xi_ - _x_ )^2 > ]  \n\
 >> standard moment _k_>2: _mk_ = < ( _xi_ - _x_ )^ _k_ >/( _s_ ^ _k_ )\n\
 \n\
+`-M, --mask=`_MASKFILE_:\n\
+    Reads a `bit1` mask file with the same rows and columns as the\n\
+    input (such as is written by lfflag(1)), and excludes samples\n\
+    whose mask bit is set.  See lofasm-filterbank(5) for the mask\n\
+    format.\n\
+\n\
 ## EXIT STATUS\n\
 \n\
 The proram exits with status 0 normally, 1 if there is an error\n\
@@ -108,6 +122,8 @@ formatted. and 4 on memory allocation errors.\n\
 \n\
 lfbxRead(3),\n\
 lfbxWrite(3),\n\
+lfmaskRead(3),\n\
+lfflag(1),\n\
 lofasm-filterbank(5)\n\
 \n";
 
@@ -117,7 +133,7 @@ lofasm-filterbank(5)\n\
 #include "markdown_parser.h"
 #include "lofasmIO.h"
 
-static const char short_opts[] = "hHVv:p:m:";
+static const char short_opts[] = "hHVv:p:m:M:";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -127,6 +143,7 @@ static const struct option long_opts[] = {
   { "verbosity", 1, 0, 'v' },
   { "percent", 1, 0, 'p' },
   { "momemnts", 1, 0, 'm' },
+  { "mask", 1, 0, 'M' },
   { 0, 0, 0, 0} };
 
 /* Comparison function for sorting data.  The comparison is written so
@@ -165,11 +182,18 @@ main( int argc, char **argv )
   int moments = 2;          /* highest-order moment */
   double *mk;               /* array of moments */
   char *infile;             /* input file name */
+  char *maskfile = NULL;    /* mask file name */
   FILE *fp = NULL;          /* file pointer */
+  FILE *fpm = NULL;         /* mask file pointer */
+  lfb_mask mstate = {};     /* mask read state */
+  unsigned char *msk = NULL; /* mask bits for data */
   lfb_hdr head = {};        /* input header */
   int64_t i, j, imax, jmax; /* indecies and ranges in dims 1 and 2 */
   int64_t n;                /* number of data read */
+  int64_t nm, ncomp;        /* mask bits per read, and data per bit */
+  int64_t nuse = 0;         /* number of unflagged data */
   int k;                    /* index over moments */
+  int bits;                 /* bit depth of data (32 or 64) */
   double *data;             /* array of data, or just one row */
   double d, min, max;       /* datum, minimum, and maximum */
 
@@ -213,6 +237,9 @@ main( int argc, char **argv )
 	return 1;
       }
       break;
+    case 'M':
+      maskfile = optarg;
+      break;
     case '?':
       if ( optopt )
 	lf_error( "unknown option -%c\n\t"
@@ -282,15 +309,13 @@ main( int argc, char **argv )
   }
 
   /* Check data type. */
-  if ( head.dims[3] != 64 ) {
-    lf_error( "requires real64 data" );
+  if ( !( bits = lfrealBits( &head ) ) ) {
+    lf_error( "requires real32 or real64 data" );
     fclose( fp );
     free( mk );
     lfbxFree( &head );
     return 3;
   }
-  if ( !head.data_type || strcmp( head.data_type, "real64" ) )
-    lf_warning( "treating as real64 data" );
 
   /* Allocate data storage. */
   if ( percent ) {
@@ -308,16 +333,53 @@ main( int argc, char **argv )
     return 4;
   }
 
+  /* Open mask, if any. */
+  ncomp = ( head.dims[2] > 0 ? head.dims[2] : 1 );
+  nm = jmax/ncomp;
+  if ( maskfile ) {
+    if ( !( fpm = lfmaskOpen( maskfile, &head ) ) ) {
+      fclose( fp );
+      free( mk );
+      free( data );
+      lfbxFree( &head );
+      return 2;
+    }
+    if ( !( msk = (unsigned char *)calloc( nm, sizeof(unsigned char) ) ) ) {
+      lf_error( "memory error" );
+      fclose( fp );
+      fclose( fpm );
+      free( mk );
+      free( data );
+      lfbxFree( &head );
+      return 4;
+    }
+  }
+
   /* Read data, updating moments and extrema as we go. */
   for ( i = 0; i < imax; i++ ) {
     if ( feof( fp ) )
       memset( data, 0, jmax*sizeof(double) );
-    else if ( ( n = fread( data, sizeof(double), jmax, fp ) ) < jmax ) {
-      lf_warning( "read %lld doubles, expected %lld",
+    else if ( ( n = lfrealRead( data, bits, jmax, fp ) ) < jmax ) {
+      lf_warning( "read %lld data, expected %lld",
 		  (long long)( i*jmax + n ), (long long)( imax*jmax ) );
       memset( data + n, 0, ( jmax - n )*sizeof(double) );
     }
-    for ( j = 0; j < jmax; j++ ) {
+
+    /* Drop flagged data, packing unflagged data at the start. */
+    n = jmax;
+    if ( fpm ) {
+      if ( ( n = lfmaskRead( msk, nm, &mstate, fpm ) ) < nm ) {
+	lf_warning( "read %lld bits from %s, expected %lld",
+		    (long long)( i*nm + n ), maskfile,
+		    (long long)( imax*nm ) );
+	memset( msk + n, 0, nm - n );
+      }
+      for ( j = n = 0; j < jmax; j++ )
+	if ( !msk[j/ncomp] )
+	  data[n++] = data[j];
+    }
+    nuse += n;
+    for ( j = 0; j < n; j++ ) {
       d = data[j];
       for ( k = 1; k <= moments; k++ )
 	mk[k] += pow( d, k );
@@ -328,9 +390,13 @@ main( int argc, char **argv )
     }
   }
   fclose( fp );
+  if ( fpm )
+    fclose( fpm );
+  if ( msk )
+    free( msk );
 
   /* Compute all standardized moments. */
-  mk[0] = imax*jmax;
+  mk[0] = nuse;
   /* Convert sums to expectation values. */
   for ( k = moments; k >= 0; k-- )
     mk[k] /= mk[0];
@@ -345,7 +411,7 @@ main( int argc, char **argv )
     mk[k] /= pow( mk[2], k );
 
   /* Write arithmetic stats. */
-  printf( "npts:   %lld\n", (long long)( imax*jmax ) );
+  printf( "npts:   %lld\n", (long long)( nuse ) );
   if ( moments > 0 )
     printf( "mean:   %g\n", mk[1] );
   if ( moments > 1 )
@@ -358,12 +424,14 @@ main( int argc, char **argv )
 
   /* Print percentiles. */
   if ( percent ) {
-    qsort( data, jmax, sizeof(double), ascend );
+    qsort( data, nuse, sizeof(double), ascend );
     for ( b = percent, a = NULL; a != b; ) {
       d = strtod( a = b, &b );
       if ( a != b )
 	printf( "%5.1f %%ile: %g\n", d,
-		data[(int)floor( 0.01*d*( jmax - 1 ) + 0.5 )] );
+		( nuse > 0 ?
+		  data[(int64_t)floor( 0.01*d*( nuse - 1 ) + 0.5 )] :
+		  strtod( "nan", 0 ) ) );
     }
   }
   return 0;
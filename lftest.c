@@ -26,6 +26,7 @@ Test lofasm routines.\n\
       --markdown         print the program's man page (markdown)\n\
   -V, --version          print program version\n\
   -v, --verbosity=LEVEL  set status message reporting level\n\
+  -m, --mask-check       check bit-packed mask I/O and exit\n\
 \n\
 Other options and non-option arguments may be allowed or required.\n\
 \n";
@@ -69,6 +70,12 @@ effects may change without notice.\n\
     (verbose, errors and warnings), or `3` (very verbose, errors,\n\
     warnings, and extra information).\n\
 \n\
+`-m, --mask-check`:\n\
+    Writes masks of 1 to 16 columns to a temporary file, one row per\n\
+    call to lfmaskWrite(3), reads them back with lfmaskRead(3), and\n\
+    exits with status 0 if every bit survives the round trip, or 1\n\
+    otherwise.\n\
+\n\
 These are the standard options for `lofasmio` programs.  Since\n\
 `lftest` is a sandbox for trying out functions, addtional options (or\n\
 non-option arguments) may be added; conceivably the above options may\n\
@@ -94,7 +101,7 @@ lofasmio(7)\n\
 #include "lofasmIO.h"
 #include "markdown_parser.h"
 
-static const char short_opts[] = ":hHVv:";
+static const char short_opts[] = ":hHVv:m";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -102,8 +109,43 @@ static const struct option long_opts[] = {
   { "markdown", 0, 0, 0 },
   { "version", 0, 0, 'V' },
   { "verbosity", 1, 0, 'v' },
+  { "mask-check", 0, 0, 'm' },
   { 0, 0, 0, 0} };
 
+
+/* Write a pseudorandom mask of nrow rows and ncol columns to a
+   temporary file one row at a time, read it back in one block, and
+   return the number of bits that differ (or -1 on an I/O error). */
+static int64_t
+mask_check( int64_t nrow, int64_t ncol )
+{
+  FILE *fp;                /* temporary file */
+  lfb_mask mask = {};      /* partial-byte state */
+  unsigned char *in, *out; /* written and read bits */
+  int64_t i, n = nrow*ncol, nerr = -1;
+  unsigned int seed = 12345 + ncol;
+
+  if ( !( in = (unsigned char *)malloc( 2*n ) ) )
+    return -1;
+  out = in + n;
+  for ( i = 0; i < n; i++ )
+    in[i] = ( ( seed = seed*1103515245 + 12345 ) >> 16 ) & 1;
+  if ( ( fp = tmpfile() ) ) {
+    for ( i = 0; i < nrow; i++ )
+      if ( lfmaskWrite( in + i*ncol, ncol, &mask, fp ) < ncol )
+	break;
+    if ( i == nrow && !lfmaskFlush( &mask, fp ) ) {
+      rewind( fp );
+      if ( lfmaskRead( out, n, &mask, fp ) == n )
+	for ( i = 0, nerr = 0; i < n; i++ )
+	  nerr += ( in[i] != out[i] );
+    }
+    fclose( fp );
+  }
+  free( in );
+  return nerr;
+}
+
 int
 main( int argc, char *argv[] )
 {
@@ -138,6 +180,16 @@ main( int argc, char *argv[] )
     case 'v':
       lofasm_verbosity = atoi( optarg );
       break;
+    case 'm':
+      for ( i = 1, j = 0; i <= 16; i++ )
+	if ( ( k = mask_check( 37, i ) ) ) {
+	  lf_error( "mask round trip failed for %lld columns"
+		    " (%lld bad bits)", (long long)( i ), (long long)( k ) );
+	  j = 1;
+	}
+      if ( !j )
+	lf_info( "mask round trip passed for 1 to 16 columns" );
+      exit( j ? EXIT_FAILURE : EXIT_SUCCESS );
     case '?':
       if ( optopt )
 	lf_error( "unknown option -%c\n\t"
@@ -20,12 +20,14 @@ static const char *usage = "\
 Usage: %s [OPTION]... TYPE [INFILE [OUTFILE]]\n\
 Converts storage type of a LoFASM data file.\n\
 \n\
-  -h, --help             print this usage information\n\
-  -H, --man              display the program's man page\n\
-      --manpage          print the program's man page (groff)\n\
-      --markdown         print the program's man page (markdown)\n\
-  -V, --version          print program version\n\
-  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -h, --help               print this usage information\n\
+  -H, --man                display the program's man page\n\
+      --manpage            print the program's man page (groff)\n\
+      --markdown           print the program's man page (markdown)\n\
+  -V, --version            print program version\n\
+  -v, --verbosity=LEVEL    set status message reporting level\n\
+  -r, --rescale            apply input data_offset and data_scale\n\
+  -s, --scale=DOFF,DSCALE  store data with new offset and scale\n\
 \n";
 
 static const char *description = "\
@@ -56,12 +58,27 @@ where _type_ is one of the recognized types (below).  Furthermore, the\n\
 final dimension length must match the bit depth of the type.  The data\n\
 is converted to the specified _TYPE_ from the command line.  The ouput\n\
 file is written with the new data block, final dimension, and\n\
-`%data_type:` header comment; all other header comments are unchanged.\n\
-\n\
-Conversion uses standard C type casting.  The program makes no attempt\n\
-to rescale the data: values out of the dynamic range of the target\n\
-_TYPE_ will typically be converted to the maximum or minimum value of\n\
-that type.\n\
+`%data_type:` header comment; all other header comments are unchanged\n\
+unless the `-r` or `-s` options are given.\n\
+\n\
+Conversion to an integer _TYPE_ saturates: values out of the dynamic\n\
+range of the target type are converted to its maximum or minimum\n\
+value, non-integer values are truncated towards zero, and NaN is\n\
+converted to zero.  Conversion to a real _TYPE_ uses standard C type\n\
+casting.  By default the program makes no attempt to rescale the\n\
+data.\n\
+\n\
+With the `-r` or `-s` options, the input is first converted to a\n\
+physical quantity _doff_ + _dscale_ x _datum_ using the input\n\
+`%data_offset:` and `%data_scale:` header comments (missing values are\n\
+taken to be 0 and 1).  The output is then stored as (_quantity_ -\n\
+_DOFF_)/_DSCALE_, and the output header records the new _DOFF_ and\n\
+_DSCALE_.  This allows, for instance, real64 data to be packed into\n\
+int16 with a chosen resolution, and unpacked again later.\n\
+\n\
+Each pair of input and output types has its own conversion kernel,\n\
+chosen once before any data is read; the kernels are simple loops\n\
+over whole rows.\n\
 \n\
 ### Recognized Types\n\
 \n\
@@ -71,19 +88,19 @@ command-line argument.\n\
 \n\
 `char8`, `uchar8`:\n\
     Signed and unsigned single-byte integers, corresponding to the C\n\
-    types `char` and `unsigned char`.\n\
+    types `int8_t` and `uint8_t`.\n\
 \n\
 `int16`, `uint16`:\n\
     Signed and unsigned two-byte integers, corresponding to the C\n\
-    types `short` and `unsigned short`.\n\
+    types `int16_t` and `uint16_t`.\n\
 \n\
 `int32`, `uint32`:\n\
     Signed and unsigned four-byte integers, corresponding to the C\n\
-    types `long` and `unsigned long`.\n\
+    types `int32_t` and `uint32_t`.\n\
 \n\
 `int64`, `uint64`:\n\
     Signed and unsigned eight-byte integers, corresponding to the C\n\
-    types `long long` and `unsigned long long`.\n\
+    types `int64_t` and `uint64_t`.\n\
 \n\
 `real32`, `real64`:\n\
     IEEE 754 single-precision and double-precision floating point\n\
@@ -129,6 +146,15 @@ lofasm-filterbank(5) documentation for more details.\n\
     (verbose, errors and warnings), or `3` (very verbose, errors,\n\
     warnings, and extra information).\n\
 \n\
+`-r, --rescale`:\n\
+    Converts the data to physical quantities using the input\n\
+    `%data_offset:` and `%data_scale:`, and sets these to 0 and 1 in\n\
+    the output.  Equivalent to `-s 0,1`.\n\
+\n\
+`-s, --scale=`_DOFF_`,`_DSCALE_:\n\
+    Converts the data to physical quantities as above, then stores\n\
+    them with offset _DOFF_ and nonzero scale factor _DSCALE_.\n\
+\n\
 ## EXIT STATUS\n\
 \n\
 The proram exits with status 0 normally, 1 if there is an error\n\
@@ -152,7 +178,7 @@ lofasm-filterbank(5)\n\
 #include "markdown_parser.h"
 #include "lofasmIO.h"
 
-static const char short_opts[] = ":hHVv:";
+static const char short_opts[] = ":hHVv:rs:";
 static const struct option long_opts[] = {
   { "help", 0, 0, 'h' },
   { "man", 0, 0, 'H' },
@@ -160,53 +186,191 @@ static const struct option long_opts[] = {
   { "markdown", 0, 0, 0 },
   { "version", 0, 0, 'V' },
   { "verbosity", 1, 0, 'v' },
+  { "rescale", 0, 0, 'r' },
+  { "scale", 1, 0, 's' },
   { 0, 0, 0, 0} };
 
-/* Macro to read a row from fpin, convert it, and write it to fpout.
-   The type of from and to are unspecified. */
-#define CONVERT( from, to ) \
-do { \
-  int ni = sizeof( *(from) ); \
-  int no = sizeof( *(to) ); \
-  if ( !( (from) = malloc( ne*ni ) ) || !( (to) = malloc( ne*no ) ) ) { \
-    lf_error( "memory error" ); \
-    fclose( fpout ); \
-    fclose( fpin ); \
-    if ( (from) ) \
-      free( (from) ); \
-    free( encoding ); \
-    return 4; \
-  } \
-  for ( i = 0; i < nrows && !feof( fpin ); i++ ) { \
-    if ( ( n = bxReadData( encoding, (unsigned char *)(from), ne*ni, fpin ) ) \
-	 < ne*ni ) { \
-      lf_warning( "read %lld bytes from %s, expected %lld", \
-	          (long long)( i*ne*ni + n ), infile, \
-                  (long long)( nrows*ne*ni ) ); \
-      memset( (unsigned char *)(from) + n, 0, ne*ni - n ); \
-    } \
-    for ( j = 0; j < ne; j++ ) \
-      (to)[j] = (from)[j]; \
-    if ( bxWriteData( encoding, (const unsigned char *)(to), ne*no, nr, fpout ) \
-	 < ne*no ) { \
-      lf_error( "error writing data to %s", outfile ); \
-      fclose( fpout ); \
-      fclose( fpin ); \
-      free( (from) ); \
-      free( (to) ); \
-      free( encoding ); \
-      return 2; \
-    } \
-  } \
-  free( (from) ); \
-  memset( (unsigned char *)(to), 0, ne*no ); \
-  for ( ; i < nrows; i++ ) \
-    bxWriteData( encoding, (const unsigned char *)(to), ne*no, nr, fpout ); \
-  free( (to) ); \
-} while ( 0 )
+/* Recognized types, in the order used to index the kernel table. */
+#define NTYPE 10
+static const char *typenames[NTYPE] = { "char8", "uchar8", "int16",
+					"uint16", "int32", "uint32",
+					"int64", "uint64", "real32",
+					"real64" };
+static const int typebits[NTYPE] = { 8, 8, 16, 16, 32, 32, 64, 64,
+				     32, 64 };
+
+/* Saturating conversions to each type, from a signed integer (s),
+   unsigned integer (u), or real (d) value.  Integer sources are
+   widened to 64 bits and compared against the target range in their
+   own signedness, so no precision is lost; real sources are compared
+   against the (exactly representable) range limits as doubles. */
+#define SAT( name, type, min, max, smax, umax ) \
+static inline type \
+sat_s_##name( int64_t x ) \
+{ \
+  return ( x < (int64_t)( min ) ? (type)( min ) : \
+	   ( x > (int64_t)( smax ) ? (type)( max ) : (type)( x ) ) ); \
+} \
+static inline type \
+sat_u_##name( uint64_t x ) \
+{ \
+  return ( x > (uint64_t)( umax ) ? (type)( max ) : (type)( x ) ); \
+} \
+static inline type \
+sat_d_##name( double x ) \
+{ \
+  return ( x != x ? (type)( 0 ) : \
+	   ( x <= (double)( min ) ? (type)( min ) : \
+	     ( x >= (double)( max ) ? (type)( max ) : (type)( x ) ) ) ); \
+}
+SAT( char8, int8_t, INT8_MIN, INT8_MAX, INT8_MAX, INT8_MAX )
+SAT( uchar8, uint8_t, 0, UINT8_MAX, UINT8_MAX, UINT8_MAX )
+SAT( int16, int16_t, INT16_MIN, INT16_MAX, INT16_MAX, INT16_MAX )
+SAT( uint16, uint16_t, 0, UINT16_MAX, UINT16_MAX, UINT16_MAX )
+SAT( int32, int32_t, INT32_MIN, INT32_MAX, INT32_MAX, INT32_MAX )
+SAT( uint32, uint32_t, 0, UINT32_MAX, UINT32_MAX, UINT32_MAX )
+SAT( int64, int64_t, INT64_MIN, INT64_MAX, INT64_MAX, INT64_MAX )
+SAT( uint64, uint64_t, 0, UINT64_MAX, INT64_MAX, UINT64_MAX )
+#define FLT( name, type ) \
+static inline type sat_s_##name( int64_t x ) { return (type)( x ); } \
+static inline type sat_u_##name( uint64_t x ) { return (type)( x ); } \
+static inline type sat_d_##name( double x ) { return (type)( x ); }
+FLT( real32, float )
+FLT( real64, double )
+
+/* Conversion kernels.  For each input type ni (C type ti, class ci)
+   and output type no (C type to), cv_ni_no converts n elements
+   directly, while sc_ni_no applies the linear transformation a*x + b
+   in double precision first. */
+typedef void (*lftype_kernel)( const void *restrict, void *restrict,
+			       int64_t, double, double );
+#define KERN( ni, ti, ci, no, to ) \
+static void \
+cv_##ni##_##no( const void *restrict vin, void *restrict vout, \
+		int64_t n, double a, double b ) \
+{ \
+  const ti *restrict in = (const ti *)( vin ); \
+  to *restrict out = (to *)( vout ); \
+  int64_t j; \
+  for ( j = 0; j < n; j++ ) \
+    out[j] = sat_##ci##_##no( in[j] ); \
+} \
+static void \
+sc_##ni##_##no( const void *restrict vin, void *restrict vout, \
+		int64_t n, double a, double b ) \
+{ \
+  const ti *restrict in = (const ti *)( vin ); \
+  to *restrict out = (to *)( vout ); \
+  int64_t j; \
+  for ( j = 0; j < n; j++ ) \
+    out[j] = sat_d_##no( a*in[j] + b ); \
+}
+#define KROW( ni, ti, ci ) \
+KERN( ni, ti, ci, char8, int8_t ) \
+KERN( ni, ti, ci, uchar8, uint8_t ) \
+KERN( ni, ti, ci, int16, int16_t ) \
+KERN( ni, ti, ci, uint16, uint16_t ) \
+KERN( ni, ti, ci, int32, int32_t ) \
+KERN( ni, ti, ci, uint32, uint32_t ) \
+KERN( ni, ti, ci, int64, int64_t ) \
+KERN( ni, ti, ci, uint64, uint64_t ) \
+KERN( ni, ti, ci, real32, float ) \
+KERN( ni, ti, ci, real64, double )
+KROW( char8, int8_t, s )
+KROW( uchar8, uint8_t, u )
+KROW( int16, int16_t, s )
+KROW( uint16, uint16_t, u )
+KROW( int32, int32_t, s )
+KROW( uint32, uint32_t, u )
+KROW( int64, int64_t, s )
+KROW( uint64, uint64_t, u )
+KROW( real32, float, d )
+KROW( real64, double, d )
+#define KTAB( p, ni ) \
+{ p##ni##_char8, p##ni##_uchar8, p##ni##_int16, p##ni##_uint16, \
+  p##ni##_int32, p##ni##_uint32, p##ni##_int64, p##ni##_uint64, \
+  p##ni##_real32, p##ni##_real64 }
+static const lftype_kernel cv_table[NTYPE][NTYPE] = {
+  KTAB( cv_, char8 ), KTAB( cv_, uchar8 ), KTAB( cv_, int16 ),
+  KTAB( cv_, uint16 ), KTAB( cv_, int32 ), KTAB( cv_, uint32 ),
+  KTAB( cv_, int64 ), KTAB( cv_, uint64 ), KTAB( cv_, real32 ),
+  KTAB( cv_, real64 ) };
+static const lftype_kernel sc_table[NTYPE][NTYPE] = {
+  KTAB( sc_, char8 ), KTAB( sc_, uchar8 ), KTAB( sc_, int16 ),
+  KTAB( sc_, uint16 ), KTAB( sc_, int32 ), KTAB( sc_, uint32 ),
+  KTAB( sc_, int64 ), KTAB( sc_, uint64 ), KTAB( sc_, real32 ),
+  KTAB( sc_, real64 ) };
+
+/* Returns the index of the named type, or -1 if unrecognized. */
+static int
+typeindex( const char *name )
+{
+  int k; /* index */
+  for ( k = 0; k < NTYPE; k++ )
+    if ( !strcmp( name, typenames[k] ) )
+      return k;
+  return -1;
+}
+
+/* Returns the index of the header comment starting with key, or -1
+   if there is none. */
+static int
+findkey( int headc, char **headv, const char *key )
+{
+  int k; /* index */
+  for ( k = 0; k < headc; k++ )
+    if ( !strncmp( headv[k], key, strlen( key ) ) )
+      return k;
+  return -1;
+}
+
+/* Sets the header comment with the given key to the given value,
+   inserting it before comment number pos if it is not present.
+   Returns 0 normally, or 4 on memory errors. */
+static int
+setkey( int *headc, char ***headv, const char *key, const char *value,
+	int pos )
+{
+  int k = findkey( *headc, *headv, key ); /* comment index */
+  char *str;                               /* new comment */
+  char **v;                                /* reallocated comments */
+  if ( !( str = (char *)malloc( strlen( key ) + strlen( value ) + 2 ) ) )
+    return 4;
+  sprintf( str, "%s %s", key, value );
+  if ( k >= 0 ) {
+    free( (*headv)[k] );
+    (*headv)[k] = str;
+    return 0;
+  }
+  if ( !( v = (char **)realloc( *headv, ( *headc + 1 )*sizeof(char *) ) ) ) {
+    free( str );
+    return 4;
+  }
+  memmove( v + pos + 1, v + pos, ( *headc - pos )*sizeof(char *) );
+  v[pos] = str;
+  (*headc)++;
+  *headv = v;
+  return 0;
+}
 
 static const char *versionkey = "hdr_version:";
 static const char *typekey = "data_type:";
+static const char *offsetkey = "data_offset:";
+static const char *scalekey = "data_scale:";
+
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpin ) fclose( fpin ); \
+  if ( fpout ) fclose( fpout ); \
+  for ( i = 0; i < headc; i++ ) \
+    if ( headv[i] ) free( headv[i] ); \
+  if ( headv ) free( headv ); \
+  if ( dimv ) free( dimv ); \
+  if ( encoding ) free( encoding ); \
+  if ( inbuf ) free( inbuf ); \
+  if ( outbuf ) free( outbuf ); \
+  exit( code ); \
+} while ( 0 )
 
 int
 main( int argc, char **argv )
@@ -214,25 +378,25 @@ main( int argc, char **argv )
   int opt, lopt;              /* option character and index */
   char *infile, *outfile;     /* input/output filenames */
   char intype[7], outtype[7]; /* input/output data types */
-  FILE *fpin, *fpout;         /* input/output file pointers */
-  char **headv;               /* header comments */
-  int64_t *dimv;              /* dimensions */
-  int headc, dimc;            /* number of comments, dimensions */
-  char *encoding;             /* encoding type */
+  int tin, tout;              /* input/output type indecies */
+  FILE *fpin = NULL;          /* input file pointer */
+  FILE *fpout = NULL;         /* output file pointer */
+  char **headv = NULL;        /* header comments */
+  int64_t *dimv = NULL;       /* dimensions */
+  int headc = 0, dimc;        /* number of comments, dimensions */
+  char *encoding = NULL;      /* encoding type */
   int64_t i, j, nrows;        /* indecies and number of rows */
   int64_t ne, nr = 0, n;      /* effective, true, and read elements per row */
+  int64_t ni, no;             /* input/output bytes per row */
+  int k;                      /* index of data_type comment */
   char *c;                    /* pointer within header comment */
-  /* Row data cast to various types. */
-  char *c8row;
-  unsigned char *uc8row;
-  short *i16row;
-  unsigned char *ui16row;
-  long *i32row;
-  unsigned long *ui32row;
-  long long *i64row;
-  unsigned long long *ui64row;
-  float *r32row;
-  double *r64row;
+  int rescale = 0;            /* whether to rescale data */
+  double doff = 0.0, dscale = 1.0; /* output offset and scale */
+  double ioff = 0.0, iscale = 1.0; /* input offset and scale */
+  double a = 1.0, b = 0.0;    /* linear transformation */
+  unsigned char *inbuf = NULL, *outbuf = NULL; /* row buffers */
+  lftype_kernel kernel;       /* conversion kernel */
+  char str[64];               /* string buffer */
 
   /* Parse options. */
   opterr = 0;
@@ -257,6 +421,19 @@ main( int argc, char **argv )
     case 'v':
       lofasm_verbosity = atoi( optarg );
       break;
+    case 'r':
+      rescale = 1;
+      doff = 0.0;
+      dscale = 1.0;
+      break;
+    case 's':
+      if ( sscanf( optarg, "%lf,%lf", &doff, &dscale ) != 2 ||
+	   dscale == 0.0 || isnan( doff ) || isnan( dscale ) ) {
+	lf_error( "bad argument %s to -s, --scale", optarg );
+	return 1;
+      }
+      rescale = 1;
+      break;
     case '?':
       if ( optopt )
 	lf_error( "unknown option -%c\n\t"
@@ -291,7 +468,7 @@ main( int argc, char **argv )
 	      "Try %s --help for more information", argv[0] );
     return 1;
   }
-  if ( sscanf( argv[optind++], "%6s", intype ) != 1 ) {
+  if ( sscanf( argv[optind++], "%6s", outtype ) != 1 ) {
     lf_error( "bad type argument" );
     return 1;
   }
@@ -306,12 +483,7 @@ main( int argc, char **argv )
   }
 
   /* Check output type. */
-  if ( strcmp( outtype, "char8" ) && strcmp( outtype, "uchar8" ) &&
-       strcmp( outtype, "int16" ) && strcmp( outtype, "uint16" ) &&
-       strcmp( outtype, "int32" ) && strcmp( outtype, "uint32" ) &&
-       strcmp( outtype, "int64" ) && strcmp( outtype, "uint64" ) &&
-       strcmp( outtype, "real32" ) && strcmp( outtype, "real32" ) &&
-       strcmp( outtype, "real64" ) && strcmp( outtype, "real64" ) ) {
+  if ( ( tout = typeindex( outtype ) ) < 0 ) {
     lf_error( "unrecognized target type %s", outtype );
     return 1;
   }
@@ -329,154 +501,116 @@ main( int argc, char **argv )
   }
   if ( bxRead( fpin, &headc, &headv, &dimc, &dimv, &encoding, NULL, 0 ) ) {
     lf_error( "could not parse header from %s", infile );
-    fclose( fpin );
-    return 2;
+    headc = 0;
+    headv = NULL;
+    dimv = NULL;
+    encoding = NULL;
+    CLEANEXIT( 2 );
   }
 
   /* Check endianness. */
-  for ( i = 0; i < headc; i++ )
-    if ( !strncmp( headv[i], versionkey, strlen( versionkey ) ) ) {
-      int x;                          /* hex character */
-      unsigned char cversion[4] = {}; /* version as byte sequence */
-      float fversion[1];              /* version converted to real32 */
-      for ( j = 0, c = headv[i] + strlen( versionkey ); j < 8 && *c; j++ ) {
-	while ( isspace( *c ) )
-	  c++;
-	x = ( *c >= '0' && *c <= '9' ? *c - '0' :
-	      ( *c >= 'a' && *c <= 'f' ? *c - 'a' + 10 :
-		( *c >= 'A' && *c <= 'F' ? *c - 'A' + 10 : -1 ) ) );
-	if ( x < 0 )
-	  break;
-	cversion[j/2] += ( j%2 ? x : 16*x );
-      }
-      if ( j < 8 )
-	lf_warning( "bad version metadata %%%s\n", headv[i] );
-      else {
-	memcpy( fversion, cversion, 4 );
-	if ( *fversion < 1.0 || *fversion > 255.0 ||
-	     *fversion != floor( *fversion ) )
-	  lf_warning( "file %s has wrong endianness", infile );
-      }
-      break;
+  if ( ( k = findkey( headc, headv, versionkey ) ) >= 0 ) {
+    int x;                          /* hex character */
+    unsigned char cversion[4] = {}; /* version as byte sequence */
+    float fversion[1];              /* version converted to real32 */
+    for ( j = 0, c = headv[k] + strlen( versionkey ); j < 8 && *c; j++ ) {
+      while ( isspace( *c ) )
+	c++;
+      x = ( *c >= '0' && *c <= '9' ? *c - '0' :
+	    ( *c >= 'a' && *c <= 'f' ? *c - 'a' + 10 :
+	      ( *c >= 'A' && *c <= 'F' ? *c - 'A' + 10 : -1 ) ) );
+      if ( x < 0 )
+	break;
+      cversion[j/2] += ( j%2 ? x : 16*x );
+      c++;
     }
-
-  /* Get input type. */
-  for ( i = 0; i < headc; i++ )
-    if ( !strncmp( headv[i], typekey, strlen( typekey ) ) ) {
-      if ( sscanf( headv[i] + strlen( typekey ), "%6s", outtype ) < 1 ) {
-	lf_error( "bad type metadata %%%s\n", headv[i] );
-	fclose( fpin );
-	for ( i = 0; i < headc; i++ )
-	  free( headv[i] );
-	free( headv );
-	free( dimv );
-	free( encoding );
-	return 3;
-      }
-      break;
+    if ( j < 8 )
+      lf_warning( "bad version metadata %%%s\n", headv[k] );
+    else {
+      memcpy( fversion, cversion, 4 );
+      if ( *fversion < 1.0 || *fversion > 255.0 ||
+	   *fversion != floor( *fversion ) )
+	lf_warning( "file %s has wrong endianness", infile );
     }
+  }
 
-  /* Check input type. */
-  if ( strcmp( intype, "char8" ) && strcmp( intype, "uchar8" ) &&
-       strcmp( intype, "int16" ) && strcmp( intype, "uint16" ) &&
-       strcmp( intype, "int32" ) && strcmp( intype, "uint32" ) &&
-       strcmp( intype, "int64" ) && strcmp( intype, "uint64" ) &&
-       strcmp( intype, "real32" ) && strcmp( intype, "real32" ) &&
-       strcmp( intype, "real64" ) && strcmp( intype, "real64" ) ) {
+  /* Get and check input type. */
+  if ( ( k = findkey( headc, headv, typekey ) ) < 0 ) {
+    lf_error( "no %%%s metadata in %s", typekey, infile );
+    CLEANEXIT( 3 );
+  }
+  if ( sscanf( headv[k] + strlen( typekey ), "%6s", intype ) < 1 ) {
+    lf_error( "bad type metadata %%%s\n", headv[k] );
+    CLEANEXIT( 3 );
+  }
+  if ( ( tin = typeindex( intype ) ) < 0 ) {
     lf_error( "unrecognized input type %s", intype );
-    fclose( fpin );
-    for ( i = 0; i < headc; i++ )
-      free( headv[i] );
-    free( headv );
-    free( dimv );
-    free( encoding );
-    return 1;
+    CLEANEXIT( 3 );
   }
-  for ( c = intype; !isdigit( (int)( *c ) ); c++ )
-    ;
-  if ( atoi( c ) != dimv[dimc-1] ) {
+  if ( typebits[tin] != dimv[dimc-1] ) {
     lf_error( "input type %s does not match bit depth %lld", intype,
 	      (long long)( dimv[dimc-1] ) );
-    fclose( fpin );
-    for ( i = 0; i < headc; i++ )
-      free( headv[i] );
-    free( headv );
-    free( dimv );
-    free( encoding );
-    return 1;
+    CLEANEXIT( 3 );
   }
 
+  /* Get rescaling, and store new scale in header. */
+  if ( rescale ) {
+    int m; /* index of comment */
+    if ( ( m = findkey( headc, headv, offsetkey ) ) >= 0 &&
+	 ( ioff = strtod( headv[m] + strlen( offsetkey ), &c ),
+	   c == headv[m] + strlen( offsetkey ) || isnan( ioff ) ) )
+      ioff = 0.0;
+    if ( ( m = findkey( headc, headv, scalekey ) ) >= 0 &&
+	 ( iscale = strtod( headv[m] + strlen( scalekey ), &c ),
+	   c == headv[m] + strlen( scalekey ) || isnan( iscale ) ) )
+      iscale = 1.0;
+    a = iscale/dscale;
+    b = ( ioff - doff )/dscale;
+    snprintf( str, sizeof(str), "%.16e", doff );
+    if ( setkey( &headc, &headv, offsetkey, str, k ) ) {
+      lf_error( "memory error" );
+      CLEANEXIT( 4 );
+    }
+    k = findkey( headc, headv, typekey );
+    snprintf( str, sizeof(str), "%.16e", dscale );
+    if ( setkey( &headc, &headv, scalekey, str, k ) ) {
+      lf_error( "memory error" );
+      CLEANEXIT( 4 );
+    }
+    k = findkey( headc, headv, typekey );
+    lf_info( "rescaling data by %g*x%+g", a, b );
+  }
+  kernel = ( rescale ? sc_table : cv_table )[tin][tout];
+
   /* Store new type in header. */
-  free( headv[i] );
-  if ( !( headv[i] = (char *)
-	  malloc( ( strlen( typekey ) + strlen( outtype ) + 2 )
-		  *sizeof(char) ) ) ) {
+  if ( setkey( &headc, &headv, typekey, outtype, k ) ) {
     lf_error( "memory error" );
-    fclose( fpin );
-    for ( i = 0; i < headc; i++ )
-      if ( headv[i] )
-	free( headv[i] );
-    free( headv );
-    free( dimv );
-    free( encoding );
-    return 4;
+    CLEANEXIT( 4 );
   }
-  sprintf( headv[i], "%s %s", typekey, outtype );
-  for ( c = outtype; !isdigit( (int)( *c ) ); c++ )
-    ;
-  dimv[dimc-1] = atoi( c );
+  dimv[dimc-1] = typebits[tout];
 
   /* Check that type conversion has not pushed us above bit limit. */
-  for ( i = 0, n = 1; i < dimc; i++, n *= dimv[i] )
-    if ( n > INT64_MAX/dimv[i] ) {
+  for ( i = 0, n = 1; i < dimc; n *= dimv[i], i++ )
+    if ( dimv[i] > 0 && n > INT64_MAX/dimv[i] ) {
       lf_error( "number of bits exceeds INT64_MAX" );
-      fclose( fpin );
-      for ( i = 0; i < headc; i++ )
-	if ( headv[i] )
-	  free( headv[i] );
-      free( headv );
-      free( dimv );
-      free( encoding );
-      return 4;
+      CLEANEXIT( 4 );
     }
 
   /* Write output header. */
   if ( !outfile ) {
     if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
       lf_error( "could not write to stdout" );
-      fclose( fpin );
-      for ( i = 0; i < headc; i++ )
-	free( headv[i] );
-      free( headv );
-      free( dimv );
-      free( encoding );
-      return 2;
+      CLEANEXIT( 2 );
     }
     outfile = "stdout";
   } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
     lf_error( "could not open output file %s", outfile );
-    fclose( fpin );
-    for ( i = 0; i < headc; i++ )
-      free( headv[i] );
-    free( headv );
-    free( dimv );
-    free( encoding );
-    return 2;
+    CLEANEXIT( 2 );
   }
   if ( bxWrite( fpout, headv, dimv, encoding, NULL, 0 ) ) {
     lf_error( "error writing header to %s", outfile );
-    fclose( fpout );
-    fclose( fpin );
-    for ( i = 0; i < headc; i++ )
-      free( headv[i] );
-    free( headv );
-    free( dimv );
-    free( encoding );
-    return 2;
+    CLEANEXIT( 2 );
   }
-  for ( i = 0; i < headc; i++ )
-    free( headv[i] );
-  free( headv );
 
   /* Get number of elements per row. */
   if ( dimc == 1 )
@@ -490,204 +624,38 @@ main( int argc, char **argv )
     for ( i = 1; i < dimc - 1; i++ )
       ne *= dimv[i];
   }
-  free( dimv );
+  ni = ne*( typebits[tin]/8 );
+  no = ne*( typebits[tout]/8 );
+  if ( !( inbuf = (unsigned char *)malloc( ni ) ) ||
+       !( outbuf = (unsigned char *)calloc( no, 1 ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
 
   /* Perform conversion. */
-  if ( !strcmp( intype, "char8" ) ) {
-    if ( !strcmp( outtype, "uchar8" ) )
-      CONVERT( c8row, uc8row );
-    else if ( !strcmp( outtype, "int16" ) )
-      CONVERT( c8row, i16row );
-    else if ( !strcmp( outtype, "uint16" ) )
-      CONVERT( c8row, ui16row );
-    else if ( !strcmp( outtype, "int32" ) )
-      CONVERT( c8row, i32row );
-    else if ( !strcmp( outtype, "uint32" ) )
-      CONVERT( c8row, ui32row );
-    else if ( !strcmp( outtype, "int64" ) )
-      CONVERT( c8row, i64row );
-    else if ( !strcmp( outtype, "uint64" ) )
-      CONVERT( c8row, ui64row );
-    else if ( !strcmp( outtype, "real32" ) )
-      CONVERT( c8row, r32row );
-    else /* if ( !strcmp( outtype, "real64" ) ) */
-      CONVERT( c8row, r64row );
-  } else if ( !strcmp( intype, "uchar8" ) ) {
-    if ( !strcmp( outtype, "char8" ) )
-      CONVERT( uc8row, c8row );
-    else if ( !strcmp( outtype, "int16" ) )
-      CONVERT( uc8row, i16row );
-    else if ( !strcmp( outtype, "uint16" ) )
-      CONVERT( uc8row, ui16row );
-    else if ( !strcmp( outtype, "int32" ) )
-      CONVERT( uc8row, i32row );
-    else if ( !strcmp( outtype, "uint32" ) )
-      CONVERT( uc8row, ui32row );
-    else if ( !strcmp( outtype, "int64" ) )
-      CONVERT( uc8row, i64row );
-    else if ( !strcmp( outtype, "uint64" ) )
-      CONVERT( uc8row, ui64row );
-    else if ( !strcmp( outtype, "real32" ) )
-      CONVERT( uc8row, r32row );
-    else /* if ( !strcmp( outtype, "real64" ) ) */
-      CONVERT( uc8row, r64row );
-  } else if ( !strcmp( intype, "int16" ) ) {
-    if ( !strcmp( outtype, "char8" ) )
-      CONVERT( i16row, c8row );
-    else if ( !strcmp( outtype, "uchar8" ) )
-      CONVERT( i16row, uc8row );
-    else if ( !strcmp( outtype, "uint16" ) )
-      CONVERT( i16row, ui16row );
-    else if ( !strcmp( outtype, "int32" ) )
-      CONVERT( i16row, i32row );
-    else if ( !strcmp( outtype, "uint32" ) )
-      CONVERT( i16row, ui32row );
-    else if ( !strcmp( outtype, "int64" ) )
-      CONVERT( i16row, i64row );
-    else if ( !strcmp( outtype, "uint64" ) )
-      CONVERT( i16row, ui64row );
-    else if ( !strcmp( outtype, "real32" ) )
-      CONVERT( i16row, r32row );
-    else /* if ( !strcmp( outtype, "real64" ) ) */
-      CONVERT( i16row, r64row );
-  } else if ( !strcmp( intype, "uint16" ) ) {
-    if ( !strcmp( outtype, "char8" ) )
-      CONVERT( ui16row, c8row );
-    else if ( !strcmp( outtype, "uchar8" ) )
-      CONVERT( ui16row, uc8row );
-    else if ( !strcmp( outtype, "int16" ) )
-      CONVERT( ui16row, i16row );
-    else if ( !strcmp( outtype, "int32" ) )
-      CONVERT( ui16row, i32row );
-    else if ( !strcmp( outtype, "uint32" ) )
-      CONVERT( ui16row, ui32row );
-    else if ( !strcmp( outtype, "int64" ) )
-      CONVERT( ui16row, i64row );
-    else if ( !strcmp( outtype, "uint64" ) )
-      CONVERT( ui16row, ui64row );
-    else if ( !strcmp( outtype, "real32" ) )
-      CONVERT( ui16row, r32row );
-    else /* if ( !strcmp( outtype, "real64" ) ) */
-      CONVERT( ui16row, r64row );
-  } else if ( !strcmp( intype, "int32" ) ) {
-    if ( !strcmp( outtype, "char8" ) )
-      CONVERT( i32row, c8row );
-    else if ( !strcmp( outtype, "uchar8" ) )
-      CONVERT( i32row, uc8row );
-    else if ( !strcmp( outtype, "int16" ) )
-      CONVERT( i32row, i16row );
-    else if ( !strcmp( outtype, "uint16" ) )
-      CONVERT( i32row, ui16row );
-    else if ( !strcmp( outtype, "uint32" ) )
-      CONVERT( i32row, ui32row );
-    else if ( !strcmp( outtype, "int64" ) )
-      CONVERT( i32row, i64row );
-    else if ( !strcmp( outtype, "uint64" ) )
-      CONVERT( i32row, ui64row );
-    else if ( !strcmp( outtype, "real32" ) )
-      CONVERT( i32row, r32row );
-    else /* if ( !strcmp( outtype, "real64" ) ) */
-      CONVERT( i32row, r64row );
-  } else if ( !strcmp( intype, "uint32" ) ) {
-    if ( !strcmp( outtype, "char8" ) )
-      CONVERT( ui32row, c8row );
-    else if ( !strcmp( outtype, "uchar8" ) )
-      CONVERT( ui32row, uc8row );
-    else if ( !strcmp( outtype, "int16" ) )
-      CONVERT( ui32row, i16row );
-    else if ( !strcmp( outtype, "uint16" ) )
-      CONVERT( ui32row, ui16row );
-    else if ( !strcmp( outtype, "int32" ) )
-      CONVERT( ui32row, i32row );
-    else if ( !strcmp( outtype, "int64" ) )
-      CONVERT( ui32row, i64row );
-    else if ( !strcmp( outtype, "uint64" ) )
-      CONVERT( ui32row, ui64row );
-    else if ( !strcmp( outtype, "real32" ) )
-      CONVERT( ui32row, r32row );
-    else /* if ( !strcmp( outtype, "real64" ) ) */
-      CONVERT( ui32row, r64row );
-  } else if ( !strcmp( intype, "int64" ) ) {
-    if ( !strcmp( outtype, "char8" ) )
-      CONVERT( i64row, c8row );
-    else if ( !strcmp( outtype, "uchar8" ) )
-      CONVERT( i64row, uc8row );
-    else if ( !strcmp( outtype, "int16" ) )
-      CONVERT( i64row, i16row );
-    else if ( !strcmp( outtype, "uint16" ) )
-      CONVERT( i64row, ui16row );
-    else if ( !strcmp( outtype, "int32" ) )
-      CONVERT( i64row, i32row );
-    else if ( !strcmp( outtype, "uint32" ) )
-      CONVERT( i64row, ui32row );
-    else if ( !strcmp( outtype, "uint64" ) )
-      CONVERT( i64row, ui64row );
-    else if ( !strcmp( outtype, "real32" ) )
-      CONVERT( i64row, r32row );
-    else /* if ( !strcmp( outtype, "real64" ) ) */
-      CONVERT( i64row, r64row );
-  } else if ( !strcmp( intype, "uint64" ) ) {
-    if ( !strcmp( outtype, "char8" ) )
-      CONVERT( ui64row, c8row );
-    else if ( !strcmp( outtype, "uchar8" ) )
-      CONVERT( ui64row, uc8row );
-    else if ( !strcmp( outtype, "int16" ) )
-      CONVERT( ui64row, i16row );
-    else if ( !strcmp( outtype, "uint16" ) )
-      CONVERT( ui64row, ui16row );
-    else if ( !strcmp( outtype, "int32" ) )
-      CONVERT( ui64row, i32row );
-    else if ( !strcmp( outtype, "uint32" ) )
-      CONVERT( ui64row, ui32row );
-    else if ( !strcmp( outtype, "int64" ) )
-      CONVERT( ui64row, i64row );
-    else if ( !strcmp( outtype, "real32" ) )
-      CONVERT( ui64row, r32row );
-    else /* if ( !strcmp( outtype, "real64" ) ) */
-      CONVERT( ui64row, r64row );
-  } else if ( !strcmp( intype, "real32" ) ) {
-    if ( !strcmp( outtype, "char8" ) )
-      CONVERT( r32row, c8row );
-    else if ( !strcmp( outtype, "uchar8" ) )
-      CONVERT( r32row, uc8row );
-    else if ( !strcmp( outtype, "int16" ) )
-      CONVERT( r32row, i16row );
-    else if ( !strcmp( outtype, "uint16" ) )
-      CONVERT( r32row, ui16row );
-    else if ( !strcmp( outtype, "int32" ) )
-      CONVERT( r32row, i32row );
-    else if ( !strcmp( outtype, "uint32" ) )
-      CONVERT( r32row, ui32row );
-    else if ( !strcmp( outtype, "int64" ) )
-      CONVERT( r32row, i64row );
-    else if ( !strcmp( outtype, "uint64" ) )
-      CONVERT( r32row, ui64row );
-    else /* if ( !strcmp( outtype, "real64" ) ) */
-      CONVERT( r32row, r64row );
-  } else if ( !strcmp( intype, "real64" ) ) {
-    if ( !strcmp( outtype, "char8" ) )
-      CONVERT( r64row, c8row );
-    else if ( !strcmp( outtype, "uchar8" ) )
-      CONVERT( r64row, uc8row );
-    else if ( !strcmp( outtype, "int16" ) )
-      CONVERT( r64row, i16row );
-    else if ( !strcmp( outtype, "uint16" ) )
-      CONVERT( r64row, ui16row );
-    else if ( !strcmp( outtype, "int32" ) )
-      CONVERT( r64row, i32row );
-    else if ( !strcmp( outtype, "uint32" ) )
-      CONVERT( r64row, ui32row );
-    else if ( !strcmp( outtype, "int64" ) )
-      CONVERT( r64row, i64row );
-    else if ( !strcmp( outtype, "uint64" ) )
-      CONVERT( r64row, ui64row );
-    else /* if ( !strcmp( outtype, "real32" ) ) */
-      CONVERT( r64row, r32row );
+  for ( i = 0; i < nrows && !feof( fpin ); i++ ) {
+    if ( ( n = bxReadData( encoding, inbuf, ni, fpin ) ) < ni ) {
+      lf_warning( "read %lld bytes from %s, expected %lld",
+		  (long long)( i*ni + n ), infile,
+		  (long long)( nrows*ni ) );
+      memset( inbuf + n, 0, ni - n );
+    }
+    kernel( inbuf, outbuf, ne, a, b );
+    if ( bxWriteData( encoding, outbuf, no, nr, fpout ) < no ) {
+      lf_error( "error writing data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
   }
+  memset( outbuf, 0, no );
+  for ( ; i < nrows; i++ )
+    bxWriteData( encoding, outbuf, no, nr, fpout );
 
   /* Finished. */
-  fclose( fpout );
-  fclose( fpin );
-  free( encoding );
-  return 0;
+  if ( fclose( fpout ) ) {
+    fpout = NULL;
+    lf_error( "error writing data to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  fpout = NULL;
+  CLEANEXIT( 0 );
 }
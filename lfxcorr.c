@@ -0,0 +1,604 @@
+static const char *version = "\
+lfxcorr version " VERSION "\n\
+Copyright (c) 2016 Teviet Creighton.\n\
+\n\
+This program is free software: you can redistribute it and/or modify\n\
+it under the terms of the GNU General Public License as published by\n\
+the Free Software Foundation, either version 3 of the License, or (at\n\
+your option) any later version.\n\
+\n\
+This program is distributed in the hope that it will be useful, but\n\
+WITHOUT ANY WARRANTY; without even the implied warranty of\n\
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU\n\
+General Public License for more details.\n\
+\n\
+You should have received a copy of the GNU General Public License\n\
+along with this program.  If not, see <http://www.gnu.org/licenses/>.\n\
+\n";
+static const char *usage = "\
+Usage: %s [OPTION]... INFILE1 INFILE2 [OUTFILE]\n\
+Cross-correlate columns of LoFASM files.\n\
+\n\
+  -h, --help             print this usage information\n\
+  -H, --man              display the program's man page\n\
+      --manpage          print the program's man page (groff)\n\
+      --markdown         print the program's man page (markdown)\n\
+  -V, --version          print program version\n\
+  -v, --verbosity=LEVEL  set status message reporting level\n\
+  -n, --length=N         block length in rows (default 1024)\n\
+  -l, --lags=L           compute lags from -L to L rows\n\
+  -p, --pairs=A:B[,...]  correlate column A of INFILE1 with B of INFILE2\n\
+  -a, --average          average the correlations of all pairs\n\
+  -j, --threads=N        compute using N threads\n\
+\n";
+
+static const char *description = "\
+# lfxcorr(1)\n\
+\n\
+## NAME\n\
+\n\
+`lfxcorr(1)` - cross-correlate lofasm-filterbank(5) files\n\
+\n\
+## SYNOPSIS\n\
+\n\
+`lfxcorr` [_OPTION_]... _INFILE1_ _INFILE2_ [_OUTFILE_]\n\
+\n\
+## DESCRIPTION\n\
+\n\
+This program cross-correlates the time series in columns of two\n\
+lofasm-filterbank(5) files _INFILE1_ and _INFILE2_, such as the same\n\
+frequency channel recorded at two stations, in order to measure and\n\
+track the relative delay between them.  The results are written to\n\
+_OUTFILE_ as a lofasm-filterbank(5) file whose dimension 2 is lag\n\
+rather than frequency.  If _OUTFILE_ is not specified, or is a single\n\
+`-` character, then standard output is used instead.  Either input\n\
+may be a single `-` character, indicating standard input.  If\n\
+_INFILE1_ and _INFILE2_ are the same name, the file is read only once,\n\
+and pairs of columns within it are correlated; in particular, this\n\
+allows a single file to be read from standard input.\n\
+\n\
+The inputs are read in blocks of _N_ rows; any rows left over after\n\
+the last full block are ignored.  For each block and each pair of\n\
+columns _x_ from _INFILE1_ and _y_ from _INFILE2_, the means are\n\
+subtracted, and the correlation coefficient:\n\
+\n\
+    c(L) = sum x(t) y(t+L) / sqrt( sum x(t)^2 sum y(t)^2 )\n\
+\n\
+is computed for lags _L_ from -_LMAX_ to _LMAX_ rows, where the sum\n\
+runs over the rows of the block.  A positive lag thus means that\n\
+features in _y_ occur later than in _x_.  The correlation is computed\n\
+with the in-tree FFT (see lfftPlan(3)), zero-padding the block to a\n\
+power of 2 of at least _N_+_LMAX_ so that the lags do not wrap\n\
+around; the two series of a pair are transformed together as the real\n\
+and imaginary parts of one complex series.  The pairs are divided\n\
+among several threads.  Non-finite input values are replaced by the\n\
+series mean.\n\
+\n\
+The output has one row per block, covering the same times as the\n\
+input, and 2 _LMAX_+1 columns, with lag measured in seconds from\n\
+-_LMAX_ _dt_ to _LMAX_ _dt_ where _dt_ is the sampling interval of\n\
+_INFILE1_.  Each pair of columns gives one component, in the order\n\
+the pairs were specified, unless `-a, --average` is given, in which\n\
+case the correlations of all pairs are averaged into a single\n\
+component.\n\
+\n\
+The data must be stored as `real32` or `real64`, with one component\n\
+per column, and both files should have the same number of rows and\n\
+sampling interval; the output is stored with the same type as\n\
+_INFILE1_.\n\
+\n\
+## OPTIONS\n\
+\n\
+`-h, --help`:\n\
+    Prints basic usage information to stdout and exits.\n\
+\n\
+`-H, --man`:\n\
+    Displays this manual page using man(1).\n\
+\n\
+`--manpage`:\n\
+    Prints this manual page to standard output, in groff format.\n\
+\n\
+`--markdown`:\n\
+    Prints this manual page to standard output, in markdown format.\n\
+\n\
+`-V, --version`:\n\
+    Prints version and copyright information.\n\
+\n\
+`-v, --verbosity=`_LEVEL_:\n\
+    Sets the verbosity level for error reporting.  _LEVEL_ may be `0`\n\
+    (quiet, no messages), `1` (default, error messages only), `2`\n\
+    (verbose, errors and warnings), or `3` (very verbose, errors,\n\
+    warnings, and extra information).\n\
+\n\
+`-n, --length=`_N_:\n\
+    Sets the number of rows in each correlated block.  The default is\n\
+    `1024`, or the number of rows if less.\n\
+\n\
+`-l, --lags=`_LMAX_:\n\
+    Sets the largest lag computed, in rows, which must be less than\n\
+    _N_.  The default is _N_/4.\n\
+\n\
+`-p, --pairs=`_A_`:`_B_[`,`...]:\n\
+    Correlates column _A_ of _INFILE1_ with column _B_ of _INFILE2_,\n\
+    for each comma-separated pair, where columns are numbered from 0.\n\
+    By default, each column of _INFILE1_ is correlated with the same\n\
+    column of _INFILE2_, which must then have the same number of\n\
+    columns.\n\
+\n\
+`-a, --average`:\n\
+    Averages the correlation coefficients of all pairs, rather than\n\
+    writing each as a separate component.\n\
+\n\
+`-j, --threads=`_N_:\n\
+    Computes the correlations using _N_ threads.  By default, one\n\
+    thread per online processor is used.\n\
+\n\
+## EXIT STATUS\n\
+\n\
+The proram exits with status 0 normally, 1 if there is an error\n\
+parsing its arguments, 2 on read/write errors, 3 if the files are\n\
+badly formatted or incompatible, and 4 on memory allocation errors.\n\
+\n\
+## SEE ALSO\n\
+\n\
+lfpower(1),\n\
+lfftPlan(3),\n\
+lofasm-filterbank(5)\n\
+\n";
+
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "markdown_parser.h"
+#include "lofasmIO.h"
+#include "lfft.h"
+
+static const char short_opts[] = "hHVv:n:l:p:aj:";
+static const struct option long_opts[] = {
+  { "help", 0, 0, 'h' },
+  { "man", 0, 0, 'H' },
+  { "manpage", 0, 0, 0 },
+  { "markdown", 0, 0, 0 },
+  { "version", 0, 0, 'V' },
+  { "verbosity", 1, 0, 'v' },
+  { "length", 1, 0, 'n' },
+  { "lags", 1, 0, 'l' },
+  { "pairs", 1, 0, 'p' },
+  { "average", 0, 0, 'a' },
+  { "threads", 1, 0, 'j' },
+  { 0, 0, 0, 0} };
+
+#define NTHR 64       /* maximum number of threads */
+#define NDEF 1024     /* default block length */
+
+/* Parameters for correlating one block.  Row t of the blocks is
+   stored in bx[t*nx] and by[t*ny] onwards, and the correlation of
+   pair p at lag l is stored in out[(lmax+l)*npair+p]. */
+typedef struct {
+  const lfft_plan *plan;    /* FFT plan */
+  int64_t n, m;             /* block and transform lengths */
+  int64_t lmax;             /* maximum lag */
+  int64_t nx, ny;           /* columns in each block */
+  const double *bx, *by;    /* input blocks */
+  int64_t npair;            /* number of pairs */
+  const int64_t *px, *py;   /* columns of each pair */
+  double *out;              /* output row */
+} xcorr_par;
+
+/* Range of pairs to be correlated by one thread. */
+typedef struct {
+  const xcorr_par *par;     /* correlation parameters */
+  int64_t p0, p1;           /* range of pairs [p0,p1) */
+  double *z;                /* FFT workspace */
+} xcorr_job;
+
+
+/* Loads column c of an n-row block with row stride s into every
+   other element of z, with its mean removed and non-finite values
+   replaced by the mean, and returns its sum of squares. */
+static double
+load_series( double *z, const double *b, int64_t c, int64_t s, int64_t n )
+{
+  int64_t t, k;             /* index and count of finite values */
+  double m = 0.0, ss = 0.0; /* mean and sum of squares */
+
+  for ( t = k = 0; t < n; t++ )
+    if ( isfinite( b[t*s+c] ) ) {
+      m += b[t*s+c];
+      k++;
+    }
+  m = ( k ? m/k : 0.0 );
+  for ( t = 0; t < n; t++ ) {
+    double x = b[t*s+c];
+    z[2*t] = ( isfinite( x ) ? x - m : 0.0 );
+    ss += z[2*t]*z[2*t];
+  }
+  return ss;
+}
+
+
+/* Correlates pairs job->p0 to job->p1 - 1.  The two series x and y
+   of a pair are the real and imaginary parts of one complex series z,
+   whose transform Z gives X[k] = (Z[k] + conj(Z[m-k]))/2 and Y[k] =
+   (Z[k] - conj(Z[m-k]))/2i; the inverse transform of conj(X)Y is
+   then the correlation. */
+static void *
+xcorr_pairs( void *arg )
+{
+  xcorr_job *job = (xcorr_job *)arg; /* job to be done */
+  const xcorr_par *p = job->par;     /* correlation parameters */
+  int64_t m = p->m;                  /* transform length */
+  int64_t q, k, l;                   /* pair, frequency, and lag */
+  double *z = job->z;                /* workspace */
+  double sx, sy, norm;               /* sums of squares, normalization */
+
+  for ( q = job->p0; q < job->p1; q++ ) {
+    memset( z, 0, 2*m*sizeof(double) );
+    sx = load_series( z, p->bx, p->px[q], p->nx, p->n );
+    sy = load_series( z + 1, p->by, p->py[q], p->ny, p->n );
+    norm = ( sx > 0.0 && sy > 0.0 ? 1.0/sqrt( sx*sy ) : 0.0 );
+    lfftForward( p->plan, z );
+
+    /* Replace Z[k] and Z[m-k] with the cross spectra at k and m-k. */
+    for ( k = 0; k <= m/2; k++ ) {
+      int64_t j = ( m - k ) % m;
+      double ar = z[2*k], ai = z[2*k+1], br = z[2*j], bi = -z[2*j+1];
+      double xr = 0.5*( ar + br ), xi = 0.5*( ai + bi );
+      double yr = 0.5*( ai - bi ), yi = -0.5*( ar - br );
+      z[2*k] = xr*yr + xi*yi;
+      z[2*k+1] = xr*yi - xi*yr;
+      z[2*j] = xr*yr + xi*yi;
+      z[2*j+1] = -( xr*yi - xi*yr );
+    }
+    lfftInverse( p->plan, z );
+    for ( l = -p->lmax; l <= p->lmax; l++ )
+      p->out[ ( p->lmax + l )*p->npair + q ] = norm*z[ 2*( ( m + l ) % m ) ];
+  }
+  return NULL;
+}
+
+
+/* Opens an input file and reads its header, returning 0 on success
+   or an exit code on failure. */
+static int
+open_input( const char *infile, FILE **fp, lfb_hdr *head, int *bits )
+{
+  if ( !strcmp( infile, "-" ) ) {
+    if ( !( *fp = lfdopen( 0, "rb" ) ) ) {
+      lf_error( "could not read stdin" );
+      return 2;
+    }
+  } else if ( !( *fp = lfopen( infile, "rb" ) ) ) {
+    lf_error( "could not open input file %s", infile );
+    return 2;
+  }
+  if ( lfbxRead( *fp, head, NULL ) ) {
+    lf_error( "could not parse header from %s", infile );
+    return 2;
+  }
+  if ( !( *bits = lfrealBits( head ) ) ) {
+    lf_error( "%s: requires real32 or real64 data", infile );
+    return 3;
+  }
+  if ( head->dims[2] != 1 ) {
+    lf_error( "%s: requires one component per column", infile );
+    return 3;
+  }
+  return 0;
+}
+
+
+/* Macro to free memory and close files before exiting. */
+#define CLEANEXIT( code ) \
+do { \
+  if ( fpx ) fclose( fpx ); \
+  if ( fpy ) fclose( fpy ); \
+  if ( fpout ) fclose( fpout ); \
+  if ( px ) free( px ); \
+  if ( bx ) free( bx ); \
+  if ( by ) free( by ); \
+  if ( out ) free( out ); \
+  if ( work ) free( work ); \
+  lfftFree( plan ); \
+  lfbxFree( &headx ); \
+  lfbxFree( &heady ); \
+  return (code); \
+} while ( 0 )
+
+int
+main( int argc, char **argv )
+{
+  int opt, lopt;            /* option character and index */
+  char *infx, *infy, *outfile; /* input/output file names */
+  FILE *fpx = NULL, *fpy = NULL, *fpout = NULL; /* file pointers */
+  long long n = 0, lmax = -1; /* block length and maximum lag */
+  char *pairs = NULL;       /* list of column pairs */
+  int avg = 0;              /* whether to average pairs */
+  int nthreads = 0;         /* number of threads */
+  int same;                 /* whether inputs are the same file */
+  lfb_hdr headx = {}, heady = {}; /* file headers */
+  int bitx, bity;           /* bit depth of data (32 or 64) */
+  int64_t nin, nx, ny;      /* input rows and columns */
+  int64_t nblk, npair, nlag; /* numbers of blocks, pairs, and lags */
+  int64_t m;                /* transform length */
+  int64_t *px = NULL, *py;  /* columns of each pair */
+  int64_t i, j, k, s;       /* indecies */
+  int status;               /* return code from functions */
+  double dt;                /* sample interval */
+  double *bx = NULL, *by = NULL; /* input blocks */
+  double *out = NULL;       /* output row */
+  double *work = NULL;      /* FFT workspaces */
+  lfft_plan *plan = NULL;   /* FFT plan */
+  xcorr_par par;            /* correlation parameters */
+  xcorr_job jobs[NTHR];     /* threads' work */
+  char *end;                /* end of parsed number */
+
+  /* Parse options. */
+  while ( ( opt = getopt_long( argc, argv, short_opts, long_opts, &lopt ) )
+          != -1 ) {
+    switch ( opt ) {
+    case 0:
+      if ( !strcmp( long_opts[lopt].name, "manpage" ) )
+	markdown_to_manpage( description, NULL );
+      else if ( !strcmp( long_opts[lopt].name, "markdown" ) )
+	fputs( description, stdout );
+      return 0;
+    case 'h':
+      fprintf( stdout, usage, argv[0] );
+      return 0;
+    case 'H':
+      markdown_to_man_out( description );
+      return 0;
+    case 'V':
+      fputs( version, stdout );
+      return 0;
+    case 'v':
+      lofasm_verbosity = atoi( optarg );
+      break;
+    case 'n':
+      if ( ( n = strtoll( optarg, &end, 10 ) ) < 2 || *end ) {
+	lf_error( "bad -n, --length argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'l':
+      if ( ( lmax = strtoll( optarg, &end, 10 ) ) < 0 || *end ) {
+	lf_error( "bad -l, --lags argument %s", optarg );
+	return 1;
+      }
+      break;
+    case 'p':
+      pairs = optarg;
+      break;
+    case 'a':
+      avg = 1;
+      break;
+    case 'j':
+      if ( ( nthreads = atoi( optarg ) ) < 1 ) {
+	lf_error( "bad argument %s to -j, --threads", optarg );
+	return 1;
+      }
+      break;
+    case '?':
+      if ( optopt )
+	lf_error( "unknown option -%c\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "unknown option %s\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    case ':':
+      if ( optopt )
+	lf_error( "option -%c requires an argument\n\t"
+		  "Try %s --help for more information",
+		  optopt, argv[0] );
+      else
+	lf_error( "option %s requires an argument\n\t"
+		  "Try %s --help for more information",
+		  argv[optind-1], argv[0] );
+      return 1;
+    default:
+      lf_error( "internal error parsing option code %c\n\t"
+		"Try %s --help for more information",
+		opt, argv[0] );
+      return 1;
+    }
+  }
+
+  /* Parse other arguments. */
+  if ( optind + 2 > argc ) {
+    lf_error( "missing input file arguments\n\t"
+	      "Try %s --help for more information", argv[0] );
+    return 1;
+  }
+  infx = argv[optind++];
+  infy = argv[optind++];
+  if ( optind >= argc || !strcmp( ( outfile = argv[optind++] ), "-" ) )
+    outfile = NULL;
+  if ( optind < argc ) {
+    lf_error( "too many arguments" );
+    return 1;
+  }
+  same = !strcmp( infx, infy );
+
+  /* Set number of threads. */
+#ifndef NO_THREADS
+  if ( nthreads < 1 && ( nthreads = sysconf( _SC_NPROCESSORS_ONLN ) ) < 1 )
+    nthreads = 1;
+#else
+  if ( nthreads > 1 )
+    lf_warning( "compiled with NO_THREADS; ignoring -j, --threads" );
+  nthreads = 1;
+#endif
+  if ( nthreads > NTHR )
+    nthreads = NTHR;
+
+  /* Read input headers. */
+  if ( ( status = open_input( infx, &fpx, &headx, &bitx ) ) )
+    CLEANEXIT( status );
+  if ( same ) {
+    bity = bitx;
+    ny = headx.dims[1];
+  } else {
+    if ( ( status = open_input( infy, &fpy, &heady, &bity ) ) )
+      CLEANEXIT( status );
+    if ( heady.dims[0] != headx.dims[0] ||
+	 heady.dim1_span != headx.dim1_span )
+      lf_warning( "%s and %s have different time sampling", infx, infy );
+    ny = heady.dims[1];
+  }
+  nin = ( same || headx.dims[0] < heady.dims[0] ? headx.dims[0] :
+	  heady.dims[0] );
+  nx = headx.dims[1];
+  dt = headx.dim1_span/headx.dims[0];
+
+  /* Parse column pairs. */
+  if ( pairs ) {
+    for ( npair = 1, end = pairs; ( end = strchr( end, ',' ) ); end++ )
+      npair++;
+  } else if ( nx != ny ) {
+    lf_error( "%s and %s have different numbers of columns", infx, infy );
+    CLEANEXIT( 3 );
+  } else
+    npair = nx;
+  if ( !( px = (int64_t *)malloc( 2*npair*sizeof(int64_t) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  py = px + npair;
+  if ( pairs ) {
+    for ( k = 0, end = pairs; k < npair; k++, end++ ) {
+      char *tail; /* end of first number */
+      px[k] = strtoll( end, &tail, 10 );
+      if ( tail == end || *tail != ':' ||
+	   ( py[k] = strtoll( end = tail + 1, &tail, 10 ), tail == end ) ||
+	   ( *tail && *tail != ',' ) || px[k] < 0 || px[k] >= nx ||
+	   py[k] < 0 || py[k] >= ny ) {
+	lf_error( "bad -p, --pairs argument %s", pairs );
+	CLEANEXIT( 1 );
+      }
+      end = tail;
+    }
+  } else
+    for ( k = 0; k < npair; k++ )
+      px[k] = py[k] = k;
+
+  /* Set block length and lags. */
+  if ( n < 1 )
+    n = ( nin < NDEF ? nin : NDEF );
+  if ( n < 2 || n > nin ) {
+    lf_error( "block length %lld exceeds length %lld", n,
+	      (long long)( nin ) );
+    CLEANEXIT( 1 );
+  }
+  if ( lmax < 0 )
+    lmax = n/4;
+  if ( lmax >= n ) {
+    lf_error( "maximum lag %lld must be less than block length %lld",
+	      lmax, n );
+    CLEANEXIT( 1 );
+  }
+  nblk = nin/n;
+  nlag = 2*lmax + 1;
+  m = lfftLength( n + lmax );
+  if ( nblk*n < nin )
+    lf_info( "ignoring last %lld rows", (long long)( nin - nblk*n ) );
+  if ( nthreads > npair )
+    nthreads = npair;
+
+  /* Allocate storage. */
+  if ( !( plan = lfftPlan( m ) ) ||
+       !( bx = (double *)malloc( n*nx*sizeof(double) ) ) ||
+       ( !same && !( by = (double *)malloc( n*ny*sizeof(double) ) ) ) ||
+       !( out = (double *)malloc( nlag*npair*sizeof(double) ) ) ||
+       !( work = (double *)malloc( nthreads*2*m*sizeof(double) ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  par.plan = plan;
+  par.n = n;
+  par.m = m;
+  par.lmax = lmax;
+  par.nx = nx;
+  par.ny = ny;
+  par.bx = bx;
+  par.by = ( same ? bx : by );
+  par.npair = npair;
+  par.px = px;
+  par.py = py;
+  par.out = out;
+  for ( k = 0; k < nthreads; k++ ) {
+    jobs[k].par = &par;
+    jobs[k].p0 = ( k*npair )/nthreads;
+    jobs[k].p1 = ( ( k + 1 )*npair )/nthreads;
+    jobs[k].z = work + 2*k*m;
+  }
+
+  /* Write output file header. */
+  headx.dims[0] = nblk;
+  headx.dims[1] = nlag;
+  headx.dims[2] = ( avg ? 1 : npair );
+  headx.dim1_span = nblk*n*dt;
+  headx.dim2_start = -lmax*dt;
+  headx.dim2_span = nlag*dt;
+  headx.frequency_offset_DC = 0.0;
+  if ( headx.dim2_label )
+    free( headx.dim2_label );
+  if ( headx.data_label )
+    free( headx.data_label );
+  headx.data_label = NULL;
+  if ( !( headx.dim2_label = strdup( "lag (s)" ) ) ||
+       !( headx.data_label = strdup( "correlation coefficient" ) ) ) {
+    lf_error( "memory error" );
+    CLEANEXIT( 4 );
+  }
+  if ( !outfile ) {
+    if ( isatty( 1 ) || !( fpout = lfdopen( 1, "wbZ" ) ) ) {
+      lf_error( "could not write to stdout" );
+      CLEANEXIT( 2 );
+    }
+    outfile = "stdout";
+  } else if ( !( fpout = lfopen( outfile, "wb" ) ) ) {
+    lf_error( "could not open output file %s", outfile );
+    CLEANEXIT( 2 );
+  }
+  if ( lfbxWrite( fpout, &headx, NULL ) ) {
+    lf_error( "error writing header to %s", outfile );
+    CLEANEXIT( 2 );
+  }
+
+  /* Read, correlate, and write each block. */
+  for ( s = 0; s < nblk; s++ ) {
+    if ( ( j = lfrealRead( bx, bitx, n*nx, fpx ) ) < n*nx ) {
+      lf_warning( "read %lld data from %s, expected %lld",
+		  (long long)( s*n*nx + j ), infx,
+		  (long long)( headx.dims[0]*nx ) );
+      memset( bx + j, 0, ( n*nx - j )*sizeof(double) );
+    }
+    if ( !same && ( j = lfrealRead( by, bity, n*ny, fpy ) ) < n*ny ) {
+      lf_warning( "read %lld data from %s, expected %lld",
+		  (long long)( s*n*ny + j ), infy,
+		  (long long)( heady.dims[0]*ny ) );
+      memset( by + j, 0, ( n*ny - j )*sizeof(double) );
+    }
+    lfthreadRun( xcorr_pairs, jobs, sizeof(*jobs), nthreads );
+    if ( avg )
+      for ( i = 0; i < nlag; i++ ) {
+	double sum = 0.0; /* sum over pairs */
+	for ( k = 0; k < npair; k++ )
+	  sum += out[ i*npair + k ];
+	out[i] = sum/npair;
+      }
+    k = ( avg ? nlag : nlag*npair );
+    if ( lfrealWrite( out, bitx, k, fpout ) < k ) {
+      lf_error( "could not write data to %s", outfile );
+      CLEANEXIT( 2 );
+    }
+  }
+
+  /* Finished. */
+  CLEANEXIT( 0 );
+}
@@ -29,6 +29,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
 #include "lofasmIO.h"
 
 #define BX_CHECK_ID 1
@@ -1477,7 +1480,7 @@ lfbxRead( FILE *fp, lfb_hdr *header, void **data )
   }
 
   /* Check total size of array. */
-  for ( i = 0, n = 1; i < LFB_DMAX; i++, n *= header->dims[i] )
+  for ( i = 0, n = 1; i < LFB_DMAX; n *= header->dims[i], i++ )
     if ( n > INT64_MAX/header->dims[i] ) {
       lf_error( "number of bits exceeds INT64_MAX" );
       return 2;
@@ -1737,3 +1740,728 @@ lfbxFree( lfb_hdr *header )
     header->data_offset = header->data_scale = strtod( "nan", 0 );
   return;
 }
+
+
+/***********************************************************************
+LOFASM FILTERBANK OVERVIEW LEVELS
+***********************************************************************/
+
+/* Overview pyramid state.  Level l (counting from 0) is downsampled
+   by a factor 2^(l+1) in both dimensions.  Completed rows of each
+   level are buffered in a temporary file until the full-resolution
+   data have been written. */
+struct tag_lfb_ovr {
+  int nlev;            /* number of overview levels */
+  int bits;            /* bit depth of output (32 or 64) */
+  int64_t dims[3];     /* full-resolution dimensions */
+  int64_t *nrow;       /* rows completed at each level */
+  int *nacc;           /* rows accumulated at each level */
+  double **acc;        /* accumulator row at each level */
+  FILE **tmp;          /* temporary row storage at each level */
+};
+
+/* Add a row to overview level l, averaging completed 2x2 boxes and
+   passing them on to the next level.  Returns 0 normally, nonzero on
+   a write error. */
+static int
+ovr_push( lfb_ovr *ovr, int l, const double *row )
+{
+  int64_t n1 = ovr->dims[1] >> ( l + 1 ); /* level row length */
+  int64_t nc = ovr->dims[2];              /* number of components */
+  double *acc = ovr->acc[l];              /* level accumulator */
+  int64_t j, k;                           /* indecies */
+
+  if ( ovr->nrow[l] >= ( ovr->dims[0] >> ( l + 1 ) ) )
+    return 0;
+  for ( j = 0; j < n1; j++ )
+    for ( k = 0; k < nc; k++ )
+      acc[j*nc+k] += row[2*j*nc+k] + row[( 2*j + 1 )*nc+k];
+  if ( ++( ovr->nacc[l] ) < 2 )
+    return 0;
+  for ( j = 0; j < n1*nc; j++ )
+    acc[j] *= 0.25;
+  if ( fwrite( acc, sizeof(double), n1*nc, ovr->tmp[l] ) < n1*nc ) {
+    lf_error( "could not write overview level %d", l + 1 );
+    return 1;
+  }
+  ovr->nrow[l]++;
+  if ( l + 1 < ovr->nlev && ovr_push( ovr, l + 1, acc ) )
+    return 1;
+  memset( acc, 0, n1*nc*sizeof(double) );
+  ovr->nacc[l] = 0;
+  return 0;
+}
+
+/* Skip over a data block of the given dimensions.  Returns 0
+   normally, nonzero if the end of file was reached prematurely. */
+static int
+ovr_skip( FILE *fp, const int64_t *dims )
+{
+  int64_t n = 1, m;  /* number of bytes to skip, and read */
+  char buf[LEN];     /* buffer for discarded data */
+  int i;             /* dimension index */
+
+  for ( i = 0; i < LFB_DMAX && dims[i]; i++ )
+    n *= dims[i];
+  n /= 8;
+  if ( !fseek( fp, n, SEEK_CUR ) )
+    return 0;
+  for ( ; n > 0; n -= m )
+    if ( ( m = fread( buf, 1, ( n < LEN ? n : LEN ), fp ) ) <= 0 )
+      return 1;
+  return 0;
+}
+
+/*
+<MARKDOWN>
+# lfovrOpen(3), lfovrAdd(3), lfovrWrite(3), lfovrFree(3)
+
+## NAME
+
+`lfovrOpen(3), lfovrAdd(3), lfovrWrite(3), lfovrFree(3)` - append
+overview levels to a LoFASM filterbank
+
+## SYNOPSIS
+
+`#include "lofasmIO.h"`
+
+`lfb_ovr *lfovrOpen( const lfb_hdr *`_header_`, int `_nlev_ `);`  
+`int lfovrAdd( lfb_ovr *`_ovr_`, const double *`_row_ `);`  
+`int lfovrWrite( FILE *`_fp_`, const lfb_hdr *`_header_`, lfb_ovr *`_ovr_ `);`  
+`void lfovrFree( lfb_ovr *`_ovr_ `);`
+
+## DESCRIPTION
+
+These functions compute reduced-resolution "overview" copies of a
+lofasm-filterbank(5) data block while it is being written, and append
+them to the file after the full-resolution data.  Overview level _l_
+is averaged over boxes of 2^_l_ x 2^_l_ points in the time and
+frequency dimensions; the file format is described in the **Overview
+Levels** section of lofasm-filterbank(5).
+
+lfovrOpen() sets up the computation of _nlev_ levels (2x, 4x, 8x,
+...) for data described by _header_, which must be real32 or real64;
+the overview levels are written with the same type, although rows are
+always supplied and accumulated as doubles.  If either
+dimension is too short to support _nlev_ levels, fewer levels are
+computed.  The returned object should be passed each row of the
+full-resolution data, in order, using lfovrAdd(), normally right after
+the row is written to the output file.  Completed overview rows are
+stored in temporary files, so memory usage is independent of the
+number of rows.
+
+After the full-resolution data block has been written, lfovrWrite()
+writes the overview levels to _fp_, coarsest first, each as a complete
+lofasm-filterbank(5) header and data block whose metadata are copied
+from _header_ with adjusted dimensions and spans.  Any rows not
+supplied by lfovrAdd() are written as zeros.  It then frees _ovr_.  To
+discard the overview levels without writing them, call lfovrFree().
+
+## RETURN VALUE
+
+lfovrOpen() returns a pointer to the new overview object, or NULL if
+the data type is unsuitable, if no levels can be computed, or if
+memory or temporary files could not be allocated.  lfovrAdd() and
+lfovrWrite() return 0 normally, or nonzero on write errors.
+
+## SEE ALSO
+
+lfovrRead(3),
+lfbxWrite(3),
+lofasm-filterbank(5)
+
+</MARKDOWN> */
+lfb_ovr *
+lfovrOpen( const lfb_hdr *header, int nlev )
+{
+  lfb_ovr *ovr; /* overview object */
+  int l;        /* level index */
+
+  /* Check arguments. */
+  if ( !header ) {
+    lf_error( "null header" );
+    return NULL;
+  }
+  if ( header->dims[3] != 32 && header->dims[3] != 64 ) {
+    lf_error( "overview levels require real32 or real64 data" );
+    return NULL;
+  }
+  for ( l = 0; l < nlev && ( header->dims[0] >> ( l + 1 ) ) > 0 &&
+	  ( header->dims[1] >> ( l + 1 ) ) > 0; l++ )
+    ;
+  if ( l < nlev )
+    lf_warning( "reducing overview levels from %d to %d", nlev, l );
+  if ( ( nlev = l ) < 1 ) {
+    lf_error( "data too small for overview levels" );
+    return NULL;
+  }
+
+  /* Allocate structure. */
+  if ( !( ovr = (lfb_ovr *)calloc( 1, sizeof(lfb_ovr) ) ) ||
+       !( ovr->nrow = (int64_t *)calloc( nlev, sizeof(int64_t) ) ) ||
+       !( ovr->nacc = (int *)calloc( nlev, sizeof(int) ) ) ||
+       !( ovr->acc = (double **)calloc( nlev, sizeof(double *) ) ) ||
+       !( ovr->tmp = (FILE **)calloc( nlev, sizeof(FILE *) ) ) ) {
+    lf_error( "memory error" );
+    lfovrFree( ovr );
+    return NULL;
+  }
+  ovr->nlev = nlev;
+  ovr->bits = header->dims[3];
+  memcpy( ovr->dims, header->dims, 3*sizeof(int64_t) );
+  for ( l = 0; l < nlev; l++ ) {
+    if ( !( ovr->acc[l] = (double *)
+	    calloc( ( ovr->dims[1] >> ( l + 1 ) )*ovr->dims[2],
+		    sizeof(double) ) ) ) {
+      lf_error( "memory error" );
+      lfovrFree( ovr );
+      return NULL;
+    }
+    if ( !( ovr->tmp[l] = tmpfile() ) ) {
+      lf_error( "could not open temporary file" );
+      lfovrFree( ovr );
+      return NULL;
+    }
+  }
+  return ovr;
+}
+
+
+int
+lfovrAdd( lfb_ovr *ovr, const double *row )
+{
+  if ( !ovr || !row ) {
+    lf_error( "null argument" );
+    return 1;
+  }
+  return ovr_push( ovr, 0, row );
+}
+
+
+int
+lfovrWrite( FILE *fp, const lfb_hdr *header, lfb_ovr *ovr )
+{
+  lfb_hdr head;   /* header of overview level */
+  double *row;    /* row of overview data */
+  int64_t i, n;   /* row index and length */
+  int l;          /* level index */
+
+  if ( !fp || !header || !ovr ) {
+    lf_error( "null argument" );
+    lfovrFree( ovr );
+    return 1;
+  }
+  for ( l = ovr->nlev - 1; l >= 0; l-- ) {
+
+    /* Write header, sharing strings with the original. */
+    memcpy( &head, header, sizeof(lfb_hdr) );
+    head.dims[0] = ovr->dims[0] >> ( l + 1 );
+    head.dims[1] = ovr->dims[1] >> ( l + 1 );
+    head.dim1_span *= (double)( head.dims[0] << ( l + 1 ) )/ovr->dims[0];
+    head.dim2_span *= (double)( head.dims[1] << ( l + 1 ) )/ovr->dims[1];
+    if ( lfbxWrite( fp, &head, NULL ) ) {
+      lf_error( "could not write overview level %d", l + 1 );
+      lfovrFree( ovr );
+      return 2;
+    }
+
+    /* Copy rows from temporary file, padding if necessary. */
+    row = ovr->acc[l];
+    n = head.dims[1]*head.dims[2];
+    rewind( ovr->tmp[l] );
+    for ( i = 0; i < head.dims[0]; i++ ) {
+      if ( i >= ovr->nrow[l] ||
+	   fread( row, sizeof(double), n, ovr->tmp[l] ) < n )
+	memset( row, 0, n*sizeof(double) );
+      if ( lfrealWrite( row, ovr->bits, n, fp ) < n ) {
+	lf_error( "could not write overview level %d", l + 1 );
+	lfovrFree( ovr );
+	return 2;
+      }
+    }
+  }
+  lfovrFree( ovr );
+  return 0;
+}
+
+
+void
+lfovrFree( lfb_ovr *ovr )
+{
+  int l; /* level index */
+  if ( !ovr )
+    return;
+  for ( l = 0; l < ovr->nlev; l++ ) {
+    if ( ovr->acc && ovr->acc[l] )
+      free( ovr->acc[l] );
+    if ( ovr->tmp && ovr->tmp[l] )
+      fclose( ovr->tmp[l] );
+  }
+  if ( ovr->nrow )
+    free( ovr->nrow );
+  if ( ovr->nacc )
+    free( ovr->nacc );
+  if ( ovr->acc )
+    free( ovr->acc );
+  if ( ovr->tmp )
+    free( ovr->tmp );
+  free( ovr );
+  return;
+}
+
+/*
+<MARKDOWN>
+# lfovrRead(3)
+
+## NAME
+
+`lfovrRead(3)` - find an overview level in a LoFASM filterbank
+
+## SYNOPSIS
+
+`#include "lofasmIO.h"`
+
+`int lfovrRead( FILE *`_fp_`, lfb_hdr *`_header_`, int64_t `_dim1_`, int64_t `_dim2_ `);`
+
+## DESCRIPTION
+
+This function searches for a reduced-resolution overview level (see
+lfovrOpen(3)) with at least _dim1_ rows and _dim2_ columns.  On entry,
+_fp_ should point to the start of a data block, normally just after a
+call to lfbxRead(3), and _header_ should describe that block (only
+its `dims` field is used).  The function skips over the data block and
+reads any subsequent overview headers, coarsest first, stopping at the
+first (i.e. coarsest) level that has at least the requested
+dimensions.  In that case the contents of _header_ are freed and
+replaced by the overview header, and _fp_ is left pointing to the
+start of the overview data.
+
+Since this function must skip over the full-resolution data, it is
+most useful for uncompressed or seekable files: for compressed files
+or pipes the data must still be decompressed or read, although not
+parsed.  If no suitable level is found, _fp_ is left at the end of
+the file, and the caller must reopen it to read the full-resolution
+data.
+
+## RETURN VALUE
+
+The function returns 0 if a suitable level was found, 1 if there was
+no suitable level, or 2 if an error occurred reading the file.
+
+## SEE ALSO
+
+lfovrOpen(3),
+lfbxRead(3),
+lofasm-filterbank(5)
+
+</MARKDOWN> */
+int
+lfovrRead( FILE *fp, lfb_hdr *header, int64_t dim1, int64_t dim2 )
+{
+  lfb_hdr head = {}; /* overview header */
+  int c;             /* first character of next header */
+
+  if ( !fp || !header ) {
+    lf_error( "null argument" );
+    return 2;
+  }
+  if ( ovr_skip( fp, header->dims ) ) {
+    lf_error( "end-of-file while skipping data" );
+    return 2;
+  }
+  while ( ( c = getc( fp ) ) != EOF ) {
+    ungetc( c, fp );
+    if ( lfbxRead( fp, &head, NULL ) ) {
+      lf_error( "could not parse overview header" );
+      lfbxFree( &head );
+      return 2;
+    }
+    if ( head.dims[0] >= dim1 && head.dims[1] >= dim2 ) {
+      lfbxFree( header );
+      memcpy( header, &head, sizeof(lfb_hdr) );
+      return 0;
+    }
+    if ( ovr_skip( fp, head.dims ) ) {
+      lf_error( "end-of-file while skipping data" );
+      lfbxFree( &head );
+      return 2;
+    }
+    lfbxFree( &head );
+  }
+  return 1;
+}
+
+
+/***********************************************************************
+LOFASM FILTERBANK REAL DATA I/O
+***********************************************************************/
+
+/*
+<MARKDOWN>
+# lfrealBits(3), lfrealRead(3), lfrealWrite(3)
+
+## NAME
+
+`lfrealBits(3), lfrealRead(3), lfrealWrite(3)` - read and write real32
+or real64 filterbank data as doubles
+
+## SYNOPSIS
+
+`#include "lofasmIO.h"`
+
+`int lfrealBits( const lfb_hdr *`_header_ `);`  
+`int64_t lfrealRead( double *`_buf_`, int `_bits_`, int64_t `_n_`, FILE *`_fp_ `);`  
+`int64_t lfrealWrite( const double *`_buf_`, int `_bits_`, int64_t `_n_`, FILE *`_fp_ `);`
+
+## DESCRIPTION
+
+These functions allow programs that process data in double precision
+to read and write files stored as either `real32` or `real64`, so that
+single-precision files need not be converted first.  Complex data are
+handled in the same way, as pairs of real numbers.
+
+The function lfrealBits() checks the final dimension of _header_ (the
+bit depth) and returns 32 or 64 if the data can be treated as real32
+or real64, respectively.  A warning is printed if the `data_type`
+field is missing or does not match the bit depth.
+
+The function lfrealRead() reads _n_ numbers of the given bit depth
+_bits_ from _fp_, converting them to double precision in _buf_.  The
+function lfrealWrite() converts _n_ doubles from _buf_ to the given bit
+depth and writes them to _fp_.  Single-precision data are converted in
+fixed-size chunks, so no extra memory is allocated; with _bits_ = 64
+these are equivalent to fread(3) and fwrite(3).
+
+## RETURN VALUE
+
+The function lfrealBits() returns 32 or 64, or 0 if the data cannot
+be read as real numbers.  The functions lfrealRead() and
+lfrealWrite() return the number of values read or written, which will
+be less than _n_ on end-of-file or error.
+
+## SEE ALSO
+
+lfbxRead(3),
+lfbxWrite(3),
+lofasm-filterbank(5)
+
+</MARKDOWN> */
+int
+lfrealBits( const lfb_hdr *header )
+{
+  int bits = header->dims[LFB_DMAX-1]; /* bit depth */
+  char type[LEN];                      /* expected data type */
+
+  if ( bits != 32 && bits != 64 )
+    return 0;
+  sprintf( type, "real%d", bits );
+  if ( !header->data_type || strcmp( header->data_type, type ) )
+    lf_warning( "treating as %s data", type );
+  return bits;
+}
+
+int64_t
+lfrealRead( double *buf, int bits, int64_t n, FILE *fp )
+{
+  float f[LEN];  /* single-precision chunk */
+  int64_t i, m;  /* number read, and read in chunk */
+  int64_t j;     /* index within chunk */
+
+  if ( bits == 64 )
+    return fread( buf, sizeof(double), n, fp );
+  for ( i = 0; i < n; i += m ) {
+    m = fread( f, sizeof(float), ( n - i < LEN ? n - i : LEN ), fp );
+    for ( j = 0; j < m; j++ )
+      buf[i+j] = f[j];
+    if ( m < LEN && i + m < n )
+      return i + m;
+  }
+  return n;
+}
+
+int64_t
+lfrealWrite( const double *buf, int bits, int64_t n, FILE *fp )
+{
+  float f[LEN];  /* single-precision chunk */
+  int64_t i, m;  /* number written, and to write in chunk */
+  int64_t j;     /* index within chunk */
+
+  if ( bits == 64 )
+    return fwrite( buf, sizeof(double), n, fp );
+  for ( i = 0; i < n; i += m ) {
+    m = ( n - i < LEN ? n - i : LEN );
+    for ( j = 0; j < m; j++ )
+      f[j] = buf[i+j];
+    if ( ( j = fwrite( f, sizeof(float), m, fp ) ) < m )
+      return i + j;
+  }
+  return n;
+}
+
+
+/***********************************************************************
+LOFASM FILTERBANK BIT MASK I/O
+***********************************************************************/
+
+/*
+<MARKDOWN>
+# lfmaskOpen(3), lfmaskRead(3), lfmaskWrite(3), lfmaskFlush(3)
+
+## NAME
+
+`lfmaskOpen(3), lfmaskRead(3), lfmaskWrite(3), lfmaskFlush(3)` - read
+and write bit-packed filterbank masks
+
+## SYNOPSIS
+
+`#include "lofasmIO.h"`
+
+`FILE *lfmaskOpen( const char *`_filename_`, const lfb_hdr *`_header_ `);`  
+`int64_t lfmaskRead( unsigned char *`_buf_`, int64_t `_n_`, lfb_mask *`_mask_`, FILE *`_fp_ `);`  
+`int64_t lfmaskWrite( const unsigned char *`_buf_`, int64_t `_n_`, lfb_mask *`_mask_`, FILE *`_fp_ `);`  
+`int lfmaskFlush( lfb_mask *`_mask_`, FILE *`_fp_ `);`
+
+## DESCRIPTION
+
+These functions read and write the data of a mask file, which is a
+lofasm-filterbank(5) file of `bit1` data flagging individual samples
+of a companion data file (see lofasm-filterbank(5)).  The bits are
+packed eight to a byte, most significant bit first, with no padding
+between rows, so that a row does not in general start on a byte
+boundary.  Within a program, each bit is held as an `unsigned char`
+that is 1 for a flagged sample and 0 otherwise.
+
+The function lfmaskOpen() opens the mask file _filename_ (or stdin,
+if _filename_ is `-`) and reads its header, checking that it is a
+mask for data described by _header_: that is, it must have `bit1`
+data with the same number of rows and columns as _header_, and a
+single component.  One mask bit thus applies to all components of a
+given row and column.  On success the stream is left positioned at
+the start of the mask data, ready for lfmaskRead().
+
+The function lfmaskRead() reads _n_ bits from _fp_, storing them in
+_buf_.  The function lfmaskWrite() writes the _n_ bits (zero or
+nonzero) in _buf_ to _fp_.  Since _n_ need not be a multiple of 8,
+each call may leave a partially read or written byte, which is held
+in the structure pointed to by _mask_:
+
+    typedef struct {
+        unsigned char byte;
+        int nbit;
+    } lfb_mask;
+
+This should be initialized to zero before the first call, and a given
+structure should be used for reading or writing a single file only.
+After the last call to lfmaskWrite(), lfmaskFlush() must be called to
+write any partial byte, padded with zero bits.
+
+## RETURN VALUE
+
+The function lfmaskOpen() returns the opened stream, or NULL (after
+printing an error message) if the file could not be opened or is not
+a matching mask.  The functions lfmaskRead() and lfmaskWrite() return
+the number of
+bits read or written, which will be less than _n_ on end-of-file or
+error.  The function lfmaskFlush() returns 0, or 1 on a write error.
+
+## SEE ALSO
+
+lfrealRead(3),
+lofasm-filterbank(5)
+
+</MARKDOWN> */
+FILE *
+lfmaskOpen( const char *filename, const lfb_hdr *header )
+{
+  FILE *fp;             /* mask file */
+  lfb_hdr mhead = {};   /* mask header */
+  int ok;               /* whether mask matches header */
+
+  if ( !strcmp( filename, "-" ) )
+    fp = lfdopen( 0, "rb" );
+  else
+    fp = lfopen( filename, "rb" );
+  if ( !fp ) {
+    lf_error( "could not open mask file %s", filename );
+    return NULL;
+  }
+  if ( lfbxRead( fp, &mhead, NULL ) ) {
+    lf_error( "could not parse header from %s", filename );
+    fclose( fp );
+    return NULL;
+  }
+  ok = ( mhead.dims[0] == header->dims[0] &&
+	 mhead.dims[1] == header->dims[1] &&
+	 mhead.dims[2] == 1 && mhead.dims[3] == 1 );
+  if ( !ok )
+    lf_error( "mask file %s does not match data dimensions", filename );
+  else if ( !mhead.data_type || strcmp( mhead.data_type, "bit1" ) )
+    lf_warning( "treating %s as bit1 data", filename );
+  lfbxFree( &mhead );
+  if ( !ok ) {
+    fclose( fp );
+    return NULL;
+  }
+  return fp;
+}
+
+int64_t
+lfmaskRead( unsigned char *buf, int64_t n, lfb_mask *mask, FILE *fp )
+{
+  unsigned char b[LEN]; /* packed chunk */
+  int64_t i = 0, m, r;  /* number read, and bytes in/read to chunk */
+  int64_t j;            /* index within chunk */
+  int c, k;             /* byte read, and bit index */
+
+  /* Use up bits left from the previous call. */
+  for ( ; i < n && mask->nbit > 0; i++ )
+    buf[i] = ( mask->byte >> --mask->nbit ) & 1;
+
+  /* Unpack whole bytes in chunks. */
+  while ( n - i >= 8 ) {
+    m = ( ( n - i )/8 < LEN ? ( n - i )/8 : LEN );
+    r = fread( b, 1, m, fp );
+    for ( j = 0; j < r; j++, i += 8 )
+      for ( k = 0; k < 8; k++ )
+	buf[i+k] = ( b[j] >> ( 7 - k ) ) & 1;
+    if ( r < m )
+      return i;
+  }
+
+  /* Start a new byte for any remaining bits. */
+  if ( i < n ) {
+    if ( ( c = getc( fp ) ) == EOF )
+      return i;
+    mask->byte = c;
+    mask->nbit = 8;
+    for ( ; i < n; i++ )
+      buf[i] = ( mask->byte >> --mask->nbit ) & 1;
+  }
+  return n;
+}
+
+int64_t
+lfmaskWrite( const unsigned char *buf, int64_t n, lfb_mask *mask, FILE *fp )
+{
+  unsigned char b[LEN]; /* packed chunk */
+  int64_t i = 0, m;     /* number written, and bytes in chunk */
+  int64_t j;            /* index within chunk */
+  int k;                /* bit index */
+
+  /* Complete any partial byte from the previous call. */
+  for ( ; i < n && mask->nbit > 0; i++ ) {
+    mask->byte |= ( buf[i] ? 1 : 0 ) << ( 7 - mask->nbit );
+    if ( ++mask->nbit == 8 ) {
+      mask->nbit = 0;
+      if ( putc( mask->byte, fp ) == EOF )
+	return i;
+      mask->byte = 0;
+    }
+  }
+
+  /* Pack whole bytes in chunks. */
+  while ( n - i >= 8 ) {
+    m = ( ( n - i )/8 < LEN ? ( n - i )/8 : LEN );
+    for ( j = 0; j < m; j++ ) {
+      b[j] = 0;
+      for ( k = 0; k < 8; k++ )
+	b[j] |= ( buf[ i + 8*j + k ] ? 1 : 0 ) << ( 7 - k );
+    }
+    if ( ( j = fwrite( b, 1, m, fp ) ) < m )
+      return i + 8*j;
+    i += 8*m;
+  }
+
+  /* Save any remaining bits, starting a new byte only if the previous
+     one was completed above. */
+  if ( i < n && mask->nbit == 0 )
+    mask->byte = 0;
+  for ( ; i < n; i++ )
+    mask->byte |= ( buf[i] ? 1 : 0 ) << ( 7 - mask->nbit++ );
+  return n;
+}
+
+int
+lfmaskFlush( lfb_mask *mask, FILE *fp )
+{
+  int err = 0; /* write error */
+
+  if ( mask->nbit > 0 )
+    err = ( putc( mask->byte, fp ) == EOF );
+  mask->byte = 0;
+  mask->nbit = 0;
+  return err;
+}
+
+
+/***********************************************************************
+THREADED JOB DISPATCH
+***********************************************************************/
+
+/*
+<MARKDOWN>
+# lfthreadRun(3)
+
+## NAME
+
+`lfthreadRun(3)` - run an array of jobs in parallel threads
+
+## SYNOPSIS
+
+`#include "lofasmIO.h"`
+
+`int lfthreadRun( void *(*`_func_`)( void * ), void *`_jobs_`, size_t `_size_`, int `_njobs_ `);`
+
+## DESCRIPTION
+
+This function calls _func_ once on each of the _njobs_ elements of the
+array _jobs_, each of which is _size_ bytes long.  The first job runs
+in the calling thread, and each of the others in a new POSIX thread;
+the function returns once all jobs are complete.  If a thread cannot
+be created, a warning is printed and that job and any remaining ones
+are run in the calling thread instead, so that every job is still run
+exactly once.  If the library was compiled with `-DNO_THREADS`, all
+jobs are run serially in the calling thread.
+
+## RETURN VALUE
+
+The function returns the number of threads (including the calling
+thread) that ran jobs.
+
+## SEE ALSO
+
+pthread_create(3)
+
+</MARKDOWN> */
+int
+lfthreadRun( void *(*func)( void * ), void *jobs, size_t size, int njobs )
+{
+  char *job = (char *)jobs; /* jobs as a byte array */
+  int k, n = 1;             /* job index, and threads used */
+#ifndef NO_THREADS
+  pthread_t *tids = NULL;   /* thread IDs for jobs 1 to n-1 */
+#endif
+
+  if ( njobs < 1 )
+    return 0;
+#ifndef NO_THREADS
+  if ( njobs > 1 && !( tids = (pthread_t *)
+		       malloc( njobs*sizeof(pthread_t) ) ) )
+    lf_warning( "could not allocate thread list; running serially" );
+  for ( ; tids && n < njobs; n++ )
+    if ( pthread_create( tids + n, NULL, func, job + n*size ) ) {
+      lf_warning( "could not create thread; running %d jobs serially",
+		  njobs - n );
+      break;
+    }
+#endif
+  func( job );
+  for ( k = n; k < njobs; k++ )
+    func( job + k*size );
+#ifndef NO_THREADS
+  for ( k = 1; k < n; k++ )
+    pthread_join( tids[k], NULL );
+  free( tids );
+#endif
+  return n;
+}
@@ -114,6 +114,15 @@ stored in a dedicated header structure `lfb_hdr`, defined as below:
     } lfb_hdr;
 
 where `LFB_DMAX`=4 is the number of dimensions in a LoFASM filterbank.
+
+### Threads
+
+Programs that can split their work across processors (e.g. with a
+`-j, --threads` option) hand an array of independent jobs to
+lfthreadRun(3), which runs them in POSIX threads and waits for them
+all to finish.  If the package is compiled with `THREADS = no` in the
+Makefile (i.e. with `-DNO_THREADS`), the same calls simply run the
+jobs one after another.
 </MARKDOWN> */
 #define LFB_DMAX 4
 typedef struct {
@@ -384,6 +393,49 @@ lfbxWrite( FILE *fp, lfb_hdr *header, void *data );
 void
 lfbxFree( lfb_hdr *header );
 
+
+/* Filterbank overview level function prototypes. */
+typedef struct tag_lfb_ovr lfb_ovr;
+lfb_ovr *
+lfovrOpen( const lfb_hdr *header, int nlev );
+int
+lfovrAdd( lfb_ovr *ovr, const double *row );
+int
+lfovrWrite( FILE *fp, const lfb_hdr *header, lfb_ovr *ovr );
+void
+lfovrFree( lfb_ovr *ovr );
+int
+lfovrRead( FILE *fp, lfb_hdr *header, int64_t dim1, int64_t dim2 );
+
+
+/* Real filterbank data I/O function prototypes. */
+int
+lfrealBits( const lfb_hdr *header );
+int64_t
+lfrealRead( double *buf, int bits, int64_t n, FILE *fp );
+int64_t
+lfrealWrite( const double *buf, int bits, int64_t n, FILE *fp );
+
+
+/* Bit-packed mask I/O function prototypes. */
+typedef struct {
+  unsigned char byte;       /* partially read or written byte */
+  int nbit;                 /* number of bits held in byte */
+} lfb_mask;
+FILE *
+lfmaskOpen( const char *filename, const lfb_hdr *header );
+int64_t
+lfmaskRead( unsigned char *buf, int64_t n, lfb_mask *mask, FILE *fp );
+int64_t
+lfmaskWrite( const unsigned char *buf, int64_t n, lfb_mask *mask, FILE *fp );
+int
+lfmaskFlush( lfb_mask *mask, FILE *fp );
+
+
+/* Threaded job dispatch prototype. */
+int
+lfthreadRun( void *(*func)( void * ), void *jobs, size_t size, int njobs );
+
 #ifdef  __cplusplus
 #if 0
 {
@@ -71,8 +71,6 @@ void write_header ( sfb_hdr* hp, FILE * fp ) {
 	 sendi (hp->nchans, fp);
 	 send ("nbits", fp);
 	 sendi (hp->nbits, fp);
-	 send ("nbits", fp);
-	 sendi (hp->nbits, fp);
 	 send ("nifs", fp);
 	 sendi (1, fp);
 	 // time
@@ -84,6 +82,117 @@ void write_header ( sfb_hdr* hp, FILE * fp ) {
 		send ("HEADER_END", fp);
 }
 
+/* Header keywords taking int, double, and 1-byte values */
+static const char * int_keys[] = { "telescope_id", "machine_id", "data_type",
+		"barycentric", "pulsarcentric", "nbits", "nsamples", "nchans", "nifs",
+		"nbeams", "ibeam", "npuls", "nbins", NULL };
+static const char * dbl_keys[] = { "fch1", "foff", "tstart", "tsamp",
+		"src_raj", "src_dej", "az_start", "za_start", "refdm", "period",
+		NULL };
+static const char * chr_keys[] = { "signed", NULL };
+
+static int inlist (const char * key, const char ** list) {
+		for ( ; *list; list++)
+				if (!strcmp (key, *list))
+						return 1;
+		return 0;
+}
+
+/* reads a length-prefixed string of at most max characters;
+ * returns number of bytes consumed or -1 on error */
+static int recv_str (char * str, int max, FILE * fp) {
+		int len;
+		if (fread (&len, sizeof (int), 1, fp) < 1 || len < 1 || len > max
+						|| fread (str, sizeof (char), len, fp) < len)
+				return -1;
+		str[len] = '\0';
+		return len + sizeof (int);
+}
+
+int read_header ( sfb_hdr * hp, FILE * fp ) {
+		char key[81], val[81];
+		int n, len, i, data_type = 1;
+		double d;
+		char c;
+		memset (hp, 0, sizeof (sfb_hdr));
+		hp->nifs = 1;
+		// dance
+		if ((n = recv_str (key, 80, fp)) < 0 || strcmp (key, "HEADER_START")) {
+				lf_error ("missing SIGPROC HEADER_START");
+				return -1;
+		}
+		// keyword-value pairs
+		while (1) {
+				if ((len = recv_str (key, 80, fp)) < 0) {
+						lf_error ("truncated SIGPROC header");
+						return -1;
+				}
+				n += len;
+				if (!strcmp (key, "HEADER_END"))
+						break;
+				if (!strcmp (key, "source_name") || !strcmp (key, "rawdatafile")) {
+						if ((len = recv_str (val, 80, fp)) < 0) {
+								lf_error ("bad SIGPROC %s value", key);
+								return -1;
+						}
+						n += len;
+						if (!strcmp (key, "source_name")) {
+								strncpy (hp->name, val, sizeof (hp->name) - 1);
+								hp->name[sizeof (hp->name) - 1] = '\0';
+						}
+				} else if (inlist (key, int_keys)) {
+						if (fread (&i, sizeof (int), 1, fp) < 1) {
+								lf_error ("truncated SIGPROC header");
+								return -1;
+						}
+						n += sizeof (int);
+						if (!strcmp (key, "telescope_id"))
+								hp->stationid = i;
+						else if (!strcmp (key, "nbits"))
+								hp->nbits = i;
+						else if (!strcmp (key, "nchans"))
+								hp->nchans = i;
+						else if (!strcmp (key, "nifs"))
+								hp->nifs = i;
+						else if (!strcmp (key, "data_type"))
+								data_type = i;
+				} else if (inlist (key, dbl_keys)) {
+						if (fread (&d, sizeof (double), 1, fp) < 1) {
+								lf_error ("truncated SIGPROC header");
+								return -1;
+						}
+						n += sizeof (double);
+						if (!strcmp (key, "fch1"))
+								hp->fch1 = d;
+						else if (!strcmp (key, "foff"))
+								hp->foff = d;
+						else if (!strcmp (key, "tstart"))
+								hp->tstart = d;
+						else if (!strcmp (key, "tsamp"))
+								hp->tsamp = d;
+						else if (!strcmp (key, "src_raj"))
+								hp->ra = d;
+						else if (!strcmp (key, "src_dej"))
+								hp->dec = d;
+				} else if (inlist (key, chr_keys)) {
+						if (fread (&c, sizeof (char), 1, fp) < 1) {
+								lf_error ("truncated SIGPROC header");
+								return -1;
+						}
+						n += sizeof (char);
+				} else {
+						lf_error ("unknown SIGPROC header keyword %s", key);
+						return -1;
+				}
+		}
+		if (data_type != 1) {
+				lf_error ("SIGPROC data_type %d is not filterbank", data_type);
+				return -1;
+		}
+		hp->npol = hp->nifs;
+		return n;
+}
+
 void lf2sg_hdr (lfb_hdr * l, sfb_hdr * s) {
 		/* Pointing defaults since lofasm doesn't point */
 		s->ra  = 0.0f;
@@ -23,4 +23,7 @@ void lf2sg_hdr (lfb_hdr * l, sfb_hdr * s);
 
 void write_header ( sfb_hdr * , FILE * );
 
+/* returns number of header bytes read, or -1 on error */
+int read_header ( sfb_hdr * , FILE * );
+
 #endif